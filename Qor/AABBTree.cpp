@@ -0,0 +1,313 @@
+#include "AABBTree.h"
+#include "Node.h"
+#include <algorithm>
+using namespace std;
+using namespace glm;
+
+AABBTree :: AABBTree(float margin, float min_margin):
+    m_Margin(margin),
+    m_MinMargin(min_margin)
+{}
+
+Box AABBTree :: combine(const Box& a, const Box& b)
+{
+    return Box(
+        glm::min(a.min(), b.min()),
+        glm::max(a.max(), b.max())
+    );
+}
+
+float AABBTree :: area(const Box& b)
+{
+    // surface area heuristic, works for flat (2D) boxes too
+    if(b.quick_zero())
+        return 0.0f;
+    if(b.quick_full())
+        return std::numeric_limits<float>::max();
+    vec3 d = b.size();
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x) + d.x + d.y + d.z;
+}
+
+bool AABBTree :: contains(const Box& outer, const Box& inner)
+{
+    return
+        outer.min().x <= inner.min().x &&
+        outer.min().y <= inner.min().y &&
+        outer.min().z <= inner.min().z &&
+        outer.max().x >= inner.max().x &&
+        outer.max().y >= inner.max().y &&
+        outer.max().z >= inner.max().z;
+}
+
+float AABBTree :: distance2(const Box& box, const glm::vec3& point)
+{
+    if(box.quick_zero())
+        return std::numeric_limits<float>::max();
+    vec3 d = glm::max(box.min() - point, vec3(0.0f));
+    d = glm::max(d, point - box.max());
+    return dot(d, d);
+}
+
+bool AABBTree :: ray_box(
+    const glm::vec3& origin,
+    const glm::vec3& inv,
+    const Box& box,
+    float max_t,
+    float& t
+){
+    float tmin = 0.0f;
+    float tmax = max_t;
+    for(unsigned i=0; i<3; ++i)
+    {
+        float t1 = (box.min()[i] - origin[i]) * inv[i];
+        float t2 = (box.max()[i] - origin[i]) * inv[i];
+        // NaN (origin on slab with zero direction) compares false and
+        // leaves the interval untouched
+        tmin = std::max(tmin, std::min(t1, t2));
+        tmax = std::min(tmax, std::max(t1, t2));
+    }
+    t = tmin;
+    return tmin <= tmax;
+}
+
+Box AABBTree :: fatten(const Box& box) const
+{
+    if(box.quick_zero() || box.quick_full())
+        return box;
+    vec3 m = glm::max(box.size() * m_Margin, vec3(m_MinMargin));
+    return Box(box.min() - m, box.max() + m);
+}
+
+AABBTree::Proxy AABBTree :: allocate()
+{
+    if(m_FreeList == NONE)
+    {
+        m_Nodes.emplace_back();
+        return (Proxy)m_Nodes.size() - 1;
+    }
+    Proxy id = m_FreeList;
+    m_FreeList = m_Nodes[id].parent;
+    m_Nodes[id] = TreeNode();
+    return id;
+}
+
+void AABBTree :: release(Proxy id)
+{
+    m_Nodes[id] = TreeNode();
+    m_Nodes[id].parent = m_FreeList;
+    m_FreeList = id;
+}
+
+AABBTree::Proxy AABBTree :: insert(const std::shared_ptr<Node>& node)
+{
+    Proxy id = allocate();
+    TreeNode& n = m_Nodes[id];
+    n.box = fatten(node->world_box());
+    n.ref = node;
+    n.node = node.get();
+    n.height = 0;
+    insert_leaf(id);
+    ++m_Leaves;
+    return id;
+}
+
+void AABBTree :: remove(Proxy proxy)
+{
+    assert(valid(proxy));
+    remove_leaf(proxy);
+    release(proxy);
+    --m_Leaves;
+}
+
+bool AABBTree :: update(Proxy proxy)
+{
+    assert(valid(proxy));
+    auto n = m_Nodes[proxy].ref.lock();
+    if(not n)
+        return false;
+
+    const Box& box = n->world_box();
+    if(contains(m_Nodes[proxy].box, box))
+        return false;
+
+    remove_leaf(proxy);
+    m_Nodes[proxy].box = fatten(box);
+    insert_leaf(proxy);
+    return true;
+}
+
+void AABBTree :: clear()
+{
+    m_Nodes.clear();
+    m_Root = NONE;
+    m_FreeList = NONE;
+    m_Leaves = 0;
+}
+
+void AABBTree :: insert_leaf(Proxy leaf)
+{
+    if(m_Root == NONE)
+    {
+        m_Root = leaf;
+        m_Nodes[leaf].parent = NONE;
+        return;
+    }
+
+    // find the best sibling by descending toward the cheapest child
+    Box leaf_box = m_Nodes[leaf].box;
+    Proxy idx = m_Root;
+    while(not m_Nodes[idx].leaf())
+    {
+        const TreeNode& n = m_Nodes[idx];
+        float a = area(n.box);
+        float combined = area(combine(n.box, leaf_box));
+
+        // cost of making a new parent for this node and the leaf
+        float cost = 2.0f * combined;
+        // minimum cost of pushing the leaf further down the tree
+        float inherit = 2.0f * (combined - a);
+
+        auto child_cost = [&](Proxy c) {
+            Box b = combine(leaf_box, m_Nodes[c].box);
+            if(m_Nodes[c].leaf())
+                return area(b) + inherit;
+            return (area(b) - area(m_Nodes[c].box)) + inherit;
+        };
+        float cost_l = child_cost(n.left);
+        float cost_r = child_cost(n.right);
+
+        if(cost < cost_l && cost < cost_r)
+            break;
+        idx = cost_l < cost_r ? n.left : n.right;
+    }
+
+    Proxy sibling = idx;
+    Proxy old_parent = m_Nodes[sibling].parent;
+    Proxy new_parent = allocate();
+    m_Nodes[new_parent].parent = old_parent;
+    m_Nodes[new_parent].box = combine(leaf_box, m_Nodes[sibling].box);
+    m_Nodes[new_parent].height = m_Nodes[sibling].height + 1;
+    m_Nodes[new_parent].left = sibling;
+    m_Nodes[new_parent].right = leaf;
+    m_Nodes[sibling].parent = new_parent;
+    m_Nodes[leaf].parent = new_parent;
+
+    if(old_parent != NONE)
+    {
+        if(m_Nodes[old_parent].left == sibling)
+            m_Nodes[old_parent].left = new_parent;
+        else
+            m_Nodes[old_parent].right = new_parent;
+    }
+    else
+        m_Root = new_parent;
+
+    // walk back up, refitting and rebalancing
+    idx = m_Nodes[leaf].parent;
+    while(idx != NONE)
+    {
+        idx = balance(idx);
+        TreeNode& n = m_Nodes[idx];
+        n.height = 1 + std::max(m_Nodes[n.left].height, m_Nodes[n.right].height);
+        n.box = combine(m_Nodes[n.left].box, m_Nodes[n.right].box);
+        idx = n.parent;
+    }
+}
+
+void AABBTree :: remove_leaf(Proxy leaf)
+{
+    if(leaf == m_Root)
+    {
+        m_Root = NONE;
+        return;
+    }
+
+    Proxy parent = m_Nodes[leaf].parent;
+    Proxy grandparent = m_Nodes[parent].parent;
+    Proxy sibling = m_Nodes[parent].left == leaf ?
+        m_Nodes[parent].right : m_Nodes[parent].left;
+
+    if(grandparent != NONE)
+    {
+        if(m_Nodes[grandparent].left == parent)
+            m_Nodes[grandparent].left = sibling;
+        else
+            m_Nodes[grandparent].right = sibling;
+        m_Nodes[sibling].parent = grandparent;
+        release(parent);
+
+        Proxy idx = grandparent;
+        while(idx != NONE)
+        {
+            idx = balance(idx);
+            TreeNode& n = m_Nodes[idx];
+            n.box = combine(m_Nodes[n.left].box, m_Nodes[n.right].box);
+            n.height = 1 + std::max(m_Nodes[n.left].height, m_Nodes[n.right].height);
+            idx = n.parent;
+        }
+    }
+    else
+    {
+        m_Root = sibling;
+        m_Nodes[sibling].parent = NONE;
+        release(parent);
+    }
+    m_Nodes[leaf].parent = NONE;
+}
+
+// Rotates the subtree at a if it is imbalanced, returns the new subtree root
+AABBTree::Proxy AABBTree :: balance(Proxy a)
+{
+    TreeNode& A = m_Nodes[a];
+    if(A.leaf() || A.height < 2)
+        return a;
+
+    Proxy b = A.left;
+    Proxy c = A.right;
+    int bal = m_Nodes[c].height - m_Nodes[b].height;
+
+    // rotate c (or b) up
+    auto rotate = [&](Proxy up, Proxy other, bool up_is_right) -> Proxy {
+        TreeNode& U = m_Nodes[up];
+        Proxy f = U.left;
+        Proxy g = U.right;
+
+        U.left = a;
+        U.parent = A.parent;
+        A.parent = up;
+
+        if(U.parent != NONE)
+        {
+            if(m_Nodes[U.parent].left == a)
+                m_Nodes[U.parent].left = up;
+            else
+                m_Nodes[U.parent].right = up;
+        }
+        else
+            m_Root = up;
+
+        // keep the taller grandchild under up, move the other into a
+        Proxy keep = f, give = g;
+        if(m_Nodes[f].height <= m_Nodes[g].height)
+            std::swap(keep, give);
+        U.right = keep;
+        if(up_is_right)
+            A.right = give;
+        else
+            A.left = give;
+        m_Nodes[give].parent = a;
+
+        A.box = combine(m_Nodes[other].box, m_Nodes[give].box);
+        U.box = combine(A.box, m_Nodes[keep].box);
+        A.height = 1 + std::max(m_Nodes[other].height, m_Nodes[give].height);
+        U.height = 1 + std::max(A.height, m_Nodes[keep].height);
+        return up;
+    };
+
+    if(bal > 1)
+        return rotate(c, b, true);
+    if(bal < -1)
+        return rotate(b, c, false);
+    return a;
+}
+
@@ -0,0 +1,256 @@
+#ifndef _AABBTREE_H_Q3R7XW2D
+#define _AABBTREE_H_Q3R7XW2D
+
+#include <vector>
+#include <memory>
+#include <array>
+#include <algorithm>
+#include "Graphics.h"
+
+class Node;
+
+/*
+ *  Incremental dynamic bounding volume tree (broadphase).
+ *
+ *  Leaves hold "fat" boxes (the node's world box grown by a margin) so
+ *  that small movements only need a containment check instead of a
+ *  reinsert.  Inner nodes are kept balanced with tree rotations, so
+ *  queries stay O(log n) as objects are added, moved and removed.
+ */
+class AABBTree
+{
+    public:
+
+        typedef int Proxy;
+        static const Proxy NONE = -1;
+
+        // margin is relative to the size of each box, with min_margin
+        // as a lower bound for very small (or flat) boxes
+        AABBTree(float margin = 0.1f, float min_margin = 0.01f);
+
+        AABBTree(const AABBTree&) = default;
+        AABBTree(AABBTree&&) = default;
+        AABBTree& operator=(const AABBTree&) = default;
+        AABBTree& operator=(AABBTree&&) = default;
+
+        Proxy insert(const std::shared_ptr<Node>& node);
+        void remove(Proxy proxy);
+
+        // refit leaf to node's current world box
+        // returns true if the leaf had to be reinserted
+        bool update(Proxy proxy);
+
+        void clear();
+
+        bool valid(Proxy proxy) const {
+            return proxy >= 0 &&
+                proxy < (Proxy)m_Nodes.size() &&
+                m_Nodes[proxy].height >= 0 &&
+                m_Nodes[proxy].leaf();
+        }
+        std::shared_ptr<Node> node(Proxy proxy) const {
+            return m_Nodes[proxy].ref.lock();
+        }
+        // raw pointer of the node the leaf was created for
+        // (only safe to dereference while ref(proxy) is not expired)
+        Node* get(Proxy proxy) const {
+            return m_Nodes[proxy].node;
+        }
+        const std::weak_ptr<Node>& ref(Proxy proxy) const {
+            return m_Nodes[proxy].ref;
+        }
+        const Box& fat_box(Proxy proxy) const {
+            return m_Nodes[proxy].box;
+        }
+
+        size_t size() const { return m_Leaves; }
+        bool empty() const { return m_Leaves == 0; }
+        int height() const {
+            return m_Root == NONE ? 0 : m_Nodes[m_Root].height;
+        }
+
+        /*
+         * Calls func(proxy) for every leaf whose fat box overlaps box.
+         * func may return false to stop the query early.
+         */
+        template<class Func>
+        void query(const Box& box, Func&& func) const
+        {
+            visit(
+                [&](const Box& b){ return b.collision(box); },
+                func
+            );
+        }
+
+        /*
+         * Calls func(proxy) for every leaf whose fat box touches the sphere
+         */
+        template<class Func>
+        void query(const glm::vec3& center, float radius, Func&& func) const
+        {
+            const float r2 = radius * radius;
+            visit(
+                [&](const Box& b){ return distance2(b, center) <= r2; },
+                func
+            );
+        }
+
+        /*
+         * Calls func(proxy, t) for every leaf whose fat box is hit by the ray
+         * within max_t, where t is the entry distance along dir (in units
+         * of dir's length).  func may return false to stop early.
+         */
+        template<class Func>
+        void raycast(
+            const glm::vec3& origin,
+            const glm::vec3& dir,
+            float max_t,
+            Func&& func
+        ) const {
+            const glm::vec3 inv(
+                1.0f / dir.x,
+                1.0f / dir.y,
+                1.0f / dir.z
+            );
+            float t;
+            visit(
+                [&](const Box& b){
+                    return ray_box(origin, inv, b, max_t, t);
+                },
+                [&](Proxy id){ return func(id, t); }
+            );
+        }
+
+        /*
+         * k nearest leaves to point, written into out as (squared distance,
+         * proxy) sorted nearest first.  dist(proxy) gives the exact squared
+         * distance of a leaf (the fat boxes only bound it from below), or
+         * a negative value to skip the leaf.
+         * out is cleared first and should be reused between calls.
+         */
+        template<class Dist>
+        void nearest(
+            const glm::vec3& point,
+            unsigned k,
+            std::vector<std::pair<float, Proxy>>& out,
+            Dist&& dist
+        ) const {
+            out.clear();
+            if(m_Root == NONE || not k)
+                return;
+
+            std::array<Proxy, MAX_STACK> stack;
+            unsigned top = 0;
+            stack[top++] = m_Root;
+            while(top)
+            {
+                Proxy id = stack[--top];
+                const TreeNode& n = m_Nodes[id];
+                if(out.size() == k && distance2(n.box, point) >= out.back().first)
+                    continue;
+                if(n.leaf())
+                {
+                    float d = dist(id);
+                    if(d < 0.0f || (out.size() == k && d >= out.back().first))
+                        continue;
+                    auto e = std::make_pair(d, id);
+                    if(out.size() == k)
+                        out.pop_back();
+                    out.insert(std::upper_bound(out.begin(), out.end(), e), e);
+                }
+                else
+                {
+                    // push the farther child first so the nearer one is
+                    // visited first and tightens the bound sooner
+                    assert(top + 2 <= MAX_STACK);
+                    float dl = distance2(m_Nodes[n.left].box, point);
+                    float dr = distance2(m_Nodes[n.right].box, point);
+                    if(dl < dr) {
+                        stack[top++] = n.right;
+                        stack[top++] = n.left;
+                    } else {
+                        stack[top++] = n.left;
+                        stack[top++] = n.right;
+                    }
+                }
+            }
+        }
+
+        // squared distance from point to the closest point in box
+        static float distance2(const Box& box, const glm::vec3& point);
+        
+        // slab test, inv is the componentwise inverse of the ray direction
+        static bool ray_box(
+            const glm::vec3& origin,
+            const glm::vec3& inv,
+            const Box& box,
+            float max_t,
+            float& t
+        );
+
+    private:
+
+        template<class Test, class Func>
+        void visit(Test&& test, Func&& func) const
+        {
+            if(m_Root == NONE)
+                return;
+
+            std::array<Proxy, MAX_STACK> stack;
+            unsigned top = 0;
+            stack[top++] = m_Root;
+            while(top)
+            {
+                Proxy id = stack[--top];
+                const TreeNode& n = m_Nodes[id];
+                if(not test(n.box))
+                    continue;
+                if(n.leaf()) {
+                    if(not func(id))
+                        return;
+                } else {
+                    assert(top + 2 <= MAX_STACK);
+                    stack[top++] = n.left;
+                    stack[top++] = n.right;
+                }
+            }
+        }
+
+        // balanced trees never get close to this height
+        static const unsigned MAX_STACK = 256;
+
+        struct TreeNode
+        {
+            Box box;
+            std::weak_ptr<Node> ref;
+            Node* node = nullptr;
+            Proxy parent = NONE; // also used as next in free list
+            Proxy left = NONE;
+            Proxy right = NONE;
+            int height = -1; // -1: free, 0: leaf
+
+            bool leaf() const { return left == NONE; }
+        };
+
+        Proxy allocate();
+        void release(Proxy id);
+        void insert_leaf(Proxy leaf);
+        void remove_leaf(Proxy leaf);
+        Proxy balance(Proxy id);
+        Box fatten(const Box& box) const;
+
+        static Box combine(const Box& a, const Box& b);
+        static float area(const Box& b);
+        static bool contains(const Box& outer, const Box& inner);
+
+        std::vector<TreeNode> m_Nodes;
+        Proxy m_Root = NONE;
+        Proxy m_FreeList = NONE;
+        size_t m_Leaves = 0;
+
+        float m_Margin;
+        float m_MinMargin;
+};
+
+#endif
+
@@ -0,0 +1,396 @@
+#include "AssetManifest.h"
+#include "kit/log/log.h"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#ifdef __linux__
+    #include <sys/inotify.h>
+    #include <unistd.h>
+#endif
+#if defined(__linux__) || defined(__APPLE__)
+    #include <sys/stat.h>
+#endif
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace {
+
+    const char* const INDEX_HEADER = "qor-assets 2";
+
+    string directory_of(const string& path) {
+        return fs::path(path).parent_path().string();
+    }
+    string name_of(const string& path) {
+        return fs::path(path).filename().string();
+    }
+
+    // in nanoseconds where the system has them, so a file added within
+    // the second its directory was indexed still changes it, -1 if gone
+    int64_t modified(const string& path) {
+#if defined(__linux__) || defined(__APPLE__)
+        struct stat st;
+        if(stat(path.c_str(), &st) != 0)
+            return -1;
+    #ifdef __APPLE__
+        const timespec& t = st.st_mtimespec;
+    #else
+        const timespec& t = st.st_mtim;
+    #endif
+        return int64_t(t.tv_sec) * 1000000000 + t.tv_nsec;
+#else
+        boost::system::error_code ec;
+        time_t t = fs::last_write_time(fs::path(path), ec);
+        return ec ? -1 : int64_t(t) * 1000000000;
+#endif
+    }
+
+}
+
+AssetManifest* AssetManifest :: get()
+{
+    static AssetManifest manifest;
+    return &manifest;
+}
+
+void AssetManifest :: build(const vector<string>& roots, const string& index_fn)
+{
+    auto l = unique_lock<mutex>(m_Mutex);
+    m_Misses.clear();
+    m_Names.clear();
+    m_Directories.clear();
+    m_Times.clear();
+    m_Roots = roots;
+    m_IndexFilename = index_fn;
+
+    if(not index_fn.empty() && load(index_fn))
+        return;
+
+    rescan();
+    LOGf("Indexed %s assets", m_Names.size());
+}
+
+void AssetManifest :: rescan()
+{
+    m_Misses.clear();
+    m_Names.clear();
+    m_Directories.clear();
+    m_Times.clear();
+    for(auto&& root: m_Roots)
+        scan(root);
+    if(not m_IndexFilename.empty())
+        save(m_IndexFilename);
+}
+
+bool AssetManifest :: stale() const
+{
+    for(auto&& dir: m_Times)
+        if(modified(dir.first) != dir.second)
+            return true;
+    return false;
+}
+
+void AssetManifest :: scan(const string& dir)
+{
+    try{
+        if(not fs::is_directory(fs::path(dir)))
+            return;
+        // "data/" is the "data" its files' parent paths give
+        string key = dir;
+        while(key.size() > 1 && (key.back() == '/' || key.back() == '\\'))
+            key.pop_back();
+        m_Times[key] = modified(key);
+        m_Directories[key];
+        watch_directory(key);
+
+        const fs::recursive_directory_iterator end;
+        for(fs::recursive_directory_iterator itr{fs::path(dir)}; itr != end; ++itr)
+        {
+            string path = itr->path().string();
+            if(fs::is_directory(itr->status())) {
+                m_Times[path] = modified(path);
+                m_Directories[path];
+                watch_directory(path);
+            }
+            else
+                add_file(path);
+        }
+    }catch(const fs::filesystem_error&){}
+}
+
+void AssetManifest :: add_file(const string& path)
+{
+    string dir = directory_of(path);
+    string name = name_of(path);
+    if(not m_Directories[dir].insert(name).second)
+        return;
+    m_Names[name].push_back(path);
+    m_Misses.erase(name);
+    m_Misses.erase(path);
+}
+
+void AssetManifest :: remove_file(const string& path)
+{
+    string dir = directory_of(path);
+    string name = name_of(path);
+    auto ditr = m_Directories.find(dir);
+    if(ditr != m_Directories.end())
+        ditr->second.erase(name);
+    auto nitr = m_Names.find(name);
+    if(nitr == m_Names.end())
+        return;
+    auto& paths = nitr->second;
+    paths.erase(std::remove(paths.begin(), paths.end(), path), paths.end());
+    if(paths.empty())
+        m_Names.erase(nitr);
+}
+
+void AssetManifest :: remove_directory(const string& dir)
+{
+    const string prefix = dir + char(fs::path::preferred_separator);
+    for(auto itr = m_Directories.begin(); itr != m_Directories.end();)
+    {
+        if(itr->first != dir && itr->first.compare(0, prefix.size(), prefix) != 0) {
+            ++itr;
+            continue;
+        }
+        for(auto&& name: itr->second)
+        {
+            auto nitr = m_Names.find(name);
+            if(nitr == m_Names.end())
+                continue;
+            string path = (fs::path(itr->first) / name).string();
+            auto& paths = nitr->second;
+            paths.erase(std::remove(paths.begin(), paths.end(), path), paths.end());
+            if(paths.empty())
+                m_Names.erase(nitr);
+        }
+        m_Times.erase(itr->first);
+        itr = m_Directories.erase(itr);
+    }
+}
+
+string AssetManifest :: find(const string& fn)
+{
+    auto l = unique_lock<mutex>(m_Mutex);
+    auto itr = m_Names.find(fn);
+    if(itr == m_Names.end())
+    {
+        // watched, poll() has already added anything new
+        if(m_Watch >= 0 || m_Misses.count(fn))
+            return string();
+        // files added since, without a watch to say so: walk once more
+        if(stale())
+            rescan();
+        itr = m_Names.find(fn);
+        if(itr == m_Names.end()) {
+            m_Misses.insert(fn);
+            return string();
+        }
+    }
+    return itr->second.front();
+}
+
+bool AssetManifest :: exists(const string& path)
+{
+    {
+        auto l = unique_lock<mutex>(m_Mutex);
+        string dir = directory_of(path);
+        auto itr = m_Directories.find(dir);
+        if(itr != m_Directories.end())
+        {
+            if(itr->second.count(name_of(path)))
+                return true;
+            if(m_Watch >= 0 || m_Misses.count(path))
+                return false;
+            // only its own directory could have gained it
+            auto t = m_Times.find(dir);
+            if(t == m_Times.end() || modified(dir) != t->second) {
+                rescan();
+                itr = m_Directories.find(dir);
+                if(itr != m_Directories.end() && itr->second.count(name_of(path)))
+                    return true;
+            }
+            m_Misses.insert(path);
+            return false;
+        }
+    }
+    // not somewhere we index
+    return fs::exists(fs::path(path));
+}
+
+size_t AssetManifest :: files() const
+{
+    auto l = unique_lock<mutex>(m_Mutex);
+    size_t r = 0;
+    for(auto&& dir: m_Directories)
+        r += dir.second.size();
+    return r;
+}
+
+bool AssetManifest :: load(const string& index_fn)
+{
+    ifstream f(index_fn);
+    if(!f)
+        return false;
+    string line;
+    if(not getline(f, line) || line != INDEX_HEADER)
+        return false;
+
+    vector<string> roots;
+    vector<string> files;
+    while(getline(f, line))
+    {
+        if(line.size() < 2 || line[1] != ' ')
+            return false;
+        string rest = line.substr(2);
+        switch(line[0])
+        {
+            case 'R':
+                roots.push_back(rest);
+                break;
+            case 'D': {
+                // a changed directory gained, lost or renamed files
+                istringstream ss(rest);
+                int64_t t;
+                string dir;
+                if(not (ss >> t) || not getline(ss.ignore(1), dir))
+                    return false;
+                if(modified(dir) != t || not fs::is_directory(fs::path(dir)))
+                    return false;
+                m_Times[dir] = t;
+                m_Directories[dir];
+                break;
+            }
+            case 'F':
+                files.push_back(rest);
+                break;
+            default:
+                return false;
+        }
+    }
+    if(roots != m_Roots)
+        return false;
+
+    for(auto&& path: files)
+        add_file(path);
+    for(auto&& dir: m_Times)
+        watch_directory(dir.first);
+    return true;
+}
+
+void AssetManifest :: save(const string& index_fn) const
+{
+    boost::system::error_code ec;
+    auto parent = fs::path(index_fn).parent_path();
+    if(not parent.empty())
+        fs::create_directories(parent, ec);
+
+    ofstream f(index_fn, ios::trunc);
+    f << INDEX_HEADER << "\n";
+    for(auto&& root: m_Roots)
+        f << "R " << root << "\n";
+    for(auto&& dir: m_Times)
+        f << "D " << dir.second << " " << dir.first << "\n";
+    // paths of each name in search order, so find() picks the same file
+    // after a load
+    for(auto&& name: m_Names)
+        for(auto&& path: name.second)
+            f << "F " << path << "\n";
+    if(!f)
+        WARNINGf("Unable to write asset index %s", index_fn);
+}
+
+bool AssetManifest :: watch()
+{
+#ifdef __linux__
+    auto l = unique_lock<mutex>(m_Mutex);
+    if(m_Watch >= 0)
+        return true;
+    m_Watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(m_Watch < 0) {
+        WARNING("Unable to watch assets for changes");
+        return false;
+    }
+    for(auto&& dir: m_Times)
+        watch_directory(dir.first);
+    LOG("Watching assets for changes");
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AssetManifest :: watch_directory(const string& dir)
+{
+#ifdef __linux__
+    if(m_Watch < 0)
+        return;
+    int wd = inotify_add_watch(
+        m_Watch, dir.c_str(),
+        IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+    );
+    if(wd >= 0)
+        m_Watches[wd] = dir;
+#endif
+}
+
+void AssetManifest :: poll()
+{
+#ifdef __linux__
+    auto l = unique_lock<mutex>(m_Mutex);
+    if(m_Watch < 0)
+        return;
+    alignas(inotify_event) char buf[4096];
+    while(true)
+    {
+        ssize_t len = read(m_Watch, buf, sizeof(buf));
+        if(len <= 0)
+            break;
+        for(char* p = buf; p < buf + len;)
+        {
+            const inotify_event* ev = (const inotify_event*)p;
+            p += sizeof(inotify_event) + ev->len;
+
+            auto itr = m_Watches.find(ev->wd);
+            if(itr == m_Watches.end())
+                continue;
+            if(ev->mask & IN_IGNORED) {
+                m_Watches.erase(itr);
+                continue;
+            }
+            if(not ev->len)
+                continue;
+            string path = (fs::path(itr->second) / ev->name).string();
+            if(ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                if(ev->mask & IN_ISDIR)
+                    scan(path);
+                else
+                    add_file(path);
+            } else if(ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                if(ev->mask & IN_ISDIR)
+                    remove_directory(path);
+                else
+                    remove_file(path);
+            }
+        }
+    }
+#endif
+}
+
+void AssetManifest :: clear()
+{
+    auto l = unique_lock<mutex>(m_Mutex);
+#ifdef __linux__
+    if(m_Watch >= 0)
+        close(m_Watch);
+#endif
+    m_Watch = -1;
+    m_Watches.clear();
+    m_Misses.clear();
+    m_Names.clear();
+    m_Directories.clear();
+    m_Times.clear();
+    m_Roots.clear();
+}
+
@@ -0,0 +1,104 @@
+#ifndef _ASSETMANIFEST_H_Q6VJ2R8C
+#define _ASSETMANIFEST_H_Q6VJ2R8C
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+ *  Index of every file under the resource search paths, so finding a
+ *  resource by file name is a hash lookup instead of a directory walk.
+ *
+ *  Built once at startup, or read back from an index file written by an
+ *  earlier run when none of the indexed directories were modified since
+ *  (any file added, removed or renamed changes its directory's time).
+ *  Unwatched, a lookup that misses walks the roots again if a directory
+ *  changed since, so files added while running are still found.  Names
+ *  that still miss are remembered until the index next changes, so
+ *  probing for optional files (a material's _NRM, ...) costs a hash
+ *  lookup too.
+ *
+ *  In development builds the directories can be watched (inotify, Linux
+ *  only) and poll() keeps the index current as files come and go, so
+ *  misses never walk.
+ *
+ *  Thread safe.
+ */
+class AssetManifest
+{
+    public:
+
+        static AssetManifest* get();
+
+        AssetManifest(const AssetManifest&) = delete;
+        AssetManifest& operator=(const AssetManifest&) = delete;
+
+        /*
+         * Indexes roots (in search order), reusing index_fn if it is still
+         * good and writing it otherwise.  No index_fn always rescans.
+         */
+        void build(
+            const std::vector<std::string>& roots,
+            const std::string& index_fn = std::string()
+        );
+
+        /*
+         * Path of the first file named fn in search order, or an empty
+         * string if there is none
+         */
+        std::string find(const std::string& fn);
+
+        // answered from the index for directories under the roots
+        bool exists(const std::string& path);
+
+        // follows changes to the roots, false where unsupported
+        bool watch();
+        // applies changes seen since the last call (once per frame)
+        void poll();
+
+        void clear();
+
+        size_t files() const;
+
+    private:
+
+        AssetManifest() = default;
+
+        // index the roots from scratch (and save it), needs the lock
+        void rescan();
+        // an indexed directory changed since it was indexed
+        bool stale() const;
+        void scan(const std::string& dir);
+        void add_file(const std::string& path);
+        void remove_file(const std::string& path);
+        void remove_directory(const std::string& dir);
+        void watch_directory(const std::string& dir);
+
+        bool load(const std::string& index_fn);
+        void save(const std::string& index_fn) const;
+
+        mutable std::mutex m_Mutex;
+        std::vector<std::string> m_Roots;
+        std::string m_IndexFilename;
+
+        // file name -> paths, in search order
+        std::unordered_map<std::string, std::vector<std::string>> m_Names;
+        // directory -> names of the files in it
+        std::unordered_map<std::string, std::unordered_set<std::string>> m_Directories;
+        // modification time (ns) of each directory when indexed
+        std::map<std::string, int64_t> m_Times;
+        // names find() and paths exists() missed since the index last
+        // changed
+        std::unordered_set<std::string> m_Misses;
+
+        // inotify descriptor and watched directories
+        int m_Watch = -1;
+        std::unordered_map<int, std::string> m_Watches;
+};
+
+#endif
+
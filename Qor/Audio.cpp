@@ -54,6 +54,16 @@ float Audio::Buffer :: length() const
     return (float)samples / (float)freq;
 }
 
+size_t Audio::Buffer :: cpu_bytes() const
+{
+    if(Headless::enabled() || not id)
+        return 0;
+    auto l = Audio::lock();
+    ALint sz = 0;
+    alGetBufferi(id, AL_SIZE, &sz);
+    return sz > 0 ? size_t(sz) : 0;
+}
+
 Audio::Source :: Source(
     unsigned int _flags
 ):
@@ -47,6 +47,8 @@ public:
         virtual ~Buffer();
         bool good() const { return id!=0; }
         float length() const;
+        // samples held by OpenAL
+        virtual size_t cpu_bytes() const override;
     };
 
     struct Source
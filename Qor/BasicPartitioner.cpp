@@ -4,6 +4,7 @@
 #include <memory>
 #include <algorithm>
 using namespace std;
+using namespace glm;
 
 #define MIN_NODES 128
 #define MIN_LIGHTS 32
@@ -103,6 +104,138 @@ void BasicPartitioner :: partition(const Node* root)
     // mark endpoints
     //m_Nodes[node_idx] = nullptr;
     //m_Lights[light_idx] = nullptr;
+
+    if(m_bOcclusion)
+        cull_occluded();
+
+    for(const Node* node: m_Nodes)
+        if(node)
+            node->select_lod(m_pCamera);
+    
+    partition_lights();
+}
+
+void BasicPartitioner :: cull_occluded()
+{
+    m_Occlusion.begin(m_pCamera->projection() * m_pCamera->view());
+    for(const Node* node: m_Nodes)
+        if(node && node->is_occluder())
+            node->rasterize_occluder(&m_Occlusion);
+    m_Occlusion.end();
+    if(not m_Occlusion.stats().occluders)
+        return;
+
+    // occluders stay, they're what hides the rest
+    m_Nodes.erase(remove_if(ENTIRE(m_Nodes), [this](const Node* node){
+        return node &&
+            not node->is_occluder() &&
+            not m_Occlusion.visible(node->world_box());
+    }), m_Nodes.end());
+}
+
+void BasicPartitioner :: partition_lights()
+{
+    const unsigned num_lights = m_Lights.size();
+    if(m_LightNodes.size() < num_lights)
+        m_LightNodes.resize(num_lights);
+    for(auto&& nodes: m_LightNodes)
+        nodes.clear();
+    if(not num_lights) {
+        m_LightGroups.clear();
+        return;
+    }
+
+    // light volume as (center, radius^2), negative radius for unbounded
+    m_LightVolumes.clear();
+    for(auto&& light: m_Lights)
+    {
+        if(not light || light->light_type() == Light::Type::DIRECTIONAL)
+            m_LightVolumes.emplace_back(0.0f, 0.0f, 0.0f, -1.0f);
+        else
+            m_LightVolumes.emplace_back(
+                light->position(Space::WORLD),
+                light->dist() * light->dist()
+            );
+    }
+
+    // bitmask of lights touching each node
+    const unsigned words = (num_lights + 63) / 64;
+    m_LightMasks.assign(m_Nodes.size() * words, 0);
+    m_LitNodes.clear();
+    for(unsigned i = 0; i < m_Nodes.size(); ++i)
+    {
+        const Node* node = m_Nodes[i];
+        if(not node)
+            continue;
+        const Box& box = node->world_box();
+        const bool zero = box.quick_zero();
+        const vec3 pos = zero ? node->position(Space::WORLD) : vec3();
+        uint64_t* mask = &m_LightMasks[i * words];
+        bool lit = false;
+        for(unsigned j = 0; j < num_lights; ++j)
+        {
+            if(not m_Lights[j])
+                continue;
+            const vec4& v = m_LightVolumes[j];
+            if(v.w >= 0.0f && not box.quick_full())
+            {
+                float d2;
+                if(zero) {
+                    vec3 d = pos - vec3(v);
+                    d2 = dot(d, d);
+                } else
+                    d2 = AABBTree::distance2(box, vec3(v));
+                if(d2 > v.w)
+                    continue;
+            }
+            mask[j / 64] |= uint64_t(1) << (j % 64);
+            m_LightNodes[j].push_back(node);
+            lit = true;
+        }
+        if(lit)
+            m_LitNodes.push_back(i);
+    }
+
+    // group nodes sharing a light set, keeping partition order within groups
+    auto mask_of = [&](unsigned idx){
+        return m_LightMasks.begin() + idx * words;
+    };
+    stable_sort(ENTIRE(m_LitNodes), [&](unsigned a, unsigned b){
+        return std::lexicographical_compare(
+            mask_of(a), mask_of(a) + words,
+            mask_of(b), mask_of(b) + words
+        );
+    });
+    unsigned groups = 0;
+    for(unsigned k = 0; k < m_LitNodes.size(); ++k)
+    {
+        unsigned idx = m_LitNodes[k];
+        if(not k || not std::equal(
+            mask_of(idx), mask_of(idx) + words, mask_of(m_LitNodes[k-1])
+        ))
+        {
+            if(groups == m_LightGroups.size())
+                m_LightGroups.emplace_back();
+            auto& group = m_LightGroups[groups++];
+            group.lights.clear();
+            group.nodes.clear();
+            for(unsigned j = 0; j < num_lights; ++j)
+                if(*(mask_of(idx) + j / 64) & (uint64_t(1) << (j % 64)))
+                    group.lights.push_back(m_Lights[j]);
+        }
+        m_LightGroups[groups-1].nodes.push_back(m_Nodes[idx]);
+    }
+    m_LightGroups.resize(groups);
+}
+
+const std::vector<const Node*>& BasicPartitioner :: visible_nodes_from(
+    const Light* light
+) const {
+    static const std::vector<const Node*> s_None;
+    for(unsigned i = 0; i < m_Lights.size(); ++i)
+        if(m_Lights[i] == light)
+            return m_LightNodes[i];
+    return s_None;
 }
 
 void BasicPartitioner :: lazy_logic(Freq:: Time t)
@@ -110,11 +243,45 @@ void BasicPartitioner :: lazy_logic(Freq:: Time t)
     
 }
 
+void BasicPartitioner :: refit(ObjectList& list)
+{
+    if(list.sweep)
+    {
+        for(unsigned i = list.objects.size(); i > 0; --i)
+            if(list.objects[i-1].expired())
+                erase_object(list, i-1);
+        list.sweep = false;
+    }
+    
+    for(auto id: *list.moved)
+        if(list.tree.valid(id))
+            list.tree.update(id);
+    list.moved->clear();
+}
+
+void BasicPartitioner :: erase_object(ObjectList& list, unsigned idx)
+{
+    auto id = list.proxies[idx];
+    if(list.tree.valid(id))
+        list.tree.remove(id);
+    auto& cons = list.connections[idx];
+    cons.first.disconnect();
+    cons.second.disconnect();
+    list.objects.erase(list.objects.begin() + idx);
+    list.proxies.erase(list.proxies.begin() + idx);
+    list.connections.erase(list.connections.begin() + idx);
+}
+
 void BasicPartitioner :: logic(Freq::Time t)
 {
     ++m_Recur;
     
     vector<shared_ptr<bool>> unset;
+    vector<weak_ptr<Node>> pcs;
+
+    for(auto& list: m_Objects)
+        refit(list);
+    m_Index.refit();
     
     // check 1-to-1 collisions
     for(
@@ -183,7 +350,7 @@ void BasicPartitioner :: logic(Freq::Time t)
             continue;
         }
 
-        auto pcs = get_potentials(a.get(), type);
+        get_potentials(a.get(), type, pcs);
         
         unsigned collisions = 0;
         //for(auto jtr = m_Objects[type].objects.begin();
@@ -194,6 +361,7 @@ void BasicPartitioner :: logic(Freq::Time t)
             auto b = jtr->lock();
             if(not b) {
             //    jtr = m_Objects[type].objects.erase(jtr);
+                m_Objects[type].sweep = true;
                 ++jtr;
                 continue;
             }
@@ -238,16 +406,15 @@ void BasicPartitioner :: logic(Freq::Time t)
         unset.push_back(m_Objects[type_a].recheck);
         unset.push_back(m_Objects[type_b].recheck);
         
-        for(auto jtr = m_Objects[type_a].objects.begin();
-            jtr != m_Objects[type_a].objects.end();
-        ){
+        for(unsigned j = 0; j < m_Objects[type_a].objects.size();)
+        {
             unsigned collisions = 0;
-            auto a = jtr->lock();
+            auto a = m_Objects[type_a].objects[j].lock();
             if(not a) {
-                jtr = m_Objects[type_a].objects.erase(jtr);
+                erase_object(m_Objects[type_a], j);
                 continue;
             }
-            auto pcs = get_potentials(a.get(), type_b);
+            get_potentials(a.get(), type_b, pcs);
             for(auto htr = pcs.begin();
                 htr != pcs.end()
             ;){
@@ -258,6 +425,7 @@ void BasicPartitioner :: logic(Freq::Time t)
                 auto b = htr->lock();
                 if(not b) {
                 //    htr = m_Objects[type_b].objects.erase(htr);
+                    m_Objects[type_b].sweep = true;
                     ++htr;
                     continue;
                 }
@@ -282,7 +450,7 @@ void BasicPartitioner :: logic(Freq::Time t)
                 else
                     itr->on_untouch(a.get(), nullptr);
             }
-            ++jtr;
+            ++j;
         }
         ++itr;
     }
@@ -302,13 +470,30 @@ void BasicPartitioner :: logic(Freq::Time t)
 std::vector<std::weak_ptr<Node>> BasicPartitioner :: get_potentials(
     Node* n, unsigned typ
 ){
-    auto potentials = m_Objects[typ].objects;
+    std::vector<std::weak_ptr<Node>> potentials;
+    get_potentials(n, typ, potentials);
+    return potentials;
+}
+
+void BasicPartitioner :: get_potentials(
+    Node* n, unsigned typ,
+    std::vector<std::weak_ptr<Node>>& out
+){
+    out.clear();
+    if(typ < m_Objects.size())
+    {
+        auto& tree = m_Objects[typ].tree;
+        const Box& box = n->world_box();
+        tree.query(box, [&](AABBTree::Proxy id){
+            out.push_back(tree.ref(id));
+            return true;
+        });
+    }
     auto pcs_itr = m_Providers.find(typ);
     if(pcs_itr != m_Providers.end()){
         auto more = pcs_itr->second(n->world_box());
-        std::copy(ENTIRE(more), back_inserter(potentials));
+        std::copy(ENTIRE(more), back_inserter(out));
     }
-    return potentials;
 }
 
 void BasicPartitioner :: register_provider(unsigned type,
@@ -458,13 +643,25 @@ void BasicPartitioner :: register_object(
     const std::shared_ptr<Node>& a,
     unsigned type
 ){
-    auto func = [&]{
+    auto func = [this, a, type]{
         if(type>=m_Objects.size()) m_Objects.resize(type+1);
-        m_Objects[type].objects.emplace_back(a);
-        auto rc = std::weak_ptr<bool>(m_Objects[type].recheck);
+        auto& list = m_Objects[type];
+        auto id = list.tree.insert(a);
+        list.objects.emplace_back(a);
+        list.proxies.push_back(id);
+        auto rc = std::weak_ptr<bool>(list.recheck);
+        auto mv = std::weak_ptr<std::vector<AABBTree::Proxy>>(list.moved);
         auto cb = [rc]{ TRY(*std::shared_ptr<bool>(rc) = true;); };
-        a->on_pend.connect(cb);
-        a->on_free.connect(cb);
+        auto move_cb = [rc, mv, id]{
+            TRY(
+                *std::shared_ptr<bool>(rc) = true;
+                std::shared_ptr<std::vector<AABBTree::Proxy>>(mv)->push_back(id);
+            );
+        };
+        list.connections.emplace_back(
+            a->on_pend.connect(move_cb),
+            a->on_free.connect(cb)
+        );
     };
     if(m_Recur)
         m_Pending.push_back(func);
@@ -476,6 +673,24 @@ void BasicPartitioner :: deregister_object(
     const std::shared_ptr<Node>& a,
     unsigned type
 ){
+    auto func = [this, a, type]{
+        if(type >= m_Objects.size())
+            return;
+        auto& list = m_Objects[type];
+        for(unsigned i = 0; i < list.objects.size(); ++i)
+        {
+            if(list.objects[i].lock() == a)
+            {
+                erase_object(list, i);
+                *list.recheck = true;
+                return;
+            }
+        }
+    };
+    if(m_Recur)
+        m_Pending.push_back(func);
+    else
+        func();
 }
 
 void BasicPartitioner :: deregister_object(
@@ -494,6 +709,15 @@ void BasicPartitioner :: deregister_object(
     });
 }
 
+void BasicPartitioner :: index(const std::shared_ptr<Node>& n, bool recursive)
+{
+    m_Index.add(n);
+    if(recursive)
+        n->each([this](Node* c){
+            m_Index.add(c->as_node());
+        }, Node::Each::RECURSIVE);
+}
+
 void BasicPartitioner :: after(std::function<void()> func)
 {
     m_Pending.push_back(func);
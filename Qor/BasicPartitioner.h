@@ -5,7 +5,11 @@
 #include "kit/kit.h"
 #include "kit/reactive/signal.h"
 #include "Light.h"
+#include "AABBTree.h"
+#include "SpatialIndex.h"
+#include "OcclusionBuffer.h"
 #include <vector>
+#include <cstdint>
 
 class BasicPartitioner:
     public IPartitioner
@@ -25,8 +29,9 @@ class BasicPartitioner:
         }
         virtual const std::vector<const Node*>& visible_nodes_from(
             const Light* light
-        ) const override {
-            return m_Nodes;
+        ) const override;
+        virtual const std::vector<LightGroup>& light_groups() const override {
+            return m_LightGroups;
         }
 
         virtual void camera(Camera* camera) override {
@@ -38,6 +43,16 @@ class BasicPartitioner:
         virtual Camera* camera() override {
             return m_pCamera;
         }
+
+        virtual void occlusion_culling(bool b) override {
+            m_bOcclusion = b;
+        }
+        virtual bool occlusion_culling() const override {
+            return m_bOcclusion;
+        }
+        virtual const OcclusionBuffer* occlusion_buffer() const override {
+            return &m_Occlusion;
+        }
         
         virtual void preload() override {
             logic(Freq::Time::ms(0));
@@ -139,10 +154,48 @@ class BasicPartitioner:
         
         //virtual void clear_collision(const std::shared_ptr<Node>& n) override;
 
+        virtual void index(const std::shared_ptr<Node>& n, bool recursive = false) override;
+        virtual void deindex(const Node* n) override {
+            m_Index.remove(n);
+        }
+        virtual unsigned query(
+            const Box& box,
+            std::vector<Node*>& out,
+            const std::function<bool(Node*)>& cond = std::function<bool(Node*)>()
+        ) override {
+            return m_Index.query(box, out, cond);
+        }
+        virtual unsigned query_radius(
+            glm::vec3 center,
+            float radius,
+            std::vector<Node*>& out,
+            const std::function<bool(Node*)>& cond = std::function<bool(Node*)>()
+        ) override {
+            return m_Index.query_radius(center, radius, out, cond);
+        }
+        virtual unsigned query_ray(
+            glm::vec3 origin,
+            glm::vec3 dir,
+            float dist,
+            std::vector<Node*>& out,
+            const std::function<bool(Node*)>& cond = std::function<bool(Node*)>()
+        ) override {
+            return m_Index.query_ray(origin, dir, dist, out, cond);
+        }
+        virtual unsigned query_nearest(
+            glm::vec3 point,
+            unsigned k,
+            std::vector<Node*>& out,
+            const std::function<bool(Node*)>& cond = std::function<bool(Node*)>()
+        ) override {
+            return m_Index.query_nearest(point, k, out, cond);
+        }
+
         virtual void clear() override {
             m_IntertypeCollisions.clear();
             m_TypedCollisions.clear();
             m_Collisions.clear();
+            m_Index.clear();
         }
         
         virtual bool empty() const override {
@@ -151,6 +204,8 @@ class BasicPartitioner:
                 m_IntertypeCollisions.empty() &&
                 m_TypedCollisions.empty() &&
                 m_Lights.empty() &&
+                m_LightGroups.empty() &&
+                m_Index.empty() &&
                 m_Nodes.empty();
         }
         virtual bool has_collisions() const override {
@@ -165,6 +220,13 @@ class BasicPartitioner:
         std::vector<std::weak_ptr<Node>> get_potentials(
             Node* obj, unsigned typ
         );
+
+        // broadphase candidates for obj against type typ, written into out
+        // (cleared first) so the caller can reuse the buffer
+        void get_potentials(
+            Node* obj, unsigned typ,
+            std::vector<std::weak_ptr<Node>>& out
+        );
         
         void after(std::function<void()> func);
         
@@ -175,8 +237,32 @@ class BasicPartitioner:
             // all objects in list are the same type
             std::vector<std::weak_ptr<Node>> objects;
             std::shared_ptr<bool> recheck = std::make_shared<bool>(true);
+
+            // broadphase over objects, proxies[i] is the leaf of objects[i]
+            AABBTree tree;
+            std::vector<AABBTree::Proxy> proxies;
+            
+            // leaves pended since the last refit
+            std::shared_ptr<std::vector<AABBTree::Proxy>> moved =
+                std::make_shared<std::vector<AABBTree::Proxy>>();
+
+            // on_pend and on_free connections of objects[i]
+            std::vector<std::pair<
+                boost::signals2::connection,
+                boost::signals2::connection
+            >> connections;
+
+            // set when a query hits an expired object
+            bool sweep = false;
         };
 
+        // fill per-light node lists and light groups for visible nodes
+        void partition_lights();
+        void cull_occluded();
+        
+        void refit(ObjectList& list);
+        void erase_object(ObjectList& list, unsigned idx);
+
         // type (index) -> objects that can be collided with
         std::vector<ObjectList> m_Objects;
         
@@ -185,9 +271,21 @@ class BasicPartitioner:
         std::vector<Pair<std::weak_ptr<Node>, unsigned>> m_TypedCollisions;
         std::vector<Pair<std::weak_ptr<Node>, std::weak_ptr<Node>>> m_Collisions;
         std::map<unsigned, std::function<std::vector<std::weak_ptr<Node>>(Box)>> m_Providers;
+
+        // scene-wide index for gameplay queries
+        SpatialIndex m_Index;
         
         std::vector<const Node*> m_Nodes;
         std::vector<const Light*> m_Lights;
+
+        // m_LightNodes[i]: visible nodes in range of m_Lights[i]
+        std::vector<std::vector<const Node*>> m_LightNodes;
+        std::vector<LightGroup> m_LightGroups;
+        
+        // scratch for partition_lights(), kept to avoid reallocating
+        std::vector<glm::vec4> m_LightVolumes;
+        std::vector<uint64_t> m_LightMasks;
+        std::vector<unsigned> m_LitNodes;
         //std::map<
         //    std::tuple<Node*, Node*>,
         //    boost::signals2::signal<
@@ -200,6 +298,9 @@ class BasicPartitioner:
         
         Camera* m_pCamera = nullptr;
 
+        bool m_bOcclusion = false;
+        OcclusionBuffer m_Occlusion;
+
         std::vector<std::function<void()>> m_Pending;
         int m_Recur = 0;
 };
@@ -35,42 +35,46 @@ void Camera :: init()
         return w;
     };
 
+    m_PerspectiveFrustum = [this]{
+        return calculate_perspective_frustum();
+    };
+
     on_pend.connect([this]{
         m_ViewMatrix.pend();
         if(m_bOrtho)
             m_OrthoFrustum.pend();
         else
-            calculate_perspective_frustum();
+            m_PerspectiveFrustum.pend();
     });
     m_bInited = true;
 }
 
-void Camera :: calculate_perspective_frustum()
+std::array<glm::vec4, 6> Camera :: calculate_perspective_frustum() const
 {
-    auto mat = *matrix(Space::WORLD);
-    auto pos = Matrix::translation(mat);
-    vec3 at = normalize(Matrix::heading(mat));
-    vec3 up = normalize(Matrix::up(mat));
-    vec3 right = normalize(Matrix::right(mat));
-    float ratio = m_Size.x / m_Size.y;
-    float hnear = 2.0f * tan(m_FOV / 2.0f) * m_ZNear;
-    float wnear = hnear * ratio;
-    float hfar = 2.0f * tan(m_FOV / 2.0f) * m_ZFar;
-    float wfar = hfar * ratio;
+    // Gribb/Hartmann plane extraction
+    // glm is column-major, so row i of the matrix is (m[0][i],...,m[3][i])
+    mat4 m = projection() * view();
+    vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
     
-    vec3 fc = pos + at * m_ZFar;
-    vec3 ftl = fc + (up * hfar/2.0f) - (right * wfar/2.0f);
-    vec3 ftr = fc + (up * hfar/2.0f) + (right * wfar/2.0f);
-    vec3 fbl = fc - (up * hfar/2.0f) - (right * wfar/2.0f);
-    vec3 fbr = fc - (up * hfar/2.0f) + (right * wfar/2.0f);
-
-    vec3 nc = pos + at * m_ZNear;
-    vec3 ntl = nc + (up * hnear/2.0f) - (right * wnear/2.0f);
-    vec3 ntr = nc + (up * hnear/2.0f) + (right * wnear/2.0f);
-    vec3 nbl = nc - (up * hnear/2.0f) - (right * wnear/2.0f);
-    vec3 nbr = nc - (up * hnear/2.0f) + (right * wnear/2.0f);
+    std::array<vec4, 6> planes = {{
+        row3 + row0, // left
+        row3 - row0, // right
+        row3 + row1, // bottom
+        row3 - row1, // top
+        row3 + row2, // near
+        row3 - row2  // far
+    }};
 
-    vec3 a = up * normalize((nc + right * wnear / 2.0f) - pos);
+    for(auto& p: planes)
+    {
+        float len = glm::length(vec3(p));
+        if(not floatcmp(len, 0.0f))
+            p /= len;
+    }
+    return planes;
 }
 
 void Camera :: logic_self(Freq::Time t)
@@ -109,9 +113,22 @@ bool Camera :: in_frustum(const Box& box) const
         assert(not box.quick_full());
         return m_OrthoFrustum().collision(box);
     }
-    else
+    
+    // nodes without bounds (lights, groups) can't be culled by them
+    if(box.quick_zero() || box.quick_full())
+        return true;
+
+    // center/extent form: the box is outside if it lies entirely
+    // behind any one of the planes
+    const vec3 c = box.center();
+    const vec3 e = box.size() / 2.0f;
+    for(const auto& p: m_PerspectiveFrustum())
     {
-        
+        vec3 n(p);
+        float d = dot(n, c) + p.w;
+        float r = dot(e, abs(n));
+        if(d + r < 0.0f)
+            return false;
     }
     return true;
 }
@@ -122,6 +139,10 @@ bool Camera :: in_frustum(glm::vec3 point) const
     
     if(m_bOrtho)
         return m_OrthoFrustum().collision(point);
+    
+    for(const auto& p: m_PerspectiveFrustum())
+        if(dot(vec3(p), point) + p.w < 0.0f)
+            return false;
     return true;
 }
 
@@ -177,8 +198,8 @@ void Camera :: recalculate_projection()
             DEG2RADf(m_FOV),
             1.0f * m_Size.x,
             1.0f * m_Size.y,
-            (not floatcmp(m_ZNear,0.0f)) ?  m_ZNear : 0.01f,
-            (not floatcmp(m_ZFar,0.0f)) ?  m_ZFar : 1000.0f
+            znear(),
+            zfar()
         );
     }
     
@@ -259,6 +280,15 @@ bool Camera :: is_visible(const Node* n, Node::LoopCtrl* lc) const
     bool cb_ret = true;
     if(m_IsNodeVisible)
         cb_ret = m_IsNodeVisible(n, lc);
-    return cb_ret && in_frustum(n->world_box());
+    if(not cb_ret)
+        return false;
+    if(not in_frustum(n->world_box())){
+        // children are contained in this box, so none of them can be
+        // visible either
+        if(lc && n->skip_child_box_check())
+            *lc = LC_SKIP;
+        return false;
+    }
+    return true;
 }
 
@@ -14,6 +14,7 @@
 #include <iostream>
 #include "kit/math/common.h"
 #include <tuple>
+#include <array>
 
 class Window;
 class Camera:
@@ -69,6 +70,8 @@ class Camera:
 
         const glm::mat4& projection() const;
         const glm::mat4& view() const;
+        // viewport in pixels
+        const glm::ivec2& size() const { return m_Size; }
         
         enum Flag {
             ORTHO = kit::bit(0),
@@ -82,6 +85,14 @@ class Camera:
         
         void range(float n, float f);
 
+        // clip distances of the perspective projection
+        float znear() const {
+            return (not floatcmp(m_ZNear,0.0f)) ? m_ZNear : 0.01f;
+        }
+        float zfar() const {
+            return (not floatcmp(m_ZFar,0.0f)) ? m_ZFar : 1000.0f;
+        }
+
         bool has_node_visible_func() const {
             return bool(m_IsNodeVisible);
         }
@@ -95,13 +106,18 @@ class Camera:
         //bool is_self_visible(const Node* n) const;
         bool is_visible(const Node* n, Node::LoopCtrl* lc = nullptr) const;
 
-        void calculate_perspective_frustum();
+        // extracts the six world-space clipping planes (left, right,
+        // bottom, top, near, far) from projection() * view()
+        std::array<glm::vec4, 6> calculate_perspective_frustum() const;
         
         virtual std::string type() const override { return "camera"; }
 
         Box ortho_frustum() const {
             return m_OrthoFrustum();
         }
+        const std::array<glm::vec4, 6>& perspective_frustum() const {
+            return m_PerspectiveFrustum();
+        }
 
         bool is_visible_func(const Node* n, Node::LoopCtrl* lc) {
             if(m_IsNodeVisible)
@@ -152,6 +168,7 @@ class Camera:
         //bool m_bWindingCW = false;
 
         mutable kit::lazy<Box> m_OrthoFrustum;
+        mutable kit::lazy<std::array<glm::vec4, 6>> m_PerspectiveFrustum;
         
 #ifndef QOR_NO_AUDIO
         Audio::Listener m_Listener;
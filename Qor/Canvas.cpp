@@ -1,6 +1,7 @@
 #include "Canvas.h"
 #include "Mesh.h"
 #include "GLTask.h"
+#include "GLState.h"
 #include "kit/math/common.h"
 #include "kit/log/log.h"
 #include "kit/log/errors.h"
@@ -17,25 +18,20 @@ Canvas :: Canvas(unsigned w, unsigned h):
 {
     if(not Headless::enabled())
     {
-        int last_id;
         unsigned id;
         
         GL_TASK_START()
             
-            glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_id);
             glGenTextures(1,&id);
             try{
                 m_Texture = make_shared<Texture>(id); // take ownership
             }catch(...){
-                glDeleteTextures(1,&id);
+                GLState::get()->delete_textures(1,&id);
                 throw;
             }
             m_Texture->size(w, h);
             
-            glBindTexture(GL_TEXTURE_2D, id);
-            BOOST_SCOPE_EXIT_ALL(last_id) {
-                glBindTexture(GL_TEXTURE_2D, last_id);
-            };
+            GLState::get()->bind_texture(0, id);
             
             glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
             glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
@@ -0,0 +1,352 @@
+#include "ClusteredLighting.h"
+#include "Light.h"
+#include "Camera.h"
+#include "GLTask.h"
+#include "GLState.h"
+#include <cmath>
+#include <algorithm>
+using namespace std;
+using namespace glm;
+
+// row length of the light index texture
+#define INDEX_WIDTH 1024
+
+// below this many lights, binning isn't worth waking the workers for
+#define MIN_PARALLEL_LIGHTS 64
+
+namespace {
+    inline int clamp_cell(float f, unsigned cells) {
+        return std::max(0, std::min(int(cells) - 1, int(std::floor(f))));
+    }
+
+    void upload_texture(
+        unsigned slot,
+        unsigned id,
+        GLint internal,
+        GLenum format,
+        uvec2 size,
+        uvec2& old_size,
+        const float* data
+    ){
+        GLState::get()->bind_texture(slot, id);
+        if(size == old_size)
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.x, size.y,
+                format, GL_FLOAT, data);
+        else {
+            glTexImage2D(GL_TEXTURE_2D, 0, internal, size.x, size.y, 0,
+                format, GL_FLOAT, data);
+            old_size = size;
+        }
+    }
+}
+
+const unsigned ClusteredLighting :: GRID_X;
+const unsigned ClusteredLighting :: GRID_Y;
+const unsigned ClusteredLighting :: GRID_Z;
+const unsigned ClusteredLighting :: CLUSTERS;
+const unsigned ClusteredLighting :: MAX_LIGHTS;
+const unsigned ClusteredLighting :: MAX_LIGHTS_PER_CLUSTER;
+const unsigned ClusteredLighting :: TEXTURE_SLOT;
+
+ClusteredLighting :: ClusteredLighting():
+    m_ClusterLights(CLUSTERS * MAX_LIGHTS_PER_CLUSTER),
+    m_ClusterCounts(CLUSTERS),
+    m_Overflow(GRID_Z),
+    m_ClusterData(CLUSTERS * 2)
+{
+    m_Threads = std::max(1u, std::min(4u, std::thread::hardware_concurrency()));
+}
+
+ClusteredLighting :: ~ClusteredLighting()
+{
+    stop_workers();
+    if(m_LightTexture)
+    {
+        unsigned ids[] = {m_LightTexture, m_ClusterTexture, m_IndexTexture};
+        GL_TASK_ASYNC_START()
+            GLState::get()->delete_textures(3, ids);
+        GL_TASK_ASYNC_END()
+    }
+}
+
+void ClusteredLighting :: build(
+    const std::vector<const Light*>& lights,
+    const Camera* camera
+){
+    m_Stats = Stats();
+    m_LightData.clear();
+    m_X.clear();
+    m_Y.clear();
+    m_Z.clear();
+    m_Radius.clear();
+    m_Index.clear();
+
+    const mat4& view = camera->view();
+    const mat4& proj = camera->projection();
+    m_ZNear = camera->znear();
+    m_ZFar = camera->zfar();
+
+    auto push_light = [&](const Light* light, const vec4& pos){
+        m_LightData.push_back(pos);
+        m_LightData.push_back(vec4(light->diffuse().vec3(), 0.0f));
+        m_LightData.push_back(vec4(light->specular().vec3(), 0.0f));
+        m_LightData.push_back(vec4(light->ambient().vec3(), 0.0f));
+    };
+
+    // unbounded lights go first, since every fragment reads them
+    for(auto&& light: lights)
+    {
+        if(not light || light->light_type() != Light::Type::DIRECTIONAL)
+            continue;
+        if(m_LightData.size() / 4 == MAX_LIGHTS)
+            break;
+        vec3 dir = vec3(view * vec4(light->position(Space::WORLD), 0.0f));
+        push_light(light, vec4(dir, -1.0f));
+        ++m_Stats.global_lights;
+    }
+    for(auto&& light: lights)
+    {
+        if(not light || light->light_type() == Light::Type::DIRECTIONAL)
+            continue;
+        if(m_LightData.size() / 4 == MAX_LIGHTS)
+            break;
+        vec3 pos = vec3(view * vec4(light->position(Space::WORLD), 1.0f));
+        m_X.push_back(pos.x);
+        m_Y.push_back(pos.y);
+        m_Z.push_back(pos.z);
+        m_Radius.push_back(light->dist());
+        m_Index.push_back(m_LightData.size() / 4);
+        push_light(light, vec4(pos, light->dist()));
+    }
+    m_Stats.lights = m_LightData.size() / 4;
+
+    // cluster range of each light, from the corners of its view space box
+    // (ndc = P00 * x / depth - P20, extremes are at the corners)
+    const unsigned num = m_X.size();
+    m_MinX.resize(num); m_MaxX.resize(num);
+    m_MinY.resize(num); m_MaxY.resize(num);
+    m_MinZ.resize(num); m_MaxZ.resize(num);
+    const float zscale = GRID_Z / std::log(m_ZFar / m_ZNear);
+    const float px = proj[0][0], ox = proj[2][0];
+    const float py = proj[1][1], oy = proj[2][1];
+    for(unsigned i = 0; i < num; ++i)
+    {
+        const float r = m_Radius[i];
+        float z0 = -m_Z[i] - r;
+        float z1 = -m_Z[i] + r;
+        float nx0 = -1.0f, nx1 = 1.0f, ny0 = -1.0f, ny1 = 1.0f;
+        if(z1 >= m_ZNear && z0 <= m_ZFar)
+        {
+            z0 = std::max(z0, m_ZNear);
+            z1 = std::min(z1, m_ZFar);
+            const float x0 = m_X[i] - r, x1 = m_X[i] + r;
+            const float y0 = m_Y[i] - r, y1 = m_Y[i] + r;
+            nx0 = std::min(px * x0 / z0, px * x0 / z1) - ox;
+            nx1 = std::max(px * x1 / z0, px * x1 / z1) - ox;
+            ny0 = std::min(py * y0 / z0, py * y0 / z1) - oy;
+            ny1 = std::max(py * y1 / z0, py * y1 / z1) - oy;
+        }
+        if(z1 < m_ZNear || z0 > m_ZFar ||
+            nx1 < -1.0f || nx0 > 1.0f ||
+            ny1 < -1.0f || ny0 > 1.0f
+        ){
+            // off screen, leave an empty range
+            m_MinZ[i] = 1;
+            m_MaxZ[i] = 0;
+            continue;
+        }
+        m_MinX[i] = clamp_cell((nx0 + 1.0f) * 0.5f * GRID_X, GRID_X);
+        m_MaxX[i] = clamp_cell((nx1 + 1.0f) * 0.5f * GRID_X, GRID_X);
+        m_MinY[i] = clamp_cell((ny0 + 1.0f) * 0.5f * GRID_Y, GRID_Y);
+        m_MaxY[i] = clamp_cell((ny1 + 1.0f) * 0.5f * GRID_Y, GRID_Y);
+        m_MinZ[i] = clamp_cell(std::log(z0 / m_ZNear) * zscale, GRID_Z);
+        m_MaxZ[i] = clamp_cell(std::log(z1 / m_ZNear) * zscale, GRID_Z);
+    }
+
+    // threads own disjoint ranges of depth slices, so nothing is shared
+    std::fill(ENTIRE(m_Overflow), 0);
+    const unsigned threads = std::min(m_Threads, GRID_Z);
+    if(threads > 1 && num >= MIN_PARALLEL_LIGHTS)
+    {
+        const unsigned per = (GRID_Z + threads - 1) / threads;
+        unsigned count = 0;
+        for(unsigned t = 1; t < threads && t * per < GRID_Z; ++t)
+            ++count;
+        if(m_Workers.size() != count)
+            start_workers(count);
+        {
+            std::unique_lock<std::mutex> l(m_WorkMutex);
+            m_SlicesPerThread = per;
+            m_Busy = count;
+            ++m_Build;
+        }
+        m_WorkCV.notify_all();
+        bin_slices(0, per);
+        std::unique_lock<std::mutex> l(m_WorkMutex);
+        m_DoneCV.wait(l, [this]{ return m_Busy == 0; });
+    }
+    else
+        bin_slices(0, GRID_Z);
+    for(auto&& o: m_Overflow)
+        m_Stats.overflow += o;
+
+    // compact into (offset, count) per cluster and one index list
+    m_IndexData.clear();
+    for(unsigned c = 0; c < CLUSTERS; ++c)
+    {
+        const unsigned count = m_ClusterCounts[c];
+        m_ClusterData[c*2] = (float)m_IndexData.size();
+        m_ClusterData[c*2 + 1] = (float)count;
+        if(not count)
+            continue;
+        ++m_Stats.clusters_used;
+        const uint16_t* idx = &m_ClusterLights[c * MAX_LIGHTS_PER_CLUSTER];
+        for(unsigned j = 0; j < count; ++j)
+            m_IndexData.push_back(idx[j]);
+    }
+    m_Stats.indices = m_IndexData.size();
+}
+
+void ClusteredLighting :: start_workers(unsigned count)
+{
+    stop_workers();
+    m_bQuit = false;
+    for(unsigned t = 1; t <= count; ++t)
+        m_Workers.emplace_back(&ClusteredLighting::worker, this, t, m_Build);
+}
+
+void ClusteredLighting :: stop_workers()
+{
+    {
+        std::unique_lock<std::mutex> l(m_WorkMutex);
+        m_bQuit = true;
+    }
+    m_WorkCV.notify_all();
+    for(auto&& w: m_Workers)
+        w.join();
+    m_Workers.clear();
+}
+
+void ClusteredLighting :: worker(unsigned idx, unsigned build)
+{
+    for(;;)
+    {
+        unsigned per;
+        {
+            std::unique_lock<std::mutex> l(m_WorkMutex);
+            m_WorkCV.wait(l, [this, build]{
+                return m_bQuit || m_Build != build;
+            });
+            if(m_bQuit)
+                return;
+            build = m_Build;
+            per = m_SlicesPerThread;
+        }
+
+        bin_slices(idx * per, std::min(GRID_Z, (idx + 1) * per));
+
+        bool done;
+        {
+            std::unique_lock<std::mutex> l(m_WorkMutex);
+            done = --m_Busy == 0;
+        }
+        if(done)
+            m_DoneCV.notify_one();
+    }
+}
+
+void ClusteredLighting :: bin_slices(unsigned first, unsigned last)
+{
+    const unsigned slice = GRID_X * GRID_Y;
+    std::fill(
+        m_ClusterCounts.begin() + first * slice,
+        m_ClusterCounts.begin() + last * slice,
+        0
+    );
+
+    unsigned overflow = 0;
+    const unsigned num = m_X.size();
+    for(unsigned i = 0; i < num; ++i)
+    {
+        const unsigned z0 = std::max<unsigned>(first, m_MinZ[i]);
+        const unsigned z1 = std::min<unsigned>(last - 1, m_MaxZ[i]);
+        if(m_MinZ[i] > m_MaxZ[i] || z0 > z1)
+            continue;
+        for(unsigned z = z0; z <= z1; ++z)
+            for(unsigned y = m_MinY[i]; y <= m_MaxY[i]; ++y)
+                for(unsigned x = m_MinX[i]; x <= m_MaxX[i]; ++x)
+                {
+                    const unsigned c = x + GRID_X * (y + GRID_Y * z);
+                    const unsigned n = m_ClusterCounts[c];
+                    if(n == MAX_LIGHTS_PER_CLUSTER) {
+                        ++overflow;
+                        continue;
+                    }
+                    m_ClusterLights[c * MAX_LIGHTS_PER_CLUSTER + n] = m_Index[i];
+                    m_ClusterCounts[c] = n + 1;
+                }
+    }
+    m_Overflow[first] = overflow;
+}
+
+void ClusteredLighting :: upload()
+{
+    if(not m_LightTexture)
+    {
+        unsigned ids[3];
+        glGenTextures(3, ids);
+        m_LightTexture = ids[0];
+        m_ClusterTexture = ids[1];
+        m_IndexTexture = ids[2];
+        for(unsigned i = 0; i < 3; ++i)
+        {
+            GLState::get()->bind_texture(TEXTURE_SLOT + i, ids[i]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+    }
+
+    // never upload empty textures
+    if(m_LightData.empty())
+        m_LightData.resize(4);
+    const unsigned rows = std::max<unsigned>(1,
+        (m_IndexData.size() + INDEX_WIDTH - 1) / INDEX_WIDTH
+    );
+    m_IndexData.resize(rows * INDEX_WIDTH);
+
+    upload_texture(TEXTURE_SLOT, m_LightTexture, GL_RGBA32F, GL_RGBA,
+        uvec2(4, m_LightData.size() / 4), m_LightTextureSize,
+        &m_LightData[0][0]
+    );
+    upload_texture(TEXTURE_SLOT + 1, m_ClusterTexture, GL_RG32F, GL_RG,
+        uvec2(GRID_X * GRID_Y, GRID_Z), m_ClusterTextureSize,
+        &m_ClusterData[0]
+    );
+    upload_texture(TEXTURE_SLOT + 2, m_IndexTexture, GL_R32F, GL_RED,
+        uvec2(INDEX_WIDTH, rows), m_IndexTextureSize,
+        &m_IndexData[0]
+    );
+    GLState::get()->active_texture(0);
+}
+
+void ClusteredLighting :: bind(Program* program, glm::uvec2 viewport)
+{
+    upload();
+
+    program->uniform(program->uniform("LightData"), (int)TEXTURE_SLOT);
+    program->uniform(program->uniform("LightClusters"), (int)TEXTURE_SLOT + 1);
+    program->uniform(program->uniform("LightIndices"), (int)TEXTURE_SLOT + 2);
+    program->uniform(program->uniform("LightDataSize"), vec2(m_LightTextureSize));
+    program->uniform(program->uniform("LightIndicesSize"), vec2(m_IndexTextureSize));
+    program->uniform(program->uniform("ClusterGrid"),
+        vec3(GRID_X, GRID_Y, GRID_Z)
+    );
+    program->uniform(program->uniform("ClusterDepth"),
+        vec2(m_ZNear, GRID_Z / std::log(m_ZFar / m_ZNear))
+    );
+    program->uniform(program->uniform("ViewportSize"), vec2(viewport));
+    program->uniform(program->uniform("NumGlobalLights"), (int)m_Stats.global_lights);
+}
+
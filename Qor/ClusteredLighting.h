@@ -0,0 +1,134 @@
+#ifndef _CLUSTEREDLIGHTING_H_R8B1WQ6E
+#define _CLUSTEREDLIGHTING_H_R8B1WQ6E
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+class Light;
+class Camera;
+
+/*
+ *  Clustered forward lighting.
+ *
+ *  The view frustum is split into a GRID_X * GRID_Y * GRID_Z grid of
+ *  clusters (screen tiles by exponential depth slices).  Each frame the
+ *  visible lights are binned into the clusters they overlap on the CPU,
+ *  and the light list and cluster data are uploaded as float textures, so
+ *  the clustered shader can light every fragment in a single pass using
+ *  only the lights of its cluster.
+ *
+ *  Directional lights have no bounds, so they are applied to every
+ *  fragment instead of being binned.
+ *
+ *  Needs float textures (GL 3.0 / ARB_texture_float, ARB_texture_rg).
+ */
+class ClusteredLighting
+{
+    public:
+
+        static const unsigned GRID_X = 16;
+        static const unsigned GRID_Y = 9;
+        static const unsigned GRID_Z = 24;
+        static const unsigned CLUSTERS = GRID_X * GRID_Y * GRID_Z;
+
+        // keep in sync with clustered.fp
+        static const unsigned MAX_LIGHTS = 1024;
+        static const unsigned MAX_LIGHTS_PER_CLUSTER = 64;
+
+        // first of the 3 texture slots used for the light data
+        static const unsigned TEXTURE_SLOT = 8;
+
+        struct Stats
+        {
+            unsigned lights = 0;
+            unsigned global_lights = 0;
+            unsigned clusters_used = 0;
+            unsigned indices = 0;
+            // light/cluster pairs dropped because a cluster was full
+            unsigned overflow = 0;
+        };
+
+        ClusteredLighting();
+        ~ClusteredLighting();
+
+        ClusteredLighting(const ClusteredLighting&) = delete;
+        ClusteredLighting& operator=(const ClusteredLighting&) = delete;
+
+        /*
+         * Bin lights into the clusters of camera's view (CPU only)
+         */
+        void build(const std::vector<const Light*>& lights, const Camera* camera);
+
+        /*
+         * Upload the last build and bind it for program.
+         * GL thread only, program must be in use.
+         */
+        void bind(Program* program, glm::uvec2 viewport);
+
+        const Stats& stats() const { return m_Stats; }
+
+        // threads used for binning (1 = binning on calling thread),
+        // the workers are kept between frames and restarted on change
+        unsigned threads() const { return m_Threads; }
+        void threads(unsigned t) { m_Threads = std::max(1u, t); }
+
+    private:
+
+        void bin_slices(unsigned first, unsigned last);
+        void upload();
+
+        // bins the idx-th range of depth slices of every build after the
+        // given one, until stopped
+        void worker(unsigned idx, unsigned build);
+        void start_workers(unsigned count);
+        void stop_workers();
+
+        // per bounded light, in view space, struct-of-arrays so the
+        // bounds pass stays vectorizable
+        std::vector<float> m_X, m_Y, m_Z, m_Radius;
+        std::vector<uint16_t> m_Index;
+        std::vector<uint8_t> m_MinX, m_MaxX, m_MinY, m_MaxY, m_MinZ, m_MaxZ;
+
+        // CLUSTERS * MAX_LIGHTS_PER_CLUSTER light indices
+        std::vector<uint16_t> m_ClusterLights;
+        std::vector<uint16_t> m_ClusterCounts;
+        std::vector<unsigned> m_Overflow; // per slice
+
+        // texture data
+        std::vector<glm::vec4> m_LightData; // 4 texels per light
+        std::vector<float> m_ClusterData; // offset, count
+        std::vector<float> m_IndexData;
+
+        unsigned m_LightTexture = 0;
+        unsigned m_ClusterTexture = 0;
+        unsigned m_IndexTexture = 0;
+        glm::uvec2 m_LightTextureSize;
+        glm::uvec2 m_ClusterTextureSize;
+        glm::uvec2 m_IndexTextureSize;
+
+        float m_ZNear = 0.01f;
+        float m_ZFar = 1000.0f;
+
+        Stats m_Stats;
+        unsigned m_Threads = 1;
+
+        std::vector<std::thread> m_Workers;
+        std::mutex m_WorkMutex;
+        std::condition_variable m_WorkCV;
+        std::condition_variable m_DoneCV;
+        // bumped once per parallel build to wake the workers
+        unsigned m_Build = 0;
+        unsigned m_SlicesPerThread = 0;
+        // workers still binning the current build
+        unsigned m_Busy = 0;
+        bool m_bQuit = false;
+};
+
+#endif
+
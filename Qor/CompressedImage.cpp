@@ -0,0 +1,416 @@
+#include "CompressedImage.h"
+#include "Common.h"
+#include "Filesystem.h"
+#include "AssetManifest.h"
+#include "kit/log/errors.h"
+#include "kit/log/log.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+using namespace std;
+
+// formats GLEW may be too old to name
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+    #define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+    #define GL_COMPRESSED_RGB8_ETC2 0x9274
+    #define GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2 0x9276
+    #define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+#endif
+
+namespace {
+
+    // little reader that throws at the end of the buffer
+    class Reader
+    {
+        public:
+            Reader(const string& fn, const vector<char>& buf):
+                m_Filename(fn),
+                m_Buffer(buf)
+            {}
+
+            uint32_t u32() {
+                uint32_t r;
+                memcpy(&r, bytes(4), 4);
+                if(m_bSwap)
+                    r = (r >> 24) | ((r >> 8) & 0xFF00) |
+                        ((r << 8) & 0xFF0000) | (r << 24);
+                return r;
+            }
+            const uint8_t* bytes(size_t n) {
+                if(m_Offset + n > m_Buffer.size())
+                    K_ERRORf(PARSE, "%s is truncated", Filesystem::getFileName(m_Filename));
+                const uint8_t* r = (const uint8_t*)&m_Buffer[m_Offset];
+                m_Offset += n;
+                return r;
+            }
+            void skip(size_t n) { bytes(n); }
+            void seek(size_t ofs) { m_Offset = ofs; }
+            size_t offset() const { return m_Offset; }
+            void swap(bool b) { m_bSwap = b; }
+
+        private:
+            const string& m_Filename;
+            const vector<char>& m_Buffer;
+            size_t m_Offset = 0;
+            bool m_bSwap = false;
+    };
+
+    const uint8_t KTX_ID[12] = {
+        0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+    };
+
+    uint32_t fourcc(const char* s) {
+        return uint32_t(uint8_t(s[0])) | (uint32_t(uint8_t(s[1])) << 8) |
+            (uint32_t(uint8_t(s[2])) << 16) | (uint32_t(uint8_t(s[3])) << 24);
+    }
+
+    // DDS header fields and flags
+    const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+    const uint32_t DDPF_FOURCC = 0x4;
+    const uint32_t DDPF_RGB = 0x40;
+    const uint32_t DDSCAPS2_CUBEMAP = 0x200;
+
+    // 565 to 888
+    void unpack565(uint16_t c, uint8_t* rgb) {
+        rgb[0] = uint8_t(((c >> 11) & 0x1F) * 255 / 31);
+        rgb[1] = uint8_t(((c >> 5) & 0x3F) * 255 / 63);
+        rgb[2] = uint8_t((c & 0x1F) * 255 / 31);
+    }
+
+    // one BC1 color block into a 4x4 RGBA block (16 * 4 bytes)
+    void decode_color(const uint8_t* src, uint8_t* out, bool bc1) {
+        const uint16_t c0 = uint16_t(src[0] | (src[1] << 8));
+        const uint16_t c1 = uint16_t(src[2] | (src[3] << 8));
+        uint8_t palette[4][4];
+        unpack565(c0, palette[0]);
+        unpack565(c1, palette[1]);
+        palette[0][3] = palette[1][3] = 255;
+        for(unsigned i = 0; i < 3; ++i)
+        {
+            if(c0 > c1 || not bc1) {
+                palette[2][i] = uint8_t((2 * palette[0][i] + palette[1][i]) / 3);
+                palette[3][i] = uint8_t((palette[0][i] + 2 * palette[1][i]) / 3);
+            } else {
+                palette[2][i] = uint8_t((palette[0][i] + palette[1][i]) / 2);
+                palette[3][i] = 0;
+            }
+        }
+        palette[2][3] = 255;
+        palette[3][3] = (c0 > c1 || not bc1) ? 255 : 0;
+
+        uint32_t bits = uint32_t(src[4]) | (uint32_t(src[5]) << 8) |
+            (uint32_t(src[6]) << 16) | (uint32_t(src[7]) << 24);
+        for(unsigned i = 0; i < 16; ++i)
+            memcpy(out + i * 4, palette[(bits >> (i * 2)) & 3], 4);
+    }
+
+    // BC3 interpolated alpha into the A of a decoded block
+    void decode_alpha(const uint8_t* src, uint8_t* out) {
+        const unsigned a0 = src[0], a1 = src[1];
+        uint8_t alpha[8] = { uint8_t(a0), uint8_t(a1) };
+        if(a0 > a1) {
+            for(unsigned i = 1; i < 7; ++i)
+                alpha[i + 1] = uint8_t(((7 - i) * a0 + i * a1) / 7);
+        } else {
+            for(unsigned i = 1; i < 5; ++i)
+                alpha[i + 1] = uint8_t(((5 - i) * a0 + i * a1) / 5);
+            alpha[6] = 0;
+            alpha[7] = 255;
+        }
+        uint64_t bits = 0;
+        for(unsigned i = 0; i < 6; ++i)
+            bits |= uint64_t(src[2 + i]) << (8 * i);
+        for(unsigned i = 0; i < 16; ++i)
+            out[i * 4 + 3] = alpha[(bits >> (i * 3)) & 7];
+    }
+
+}
+
+CompressedImage :: CompressedImage(const string& fn)
+{
+    // not Filesystem::file_to_buffer(), which reads in text mode
+    ifstream file(fn, ios::binary);
+    vector<char> buf(
+        (istreambuf_iterator<char>(file)),
+        istreambuf_iterator<char>()
+    );
+    if(buf.empty())
+        K_ERROR(READ, fn);
+
+    if(buf.size() >= sizeof(KTX_ID) && memcmp(&buf[0], KTX_ID, sizeof(KTX_ID)) == 0)
+        load_ktx(fn, buf);
+    else if(buf.size() >= 4 && memcmp(&buf[0], "DDS ", 4) == 0)
+        load_dds(fn, buf);
+    else
+        K_ERRORf(PARSE, "%s is not a KTX or DDS file", Filesystem::getFileName(fn));
+
+    if(m_Levels.empty())
+        K_ERRORf(PARSE, "%s has no image data", Filesystem::getFileName(fn));
+}
+
+bool CompressedImage :: is_container(const string& fn)
+{
+    string ext = Filesystem::getExtension(fn);
+    return ext == "ktx" || ext == "dds";
+}
+
+string CompressedImage :: cooked(const string& fn)
+{
+    if(is_container(fn))
+        return string();
+    string base = Filesystem::cutExtension(fn);
+    for(const char* ext: {".ktx", ".dds"})
+    {
+        string cfn = base + ext;
+        if(AssetManifest::get()->exists(cfn))
+            return cfn;
+    }
+    return string();
+}
+
+size_t CompressedImage :: block_bytes(unsigned internal_format)
+{
+    switch(internal_format)
+    {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGB8_ETC2:
+        case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+            return 8;
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+        case GL_COMPRESSED_RGBA8_ETC2_EAC:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+void CompressedImage :: load_ktx(const string& fn, const vector<char>& buf)
+{
+    Reader r(fn, buf);
+    r.skip(sizeof(KTX_ID));
+    uint32_t endianness = r.u32();
+    if(endianness == 0x01020304)
+        r.swap(true);
+    else if(endianness != 0x04030201)
+        K_ERROR(PARSE, fn);
+
+    const uint32_t type = r.u32();
+    r.u32(); // type size
+    const uint32_t format = r.u32();
+    const uint32_t internal_format = r.u32();
+    r.u32(); // base internal format
+    const uint32_t width = r.u32();
+    const uint32_t height = r.u32();
+    const uint32_t depth = r.u32();
+    const uint32_t elements = r.u32();
+    const uint32_t faces = r.u32();
+    const uint32_t levels = std::max<uint32_t>(1, r.u32());
+    const uint32_t kv_bytes = r.u32();
+    if(depth > 1 || elements > 0 || faces != 1 || not width || not height)
+        K_ERRORf(PARSE, "%s: only 2D textures are supported", Filesystem::getFileName(fn));
+
+    // we upload top row first, like Texture does with images
+    const uint8_t* kv = r.bytes(kv_bytes);
+    string kvs((const char*)kv, kv_bytes);
+    if(kvs.find("KTXorientation") != string::npos && kvs.find("T=u") != string::npos)
+        WARNINGf("%s is stored bottom row first and will be upside down", Filesystem::getFileName(fn));
+
+    m_InternalFormat = internal_format;
+    m_Format = format;
+    m_Type = type;
+    if(compressed() && not block_bytes(m_InternalFormat))
+        K_ERRORf(PARSE, "%s: unknown compressed format %s", Filesystem::getFileName(fn) % m_InternalFormat);
+
+    for(uint32_t i = 0; i < levels; ++i)
+    {
+        const uint32_t size = r.u32();
+        Level level;
+        level.width = std::max<uint32_t>(1, width >> i);
+        level.height = std::max<uint32_t>(1, height >> i);
+        const uint8_t* data = r.bytes(size);
+        level.data.assign(data, data + size);
+        m_Levels.push_back(std::move(level));
+        r.skip((4 - size % 4) % 4); // mip padding
+    }
+}
+
+void CompressedImage :: load_dds(const string& fn, const vector<char>& buf)
+{
+    Reader r(fn, buf);
+    r.skip(4); // magic
+    if(r.u32() != 124)
+        K_ERROR(PARSE, fn);
+    const uint32_t flags = r.u32();
+    const uint32_t height = r.u32();
+    const uint32_t width = r.u32();
+    r.u32(); // pitch or linear size
+    const uint32_t depth = r.u32();
+    const uint32_t mips = r.u32();
+    r.skip(11 * 4);
+
+    // pixel format
+    r.u32();
+    const uint32_t pf_flags = r.u32();
+    const uint32_t pf_fourcc = r.u32();
+    const uint32_t pf_bits = r.u32();
+    const uint32_t mask_r = r.u32();
+    const uint32_t mask_g = r.u32();
+    const uint32_t mask_b = r.u32();
+    const uint32_t mask_a = r.u32();
+
+    r.u32(); // caps
+    const uint32_t caps2 = r.u32();
+    r.skip(3 * 4);
+    if((caps2 & DDSCAPS2_CUBEMAP) || depth > 1 || not width || not height)
+        K_ERRORf(PARSE, "%s: only 2D textures are supported", Filesystem::getFileName(fn));
+
+    if(pf_flags & DDPF_FOURCC)
+    {
+        if(pf_fourcc == fourcc("DXT1"))
+            m_InternalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        else if(pf_fourcc == fourcc("DXT3"))
+            m_InternalFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        else if(pf_fourcc == fourcc("DXT5"))
+            m_InternalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        else if(pf_fourcc == fourcc("DX10"))
+        {
+            // sRGB variants load as linear, like the rest of our textures
+            const uint32_t dxgi = r.u32();
+            r.skip(4 * 4);
+            switch(dxgi)
+            {
+                case 71: case 72:
+                    m_InternalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; break;
+                case 74: case 75:
+                    m_InternalFormat = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT; break;
+                case 77: case 78:
+                    m_InternalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+                case 98: case 99:
+                    m_InternalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM; break;
+                default:
+                    K_ERRORf(PARSE, "%s: unsupported DXGI format %s", Filesystem::getFileName(fn) % dxgi);
+            }
+        }
+        else
+            K_ERRORf(PARSE, "%s: unsupported DDS format", Filesystem::getFileName(fn));
+    }
+    else if((pf_flags & DDPF_RGB) && pf_bits == 32 &&
+        mask_r == 0x00FF0000 && mask_g == 0x0000FF00 &&
+        mask_b == 0x000000FF && mask_a == 0xFF000000
+    ){
+        m_InternalFormat = GL_RGBA8;
+        m_Format = GL_BGRA;
+        m_Type = GL_UNSIGNED_BYTE;
+    }
+    else
+        K_ERRORf(PARSE, "%s: unsupported DDS format", Filesystem::getFileName(fn));
+
+    const uint32_t levels = (flags & DDSD_MIPMAPCOUNT) ? std::max<uint32_t>(1, mips) : 1;
+    const size_t block = block_bytes(m_InternalFormat);
+    for(uint32_t i = 0; i < levels; ++i)
+    {
+        Level level;
+        level.width = std::max<uint32_t>(1, width >> i);
+        level.height = std::max<uint32_t>(1, height >> i);
+        const size_t size = compressed() ?
+            size_t((level.width + 3) / 4) * ((level.height + 3) / 4) * block :
+            size_t(level.width) * level.height * 4;
+        const uint8_t* data = r.bytes(size);
+        level.data.assign(data, data + size);
+        m_Levels.push_back(std::move(level));
+    }
+}
+
+bool CompressedImage :: supported() const
+{
+    if(not compressed())
+        return true;
+    switch(m_InternalFormat)
+    {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+            return GLEW_EXT_texture_compression_s3tc;
+        case GL_COMPRESSED_RGBA_BPTC_UNORM:
+            return GLEW_ARB_texture_compression_bptc || GLEW_VERSION_4_2;
+        case GL_COMPRESSED_RGB8_ETC2:
+        case GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2:
+        case GL_COMPRESSED_RGBA8_ETC2_EAC:
+            return GLEW_ARB_ES3_compatibility || GLEW_VERSION_4_3;
+        default:
+            return false;
+    }
+}
+
+bool CompressedImage :: decompress()
+{
+    if(not compressed())
+        return true;
+    const unsigned fmt = m_InternalFormat;
+    const bool bc1 = fmt == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ||
+        fmt == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    const bool bc2 = fmt == GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+    const bool bc3 = fmt == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    if(not bc1 && not bc2 && not bc3)
+        return false;
+    const size_t block = bc1 ? 8 : 16;
+
+    for(Level& level: m_Levels)
+    {
+        const unsigned bw = (level.width + 3) / 4;
+        const unsigned bh = (level.height + 3) / 4;
+        if(level.data.size() < size_t(bw) * bh * block)
+            return false;
+        vector<uint8_t> rgba(size_t(level.width) * level.height * 4);
+        uint8_t texels[16 * 4];
+        for(unsigned by = 0; by < bh; ++by)
+            for(unsigned bx = 0; bx < bw; ++bx)
+            {
+                const uint8_t* src = &level.data[(by * bw + bx) * block];
+                // alpha comes first in BC2/3 blocks
+                decode_color(bc1 ? src : src + 8, texels, bc1);
+                if(bc2)
+                    for(unsigned i = 0; i < 16; ++i) {
+                        unsigned a = (src[i / 2] >> ((i % 2) * 4)) & 0xF;
+                        texels[i * 4 + 3] = uint8_t(a * 17);
+                    }
+                else if(bc3)
+                    decode_alpha(src, texels);
+
+                for(unsigned y = 0; y < 4; ++y)
+                {
+                    const unsigned py = by * 4 + y;
+                    if(py >= level.height)
+                        break;
+                    for(unsigned x = 0; x < 4; ++x)
+                    {
+                        const unsigned px = bx * 4 + x;
+                        if(px >= level.width)
+                            break;
+                        memcpy(&rgba[(size_t(py) * level.width + px) * 4], texels + (y * 4 + x) * 4, 4);
+                    }
+                }
+            }
+        level.data.swap(rgba);
+    }
+    m_InternalFormat = GL_RGBA8;
+    m_Format = GL_RGBA;
+    m_Type = GL_UNSIGNED_BYTE;
+    return true;
+}
+
+size_t CompressedImage :: bytes() const
+{
+    size_t r = 0;
+    for(const Level& level: m_Levels)
+        r += level.data.size();
+    return r;
+}
+
@@ -0,0 +1,77 @@
+#ifndef _COMPRESSEDIMAGE_H_H6XK2V9D
+#define _COMPRESSEDIMAGE_H_H6XK2V9D
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ *  A cooked texture file (KTX 1.1 or DDS) read into GL upload form:
+ *  a GL internal format and every mip level's data, top row first.
+ *
+ *  Holds S3TC/BC1-3, BC7 or ETC2 block data, or plain pixels KTX files
+ *  describe with a GL format and type.  When the driver can't take the
+ *  block format, decompress() turns BC1-3 into RGBA8.
+ *
+ *  Pure CPU, no GL context needed.
+ */
+class CompressedImage
+{
+    public:
+
+        struct Level
+        {
+            unsigned width;
+            unsigned height;
+            std::vector<uint8_t> data;
+        };
+
+        // throws (PARSE) on files it doesn't understand
+        explicit CompressedImage(const std::string& fn);
+
+        // files this loads
+        static bool is_container(const std::string& fn);
+
+        /*
+         * Cooked file next to an image (foo.ktx or foo.dds for foo.png),
+         * or an empty string
+         */
+        static std::string cooked(const std::string& fn);
+
+        // block compressed, as opposed to format/type pixels
+        bool compressed() const { return m_Format == 0; }
+
+        // the GL driver can upload it as is (after GL is initialized)
+        bool supported() const;
+
+        // BC1-3 to GL_RGBA8, false for other formats
+        bool decompress();
+
+        unsigned internal_format() const { return m_InternalFormat; }
+        // pixel format and type of uncompressed data
+        unsigned format() const { return m_Format; }
+        unsigned type() const { return m_Type; }
+
+        const std::vector<Level>& levels() const { return m_Levels; }
+        unsigned width() const { return m_Levels.empty() ? 0 : m_Levels[0].width; }
+        unsigned height() const { return m_Levels.empty() ? 0 : m_Levels[0].height; }
+
+        // bytes of all levels
+        size_t bytes() const;
+
+    private:
+
+        void load_ktx(const std::string& fn, const std::vector<char>& buf);
+        void load_dds(const std::string& fn, const std::vector<char>& buf);
+
+        // bytes in a level of a block format
+        static size_t block_bytes(unsigned internal_format);
+
+        unsigned m_InternalFormat = 0;
+        unsigned m_Format = 0;
+        unsigned m_Type = 0;
+        std::vector<Level> m_Levels;
+};
+
+#endif
+
@@ -0,0 +1,249 @@
+#include "GLState.h"
+#include <algorithm>
+#include <iterator>
+using namespace std;
+
+const unsigned GLState :: MAX_TEXTURE_UNITS;
+const unsigned GLState :: MAX_ATTRIBUTES;
+const unsigned GLState :: UNKNOWN;
+
+GLState* GLState :: get()
+{
+    static GLState state;
+    return &state;
+}
+
+GLState :: GLState()
+{
+    invalidate();
+}
+
+bool GLState :: changed(unsigned& cached, unsigned value)
+{
+    if(cached == value) {
+        ++m_Stats.skipped_binds;
+        return false;
+    }
+    cached = value;
+    ++m_Stats.binds;
+    return true;
+}
+
+void GLState :: use_program(unsigned id)
+{
+    if(changed(m_Program, id))
+        glUseProgram(id);
+}
+
+void GLState :: bind_buffer(GLenum target, unsigned id)
+{
+    unsigned* cached;
+    switch(target)
+    {
+        case GL_ARRAY_BUFFER: cached = &m_ArrayBuffer; break;
+        case GL_ELEMENT_ARRAY_BUFFER: cached = &m_ElementBuffer; break;
+        case GL_PIXEL_UNPACK_BUFFER: cached = &m_PixelUnpackBuffer; break;
+        default:
+            ++m_Stats.binds;
+            glBindBuffer(target, id);
+            return;
+    }
+    if(changed(*cached, id))
+        glBindBuffer(target, id);
+}
+
+void GLState :: bind_vertex_array(unsigned id)
+{
+    if(changed(m_VertexArray, id)) {
+        glBindVertexArray(id);
+        // element buffer and attribute arrays belong to the VAO
+        m_ElementBuffer = UNKNOWN;
+        fill(begin(m_Attributes), end(m_Attributes), UNKNOWN);
+    }
+}
+
+void GLState :: active_texture(unsigned unit)
+{
+    if(changed(m_ActiveUnit, unit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+void GLState :: bind_texture(unsigned unit, unsigned id)
+{
+    active_texture(unit);
+    if(unit >= MAX_TEXTURE_UNITS) {
+        ++m_Stats.binds;
+        glBindTexture(GL_TEXTURE_2D, id);
+        return;
+    }
+    if(changed(m_Textures[unit], id))
+        glBindTexture(GL_TEXTURE_2D, id);
+}
+
+void GLState :: enable(GLenum cap, bool b)
+{
+    int idx;
+    switch(cap)
+    {
+        case GL_BLEND: idx = BLEND; break;
+        case GL_DEPTH_TEST: idx = DEPTH_TEST; break;
+        case GL_CULL_FACE: idx = CULL_FACE; break;
+        case GL_MULTISAMPLE: idx = MULTISAMPLE; break;
+        default: idx = -1; break;
+    }
+    if(idx < 0 || changed(m_Caps[idx], b ? 1 : 0)) {
+        if(idx < 0)
+            ++m_Stats.binds;
+        if(b)
+            glEnable(cap);
+        else
+            glDisable(cap);
+    }
+}
+
+void GLState :: blend_func(GLenum src, GLenum dst)
+{
+    if(m_BlendSrc == src && m_BlendDst == dst) {
+        ++m_Stats.skipped_binds;
+        return;
+    }
+    m_BlendSrc = src;
+    m_BlendDst = dst;
+    ++m_Stats.binds;
+    glBlendFunc(src, dst);
+}
+
+void GLState :: depth_func(GLenum func)
+{
+    if(changed(m_DepthFunc, func))
+        glDepthFunc(func);
+}
+
+void GLState :: depth_mask(bool b)
+{
+    if(changed(m_DepthMask, b ? 1 : 0))
+        glDepthMask(b ? GL_TRUE : GL_FALSE);
+}
+
+void GLState :: cull_face(GLenum face)
+{
+    if(changed(m_CullFace, face))
+        glCullFace(face);
+}
+
+void GLState :: front_face(GLenum dir)
+{
+    if(changed(m_FrontFace, dir))
+        glFrontFace(dir);
+}
+
+void GLState :: attribute_array(unsigned index, bool b)
+{
+    if(index >= MAX_ATTRIBUTES || changed(m_Attributes[index], b ? 1 : 0)) {
+        if(index >= MAX_ATTRIBUTES)
+            ++m_Stats.binds;
+        if(b)
+            glEnableVertexAttribArray(index);
+        else
+            glDisableVertexAttribArray(index);
+    }
+}
+
+void GLState :: draw_arrays(GLenum mode, int first, unsigned count, unsigned instances)
+{
+    ++m_Stats.draw_calls;
+    if(instances > 1) {
+        m_Stats.instances += instances;
+        glDrawArraysInstanced(mode, first, count, instances);
+    } else
+        glDrawArrays(mode, first, count);
+}
+
+void GLState :: draw_elements(GLenum mode, unsigned count, GLenum type, const void* ofs, unsigned instances)
+{
+    ++m_Stats.draw_calls;
+    if(instances > 1) {
+        m_Stats.instances += instances;
+        glDrawElementsInstanced(mode, count, type, ofs, instances);
+    } else
+        glDrawElements(mode, count, type, ofs);
+}
+
+void GLState :: delete_program(unsigned id)
+{
+    if(not id)
+        return;
+    glDeleteProgram(id);
+    // deleted IDs may be reused
+    if(m_Program == id)
+        m_Program = UNKNOWN;
+}
+
+void GLState :: delete_buffers(unsigned count, const unsigned* ids)
+{
+    glDeleteBuffers(count, ids);
+    // GL unbinds deleted buffers
+    for(unsigned i = 0; i < count; ++i)
+    {
+        if(not ids[i])
+            continue;
+        if(m_ArrayBuffer == ids[i])
+            m_ArrayBuffer = 0;
+        if(m_ElementBuffer == ids[i])
+            m_ElementBuffer = UNKNOWN;
+        if(m_PixelUnpackBuffer == ids[i])
+            m_PixelUnpackBuffer = 0;
+    }
+}
+
+void GLState :: delete_textures(unsigned count, const unsigned* ids)
+{
+    glDeleteTextures(count, ids);
+    for(unsigned i = 0; i < count; ++i)
+    {
+        if(not ids[i])
+            continue;
+        for(auto& t: m_Textures)
+            if(t == ids[i])
+                t = 0;
+    }
+}
+
+void GLState :: delete_vertex_arrays(unsigned count, const unsigned* ids)
+{
+    glDeleteVertexArrays(count, ids);
+    for(unsigned i = 0; i < count; ++i)
+        if(ids[i] && m_VertexArray == ids[i]) {
+            m_VertexArray = 0;
+            m_ElementBuffer = UNKNOWN;
+            fill(begin(m_Attributes), end(m_Attributes), UNKNOWN);
+        }
+}
+
+void GLState :: invalidate()
+{
+    m_Program = UNKNOWN;
+    m_ArrayBuffer = UNKNOWN;
+    m_ElementBuffer = UNKNOWN;
+    m_PixelUnpackBuffer = UNKNOWN;
+    m_VertexArray = UNKNOWN;
+    m_ActiveUnit = UNKNOWN;
+    fill(begin(m_Textures), end(m_Textures), UNKNOWN);
+    fill(begin(m_Caps), end(m_Caps), UNKNOWN);
+    m_BlendSrc = UNKNOWN;
+    m_BlendDst = UNKNOWN;
+    m_DepthFunc = UNKNOWN;
+    m_DepthMask = UNKNOWN;
+    m_CullFace = UNKNOWN;
+    m_FrontFace = UNKNOWN;
+    fill(begin(m_Attributes), end(m_Attributes), UNKNOWN);
+}
+
+void GLState :: frame()
+{
+    m_LastFrame = m_Stats;
+    m_Stats = Stats();
+    // anything outside the renderer (GUI, console) may have changed state
+    invalidate();
+}
+
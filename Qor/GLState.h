@@ -0,0 +1,115 @@
+#ifndef _GLSTATE_H_K2V7Q9XD
+#define _GLSTATE_H_K2V7Q9XD
+
+#include "Common.h"
+
+/*
+ *  Shadows the GL state the renderer touches most (program, buffer per
+ *  target, VAO, texture per unit, blend/depth/cull state, enabled vertex
+ *  attribute arrays) and skips calls that would not change anything.
+ *
+ *  GL thread only.  Code that changes this state with raw GL calls must
+ *  call invalidate() afterwards, and GL objects should be deleted through
+ *  the delete_* calls so stale IDs are forgotten.
+ *
+ *  Counts draws and binds for the current and the last full frame.
+ */
+class GLState
+{
+    public:
+
+        struct Stats
+        {
+            unsigned draw_calls = 0;
+            // instances drawn by instanced draws (counted once per draw)
+            unsigned instances = 0;
+            // calls passed through to GL
+            unsigned binds = 0;
+            // redundant calls filtered out
+            unsigned skipped_binds = 0;
+        };
+
+        static const unsigned MAX_TEXTURE_UNITS = 16;
+        static const unsigned MAX_ATTRIBUTES = 32;
+
+        static GLState* get();
+
+        GLState(const GLState&) = delete;
+        GLState& operator=(const GLState&) = delete;
+
+        void use_program(unsigned id);
+        void bind_buffer(GLenum target, unsigned id);
+        void bind_vertex_array(unsigned id);
+        void active_texture(unsigned unit);
+        // binds a GL_TEXTURE_2D to unit, leaving unit active
+        void bind_texture(unsigned unit, unsigned id);
+
+        // GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE and GL_MULTISAMPLE are
+        // cached, other caps are passed through
+        void enable(GLenum cap, bool b = true);
+        void disable(GLenum cap) { enable(cap, false); }
+        void blend_func(GLenum src, GLenum dst);
+        void depth_func(GLenum func);
+        void depth_mask(bool b);
+        void cull_face(GLenum face);
+        void front_face(GLenum dir);
+
+        void attribute_array(unsigned index, bool b);
+
+        void draw_arrays(GLenum mode, int first, unsigned count, unsigned instances = 1);
+        void draw_elements(GLenum mode, unsigned count, GLenum type, const void* ofs, unsigned instances = 1);
+
+        void delete_program(unsigned id);
+        void delete_buffers(unsigned count, const unsigned* ids);
+        void delete_textures(unsigned count, const unsigned* ids);
+        void delete_vertex_arrays(unsigned count, const unsigned* ids);
+
+        // forget everything, so the next call of each kind reaches GL
+        void invalidate();
+
+        // end of frame: keeps this frame's stats and starts over
+        void frame();
+
+        const Stats& stats() const { return m_LastFrame; }
+        const Stats& current_stats() const { return m_Stats; }
+
+    private:
+
+        GLState();
+
+        bool changed(unsigned& cached, unsigned value);
+
+        // unknown state always reaches GL
+        static const unsigned UNKNOWN = ~0u;
+
+        enum Cap
+        {
+            BLEND,
+            DEPTH_TEST,
+            CULL_FACE,
+            MULTISAMPLE,
+            MAX_CAPS
+        };
+
+        unsigned m_Program;
+        unsigned m_ArrayBuffer;
+        unsigned m_ElementBuffer;
+        unsigned m_PixelUnpackBuffer;
+        unsigned m_VertexArray;
+        unsigned m_ActiveUnit;
+        unsigned m_Textures[MAX_TEXTURE_UNITS];
+        unsigned m_Caps[MAX_CAPS];
+        unsigned m_BlendSrc;
+        unsigned m_BlendDst;
+        unsigned m_DepthFunc;
+        unsigned m_DepthMask;
+        unsigned m_CullFace;
+        unsigned m_FrontFace;
+        unsigned m_Attributes[MAX_ATTRIBUTES];
+
+        Stats m_Stats;
+        Stats m_LastFrame;
+};
+
+#endif
+
@@ -2,6 +2,7 @@
 #define _PARTITIONER_H
 
 #include <vector>
+#include <memory>
 #include <functional>
 #include "Graphics.h"
 #include "IRealtime.h"
@@ -9,25 +10,49 @@
 class Node;
 class Light;
 class Camera;
+class OcclusionBuffer;
 
 class IPartitioner:
     public IRealtime
 {
     public:
+
+        // visible nodes lit by exactly the same set of visible lights
+        struct LightGroup
+        {
+            std::vector<const Light*> lights;
+            std::vector<const Node*> nodes;
+        };
+        
         IPartitioner() {}
         virtual ~IPartitioner() {}
 
         virtual void partition(const Node* root) = 0;
         virtual const std::vector<const Light*>& visible_lights() const = 0;
         virtual const std::vector<const Node*>& visible_nodes() const = 0;
+
+        // visible nodes within range of light
         virtual const std::vector<const Node*>& visible_nodes_from(
             const Light* light
         ) const = 0;
+
+        // visible nodes grouped by the lights affecting them,
+        // nodes outside the range of every light are left out
+        virtual const std::vector<LightGroup>& light_groups() const = 0;
         
         virtual void camera(Camera* camera) = 0;
         virtual const Camera* camera() const = 0;
         virtual Camera* camera() = 0;
 
+        /*
+         * Culling visible nodes hidden behind occluders (see
+         * Node::is_occluder()), for partitioners that support it.
+         * The buffer holds this frame's occlusion stats.
+         */
+        virtual void occlusion_culling(bool b) {}
+        virtual bool occlusion_culling() const { return false; }
+        virtual const OcclusionBuffer* occlusion_buffer() const { return nullptr; }
+
         virtual void preload() = 0;
         virtual void logic(Freq::Time) = 0;
 
@@ -77,6 +102,38 @@ class IPartitioner:
         virtual std::vector<Node*> get_collisions_for(Node* n, unsigned type) = 0;
         virtual std::vector<Node*> get_collisions_for(unsigned type_a, unsigned type_b) = 0;
         
+        /*
+         * Spatial queries over indexed nodes.
+         * Results are written into out (cleared first), and the number of
+         * results is returned.  Reuse out between calls to avoid allocation.
+         */
+        virtual void index(const std::shared_ptr<Node>& n, bool recursive = false) = 0;
+        virtual void deindex(const Node* n) = 0;
+        virtual unsigned query(
+            const Box& box,
+            std::vector<Node*>& out,
+            const std::function<bool(Node*)>& cond = std::function<bool(Node*)>()
+        ) = 0;
+        virtual unsigned query_radius(
+            glm::vec3 center,
+            float radius,
+            std::vector<Node*>& out,
+            const std::function<bool(Node*)>& cond = std::function<bool(Node*)>()
+        ) = 0;
+        virtual unsigned query_ray(
+            glm::vec3 origin,
+            glm::vec3 dir,
+            float dist,
+            std::vector<Node*>& out,
+            const std::function<bool(Node*)>& cond = std::function<bool(Node*)>()
+        ) = 0;
+        virtual unsigned query_nearest(
+            glm::vec3 point,
+            unsigned k,
+            std::vector<Node*>& out,
+            const std::function<bool(Node*)>& cond = std::function<bool(Node*)>()
+        ) = 0;
+        
         virtual void clear() = 0;
         virtual bool empty() const = 0;
         virtual bool has_collisions() const = 0;
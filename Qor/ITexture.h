@@ -14,9 +14,9 @@ class ITexture:
             Resource(fn)
         {}
         virtual ~ITexture() {}
-        //virtual unsigned int id(Pass* pass = nullptr) const {
-        //    return 0;
-        //}
+        virtual unsigned int id(Pass* pass = nullptr) const {
+            return 0;
+        }
         virtual void bind(Pass* pass, unsigned slot=0) const {}
         virtual void unbind(Pass* pass) const {}
         virtual void bind_nomaterial(Pass* pass, unsigned slot=0) const {}
@@ -26,6 +26,14 @@ class ITexture:
         virtual void size(unsigned w, unsigned h) = 0;
         virtual glm::uvec2 center() const = 0;
 
+        /*
+         * Part of the bound texture this one covers, as UV offset (xy) and
+         * scale (zw).  Less than all of it for images inside an atlas page.
+         */
+        virtual glm::vec4 region() const {
+            return glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        }
+
         virtual std::string name() const = 0;
         virtual std::string filename() const = 0;
 
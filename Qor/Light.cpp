@@ -33,7 +33,7 @@ Light :: Light(const std::shared_ptr<Meta>& meta):
             m_Specular = Color::black();
     }
     
-    m_Dist = (float)meta->at<double>("distance", 1.0);
+    dist((float)meta->at<double>("distance", 1.0));
     m_Cutoff = (float)meta->at<double>("cutoff", 1.0);
 }
 
@@ -77,6 +77,7 @@ void Light :: dist(float f)
     m_Dist = f;
     m_Box.min() = glm::vec3(-f, -f, -f);
     m_Box.max() = glm::vec3(f, f, f);
+    pend_box();
 }
 //m_Box.max = glm::vec3(0.5f);
 
@@ -25,7 +25,10 @@ class Light:
             //m_Type(Type::POINT),
             //m_Atten(glm::vec3(1.0f, 0.0f, 0.0f)),
             //m_Flags(0)
-        {}
+        {
+            // the box is its reach, for culling
+            dist(m_Dist);
+        }
         virtual ~Light() {}
         
         // bind: to be called only by Pipeline during a render
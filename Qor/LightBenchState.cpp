@@ -0,0 +1,156 @@
+#include "LightBenchState.h"
+#include "BasicPartitioner.h"
+#include "Qor.h"
+#include "GLTask.h"
+#include <glm/glm.hpp>
+#include <chrono>
+#include <random>
+using namespace std;
+using namespace glm;
+
+#define GRID_SIZE 32
+#define GRID_SPACING 2.0f
+#define LIGHT_RANGE 6.0f
+#define WARMUP_FRAMES 30
+#define BENCH_FRAMES 300
+
+LightBenchState :: LightBenchState(Qor* engine):
+    m_pQor(engine),
+    m_pInput(engine->input()),
+    m_pRoot(make_shared<Node>()),
+    m_pPipeline(engine->pipeline()),
+    m_pResources(engine->resources())
+{
+    for(unsigned lights: {8u, 64u, 256u}) {
+        m_Runs.emplace_back(lights, false);
+        m_Runs.emplace_back(lights, true);
+    }
+}
+
+void LightBenchState :: preload()
+{
+    // decodes on the loader threads while the lights are set up
+    auto logo = m_pQor->resources()->cache_async<ITexture>("logo.png");
+
+    m_pCamera = make_shared<Camera>(m_pQor->resources(), m_pQor->window());
+    m_pCamera->position(vec3(0.0f, 0.0f, 40.0f));
+    m_pRoot->add(m_pCamera->as_node());
+
+    const float ofs = (GRID_SIZE - 1) * GRID_SPACING * 0.5f;
+
+    // fixed seed, so every run lights the same scene
+    mt19937 rng(1);
+    uniform_real_distribution<float> xy(-ofs, ofs);
+    uniform_real_distribution<float> z(1.0f, 3.0f);
+    uniform_real_distribution<float> c(0.2f, 1.0f);
+    for(unsigned i = 0; i < 256; ++i)
+    {
+        auto light = make_shared<Light>();
+        light->dist(LIGHT_RANGE);
+        light->diffuse(Color(c(rng), c(rng), c(rng)));
+        light->position(vec3(xy(rng), xy(rng), z(rng)));
+        m_pRoot->add(light);
+        m_Lights.push_back(light);
+    }
+
+    auto geometry = make_shared<MeshGeometry>(Prefab::cube());
+    vector<shared_ptr<IMeshModifier>> mods {
+        make_shared<Wrap>(Prefab::cube_wrap()),
+        make_shared<MeshNormals>(Prefab::cube_normals())
+    };
+    auto material = make_shared<MeshMaterial>(logo.get());
+    for(unsigned y = 0; y < GRID_SIZE; ++y)
+        for(unsigned x = 0; x < GRID_SIZE; ++x)
+        {
+            auto mesh = make_shared<Mesh>(geometry, mods, material);
+            mesh->position(vec3(x * GRID_SPACING - ofs, y * GRID_SPACING - ofs, 0.0f));
+            m_pRoot->add(mesh);
+        }
+}
+
+LightBenchState :: ~LightBenchState()
+{
+    m_pPipeline->override_shader(PassType::NORMAL, (unsigned)PassType::NORMAL);
+    m_pPipeline->partitioner()->clear();
+}
+
+void LightBenchState :: enter()
+{
+    m_pCamera->perspective();
+    m_pPipeline->bg_color(Color::black());
+    m_pPipeline->winding(false);
+
+    // multipass shades with the lit shader in its detail pass
+    m_LitShader = m_pPipeline->load_shaders({"lit"});
+    m_pPipeline->override_shader(PassType::NORMAL, m_LitShader);
+
+    start(0);
+}
+
+void LightBenchState :: start(unsigned run)
+{
+    m_Run = run;
+    m_Frame = 0;
+    for(unsigned i = 0; i < m_Lights.size(); ++i)
+        m_Lights[i]->visible(i < m_Runs[run].lights);
+}
+
+void LightBenchState :: logic(Freq::Time t)
+{
+    if(m_pInput->key(SDLK_ESCAPE))
+        m_pQor->quit();
+
+    m_pRoot->logic(t);
+
+    if(m_Frame < WARMUP_FRAMES + BENCH_FRAMES)
+        return;
+
+    const Run& run = m_Runs[m_Run];
+    const auto& gl = m_pPipeline->gl_stats();
+    LOGf("%s lights, %s: %s ms/frame (%s draws, %s binds, %s skipped)",
+        run.lights %
+        (run.clustered ? "clustered" : "multipass") %
+        (run.ms / run.frames) %
+        gl.draw_calls % gl.binds % gl.skipped_binds
+    );
+    if(m_Run + 1 < m_Runs.size())
+        start(m_Run + 1);
+    else {
+        report();
+        m_pQor->quit();
+    }
+}
+
+void LightBenchState :: report() const
+{
+    LOG("lights | multipass ms | clustered ms");
+    for(unsigned i = 0; i + 1 < m_Runs.size(); i += 2)
+        LOGf("%s | %s | %s",
+            m_Runs[i].lights %
+            (m_Runs[i].ms / m_Runs[i].frames) %
+            (m_Runs[i+1].ms / m_Runs[i+1].frames)
+        );
+}
+
+void LightBenchState :: render() const
+{
+    Run& run = m_Runs[m_Run];
+
+    auto t0 = chrono::steady_clock::now();
+    m_pPipeline->render(
+        m_pRoot.get(), m_pCamera.get(), nullptr,
+        Pipeline::LIGHTS | (run.clustered ? Pipeline::CLUSTERED : 0)
+    );
+    // wait for the GPU, so the time covers shading and not just submission
+    GL_TASK_START()
+        glFinish();
+    GL_TASK_END()
+    auto t1 = chrono::steady_clock::now();
+
+    if(m_Frame >= WARMUP_FRAMES) {
+        run.ms += chrono::duration<double, milli>(t1 - t0).count();
+        ++run.frames;
+    }
+    ++m_Frame;
+}
+
@@ -0,0 +1,70 @@
+#ifndef _LIGHTBENCHSTATE_H_6FQ0ZJ3N
+#define _LIGHTBENCHSTATE_H_6FQ0ZJ3N
+
+#include "State.h"
+#include "Input.h"
+#include "Camera.h"
+#include "Pipeline.h"
+#include "Mesh.h"
+#include "Light.h"
+
+class Qor;
+
+/*
+ *  Lighting benchmark (run with benchmark=lights)
+ *
+ *  Renders a field of cubes under 8, 64 and 256 point lights with the
+ *  multipass and the clustered lighting paths, logs the average frame
+ *  time (including GPU time) of each, then quits.
+ */
+class LightBenchState:
+    public State
+{
+    public:
+        LightBenchState(Qor* engine);
+        virtual ~LightBenchState();
+
+        virtual void preload() override;
+        virtual void enter() override;
+        virtual void logic(Freq::Time t) override;
+        virtual void render() const override;
+        virtual bool needs_load() const override {
+            return true;
+        }
+
+    private:
+
+        struct Run
+        {
+            Run(unsigned lights, bool clustered):
+                lights(lights),
+                clustered(clustered)
+            {}
+            unsigned lights;
+            bool clustered;
+            double ms = 0.0;
+            unsigned frames = 0;
+        };
+
+        void start(unsigned run);
+        void report() const;
+
+        Qor* m_pQor = nullptr;
+        Input* m_pInput = nullptr;
+        Pipeline* m_pPipeline = nullptr;
+        Cache<Resource, std::string>* m_pResources = nullptr;
+
+        std::shared_ptr<Node> m_pRoot;
+        std::shared_ptr<Camera> m_pCamera;
+        std::vector<std::shared_ptr<Light>> m_Lights;
+
+        // results are written during render()
+        mutable std::vector<Run> m_Runs;
+        mutable unsigned m_Frame = 0;
+        unsigned m_Run = 0;
+
+        unsigned m_LitShader = ~0u;
+};
+
+#endif
+
@@ -67,6 +67,24 @@ LoadingState :: LoadingState(Qor* qor):
         ));
         m_pRoot->add(m_pLogo);
     }
+
+    if(m_pQor->exists("loading-bar.png"))
+    {
+        m_pBar = make_shared<Mesh>(
+            make_shared<MeshGeometry>(Prefab::quad(
+                vec2(0.0f, 0.0f),
+                vec2(sw, icon_size / 4.0f)
+            )),
+            vector<shared_ptr<IMeshModifier>>{
+                make_shared<Wrap>(Prefab::quad_wrap())
+            },
+            make_shared<MeshMaterial>(
+                m_pQor->resources()->cache_cast<ITexture>("loading-bar.png")
+            )
+        );
+        m_pBar->scale(vec3(0.0f, 1.0f, 1.0f));
+        m_pRoot->add(m_pBar);
+    }
     //bg->position(vec3(0.0f,0.0f,-2.0f));
     //m_pLogo->add_modifier(make_shared<Wrap>(Prefab::quad_wrap()));
     //m_pLogo->material(make_shared<MeshMaterial>(
@@ -129,6 +147,17 @@ LoadingState :: ~LoadingState()
 {
 }
 
+float LoadingState :: progress() const
+{
+    auto p = m_pQor->state(1)->progress();
+    if(p)
+        return *p;
+    auto loads = m_pQor->resources()->load_progress();
+    if(loads.total)
+        return float(loads.done) / loads.total;
+    return 0.0f;
+}
+
 //void LoadingState :: fade_to(const Color& c, float t)
 //{
 //    //m_Fade.set(Freq::Time::seconds(t), ~c, c);
@@ -187,6 +216,12 @@ void LoadingState :: logic(Freq::Time t)
     ));
     m_pWaitIcon->pend();
 
+    if(m_pBar) {
+        m_pBar->reset_orientation();
+        m_pBar->scale(vec3(progress(), 1.0f, 1.0f));
+        m_pBar->pend();
+    }
+
     if(m_pQor->state(1)->finished_loading()) {
         if(m_Fade.elapsed()) {
             if(m_Fade.get() == Color::white())
@@ -31,6 +31,9 @@ class LoadingState:
     
     private:
         
+        // 0 to 1, from the loading state or the cache's async loads
+        float progress() const;
+
         //void fade_to(const Color& c, float t);
         
         Qor* m_pQor = nullptr;
@@ -41,6 +44,8 @@ class LoadingState:
         
         std::shared_ptr<Mesh> m_pWaitIcon;
         std::shared_ptr<Mesh> m_pLogo;
+        // scaled to how much has loaded (optional)
+        std::shared_ptr<Mesh> m_pBar;
         
         Pipeline* m_pPipeline;
         std::shared_ptr<Camera> m_pCamera;
@@ -5,6 +5,7 @@
 #include "Qor.h"
 #include "ScriptState.h"
 #include "BasicState.h"
+#include "LightBenchState.h"
 #include "Interpreter.h"
 #include "Interpreter.h"
 #include "Info.h"
@@ -20,7 +21,9 @@ int main(int argc, char* argv[])
 {
     auto engine = kit::make_unique<Qor>(argc, (const char**)argv);
     
-    if(engine->args().value_or("mod", "").empty())
+    if(engine->args().value_or("benchmark", "") == "lights")
+        engine->states().register_class<LightBenchState>(); // lighting benchmark
+    else if(engine->args().value_or("mod", "").empty())
         engine->states().register_class<BasicState>(); // run basic state
     else
         engine->states().register_class<ScriptState>(); // run python mod
@@ -0,0 +1,49 @@
+#include "MappedFile.h"
+#include "Filesystem.h"
+#include "kit/log/errors.h"
+#include <fstream>
+#include <iterator>
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+using namespace std;
+
+MappedFile :: MappedFile(const string& fn)
+{
+#ifndef _WIN32
+    int fd = ::open(fn.c_str(), O_RDONLY);
+    if(fd < 0)
+        K_ERROR(READ, Filesystem::getFileName(fn));
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED) {
+            m_pData = (const char*)p;
+            m_Size = st.st_size;
+            m_bMapped = true;
+        }
+    }
+    ::close(fd);
+#endif
+    if(not m_bMapped)
+    {
+        ifstream f(fn, ios::binary);
+        if(!f)
+            K_ERROR(READ, Filesystem::getFileName(fn));
+        m_Buffer.assign(istreambuf_iterator<char>(f), istreambuf_iterator<char>());
+        m_pData = m_Buffer.data();
+        m_Size = m_Buffer.size();
+    }
+}
+
+MappedFile :: ~MappedFile()
+{
+#ifndef _WIN32
+    if(m_bMapped)
+        munmap((void*)m_pData, m_Size);
+#endif
+}
+
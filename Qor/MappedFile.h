@@ -0,0 +1,36 @@
+#ifndef _MAPPEDFILE_H_K8D2PX4W
+#define _MAPPEDFILE_H_K8D2PX4W
+
+#include <string>
+#include <vector>
+
+/*
+ *  A whole file in memory, read only: mapped where the platform can
+ *  (mmap), read into a buffer where it can't.
+ */
+class MappedFile
+{
+    public:
+
+        // throws (READ) if fn can't be opened
+        explicit MappedFile(const std::string& fn);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const char* data() const { return m_pData; }
+        size_t size() const { return m_Size; }
+        const char* begin() const { return m_pData; }
+        const char* end() const { return m_pData + m_Size; }
+
+    private:
+
+        const char* m_pData = nullptr;
+        size_t m_Size = 0;
+        bool m_bMapped = false;
+        std::vector<char> m_Buffer;
+};
+
+#endif
+
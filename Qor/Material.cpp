@@ -1,6 +1,9 @@
 #include "Material.h"
 #include "Filesystem.h"
 #include "Pipeline.h"
+#include "TextureAtlas.h"
+#include "TextureStreamer.h"
+#include "AssetManifest.h"
 #include "kit/log/log.h"
 #include <boost/filesystem.hpp>
 #include <vector>
@@ -58,43 +61,94 @@ Material :: Material(
 
 void Material :: load_detail_maps(std::string fn)
 {
-    fn = m_pCache->transform(fn);
+    // detail maps first: only plain textures can go in the atlas, since
+    // the maps would need the same UVs
+    auto names = texture_names(fn, m_pConfig, m_pCache);
+    vector<shared_ptr<ITexture>> maps;
+    bool detail = false;
+    for(size_t i = 1; i < names.size(); ++i) {
+        if(names[i].empty()) {
+            maps.push_back(shared_ptr<Texture>()); // null
+            continue;
+        }
+        maps.push_back(load_texture(names[i]));
+        detail = true;
+    }
+
+    shared_ptr<ITexture> diffuse;
+    if(atlased(m_pConfig, detail))
+        diffuse = TextureAtlas::get()->add(names[0]);
+    if(not diffuse)
+        diffuse = load_texture(names[0]);
+    m_Textures.push_back(diffuse);
+    m_Filename = m_Textures[0]->filename();
+    m_Textures.insert(m_Textures.end(), ENTIRE(maps));
+    // TODO: remove null textures at the end of m_Textures list.
+    // We only need nulls in between textures to get the right offsets if
+    // there are some missing.
+    
+    //LOGf("textures: %s", m_Textures.size());
+}
+
+vector<string> Material :: texture_names(
+    string fn,
+    shared_ptr<Meta> cfg,
+    Cache<Resource, std::string>* cache
+){
+    fn = cache->transform(fn);
     
     string fn_real = Filesystem::cutInternal(fn);
     string ext = Filesystem::getExtension(fn_real);
     string cut = Filesystem::cutExtension(fn_real);
-    string emb = Filesystem::getInternal(fn);
-     
-    m_Textures.push_back(make_shared<Texture>(
-        tuple<string,ICache*>(fn,m_pCache)
-    ));
-    m_Filename = m_Textures[0]->filename();
-    //m_Textures.push_back(m_pCache->m_pCache_cast<Texture>(fn));
+    
+    vector<string> r{fn};
     for(auto&& t: s_ExtraMapNames) {
         string tfn;
         try{
-            tfn = m_pConfig->at<string>(boost::to_lower_copy(t), cut + "_" + t + "." + ext);
+            tfn = cfg->at<string>(boost::to_lower_copy(t), cut + "_" + t + "." + ext);
         }catch(const std::out_of_range&){
-            m_Textures.push_back(shared_ptr<Texture>()); // null
-            return;
-        }
-        tfn = m_pCache->transform(tfn);
-        if(fs::exists(
-            fs::path(tfn)
-        )){
-            // TODO: material will be cached, so no need to use m_pCache for this
-            m_Textures.push_back(make_shared<Texture>(
-                tuple<string, ICache*>(tfn, m_pCache)
-            ));
-        }else{
-            m_Textures.push_back(shared_ptr<Texture>()); // null
+            r.push_back(string());
+            break;
         }
+        tfn = cache->transform(tfn);
+        r.push_back(AssetManifest::get()->exists(tfn) ? tfn : string());
     }
-    // TODO: remove null textures at the end of m_Textures list.
-    // We only need nulls in between textures to get the right offsets if
-    // there are some missing.
-    
-    //LOGf("textures: %s", m_Textures.size());
+    return r;
+}
+
+bool Material :: atlased(shared_ptr<Meta> cfg, bool detail)
+{
+    return TextureAtlas::enabled() && not detail &&
+        (not cfg || cfg->at<bool>("atlas", true));
+}
+
+bool Material :: cached(const string& fn, Cache<Resource, std::string>* cache)
+{
+    // images with detail maps or a json are materials of their own
+    return not TextureStreamer::enabled() && not supported(fn, cache);
+}
+
+shared_ptr<ITexture> Material :: load_texture(const string& fn)
+{
+    // decoded in the background (settings.json: video.texture-streaming)
+    if(TextureStreamer::enabled())
+        return TextureStreamer::get()->load(fn);
+    // shared with other materials, and loaded ahead by cache_async()
+    if(cached(fn, m_pCache)) {
+        auto r = m_pCache->cache_cast<ITexture>(fn);
+        m_Cached.push_back(r.get());
+        return r;
+    }
+    return make_shared<Texture>(tuple<string, ICache*>(fn, m_pCache));
+}
+
+bool Material :: unatlas()
+{
+    if(m_Textures.empty() || not dynamic_cast<AtlasTexture*>(m_Textures[0].get()))
+        return false;
+    WARNINGf("%s: repeating UVs, drawing from its own texture", m_Filename);
+    m_Textures[0] = load_texture(m_Filename);
+    return true;
 }
 
 void Material :: load_json(string fn)
@@ -208,10 +262,31 @@ Material :: ~Material()
 {
 }
 
-//unsigned int Material :: id(Pass* pass) const
-//{
-//    return 0;
-//}
+unsigned int Material :: id(Pass* pass) const
+{
+    if(m_Textures.empty() || not m_Textures[0])
+        return 0;
+    return m_Textures[0]->id(pass);
+}
+
+glm::vec4 Material :: region() const
+{
+    if(m_Textures.empty() || not m_Textures[0])
+        return ITexture::region();
+    return m_Textures[0]->region();
+}
+
+size_t Material :: gpu_bytes() const
+{
+    size_t r = 0;
+    for(auto&& t: m_Textures)
+        if(t && not dynamic_cast<const AtlasTexture*>(t.get()) &&
+            std::find(ENTIRE(m_Cached), t.get()) == m_Cached.end())
+        {
+            r += t->gpu_bytes();
+        }
+    return r;
+}
 
 void Material :: bind(Pass* pass, unsigned slot) const
 {
@@ -254,6 +329,74 @@ void Material :: bind(Pass* pass, unsigned slot) const
     after(pass);
 }
 
+/*static*/ vector<string> Material :: dependencies(
+    string fn,
+    Cache<Resource, std::string>* cache
+){
+    string fn_real = Filesystem::cutInternal(fn);
+    string ext = Filesystem::getExtension(fn_real);
+    string cut = Filesystem::cutExtension(fn_real);
+    string emb = Filesystem::getInternal(fn);
+
+    // the image it draws, found the way the constructor finds it
+    auto cfg = make_shared<Meta>();
+    string image;
+    if(ext == "mtl")
+    {
+        fstream f(fn_real);
+        string line, itr_material;
+        while(getline(f, line))
+        {
+            istringstream ss(line);
+            string nothing;
+            ss >> nothing;
+            if(boost::starts_with(line, "newmtl"))
+                ss >> itr_material;
+            else if(itr_material == emb && boost::starts_with(line, "map_Kd")) {
+                std::getline(ss, image);
+                boost::trim(image);
+                image = Filesystem::getFileName(image);
+                break;
+            }
+        }
+        if(image.empty())
+            return vector<string>();
+        // a json beside it describes the material instead
+        auto json_name = Filesystem::changeExtension(image, "json");
+        if(cache->transform(json_name) != json_name)
+            return vector<string>();
+    }
+    else
+    {
+        string json_name = fn_real;
+        if(ext != "json") {
+            json_name = Filesystem::getFileName(cut) + ".json";
+            json_name = cache->transform(json_name) != json_name ?
+                cache->transform(json_name) : string();
+        }
+        if(not json_name.empty()) {
+            cfg = make_shared<Meta>(json_name);
+            if(cfg->empty())
+                return vector<string>();
+            image = cfg->at<string>("texture", Filesystem::getFileNameNoExt(fn) + ".png");
+        } else
+            image = fn;
+    }
+
+    auto names = texture_names(image, cfg, cache);
+    bool detail = false;
+    for(size_t i = 1; i < names.size(); ++i)
+        detail = detail || not names[i].empty();
+    vector<string> r;
+    for(size_t i = 0; i < names.size(); ++i) {
+        if(names[i].empty() || (i == 0 && atlased(cfg, detail)))
+            continue;
+        if(cached(names[i], cache))
+            r.push_back(names[i]);
+    }
+    return r;
+}
+
 /*static*/ bool Material :: supported(
     string fn,
     Cache<Resource, std::string>* cache
@@ -279,9 +422,7 @@ void Material :: bind(Pass* pass, unsigned slot) const
     for(auto&& t: s_ExtraMapNames) {
         auto tfn = cut + "_" + t + "." + ext;
         tfn = cache->transform(tfn);
-        if(fs::exists(
-            fs::path(tfn)
-        )){
+        if(AssetManifest::get()->exists(tfn)){
             ++compat;
         }
     }
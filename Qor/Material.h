@@ -24,7 +24,7 @@ class Material:
             )
         {}
         virtual ~Material();
-        //virtual unsigned int id(Pass* pass = nullptr) const override;
+        virtual unsigned int id(Pass* pass = nullptr) const override;
         virtual void bind(Pass* pass, unsigned slot = 0) const override;
         virtual void unbind(Pass* pass) const override;
 
@@ -33,6 +33,15 @@ class Material:
             Cache<Resource, std::string>* cache
         );
 
+        /*
+         * Textures a material will take from the cache, worked out without
+         * loading it (see ResourceCache::register_dependencies())
+         */
+        static std::vector<std::string> dependencies(
+            std::string fn,
+            Cache<Resource, std::string>* cache
+        );
+
         enum ExtraMap {
             //DIFF = 0,
             NRM,
@@ -47,6 +56,19 @@ class Material:
         virtual glm::uvec2 size() const override { return m_Textures.at(0)->size(); }
         virtual void size(unsigned w, unsigned h) override { m_Textures.at(0)->size(w,h); }
         virtual glm::uvec2 center() const override { return m_Textures.at(0)->center(); }
+        virtual glm::vec4 region() const override;
+
+        /*
+         * Swaps an atlas image for the image's own texture, so meshes whose
+         * UVs repeat can tile it.  Returns false if it wasn't in the atlas.
+         */
+        bool unatlas();
+
+        /*
+         * Textures and detail maps made for this material alone.  Cached
+         * and atlas textures are counted by the texture class and atlas.
+         */
+        virtual size_t gpu_bytes() const override;
         
         kit::signal<void(Pass*)> before;
         kit::signal<void(Pass*)> after;
@@ -76,6 +98,21 @@ class Material:
         void load_json(std::string fn);
         void load_mtllib(std::string fn, std::string emb);
         void load_detail_maps(std::string fn);
+        std::shared_ptr<ITexture> load_texture(const std::string& fn);
+
+        // diffuse, then each detail map or "" where there isn't one
+        static std::vector<std::string> texture_names(
+            std::string fn,
+            std::shared_ptr<Meta> cfg,
+            Cache<Resource, std::string>* cache
+        );
+        // diffuse goes in the atlas
+        static bool atlased(std::shared_ptr<Meta> cfg, bool detail);
+        // taken from the cache rather than made for this material
+        static bool cached(
+            const std::string& fn,
+            Cache<Resource, std::string>* cache
+        );
         
         Cache<Resource, std::string>* m_pCache = nullptr;
         
@@ -83,6 +120,8 @@ class Material:
         std::string m_Name;
         
         std::vector<std::shared_ptr<ITexture>> m_Textures;
+        // those of m_Textures that are cache entries of their own
+        std::vector<const ITexture*> m_Cached;
         //bool m_bComposite = false;
 
         Color m_Ambient = Color::white();
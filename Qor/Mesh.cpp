@@ -1,7 +1,14 @@
 #include "Mesh.h"
 #include "Common.h"
 #include "GLTask.h"
+#include "GLState.h"
+#include "StreamBuffer.h"
+#include "OcclusionBuffer.h"
+#include "Simplifier.h"
+#include "Camera.h"
 #include "Filesystem.h"
+#include "MeshFile.h"
+#include "ObjFile.h"
 #include "kit/log/log.h"
 #include <fstream>
 #include <sstream>
@@ -9,6 +16,10 @@
 #include <tuple>
 #include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <limits>
 #include <boost/algorithm/string.hpp>
 #include <glm/glm.hpp>
 #include <boost/tokenizer.hpp>
@@ -39,7 +50,7 @@ void MeshGeometry :: clear_cache()
     if(m_VertexBuffer)
     {
         GL_TASK_START()
-            glDeleteBuffers(1, &m_VertexBuffer);
+            GLState::get()->delete_buffers(1, &m_VertexBuffer);
             m_VertexBuffer = 0;
         GL_TASK_END()
     }
@@ -50,14 +61,14 @@ void MeshIndexedGeometry :: clear_cache()
     if(m_VertexBuffer)
     {
         GL_TASK_START()
-            glDeleteBuffers(1, &m_VertexBuffer);
+            GLState::get()->delete_buffers(1, &m_VertexBuffer);
             m_VertexBuffer = 0;
         GL_TASK_END()
     }
     if(m_IndexBuffer)
     {
         GL_TASK_START()
-            glDeleteBuffers(1, &m_IndexBuffer);
+            GLState::get()->delete_buffers(1, &m_IndexBuffer);
             m_IndexBuffer = 0;
         GL_TASK_END()
     }
@@ -68,7 +79,7 @@ void Wrap :: clear_cache()
     if(m_VertexBuffer)
     {
         GL_TASK_START()
-            glDeleteBuffers(1, &m_VertexBuffer);
+            GLState::get()->delete_buffers(1, &m_VertexBuffer);
             m_VertexBuffer = 0;
         GL_TASK_END()
     }
@@ -79,7 +90,7 @@ void MeshColors :: clear_cache()
     if(m_VertexBuffer)
     {
         GL_TASK_START()
-            glDeleteBuffers(1, &m_VertexBuffer);
+            GLState::get()->delete_buffers(1, &m_VertexBuffer);
             m_VertexBuffer = 0;
         GL_TASK_END()
     }
@@ -90,7 +101,7 @@ void MeshFade :: clear_cache()
     if(m_VertexBuffer)
     {
         GL_TASK_START()
-            glDeleteBuffers(1, &m_VertexBuffer);
+            GLState::get()->delete_buffers(1, &m_VertexBuffer);
             m_VertexBuffer = 0;
         GL_TASK_END()
     }
@@ -101,7 +112,7 @@ void MeshNormals :: clear_cache()
     if(m_VertexBuffer)
     {
         GL_TASK_START()
-            glDeleteBuffers(1, &m_VertexBuffer);
+            GLState::get()->delete_buffers(1, &m_VertexBuffer);
             m_VertexBuffer = 0;
         GL_TASK_END()
     }
@@ -112,7 +123,7 @@ void MeshTangents :: clear_cache()
     if(m_VertexBuffer)
     {
         GL_TASK_START()
-            glDeleteBuffers(1, &m_VertexBuffer);
+            GLState::get()->delete_buffers(1, &m_VertexBuffer);
             m_VertexBuffer = 0;
         GL_TASK_END()
     }
@@ -123,7 +134,7 @@ void MeshBinormals :: clear_cache()
     if(m_VertexBuffer)
     {
         GL_TASK_START()
-            glDeleteBuffers(1, &m_VertexBuffer);
+            GLState::get()->delete_buffers(1, &m_VertexBuffer);
             m_VertexBuffer = 0;
         GL_TASK_END()
     }
@@ -138,7 +149,7 @@ void MeshGeometry :: cache(Pipeline* pipeline) const
     {
         GL_TASK_START()
             glGenBuffers(1, &m_VertexBuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+            GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_VertexBuffer);
             glBufferData(
                 GL_ARRAY_BUFFER,
                 m_Vertices.size() * 3 * sizeof(float),
@@ -160,7 +171,7 @@ void MeshIndexedGeometry :: cache(Pipeline* pipeline) const
     {
         GL_TASK_START()
             glGenBuffers(1, &m_VertexBuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+            GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_VertexBuffer);
             glBufferData(
                 GL_ARRAY_BUFFER,
                 m_Vertices.size() * 3 * sizeof(float),
@@ -169,11 +180,19 @@ void MeshIndexedGeometry :: cache(Pipeline* pipeline) const
             );
         GL_TASK_END()
     }
+    cache_indices(pipeline);
+}
+
+void MeshIndexedGeometry :: cache_indices(Pipeline* pipeline) const
+{
+    if(m_Indices.empty())
+        return;
+
     if(!m_IndexBuffer)
     {
         GL_TASK_START()
             glGenBuffers(1, &m_IndexBuffer);
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
+            GLState::get()->bind_buffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
             glBufferData(
                 GL_ELEMENT_ARRAY_BUFFER,
                 m_Indices.size() * 3 * sizeof(unsigned),
@@ -193,7 +212,7 @@ void Wrap :: cache(Pipeline* pipeline) const
     {
         GL_TASK_START()
             glGenBuffers(1, &m_VertexBuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+            GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_VertexBuffer);
             glBufferData(
                 GL_ARRAY_BUFFER,
                 m_UV.size() * 2 * sizeof(float),
@@ -213,7 +232,7 @@ void MeshColors :: cache(Pipeline* pipeline) const
     {
         GL_TASK_START()
             glGenBuffers(1, &m_VertexBuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+            GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_VertexBuffer);
             glBufferData(
                 GL_ARRAY_BUFFER,
                 m_Colors.size() * 4 * sizeof(float),
@@ -233,7 +252,7 @@ void MeshFade :: cache(Pipeline* pipeline) const
     {
         GL_TASK_START()
             glGenBuffers(1, &m_VertexBuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+            GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_VertexBuffer);
             glBufferData(
                 GL_ARRAY_BUFFER,
                 m_Fade.size() * sizeof(float),
@@ -253,7 +272,7 @@ void MeshNormals :: cache(Pipeline* pipeline) const
     {
         GL_TASK_START()
             glGenBuffers(1, &m_VertexBuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+            GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_VertexBuffer);
             glBufferData(
                 GL_ARRAY_BUFFER,
                 m_Normals.size() * 3 * sizeof(float),
@@ -273,7 +292,7 @@ void MeshTangents :: cache(Pipeline* pipeline) const
     {
         GL_TASK_START()
             glGenBuffers(1, &m_VertexBuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+            GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_VertexBuffer);
             glBufferData(
                 GL_ARRAY_BUFFER,
                 m_Tangents.size() * 4 * sizeof(float),
@@ -293,7 +312,7 @@ void MeshBinormals :: cache(Pipeline* pipeline) const
     {
         GL_TASK_START()
             glGenBuffers(1, &m_VertexBuffer);
-            glBindBuffer(GL_ARRAY_BUFFER, m_VertexBuffer);
+            GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_VertexBuffer);
             glBufferData(
                 GL_ARRAY_BUFFER,
                 m_Binormals.size() * 4 * sizeof(float),
@@ -305,6 +324,15 @@ void MeshBinormals :: cache(Pipeline* pipeline) const
 }
 
 void MeshGeometry :: apply(Pass* pass) const
+{
+    if(m_Vertices.empty())
+        return;
+
+    bind(pass);
+    draw(pass);
+}
+
+void MeshGeometry :: bind(Pass* pass) const
 {
     if(m_Vertices.empty())
         return;
@@ -319,7 +347,13 @@ void MeshGeometry :: apply(Pass* pass) const
         pass->attribute_id((unsigned)Pipeline::AttributeID::VERTEX),
         3, GL_FLOAT, GL_FALSE, 0, (GLubyte*)NULL
     );
-    glDrawArrays(GL_TRIANGLES, 0, m_Vertices.size());
+}
+
+void MeshGeometry :: draw(Pass* pass) const
+{
+    if(m_Vertices.empty())
+        return;
+    GLState::get()->draw_arrays(GL_TRIANGLES, 0, m_Vertices.size(), pass->instances());
 }
 
 void MeshGeometry :: append(std::vector<glm::vec3> verts)
@@ -335,6 +369,15 @@ void MeshIndexedGeometry :: apply(Pass* pass) const
     if(m_Indices.empty())
         return;
 
+    bind(pass);
+    draw(pass);
+}
+
+void MeshIndexedGeometry :: bind(Pass* pass) const
+{
+    if(m_Indices.empty())
+        return;
+
     Pipeline* pipeline = pass->pipeline();
     cache(pipeline);
 
@@ -345,8 +388,21 @@ void MeshIndexedGeometry :: apply(Pass* pass) const
         pass->attribute_id((unsigned)Pipeline::AttributeID::VERTEX),
         3, GL_FLOAT, GL_FALSE, 0, (GLubyte*)NULL
     );
-    
-    glDrawElements(GL_TRIANGLES, 3 * m_Indices.size(), GL_UNSIGNED_INT, (GLubyte*)NULL);
+}
+
+void MeshIndexedGeometry :: bind_indices(Pass* pass) const
+{
+    pass->element_buffer(m_IndexBuffer);
+}
+
+void MeshIndexedGeometry :: draw(Pass* pass) const
+{
+    if(m_Indices.empty())
+        return;
+    GLState::get()->draw_elements(
+        GL_TRIANGLES, 3 * m_Indices.size(), GL_UNSIGNED_INT, (GLubyte*)NULL,
+        pass->instances()
+    );
 }
 
 unsigned Wrap :: layout() const
@@ -400,10 +456,44 @@ void Wrap :: apply(Pass* pass) const
 
 void Wrap :: append(std::vector<glm::vec2> data)
 {
+    for(auto& uv: data)
+        uv = vec2(m_Region) + uv * vec2(m_Region.z, m_Region.w);
     m_UV.insert(m_UV.end(), ENTIRE(data));
     clear_cache();
 }
 
+void Wrap :: region(const vec4& r)
+{
+    if(r == m_Region || m_UV.empty() || m_bRepeats)
+        return;
+
+    // back into the texture's own space
+    const vec2 old_ofs = vec2(m_Region), old_scale = vec2(m_Region.z, m_Region.w);
+    vector<vec2> uv(m_UV.size());
+    vec2 lo(numeric_limits<float>::max()), hi(numeric_limits<float>::lowest());
+    for(size_t i = 0; i < m_UV.size(); ++i) {
+        uv[i] = (m_UV[i] - old_ofs) / old_scale;
+        lo = glm::min(lo, uv[i]);
+        hi = glm::max(hi, uv[i]);
+    }
+
+    // a region has no neighbors to repeat into, so pull UVs that sit in
+    // a single repeat (like flipped quads in [-1,0]) back into [0,1]
+    const float EPSILON = 0.0001f;
+    vec2 shift = floor(lo + vec2(EPSILON));
+    if(hi.x - shift.x > 1.0f + EPSILON || hi.y - shift.y > 1.0f + EPSILON) {
+        m_bRepeats = true;
+        return;
+    }
+
+    for(auto& t: uv)
+        t = vec2(r) + (t - shift) * vec2(r.z, r.w);
+    // new storage, so an interleaved buffer built from the old notices
+    m_UV.swap(uv);
+    m_Region = r;
+    clear_cache();
+}
+
 void MeshColors :: apply(Pass* pass) const
 {
     if(m_Colors.empty())
@@ -517,75 +607,6 @@ void MeshMaterial :: apply(Pass* pass) const
     m_pTexture->bind(pass);
 }
 
-bool vec4cmp(const vec4& a,const vec4& b)
-{
-    if(a.x != b.x)
-        return a.x < b.x;
-    if(a.y != b.y)
-        return a.y < b.y;
-    if(a.z != b.z)
-        return a.z < b.z;
-    return a.w < b.w;
-}
-
-bool vec3cmp(const vec3& a,const vec3& b)
-{
-    if(a.x != b.x)
-        return a.x < b.x;
-    if(a.y != b.y)
-        return a.y < b.y;
-    return a.z < b.z;
-}
-
-bool vec2cmp(const vec2& a,const vec2& b)
-{
-    if(a.x != b.x)
-        return a.x < b.x;
-    return a.y < b.y;
-}
-
-// vertex compare that ignores bitangents
-struct vertcmp
-{
-    bool operator()(const tuple<
-        vec3, // v
-        vec2, // w
-        vec3, // n
-        vec4 // t
-    >& a,const tuple<
-        vec3, // v
-        vec2, // w
-        vec3, // n
-        vec4 // t
-    >& b
-    ){
-        if(get<0>(a) != get<0>(b))
-            return vec3cmp(get<0>(a), get<0>(b));
-        if(get<1>(a) != get<1>(b))
-            return vec2cmp(get<1>(a), get<1>(b));
-        //if(get<2>(a) != get<2>(b))
-        return vec3cmp(get<2>(a), get<2>(b));
-        //return vec4cmp(get<3>(a), get<3>(b));
-    }
-};
-
-//bool vertcmp(const tuple<
-//    vec3, // v
-//    vec2, // w
-//    vec3 // n
-//>& a,const tuple<
-//    vec3, // v
-//    vec2, // w
-//    vec3 // n
-//>& b
-//) {
-//    if(get<0>(a) != get<0>(b))
-//        return vec3(get<0>(a) < get<0>(b));
-//    if(get<1>(a) != get<1>(b))
-//        return vec2(get<0>(a) < get<0>(b));
-//    return vec3(get<2>(a), get<2>(b));
-//}
-
 Mesh::Data :: Data(
     string fn,
     Cache<Resource, string>* cache
@@ -636,13 +657,23 @@ Mesh::Data :: Data(
     fn = Filesystem::cutInternal(fn);
     string ext = Filesystem::getExtension(fn);
     //LOGf("getExtension: %s", ext)
-    if(ext == "obj")
-        load_obj(fn, this_object, this_material);
-    else if(ext == "json")
-        load_json(fn, this_object, this_material);
+    string binary = MeshFile::is_container(fn) ? fn : MeshFile::cooked(fn);
+    if(binary.empty() || not load_binary(binary, this_object, this_material))
+    {
+        if(ext == "obj")
+            load_obj(fn, this_object, this_material);
+        else if(ext == "json")
+            load_json(fn, this_object, this_material);
+        else if(ext == "qmesh")
+            K_ERRORf(READ, "\"%s:%s\" in %s",
+                this_object % this_material % Filesystem::getFileName(fn)
+            );
+    }
 
     //calculate_tangents();
     calculate_box();
+    if(s_LODLevels)
+        generate_lods(s_LODLevels);
 
     //auto t2 = std::chrono::high_resolution_clock::now();
     
@@ -755,6 +786,101 @@ void Mesh::Data :: load_json(string fn, string this_object, string this_material
     //LOG("done loading json");
 }
 
+vector<string> Mesh::Data :: dependencies(
+    string fn,
+    Cache<Resource, string>* cache
+){
+    vector<string> tokens;
+    string fn_base = Filesystem::getFileNameNoInternal(fn);
+    boost::split(tokens, fn_base, boost::is_any_of(":"));
+    if(tokens.size() < 3)
+        return vector<string>();
+    const string unit_name = tokens[1] + ":" + tokens[2];
+
+    // same order the constructor tries them in
+    fn = Filesystem::cutInternal(Filesystem::cutInternal(fn));
+    string ext = Filesystem::getExtension(fn);
+    string binary = MeshFile::is_container(fn) ? fn : MeshFile::cooked(fn);
+    if(not binary.empty())
+        if(auto unit = MeshFile::open(binary)->unit(unit_name))
+            return unit->material.empty() ?
+                vector<string>() : vector<string>{unit->material};
+
+    if(ext == "obj")
+    {
+        ifstream f(fn);
+        string line;
+        while(getline(f, line))
+        {
+            if(starts_with(line, "mtllib ")) {
+                istringstream ss(line.substr(7));
+                string mtllib;
+                if(ss >> mtllib)
+                    return vector<string>{mtllib + ":" + tokens[2]};
+                break;
+            }
+            // geometry starts, no mtllib
+            if(starts_with(line, "v ") || starts_with(line, "f "))
+                break;
+        }
+    }
+    else if(ext == "json")
+    {
+        auto doc = ((ResourceCache*)cache)->config(fn)->meta("data")->meta(unit_name);
+        auto tex = doc->at<string>("image", string());
+        if(Filesystem::getExtension(tex).empty())
+            tex += ".png";
+        if(not tex.empty() && tex!=".png")
+            return vector<string>{tex};
+    }
+    return vector<string>();
+}
+
+bool Mesh::Data :: load_binary(string fn, string this_object, string this_material)
+{
+    auto file = MeshFile::open(fn);
+    auto unit = file->unit(this_object + ":" + this_material);
+    if(not unit)
+        return false;
+
+    // blocks are laid out like the vectors, so these are plain copies
+    vector<vec3> verts(ENTIRE(unit->vertices));
+    if(unit->indices.empty())
+        geometry = make_shared<MeshGeometry>(std::move(verts));
+    else
+        geometry = make_shared<MeshIndexedGeometry>(
+            std::move(verts),
+            vector<uvec3>(ENTIRE(unit->indices))
+        );
+    if(not unit->wrap.empty())
+        mods.push_back(make_shared<Wrap>(
+            vector<vec2>(ENTIRE(unit->wrap))
+        ));
+    if(not unit->normals.empty())
+        mods.push_back(make_shared<MeshNormals>(
+            vector<vec3>(ENTIRE(unit->normals))
+        ));
+    if(not unit->tangents.empty())
+        mods.push_back(make_shared<MeshTangents>(
+            vector<vec4>(ENTIRE(unit->tangents))
+        ));
+    if(not unit->fade.empty())
+        mods.push_back(make_shared<MeshFade>(
+            vector<float>(ENTIRE(unit->fade))
+        ));
+
+    if(not unit->material.empty()) {
+        try{
+            material = make_shared<MeshMaterial>(
+                cache->cache_cast<ITexture>(unit->material)
+            );
+        }catch(const std::out_of_range&){
+            WARNINGf("Texture unit %s had problems loading.", unit->material);
+        }
+    }
+    return true;
+}
+
 //void Mesh::Data :: load_assimp(string fn, string this_object, string this_material)
 //{
 //    auto_ptr<Assimp::Importer> importer(new Assimp::Importer());
@@ -783,265 +909,29 @@ void Mesh::Data :: load_json(string fn, string this_object, string this_material
 
 void Mesh::Data :: load_obj(string fn, string this_object, string this_material)
 {
-    ifstream f(fn);
-    if(!f.good()) {
-        K_ERROR(READ, Filesystem::getFileName(fn));
-    }
-    string line;
-    vector<vec3> verts;
-    vector<vec2> wrap;
-    vector<vec3> normals;
-    //vector<vec4> tangents;
-    //vector<vec4> binormals;
-    
-    set<
-        tuple<
-            vec3, // v
-            vec2, // w
-            vec3, // n
-            vec4 // t
-        >,
-        vertcmp
-    > newset;
-    vector<
-        tuple<
-            vec3, // v
-            vec2, // w
-            vec3, // n
-            vec4 // t
-        >
-    > newvec;
-
-    vector<uvec3> faces;
-    unordered_map<
-        unsigned,
-        tuple<vec4 /*total*/, unsigned /*count*/>
-    > tangent_averages;
-    
-    string mtllib;
-    //bool untriangulated = false;
-    //vector<vec2> wrap_index;
-    //vector<vec3> normal_index;
-    
-    string itr_object;
-    string itr_material;
-        
-    while(getline(f, line))
-    {
-        if(starts_with(trim_copy(line), "#"))
-            continue;
-
-        istringstream ss(line);
-        string nothing;
-        ss >> nothing;
-        
-        if(starts_with(line, "mtllib ")) {
-            ss >> mtllib;
-            continue;
-        }
-        else if(starts_with(line, "o ")){
-            ss >> itr_object;
-            continue;
-        }
-        else if(starts_with(line, "usemtl ")) {
-            ss >> itr_material;
-            continue;
-        }
-
-        if(starts_with(line, "v "))
-        {
-            vec3 vec;
-            float* v = value_ptr(vec);
-            ss >> v[0];
-            ss >> v[1];
-            ss >> v[2];
-            verts.push_back(vec);
-        }
-        else if(starts_with(line, "vn "))
-        {
-            vec3 vec;
-            float* v = value_ptr(vec);
-            ss >> v[0];
-            ss >> v[1];
-            ss >> v[2];
-            normals.push_back(vec);
-        }
-        else if(starts_with(line, "vt "))
-        {
-            vec2 vec;
-            float* v = value_ptr(vec);
-            ss >> v[0];
-            ss >> v[1];
-            v[1] = 1.0f - v[1];
-            wrap.push_back(vec);
-        }
-        else if(starts_with(line, "f "))
-        {
-            //assert(!this_object.empty());
-            //assert(!this_material.empty());
-            
-            if(this_object != itr_object)
-                continue;
-            if(this_material != itr_material)
-                continue;
-            
-            //uvec4 index;
-            unsigned index[4] = {0};
-            tuple<vec3, vec2, vec3, vec4> vert[4] = {};
-            unsigned vert_count = 0;
-            
-            for(unsigned i=0;i<4;++i) {
-                vert[i] = tuple<vec3, vec2, vec3, vec4>();
-                
-                unsigned v[3] = {0};
-                
-                string face;
-                if(!(ss >> face)) {
-                    if(i == 3)
-                        continue;
-                        
-                    //WARNING("not enough vertices");
-                    //ERROR(GENERAL, "not triangulated");
-                    WARNING("not triangulated");
-                    //untriangulated = true;
-                    continue;
-                }
-                
-                ++vert_count;
-                
-                vector<string> tokens;
-                boost::split(tokens, face, is_any_of("/"));
-
-                try{
-                    v[0] = boost::lexical_cast<unsigned>(tokens.at(0)) - 1;
-                    get<0>(vert[i]) = verts.at(v[0]);
-                }catch(...){
-                    LOGf("(%s) vertex at index %s",
-                        Filesystem::getFileName(fn) % v[0]
-                    );
-                }
-                try{
-                    v[1] = boost::lexical_cast<unsigned>(tokens.at(1)) - 1;
-                    get<1>(vert[i]) = wrap.at(v[1]);
-                }catch(...){
-                    //LOGf("(%s) no wrap (UV) at index %s",
-                    //    Filesystem::getFileName(fn) % v[1]
-                    //);
-                }
-                try{
-                    v[2] = boost::lexical_cast<unsigned>(tokens.at(2)) - 1;
-                    get<2>(vert[i]) = normals.at(v[2]);
-                }catch(...){
-                    //LOGf("(%s) no normal at index %s",
-                    //    Filesystem::getFileName(fn) % v[2]
-                    //);
-                }
-            }
-
-            for(unsigned i=0;i<vert_count;++i) {
-                // TODO: calc tangents?
-                
-                // attempt to add
-                if(newset.insert(vert[i]).second)
-                {
-                    // new index
-                    newvec.push_back(vert[i]);
-                    index[i] = newvec.size()-1;
-                }
-                else
-                {
-                    // already added
-                    // average the tangent
-                    auto itr = std::find(ENTIRE(newvec), vert[i]);
-                    size_t old_idx = std::distance(newvec.begin(), itr);
-                    if(old_idx != newvec.size())
-                    {
-                        //tuple<vec4, unsigned>& avg =
-                        //    tangent_averages[old_idx];
-                        //get<0>(avg) += vec4();
-                        //++get<1>(avg);
-
-                        // calc new avg and update in newvec
-                        //vec4 new_avg;
-                        //if(get<0>(avg) != vec4())
-                        //    new_avg = get<0>(avg)/(get<1>(avg)*1.0f);
-                        //get<3>(newvec[old_idx]) = new_avg;
-
-                        index[i] = old_idx;
-                    }
-                    else
-                        assert(false);
-                }
-            }
-            
-            string another;
-            if(ss >> another) {
-                //ERROR(GENERAL, "not triangulated");
-                WARNING("not triangulated");
-                //untriangulated = true;
-            }
-            
-            faces.push_back(uvec3(index[0],index[1],index[2]));
-            // triangulate quad
-            if(vert_count == 4)
-                faces.push_back(uvec3(index[2],index[3],index[0]));
-        }
-        else
-        {
-            // ignore line
-            //LOGf("\"%s\": ignoring line: \n\t%s",
-            //    Filesystem::getFileName(fn) % line
-            //);
-        }
-    }
-    
-    if(!newvec.empty())
-    {
-        verts.clear();
-        verts.reserve(newvec.size());
-        wrap.clear();
-        wrap.reserve(newvec.size());
-        normals.clear();
-        normals.reserve(newvec.size());
-        for(auto&& v: newvec) {
-            verts.push_back(get<0>(v));
-            wrap.push_back(get<1>(v));
-            normals.push_back(get<2>(v));
-            //tangents.push_back(get<3>(v));
-        }
-        geometry = make_shared<MeshIndexedGeometry>(verts, faces);
-        assert(!verts.empty());
-        assert(!wrap.empty());
-        assert(!normals.empty());
-        //LOGf("grab %s:%s from cache", mtllib%this_material);
-        try{
-            material = make_shared<MeshMaterial>(
-                cache->cache_cast<ITexture>(mtllib + ":" + this_material)
-            );
-        }catch(const std::out_of_range&){
-            WARNINGf("Texture unit %s:%s had problems loading.", mtllib % this_material);
-        }
-        mods.push_back(make_shared<Wrap>(wrap));
-        mods.push_back(make_shared<MeshNormals>(normals));
-        //mods.push_back(make_shared<MeshTangents>(tangents));
-
-        //LOGf("%s polygons loaded on \"%s:%s:%s\"",
-        //    faces.size() %
-        //    Filesystem::getFileName(fn) % this_object % this_material
-        //);
-    }
-    else
+    auto file = ObjFile::open(fn);
+    auto unit = file->unit(this_object + ":" + this_material);
+    if(not unit)
     {
         WARNINGf(
             "No mesh data available for \"%s:%s:%s\"",
             Filesystem::getFileName(fn) % this_object % this_material
         );
+        return;
     }
 
-    //if(untriangulated)
-    //    WARNINGf("Not triangulated: %s",
-    //        (Filesystem::getFileName(fn) + ":" + this_material)
-    //    );
+    geometry = make_shared<MeshIndexedGeometry>(unit->vertices, unit->faces);
+    //LOGf("grab %s:%s from cache", mtllib%this_material);
+    try{
+        material = make_shared<MeshMaterial>(
+            cache->cache_cast<ITexture>(file->mtllib() + ":" + this_material)
+        );
+    }catch(const std::out_of_range&){
+        WARNINGf("Texture unit %s:%s had problems loading.", file->mtllib() % this_material);
+    }
+    mods.push_back(make_shared<Wrap>(unit->wrap));
+    mods.push_back(make_shared<MeshNormals>(unit->normals));
+    //mods.push_back(make_shared<MeshTangents>(tangents));
 }
 
 vector<string> Mesh :: Data :: decompose(string fn, Cache<Resource, string>* cache)
@@ -1052,7 +942,16 @@ vector<string> Mesh :: Data :: decompose(string fn, Cache<Resource, string>* cac
     auto internal = Filesystem::getInternal(fn);
     auto fn_cut = Filesystem::cutInternal(fn);
     
-    if(Filesystem::hasExtension(fn_cut, "json"))
+    string binary = MeshFile::is_container(fn_cut) ? fn_cut : MeshFile::cooked(fn_cut);
+    if(not binary.empty())
+    {
+        // json scenes ask for the units of one mesh, the rest for all
+        bool all = internal.empty() && not Filesystem::hasExtension(fn_cut, "json");
+        for(auto&& unit: MeshFile::open(binary)->units())
+            if(all || boost::starts_with(unit.name, internal + ":"))
+                units.push_back(unit.name);
+    }
+    else if(Filesystem::hasExtension(fn_cut, "json"))
     {
         auto config = ((ResourceCache*)cache)->config(fn_cut);
         for(auto& e: *config->meta("data"))
@@ -1065,29 +964,8 @@ vector<string> Mesh :: Data :: decompose(string fn, Cache<Resource, string>* cac
     }
     else
     {
-        //LOGf("decomposing obj %s", fn);
-        ifstream f(fn);
-        string itr_object, itr_material, line;
-        while(getline(f, line))
-        {
-            //LOG("decomposing line");
-            istringstream ss(line);
-            string nothing;
-            ss >> nothing;
-            
-            if(starts_with(line, "o ")) {
-                ss >> itr_object;
-                //LOGf("found obj %s", itr_object);
-            }
-            else if(starts_with(line, "usemtl ")) {
-                ss >> itr_material;
-                //LOG("decomposing mat");
-                auto id = itr_object + ":" + itr_material;
-                //LOGf("unit %s", id);
-                if(std::find(ENTIRE(units), id) == units.end())
-                    units.push_back(id);
-            }
-        }
+        // the parse is shared with the units loading next
+        units = ObjFile::open(fn_cut)->names();
     }
 
     return units;
@@ -1194,6 +1072,70 @@ void Mesh :: Data :: calculate_box()
     //LOGf("box: %s", string(box));
 }
 
+size_t Mesh :: Data :: cpu_bytes() const
+{
+    size_t r = 0;
+    if(geometry)
+        r += geometry->components() * geometry->vertex_count() * sizeof(float) +
+            geometry->index_count() * sizeof(unsigned);
+    for(auto&& m: mods)
+        if(m)
+            r += m->components() * m->vertex_count() * sizeof(float);
+    for(auto&& lod: lods)
+        r += lod->indices().size() * sizeof(unsigned);
+    return r;
+}
+
+size_t Mesh :: Data :: gpu_bytes() const
+{
+    if(not geometry)
+        return 0;
+    size_t r = 0;
+    // interleaved, or a buffer per attribute
+    if(vertex_buffer.id())
+        r += vertex_buffer.stride() * geometry->vertex_count();
+    if(geometry->buffer_id())
+        r += geometry->components() * geometry->vertex_count() * sizeof(float);
+    for(auto&& m: mods)
+        if(m && m->buffer_id())
+            r += m->components() * m->vertex_count() * sizeof(float);
+    if(vertex_buffer.ready() || geometry->buffer_id()) {
+        r += geometry->index_count() * sizeof(unsigned);
+        for(auto&& lod: lods)
+            r += lod->indices().size() * sizeof(unsigned);
+    }
+    return r;
+}
+
+unsigned Mesh::Data :: s_LODLevels = 0;
+
+void Mesh :: Data :: generate_lods(unsigned levels, float ratio)
+{
+    lods.clear();
+    if(empty() || not levels)
+        return;
+    if(not geometry->vertex_data())
+        return;
+
+    Simplifier simplifier(
+        geometry->vertex_data(), geometry->vertex_count(),
+        geometry->index_data(), geometry->index_count()
+    );
+    size_t triangles = simplifier.triangles();
+    for(unsigned i = 0; i < levels; ++i)
+    {
+        size_t target = size_t(triangles * ratio);
+        if(target < 2)
+            break;
+        auto level = simplifier.simplify(target);
+        // stuck, further levels would be the same
+        if(level.indices.size() / 3 >= triangles)
+            break;
+        triangles = level.indices.size() / 3;
+        lods.push_back(make_shared<MeshLOD>(move(level.indices), level.error));
+    }
+}
+
 Mesh :: Mesh(aiMesh* mesh, Cache<Resource, string>* cache, vector<shared_ptr<MeshMaterial>>& materials):
     Node((std::string)mesh->mName.data), // OSX complains w/o cast
     m_pCache(cache)
@@ -1273,7 +1215,7 @@ Mesh :: Mesh(string fn, Cache<Resource, string>* cache):
 {
     string fn_real = Filesystem::cutInternal(fn);
     string ext = Filesystem::getExtension(fn_real);
-    if(ext != "json")
+    if(ext != "json" && ext != "qmesh")
     {
         load_assimp(fn);
     }
@@ -1423,6 +1365,401 @@ void Mesh :: process_material_settings()
     }
 }
 
+unsigned MeshVertexArrays :: find(unsigned shader, unsigned layout) const
+{
+    for(const auto& e: m_Arrays)
+        if(e.shader == shader && e.layout == layout)
+            return e.id;
+    return 0;
+}
+
+void MeshVertexArrays :: add(unsigned shader, unsigned layout, unsigned id)
+{
+    m_Arrays.push_back(Entry{shader, layout, id});
+}
+
+void MeshVertexArrays :: clear()
+{
+    if(m_Arrays.empty())
+        return;
+    vector<unsigned> ids;
+    ids.reserve(m_Arrays.size());
+    for(const auto& e: m_Arrays)
+        ids.push_back(e.id);
+    m_Arrays.clear();
+    GL_TASK_ASYNC_START()
+        GLState::get()->delete_vertex_arrays(ids.size(), &ids[0]);
+    GL_TASK_ASYNC_END()
+}
+
+unsigned MeshVertexBuffer :: s_DefaultFormat = MeshVertexBuffer::FULL;
+MeshVertexBuffer::Stats MeshVertexBuffer :: s_Stats;
+
+namespace {
+
+    // builds this many frames apart or less count as the data changing
+    // every frame
+    const unsigned REBUILD_FRAMES = 4;
+
+    uint16_t pack_half(float f)
+    {
+        uint32_t x;
+        memcpy(&x, &f, sizeof(x));
+        uint32_t sign = (x >> 16) & 0x8000;
+        int exp = int((x >> 23) & 0xff) - 127 + 15;
+        uint32_t mant = x & 0x7fffff;
+        if(((x >> 23) & 0xff) == 0xff) // inf, nan
+            return uint16_t(sign | 0x7c00 | (mant ? 0x200 : 0));
+        if(exp >= 31)
+            return uint16_t(sign | 0x7c00);
+        if(exp <= 0) { // denormal or zero
+            if(exp < -10)
+                return uint16_t(sign);
+            mant |= 0x800000;
+            unsigned shift = 14 - exp;
+            uint32_t h = mant >> shift;
+            if((mant >> (shift - 1)) & 1)
+                ++h;
+            return uint16_t(sign | h);
+        }
+        uint32_t h = sign | (uint32_t(exp) << 10) | (mant >> 13);
+        if(mant & 0x1000) // round (carries into the exponent correctly)
+            ++h;
+        return uint16_t(h);
+    }
+
+    // signed normalized 2_10_10_10, w is only a sign (-1, 0 or 1)
+    uint32_t pack_snorm_10(const float* v, unsigned components)
+    {
+        auto q = [](float f) -> uint32_t {
+            f = std::max(-1.0f, std::min(1.0f, f));
+            return uint32_t(int(std::round(f * 511.0f))) & 0x3ff;
+        };
+        uint32_t r = q(v[0]) | (q(v[1]) << 10) | (q(v[2]) << 20);
+        // -2 and 1 decode to -1 and 1 under both GL conversion rules
+        if(components > 3 && v[3] != 0.0f)
+            r |= uint32_t(v[3] < 0.0f ? 2 : 1) << 30;
+        return r;
+    }
+
+    uint8_t pack_unorm_8(float f)
+    {
+        return uint8_t(std::round(std::max(0.0f, std::min(1.0f, f)) * 255.0f));
+    }
+}
+
+MeshVertexBuffer::Source MeshVertexBuffer :: source(const IMeshModifier* mod)
+{
+    return Source{mod, mod->vertex_data(), mod->vertex_count()};
+}
+
+unsigned MeshVertexBuffer :: format() const
+{
+    return m_Format == DEFAULT_FORMAT ? s_DefaultFormat : m_Format;
+}
+
+bool MeshVertexBuffer :: current(
+    const IMeshGeometry* geometry,
+    const vector<shared_ptr<IMeshModifier>>& mods
+) const {
+    if(not m_bBuilt || m_Sources.size() != mods.size() + 1)
+        return false;
+    if(not (m_Sources[0] == source(geometry)))
+        return false;
+    for(unsigned i = 0; i < mods.size(); ++i)
+        if(not (m_Sources[i + 1] == source(mods[i].get())))
+            return false;
+    return true;
+}
+
+void MeshVertexBuffer :: build(
+    const IMeshGeometry* geometry,
+    const vector<shared_ptr<IMeshModifier>>& mods
+){
+    clear();
+    m_bBuilt = true;
+    m_Sources.push_back(source(geometry));
+    for(const auto& m: mods)
+        m_Sources.push_back(source(m.get()));
+
+    const size_t count = geometry->vertex_count();
+    if(not count)
+        return;
+    
+    // a later modifier of an attribute replaces an earlier one, as
+    // applying them in order did
+    typedef Pipeline::AttributeID A;
+    const unsigned max_attr = (unsigned)A::MAX;
+    const IMeshModifier* attrs[max_attr] = {};
+    attrs[(unsigned)A::VERTEX] = geometry;
+    for(const auto& m: mods)
+    {
+        unsigned layout = m->layout();
+        if(not layout)
+            continue;
+        // not one value per vertex: keep separate buffers
+        if(not m->components() || m->vertex_count() != count)
+            return;
+        for(unsigned i = 0; i < max_attr; ++i)
+            if(layout & (1U << i))
+                attrs[i] = m.get();
+    }
+
+    // packed types are GL 3.3 (2_10_10_10) and 3.0 (half float)
+    unsigned fmt = format();
+    const bool compact = (fmt & COMPACT) && GLEW_VERSION_3_3;
+    const bool compact_pos = (fmt & COMPACT_POSITIONS) != 0;
+    
+    unsigned ofs = 0;
+    for(unsigned i = 0; i < max_attr; ++i)
+    {
+        if(not attrs[i])
+            continue;
+        const unsigned comps = attrs[i]->components();
+        Attribute a{i, comps, GL_FLOAT, false, ofs};
+        unsigned size = comps * sizeof(float);
+        if(i == (unsigned)A::VERTEX && compact_pos) {
+            a.type = GL_UNSIGNED_SHORT;
+            a.normalized = true;
+            size = 4 * sizeof(uint16_t); // padded to keep 4-byte alignment
+        } else if(compact && (
+            i == (unsigned)A::NORMAL ||
+            i == (unsigned)A::TANGENT ||
+            i == (unsigned)A::BINORMAL
+        )){
+            a.type = GL_INT_2_10_10_10_REV;
+            a.components = 4;
+            a.normalized = true;
+            size = sizeof(uint32_t);
+        } else if(compact && i == (unsigned)A::WRAP) {
+            a.type = GL_HALF_FLOAT;
+            size = comps * sizeof(uint16_t);
+        } else if(compact && i == (unsigned)A::COLOR) {
+            a.type = GL_UNSIGNED_BYTE;
+            a.normalized = true;
+            size = (comps + 3) / 4 * 4;
+        }
+        m_Attributes.push_back(a);
+        ofs += size;
+        m_FloatBytes += comps * sizeof(float) * count;
+        m_Layout |= 1U << i;
+    }
+    m_Stride = ofs;
+    m_Bytes = count * m_Stride;
+
+    // positions relative to the bounds of the geometry
+    m_PositionScale = vec3(1.0f);
+    m_PositionOffset = vec3(0.0f);
+    const float* verts = geometry->vertex_data();
+    if(compact_pos)
+    {
+        vec3 lo(verts[0], verts[1], verts[2]), hi = lo;
+        for(size_t v = 0; v < count; ++v) {
+            vec3 p(verts[v*3], verts[v*3+1], verts[v*3+2]);
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+        m_PositionOffset = lo;
+        m_PositionScale = hi - lo;
+    }
+
+    vector<uint8_t> data(m_Bytes);
+    for(const auto& a: m_Attributes)
+    {
+        const unsigned comps = attrs[a.id]->components();
+        const float* src = attrs[a.id]->vertex_data();
+        uint8_t* dst = &data[a.offset];
+        for(size_t v = 0; v < count; ++v, src += comps, dst += m_Stride)
+        {
+            switch(a.type)
+            {
+                case GL_FLOAT:
+                    memcpy(dst, src, comps * sizeof(float));
+                    break;
+                case GL_UNSIGNED_SHORT: {
+                    uint16_t p[4] = {0, 0, 0, 0};
+                    for(unsigned c = 0; c < 3; ++c)
+                        if(m_PositionScale[c] > 0.0f)
+                            p[c] = uint16_t(std::round(
+                                (src[c] - m_PositionOffset[c]) / m_PositionScale[c] * 65535.0f
+                            ));
+                    memcpy(dst, p, sizeof(p));
+                    break;
+                }
+                case GL_INT_2_10_10_10_REV: {
+                    uint32_t p = pack_snorm_10(src, comps);
+                    memcpy(dst, &p, sizeof(p));
+                    break;
+                }
+                case GL_HALF_FLOAT: {
+                    uint16_t p[4];
+                    for(unsigned c = 0; c < comps; ++c)
+                        p[c] = pack_half(src[c]);
+                    memcpy(dst, p, comps * sizeof(uint16_t));
+                    break;
+                }
+                case GL_UNSIGNED_BYTE:
+                    for(unsigned c = 0; c < comps; ++c)
+                        dst[c] = pack_unorm_8(src[c]);
+                    break;
+            }
+        }
+    }
+
+    // rebuilt on frame after frame (morphs, edited modifiers), unlike
+    // one-off rebuilds (cache clears, atlas remaps), which stay static
+    const unsigned frame = StreamBuffer::get()->frame_id();
+    if(m_LastBuild != ~0u && frame - m_LastBuild <= REBUILD_FRAMES)
+        ++m_Rebuilds;
+    else
+        m_Rebuilds = 0;
+    m_LastBuild = frame;
+
+    // anything bigger than a frame's share of the ring would be uploaded
+    // whole every frame, so only meshes marked dynamic stream past it
+    const bool changing = m_Rebuilds >= 2 &&
+        data.size() <= StreamBuffer::get()->region_size();
+    if(m_bDynamic || changing)
+    {
+        m_bStreamed = true;
+        m_Data = std::move(data);
+        return;
+    }
+
+    GL_TASK_START()
+        glGenBuffers(1, &m_ID);
+        GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_ID);
+        glBufferData(GL_ARRAY_BUFFER, data.size(), &data[0], GL_STATIC_DRAW);
+    GL_TASK_END()
+
+    ++s_Stats.buffers;
+    s_Stats.bytes += m_Bytes;
+    s_Stats.float_bytes += m_FloatBytes;
+}
+
+void MeshVertexBuffer :: bind(Pass* pass, unsigned layout) const
+{
+    pass->vertex_buffer(render_id());
+    const unsigned base = m_bStreamed ? m_StreamOffset : 0;
+    for(const auto& a: m_Attributes)
+        if(layout & (1U << a.id))
+            glVertexAttribPointer(
+                pass->attribute_id(a.id),
+                a.components, a.type, a.normalized ? GL_TRUE : GL_FALSE,
+                m_Stride, (GLubyte*)NULL + base + a.offset
+            );
+}
+
+unsigned MeshVertexBuffer :: render_id() const
+{
+    if(not m_bStreamed)
+        return m_ID;
+    return m_bOverflow ? m_OverflowID : StreamBuffer::get()->id();
+}
+
+void MeshVertexBuffer :: stream()
+{
+    if(not m_bStreamed || m_Data.empty())
+        return;
+    StreamBuffer* ring = StreamBuffer::get();
+    if(m_StreamFrame == ring->frame_id())
+        return;
+    m_StreamFrame = ring->frame_id();
+
+    m_StreamOffset = ring->write(&m_Data[0], m_Data.size());
+    m_bOverflow = m_StreamOffset == ~0u;
+    if(not m_bOverflow)
+        return;
+
+    m_StreamOffset = 0;
+    if(not m_OverflowID)
+        glGenBuffers(1, &m_OverflowID);
+    GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_OverflowID);
+    glBufferData(GL_ARRAY_BUFFER, m_Data.size(), &m_Data[0], GL_STREAM_DRAW);
+}
+
+void MeshVertexBuffer :: clear()
+{
+    if(m_ID)
+    {
+        unsigned id = m_ID;
+        GL_TASK_ASYNC_START()
+            GLState::get()->delete_buffers(1, &id);
+        GL_TASK_ASYNC_END()
+        m_ID = 0;
+        --s_Stats.buffers;
+        s_Stats.bytes -= m_Bytes;
+        s_Stats.float_bytes -= m_FloatBytes;
+    }
+    m_Stride = 0;
+    m_Layout = 0;
+    m_Bytes = 0;
+    m_FloatBytes = 0;
+    m_PositionScale = vec3(1.0f);
+    m_PositionOffset = vec3(0.0f);
+    m_Attributes.clear();
+    m_Sources.clear();
+    m_bBuilt = false;
+    m_bStreamed = false;
+    m_bOverflow = false;
+    m_Data.clear();
+    m_StreamFrame = ~0u;
+}
+
+void MeshVertexBuffer :: release()
+{
+    if(m_OverflowID)
+    {
+        unsigned id = m_OverflowID;
+        GL_TASK_ASYNC_START()
+            GLState::get()->delete_buffers(1, &id);
+        GL_TASK_ASYNC_END()
+        m_OverflowID = 0;
+    }
+}
+
+void MeshLOD :: cache(Pipeline* pipeline) const
+{
+    if(m_IndexBuffer || m_Indices.empty())
+        return;
+    GL_TASK_START()
+        glGenBuffers(1, &m_IndexBuffer);
+        GLState::get()->bind_buffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
+        glBufferData(
+            GL_ELEMENT_ARRAY_BUFFER,
+            m_Indices.size() * sizeof(unsigned),
+            &m_Indices[0],
+            GL_STATIC_DRAW
+        );
+    GL_TASK_END()
+}
+
+void MeshLOD :: clear_cache()
+{
+    if(m_IndexBuffer)
+    {
+        GL_TASK_START()
+            GLState::get()->delete_buffers(1, &m_IndexBuffer);
+            m_IndexBuffer = 0;
+        GL_TASK_END()
+    }
+}
+
+void MeshLOD :: bind(Pass* pass) const
+{
+    pass->element_buffer(m_IndexBuffer);
+}
+
+void MeshLOD :: draw(Pass* pass) const
+{
+    if(m_Indices.empty())
+        return;
+    GLState::get()->draw_elements(
+        GL_TRIANGLES, m_Indices.size(), GL_UNSIGNED_INT, (GLubyte*)NULL,
+        pass->instances()
+    );
+}
+
 void Mesh :: clear_cache() const
 {
     //if(!m_pData)
@@ -1431,29 +1768,65 @@ void Mesh :: clear_cache() const
     for(const auto& m: m_pData->mods)
         m->clear_cache();
 
-    //if(m_pData->vertex_array)
-    //{
-    //    GL_TASK_START()
-    //        glDeleteVertexArrays(1, &m_pData->vertex_array);
-    //    GL_TASK_END()
-    //    m_pData->vertex_array = 0;
-    //}
+    m_pData->vertex_arrays.clear();
+    m_pData->vertex_buffer.clear();
+    for(const auto& lod: m_pData->lods)
+        lod->clear_cache();
 }
 
 void Mesh :: cache(Pipeline* pipeline) const
 {
     //if(!m_pData)
     //    return;
-    //if(!m_pData->vertex_array) {
-    //    GL_TASK_START()
-    //        glGenVertexArrays(1, &m_pData->vertex_array);
-    //    GL_TASK_END()
-    //}
 
-    for(const auto& m: m_pData->mods)
+    // images in an atlas draw from part of the page
+    if(m_pData->material && m_pData->material->texture())
+    {
+        auto tex = m_pData->material->texture();
+        bool repeats = false;
+        for(const auto& m: m_pData->mods)
+            if(m->layout() & Pipeline::WRAP)
+                if(auto wrap = dynamic_cast<Wrap*>(m.get())) {
+                    wrap->region(tex->region());
+                    repeats = repeats || wrap->repeats();
+                }
+        // tiled surfaces can't sample part of a page, so the material goes
+        // back to its own texture and the other meshes sharing it remap to
+        // the full region on their next cache()
+        if(repeats)
+            if(auto mat = dynamic_cast<Material*>(tex))
+                mat->unatlas();
+    }
+
+    auto& vb = m_pData->vertex_buffer;
+    if(m_pData->geometry && not vb.current(m_pData->geometry.get(), m_pData->mods))
+    {
+        m_pData->vertex_arrays.clear();
+        vb.build(m_pData->geometry.get(), m_pData->mods);
+    }
+    for(const auto& lod: m_pData->lods)
+        lod->cache(pipeline);
+    if(vb.ready())
+    {
+        m_pData->geometry->cache_indices(pipeline);
+        return;
+    }
+
+    // vertex arrays hold on to the buffers they were built with, so
+    // any buffer (re)created here makes them stale
+    bool rebuilt = false;
+    for(const auto& m: m_pData->mods) {
+        bool cached = m->buffer_id();
         m->cache(pipeline);
-    if(m_pData->geometry)
+        rebuilt |= not cached && m->buffer_id();
+    }
+    if(m_pData->geometry) {
+        bool cached = m_pData->geometry->buffer_id();
         m_pData->geometry->cache(pipeline);
+        rebuilt |= not cached && m_pData->geometry->buffer_id();
+    }
+    if(rebuilt)
+        m_pData->vertex_arrays.clear();
 }
 
 void Mesh :: swap_modifier(
@@ -1501,17 +1874,179 @@ void Mesh :: render_self(Pass* pass) const
         layout |= m->layout();
     }
     
-    //pass->vertex_array(m_pData->vertex_array);
-    layout = pass->layout(layout);
     if(m_pData->material)
         m_pData->material->apply(pass);
+    pipeline->position_decode(
+        m_pData->vertex_buffer.position_scale(),
+        m_pData->vertex_buffer.position_offset()
+    );
     
+    // instanced draws set their per-instance attributes up on the
+    // default vertex array, as do streamed meshes, whose offset into the
+    // ring moves every frame
+    m_pData->vertex_buffer.stream();
+    if(pass->instances() > 1 || not GLEW_VERSION_3_0 ||
+        m_pData->vertex_buffer.streamed())
+    {
+        pass->vertex_array(0);
+        bind_attributes(pass, pass->layout(layout));
+        draw_geometry(pass);
+        return;
+    }
+    
+    // otherwise attribute state is baked once per shader and layout
+    unsigned shader = (unsigned)pass->type();
+    layout = pass->layout_mask(layout);
+    unsigned vao = m_pData->vertex_arrays.find(shader, layout);
+    if(vao)
+        pass->vertex_array(vao);
+    else
+    {
+        glGenVertexArrays(1, &vao);
+        pass->vertex_array(vao);
+        bind_attributes(pass, pass->layout(layout));
+        m_pData->vertex_arrays.add(shader, layout, vao);
+    }
+    draw_geometry(pass);
+    
+    //pass->layout(0);
+}
+
+void Mesh :: bind_attributes(Pass* pass, unsigned layout) const
+{
+    const auto& vb = m_pData->vertex_buffer;
+    if(vb.ready())
+    {
+        vb.bind(pass, layout);
+        m_pData->geometry->bind_indices(pass);
+        return;
+    }
     for(const auto& m: m_pData->mods)
         if(layout & m->layout())
             m->apply(pass);
-    m_pData->geometry->apply(pass);
-    
-    //pass->layout(0);
+    m_pData->geometry->bind(pass);
+}
+
+void Mesh :: draw_geometry(Pass* pass) const
+{
+    const auto& lods = m_pData->lods;
+    if(m_LOD && m_LOD <= lods.size())
+    {
+        const MeshLOD* lod = lods[m_LOD - 1].get();
+        lod->bind(pass);
+        lod->draw(pass);
+        return;
+    }
+    // a level may have left its indices in the vertex array
+    if(not lods.empty())
+        m_pData->geometry->bind_indices(pass);
+    m_pData->geometry->draw(pass);
+}
+
+const void* Mesh :: render_instance_key() const
+{
+    if(empty() || not self_visible())
+        return nullptr;
+    // only meshes drawn at the same level batch together
+    if(m_LOD && m_LOD <= m_pData->lods.size())
+        return m_pData->lods[m_LOD - 1].get();
+    return m_pData.get();
+}
+
+float Mesh :: s_LODBias = 1.0f;
+
+void Mesh :: select_lod(const Camera* camera) const
+{
+    const auto& lods = m_pData->lods;
+    if(lods.empty() || not camera) {
+        m_LOD = 0;
+        return;
+    }
+    m_LOD = std::min<unsigned>(m_LOD, lods.size());
+
+    // pixels per model unit at the box's nearest point
+    const Box& local = m_pData->box;
+    const Box& world = world_box();
+    if(not local || not world) {
+        m_LOD = 0;
+        return;
+    }
+    float local_size = length(local.max() - local.min());
+    float world_size = length(world.max() - world.min());
+    float scale = local_size > 0.0f ? world_size / local_size : 1.0f;
+    const mat4& proj = camera->projection();
+    float pixels = proj[1][1] * 0.5f * camera->size().y * scale;
+    if(not camera->is_ortho())
+    {
+        vec3 center = (world.min() + world.max()) * 0.5f;
+        float depth = -(camera->view() * vec4(center, 1.0f)).z;
+        pixels /= std::max(depth - world_size * 0.5f, camera->znear());
+    }
+
+    // move a level only once it's well past the threshold, so a mesh
+    // sitting at the boundary doesn't flip every frame
+    const float HYSTERESIS = 0.25f;
+    const float threshold = s_LODBias;
+    auto error = [&lods, pixels](unsigned level) {
+        return level ? lods[level - 1]->error() * pixels : 0.0f;
+    };
+    while(m_LOD && error(m_LOD) > threshold * (1.0f + HYSTERESIS))
+        --m_LOD;
+    while(m_LOD < lods.size() && error(m_LOD + 1) < threshold * (1.0f - HYSTERESIS))
+        ++m_LOD;
+}
+
+void Mesh :: rasterize_occluder(OcclusionBuffer* buf) const
+{
+    const IMeshGeometry* geometry = m_pOccluder ?
+        m_pOccluder.get() : m_pData->geometry.get();
+    if(not geometry)
+        return;
+    buf->rasterize(
+        *matrix_c(Space::WORLD),
+        geometry->vertex_data(), geometry->vertex_count(),
+        geometry->index_data(), geometry->index_count()
+    );
+}
+
+void Mesh :: render_instances(
+    Pass* pass,
+    const Node* const* nodes,
+    unsigned count
+) const {
+    Pipeline* pipeline = pass->pipeline();
+    if(count < 2 || not pipeline->begin_instances(pass, nodes, count)) {
+        Node::render_instances(pass, nodes, count);
+        return;
+    }
+
+    for(unsigned i = 0; i < count; ++i) {
+        nodes[i]->before_render(pass);
+        nodes[i]->before_render_self(pass);
+    }
+    render_self(pass);
+    for(unsigned i = 0; i < count; ++i) {
+        nodes[i]->after_render_self(pass);
+        nodes[i]->after_render(pass);
+    }
+
+    pipeline->end_instances(pass);
+}
+
+unsigned Mesh :: render_texture_id() const
+{
+    if(not m_pData->material || not m_pData->material->texture())
+        return 0;
+    return m_pData->material->texture()->id();
+}
+
+unsigned Mesh :: render_buffer_id() const
+{
+    if(not m_pData->geometry)
+        return 0;
+    if(m_pData->vertex_buffer.ready())
+        return m_pData->vertex_buffer.render_id();
+    return m_pData->geometry->buffer_id();
 }
 
 bool Mesh :: bake_one(
@@ -1873,6 +2408,7 @@ std::shared_ptr<Mesh> Mesh :: line(glm::vec3 start, glm::vec3 end, shared_ptr<Te
         },
         make_shared<MeshMaterial>(tex)
     );
+    mesh->dynamic(true);
     mesh->position(start);
     auto len = glm::length(v);
     v = normalize(v);
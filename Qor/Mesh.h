@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <memory>
+#include <cstdint>
 #include "kit/math/common.h"
 #include "IRenderable.h"
 #include "Common.h"
@@ -56,6 +57,18 @@ class IMeshModifier:
             return 0;
         }
 
+        // vertex buffer, or 0 if not cached
+        virtual unsigned buffer_id() const { return 0; }
+
+        /*
+         * CPU-side per-vertex data, used to interleave all of a mesh's
+         * attributes into one buffer: floats per vertex (0 for modifiers
+         * without a vertex attribute), data and vertex count
+         */
+        virtual unsigned components() const { return 0; }
+        virtual const float* vertex_data() const { return nullptr; }
+        virtual size_t vertex_count() const { return 0; }
+
         virtual ~IMeshModifier() {}
     private:
 
@@ -73,6 +86,26 @@ class IMeshGeometry:
         virtual bool empty() const { return true; }
         virtual bool indexed() const = 0;
         virtual size_t size() const = 0;
+
+        /*
+         * apply() split in two: bind() sets up the vertex (and index)
+         * buffers for a vertex array, draw() issues the draw call
+         */
+        virtual void bind(Pass* pass) const {}
+        virtual void draw(Pass* pass) const {}
+
+        /*
+         * Index buffer only, for geometry whose vertices are interleaved
+         * into the mesh's vertex buffer
+         */
+        virtual void cache_indices(Pipeline* pipeline) const {}
+        virtual void bind_indices(Pass* pass) const {
+            pass->element_buffer(0);
+        }
+
+        // CPU-side indices (3 per triangle), null if not indexed
+        virtual const unsigned* index_data() const { return nullptr; }
+        virtual size_t index_count() const { return 0; }
         
         //virtual std::vector<glm::vec3>& indices() {
         //    return glm::uvec3();
@@ -109,6 +142,8 @@ class MeshGeometry:
 
         //virtual void pre_apply(Pass* pass) const override;
         virtual void apply(Pass* pass) const override;
+        virtual void bind(Pass* pass) const override;
+        virtual void draw(Pass* pass) const override;
         virtual void cache(Pipeline* pipeline) const override;
         virtual void clear_cache() override;
         //virtual std::vector<glm::vec3>& verts() {
@@ -127,6 +162,12 @@ class MeshGeometry:
         virtual bool empty() const override { return m_Vertices.empty(); }
         virtual bool indexed() const override { return false;}
         virtual size_t size() const override { return m_Vertices.size(); }
+        virtual unsigned buffer_id() const override { return m_VertexBuffer; }
+        virtual unsigned components() const override { return 3; }
+        virtual const float* vertex_data() const override {
+            return m_Vertices.empty() ? nullptr : &m_Vertices[0][0];
+        }
+        virtual size_t vertex_count() const override { return m_Vertices.size(); }
         
     private:
         mutable unsigned int m_VertexBuffer = 0;
@@ -166,7 +207,11 @@ class MeshIndexedGeometry:
         }
         
         virtual void apply(Pass* pass) const override;
+        virtual void bind(Pass* pass) const override;
+        virtual void draw(Pass* pass) const override;
         virtual void cache(Pipeline* pipeline) const override;
+        virtual void cache_indices(Pipeline* pipeline) const override;
+        virtual void bind_indices(Pass* pass) const override;
         virtual void clear_cache() override;
         virtual bool indexed() const override { return true; }
         
@@ -184,6 +229,16 @@ class MeshIndexedGeometry:
         
         virtual bool empty() const override { return m_Indices.empty(); }
         virtual size_t size() const override { return m_Indices.size(); }
+        virtual unsigned buffer_id() const override { return m_VertexBuffer; }
+        virtual unsigned components() const override { return 3; }
+        virtual const float* vertex_data() const override {
+            return m_Vertices.empty() ? nullptr : &m_Vertices[0][0];
+        }
+        virtual size_t vertex_count() const override { return m_Vertices.size(); }
+        virtual const unsigned* index_data() const override {
+            return m_Indices.empty() ? nullptr : &m_Indices[0][0];
+        }
+        virtual size_t index_count() const override { return 3 * m_Indices.size(); }
 
     private:
         // TODO: these are just placholders, finish this
@@ -222,6 +277,7 @@ class MeshMaterial
         }
 
         ITexture* texture() { return m_pTexture.get(); }
+        const ITexture* texture() const { return m_pTexture.get(); }
         void ambient(Color c) { m_Ambient = c; }
         Color ambient() const { return m_Ambient; }
         void diffuse(Color c) { m_Diffuse = c; }
@@ -288,12 +344,14 @@ class Wrap:
             m_UV(uv)
         {}
         Wrap(const Wrap& rhs):
-            m_UV(rhs.m_UV)
+            m_UV(rhs.m_UV),
+            m_Region(rhs.m_Region)
             // don't copy VBO id, since content will be changing
         {}
         virtual ~Wrap() {clear_cache();}
         Wrap(Wrap&& rhs):
-            m_UV(rhs.m_UV)
+            m_UV(rhs.m_UV),
+            m_Region(rhs.m_Region)
         {
             m_VertexBuffer = 0;
         }
@@ -307,13 +365,32 @@ class Wrap:
         }
 
         virtual unsigned layout() const override;
+        virtual unsigned buffer_id() const override { return m_VertexBuffer; }
+        virtual unsigned components() const override { return 2; }
+        virtual const float* vertex_data() const override {
+            return m_UV.empty() ? nullptr : &m_UV[0][0];
+        }
+        virtual size_t vertex_count() const override { return m_UV.size(); }
 
         void append(std::vector<glm::vec2> data);
+
+        /*
+         * Moves the UVs into a texture region (ITexture::region()), for
+         * textures inside an atlas.  UVs spanning more than one repeat
+         * of the texture can't be moved and are left alone, and repeats()
+         * tells the mesh to draw from the image's own texture instead.
+         */
+        void region(const glm::vec4& r);
+        const glm::vec4& region() const { return m_Region; }
+        bool repeats() const { return m_bRepeats; }
         
     private:
         mutable unsigned int m_VertexBuffer = 0;
         //mutable bool m_bNeedsCache = false;
         std::vector<glm::vec2> m_UV;
+        glm::vec4 m_Region = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+        // refused a region, UVs tile the texture
+        bool m_bRepeats = false;
         //mutable VertexBuffer m_Buffer;
 };
 
@@ -346,6 +423,12 @@ class MeshColors:
         }
 
         virtual unsigned layout() const override;
+        virtual unsigned buffer_id() const override { return m_VertexBuffer; }
+        virtual unsigned components() const override { return 4; }
+        virtual const float* vertex_data() const override {
+            return m_Colors.empty() ? nullptr : &m_Colors[0][0];
+        }
+        virtual size_t vertex_count() const override { return m_Colors.size(); }
         
     private:
         mutable unsigned int m_VertexBuffer = 0;
@@ -381,6 +464,12 @@ class MeshFade:
         }
 
         virtual unsigned layout() const override;
+        virtual unsigned buffer_id() const override { return m_VertexBuffer; }
+        virtual unsigned components() const override { return 1; }
+        virtual const float* vertex_data() const override {
+            return m_Fade.empty() ? nullptr : &m_Fade[0];
+        }
+        virtual size_t vertex_count() const override { return m_Fade.size(); }
         
     private:
         mutable unsigned int m_VertexBuffer = 0;
@@ -415,6 +504,12 @@ class MeshTangents:
         }
 
         virtual unsigned layout() const override;
+        virtual unsigned buffer_id() const override { return m_VertexBuffer; }
+        virtual unsigned components() const override { return 4; }
+        virtual const float* vertex_data() const override {
+            return m_Tangents.empty() ? nullptr : &m_Tangents[0][0];
+        }
+        virtual size_t vertex_count() const override { return m_Tangents.size(); }
         
     private:
         mutable unsigned int m_VertexBuffer = 0;
@@ -447,6 +542,12 @@ class MeshBinormals:
         }
 
         virtual unsigned layout() const override;
+        virtual unsigned buffer_id() const override { return m_VertexBuffer; }
+        virtual unsigned components() const override { return 4; }
+        virtual const float* vertex_data() const override {
+            return m_Binormals.empty() ? nullptr : &m_Binormals[0][0];
+        }
+        virtual size_t vertex_count() const override { return m_Binormals.size(); }
         
     private:
         mutable unsigned int m_VertexBuffer = 0;
@@ -481,6 +582,12 @@ class MeshNormals:
         }
 
         virtual unsigned layout() const override;
+        virtual unsigned buffer_id() const override { return m_VertexBuffer; }
+        virtual unsigned components() const override { return 3; }
+        virtual const float* vertex_data() const override {
+            return m_Normals.empty() ? nullptr : &m_Normals[0][0];
+        }
+        virtual size_t vertex_count() const override { return m_Normals.size(); }
         
     private:
         mutable unsigned int m_VertexBuffer = 0;
@@ -488,6 +595,264 @@ class MeshNormals:
 };
 
 
+/*
+ *  Vertex array objects of a Mesh::Data, one per (shader slot, attribute
+ *  layout) it was drawn with.  Copies start out empty, since the GL
+ *  objects can't be shared.
+ */
+class MeshVertexArrays
+{
+    public:
+        MeshVertexArrays() = default;
+        MeshVertexArrays(const MeshVertexArrays&) {}
+        MeshVertexArrays(MeshVertexArrays&& rhs):
+            m_Arrays(std::move(rhs.m_Arrays))
+        {
+            rhs.m_Arrays.clear();
+        }
+        MeshVertexArrays& operator=(const MeshVertexArrays&) {
+            clear();
+            return *this;
+        }
+        MeshVertexArrays& operator=(MeshVertexArrays&& rhs) {
+            clear();
+            std::swap(m_Arrays, rhs.m_Arrays);
+            return *this;
+        }
+        ~MeshVertexArrays() { clear(); }
+
+        // vertex array for shader and layout, or 0 if not built yet
+        unsigned find(unsigned shader, unsigned layout) const;
+        void add(unsigned shader, unsigned layout, unsigned id);
+        void clear();
+        bool empty() const { return m_Arrays.empty(); }
+
+    private:
+        struct Entry
+        {
+            unsigned shader;
+            unsigned layout;
+            unsigned id;
+        };
+        std::vector<Entry> m_Arrays;
+};
+
+/*
+ *  All vertex attributes of a Mesh::Data (geometry and modifiers)
+ *  interleaved into a single buffer, described by a stride and the
+ *  offset and GL type of each attribute.  Built at cache time from the
+ *  modifiers' CPU-side data, which stays the editing API.
+ *
+ *  Meshes whose attributes don't all have one value per vertex can't be
+ *  interleaved; those keep a buffer per modifier (id() stays 0).
+ *  Copies start out empty, but keep the format.
+ *
+ *  Dynamic buffers (marked so, or rebuilt on several frames close together
+ *  and small enough for the ring) keep their packed data on the CPU and
+ *  stream() it into the StreamBuffer ring on each frame they are drawn,
+ *  instead of recreating a GL buffer whenever they change.
+ */
+class MeshVertexBuffer
+{
+    public:
+
+        /*
+         * Vertex formats (flags)
+         *   COMPACT: normals, tangents and binormals as normalized
+         *     2_10_10_10 ints, UVs as half floats and colors as unorm8
+         *     (converted by GL, needs GL 3.3)
+         *   COMPACT_POSITIONS: positions as unorm16 relative to the
+         *     mesh bounds, decoded by the shader's PositionScale and
+         *     PositionOffset uniforms
+         */
+        enum Format
+        {
+            FULL = 0,
+            COMPACT = kit::bit(0),
+            COMPACT_POSITIONS = kit::bit(1),
+            DEFAULT_FORMAT = ~0u // use default_format()
+        };
+
+        struct Attribute
+        {
+            unsigned id; // Pipeline::AttributeID
+            unsigned components;
+            unsigned type; // GL type
+            bool normalized;
+            unsigned offset; // bytes
+        };
+
+        // interleaved buffers alive, and what they'd take as floats
+        struct Stats
+        {
+            unsigned buffers = 0;
+            size_t bytes = 0;
+            size_t float_bytes = 0;
+            size_t saved() const { return float_bytes - bytes; }
+        };
+
+        MeshVertexBuffer() = default;
+        MeshVertexBuffer(const MeshVertexBuffer& rhs):
+            m_Format(rhs.m_Format),
+            m_bDynamic(rhs.m_bDynamic)
+        {}
+        MeshVertexBuffer& operator=(const MeshVertexBuffer& rhs) {
+            clear();
+            release();
+            m_Format = rhs.m_Format;
+            m_bDynamic = rhs.m_bDynamic;
+            return *this;
+        }
+        ~MeshVertexBuffer() {
+            clear();
+            release();
+        }
+
+        // false if geometry or modifiers changed since the last build()
+        bool current(
+            const IMeshGeometry* geometry,
+            const std::vector<std::shared_ptr<IMeshModifier>>& mods
+        ) const;
+
+        // GL thread only
+        void build(
+            const IMeshGeometry* geometry,
+            const std::vector<std::shared_ptr<IMeshModifier>>& mods
+        );
+
+        /*
+         * Binds the buffer and points the attributes in layout
+         * (Pipeline::AttributeFlags) at it
+         */
+        void bind(Pass* pass, unsigned layout) const;
+
+        /*
+         * Writes streamed data for this frame if it isn't yet (GL thread,
+         * before bind())
+         */
+        void stream();
+
+        void clear();
+
+        // GL buffer of a static build (0 if streamed or not interleaved)
+        unsigned id() const { return m_ID; }
+        bool streamed() const { return m_bStreamed; }
+        // interleaved, either way
+        bool ready() const { return m_bStreamed || m_ID; }
+        // buffer bind() uses (the ring, when streamed)
+        unsigned render_id() const;
+
+        // stream from the first build on; takes effect on the next build()
+        bool dynamic() const { return m_bDynamic; }
+        void dynamic(bool b) {
+            m_bDynamic = b;
+            m_bBuilt = false;
+        }
+        unsigned stride() const { return m_Stride; }
+        unsigned layout() const { return m_Layout; }
+        const std::vector<Attribute>& attributes() const { return m_Attributes; }
+
+        // position = attribute * scale + offset
+        const glm::vec3& position_scale() const { return m_PositionScale; }
+        const glm::vec3& position_offset() const { return m_PositionOffset; }
+
+        // takes effect on the next build()
+        unsigned format() const;
+        void format(unsigned f) {
+            m_Format = f;
+            m_bBuilt = false;
+        }
+
+        // format of meshes left at DEFAULT_FORMAT (settings.json:
+        // video.vertex-format = "full", "compact" or "compact-positions")
+        static unsigned default_format() { return s_DefaultFormat; }
+        static void default_format(unsigned f) { s_DefaultFormat = f; }
+
+        static const Stats& stats() { return s_Stats; }
+
+    private:
+
+        // what build() saw of each attribute source
+        struct Source
+        {
+            const IMeshModifier* mod;
+            const float* data;
+            size_t count;
+            bool operator==(const Source& rhs) const {
+                return mod == rhs.mod && data == rhs.data && count == rhs.count;
+            }
+        };
+
+        static Source source(const IMeshModifier* mod);
+
+        // deletes the overflow buffer, which clear() keeps
+        void release();
+
+        unsigned m_ID = 0;
+        unsigned m_Stride = 0;
+        unsigned m_Layout = 0;
+        unsigned m_Format = DEFAULT_FORMAT;
+        size_t m_Bytes = 0;
+        size_t m_FloatBytes = 0;
+        glm::vec3 m_PositionScale = glm::vec3(1.0f);
+        glm::vec3 m_PositionOffset = glm::vec3(0.0f);
+        std::vector<Attribute> m_Attributes;
+        std::vector<Source> m_Sources;
+        bool m_bBuilt = false;
+
+        // streaming
+        bool m_bDynamic = false;
+        bool m_bStreamed = false;
+        // frame_id() of the last build, and builds in a row that came
+        // within a few frames of the one before
+        unsigned m_LastBuild = ~0u;
+        unsigned m_Rebuilds = 0;
+        std::vector<uint8_t> m_Data;
+        unsigned m_StreamFrame = ~0u;
+        unsigned m_StreamOffset = 0;
+        // data that didn't fit the ring is orphaned into a buffer of
+        // its own, kept across builds
+        unsigned m_OverflowID = 0;
+        bool m_bOverflow = false;
+
+        static unsigned s_DefaultFormat;
+        static Stats s_Stats;
+};
+
+/*
+ *  A simplified level of a Mesh::Data: an index list over the same
+ *  vertices as the full geometry (see Simplifier), so it draws from the
+ *  mesh's own vertex buffer and attributes with a smaller element buffer.
+ */
+class MeshLOD
+{
+    public:
+        MeshLOD(std::vector<unsigned> indices, float error):
+            m_Indices(std::move(indices)),
+            m_Error(error)
+        {}
+        MeshLOD(const MeshLOD&) = delete;
+        MeshLOD& operator=(const MeshLOD&) = delete;
+        ~MeshLOD() { clear_cache(); }
+
+        void cache(Pipeline* pipeline) const;
+        void clear_cache();
+
+        // binds the element buffer, after the mesh's vertex data
+        void bind(Pass* pass) const;
+        void draw(Pass* pass) const;
+
+        // largest distance from the full geometry, in model units
+        float error() const { return m_Error; }
+        size_t triangles() const { return m_Indices.size() / 3; }
+        const std::vector<unsigned>& indices() const { return m_Indices; }
+
+    private:
+        mutable unsigned m_IndexBuffer = 0;
+        std::vector<unsigned> m_Indices;
+        float m_Error;
+};
+
 /*
  *  A mesh that can share attributes/modifiers as between other meshes
  *  It can be used as a unique mesh, an instance, or an instance with different
@@ -537,12 +902,27 @@ class Mesh:
                 std::string this_object,
                 std::string this_material
             );
+            // unit of a cooked .qmesh, false if the file doesn't have it
+            bool load_binary(
+                std::string fn,
+                std::string this_object,
+                std::string this_material
+            );
 
             static std::vector<std::string> decompose(
                 std::string fn,
                 Cache<Resource, std::string>*
             );
 
+            /*
+             * The material a unit ("file:object:material") will take from
+             * the cache, worked out without loading it
+             */
+            static std::vector<std::string> dependencies(
+                std::string fn,
+                Cache<Resource, std::string>* cache
+            );
+
             Box box;
             
             std::shared_ptr<IMeshGeometry> geometry;
@@ -550,11 +930,34 @@ class Mesh:
             std::shared_ptr<MeshMaterial> material;
             //std::string filename; // stored in Resource
             Cache<Resource, std::string>* cache = nullptr;
-            unsigned int vertex_array = 0;
+            // built on first draw, cleared whenever buffers are rebuilt
+            // or the modifier set changes
+            MeshVertexArrays vertex_arrays;
+            MeshVertexBuffer vertex_buffer;
+            // simplified levels, finest first, sharing geometry's vertices
+            std::vector<std::shared_ptr<MeshLOD>> lods;
 
             void calculate_tangents();
             void calculate_box();
             bool empty() const { return not geometry || geometry->empty(); }
+
+            // attributes, indices and detail levels, on the GPU once cached
+            virtual size_t cpu_bytes() const override;
+            virtual size_t gpu_bytes() const override;
+
+            /*
+             * Replaces lods with up to levels simplifications, each with
+             * about ratio of the triangles of the one before
+             */
+            void generate_lods(unsigned levels, float ratio = 0.5f);
+
+            // levels generated for loaded meshes (settings.json:
+            // video.lod-levels, 0 for none)
+            static unsigned lod_levels() { return s_LODLevels; }
+            static void lod_levels(unsigned n) { s_LODLevels = n; }
+
+            private:
+                static unsigned s_LODLevels;
         };
 
         Mesh() {
@@ -623,6 +1026,43 @@ class Mesh:
         void clear_cache() const;
         void cache(Pipeline* pipeline) const;
         virtual void render_self(Pass* pass) const override;
+        virtual const void* render_instance_key() const override;
+        virtual void render_instances(
+            Pass* pass,
+            const Node* const* nodes,
+            unsigned count
+        ) const override;
+        virtual unsigned render_texture_id() const override;
+        virtual unsigned render_buffer_id() const override;
+
+        /*
+         * Hides what is behind it from occlusion culling, drawn with its
+         * own geometry or a simpler proxy (e.g. a wall's inner box)
+         */
+        bool occluder() const { return m_bOccluder; }
+        void occluder(bool b) { m_bOccluder = b; }
+        void occluder(std::shared_ptr<IMeshGeometry> proxy) {
+            m_pOccluder = proxy;
+            m_bOccluder = (bool)proxy;
+        }
+        virtual bool is_occluder() const override {
+            return m_bOccluder && not empty();
+        }
+        virtual void rasterize_occluder(OcclusionBuffer* buf) const override;
+
+        /*
+         * Picks the coarsest level whose error projects to under
+         * lod_bias() pixels, with some slack around the switch so
+         * levels don't flicker at the boundary
+         */
+        virtual void select_lod(const Camera* camera) const override;
+        // 0 is the full geometry, n is Data::lods[n-1]
+        unsigned lod() const { return m_LOD; }
+
+        // pixels of error allowed, higher is coarser (settings.json:
+        // video.lod-bias)
+        static float lod_bias() { return s_LODBias; }
+        static void lod_bias(float f) { s_LODBias = f; }
 
         void clear_modifiers() {
             clear_cache();
@@ -645,6 +1085,9 @@ class Mesh:
         void set_geometry(std::shared_ptr<IMeshGeometry> geometry) {
             // ref-count will clean up old geometry
             m_pData->geometry = geometry;
+            m_pData->vertex_arrays.clear();
+            m_pData->lods.clear();
+            m_LOD = 0;
             update();
         }
 
@@ -654,6 +1097,7 @@ class Mesh:
 
         void add_modifier(std::shared_ptr<IMeshModifier> mod) {
             m_pData->mods.push_back(mod);
+            m_pData->vertex_arrays.clear();
         }
         
         void swap_material(std::string from, std::string to, Cache<Resource, std::string>* cache);
@@ -664,6 +1108,22 @@ class Mesh:
             m_pData->material = mat;
         }
 
+        // MeshVertexBuffer::Format of the (shared) mesh data
+        unsigned vertex_format() const {
+            return m_pData->vertex_buffer.format();
+        }
+        void vertex_format(unsigned f) {
+            m_pData->vertex_buffer.format(f);
+        }
+
+        // hint that the mesh data changes often (see MeshVertexBuffer)
+        bool dynamic() const {
+            return m_pData->vertex_buffer.dynamic();
+        }
+        void dynamic(bool b) {
+            m_pData->vertex_buffer.dynamic(b);
+        }
+
         /*
          *  Specify a new origin for the mesh
          */
@@ -899,6 +1359,13 @@ class Mesh:
         
     private:
 
+        // points the attributes in layout at this mesh's vertex data
+        void bind_attributes(Pass* pass, unsigned layout) const;
+        // draws the selected level
+        void draw_geometry(Pass* pass) const;
+
+        static float s_LODBias;
+
         mutable std::shared_ptr<Data> m_pData;
 
         // if null, mesh is single
@@ -915,6 +1382,9 @@ class Mesh:
 
         bool m_bHasInertia = true;
         bool m_bBakeable = false;
+        bool m_bOccluder = false;
+        std::shared_ptr<IMeshGeometry> m_pOccluder;
+        mutable unsigned m_LOD = 0;
         float m_Mass = 0.0f;
         float m_Friction = -1.0f;
 };
@@ -0,0 +1,178 @@
+#include "MeshFile.h"
+#include "Filesystem.h"
+#include "AssetManifest.h"
+#include "kit/log/errors.h"
+#include "kit/log/log.h"
+#include "kit/kit.h"
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <map>
+#include <mutex>
+using namespace std;
+namespace fs = boost::filesystem;
+
+const uint32_t MeshFile :: VERSION;
+
+namespace {
+
+    const char MAGIC[4] = {'Q','M','S','H'};
+    const size_t HEADER_SIZE = 4 * sizeof(uint32_t);
+    const size_t UNIT_SIZE = 16 * sizeof(uint32_t);
+
+    bool little_endian() {
+        const uint16_t one = 1;
+        return *(const uint8_t*)&one == 1;
+    }
+
+    // mappings shared by open()
+    mutex s_Mutex;
+    map<string, weak_ptr<MeshFile>> s_Files;
+    shared_ptr<MeshFile> s_pLast;
+
+}
+
+MeshFile :: MeshFile(const string& fn):
+    m_Filename(fn)
+{
+    if(not little_endian())
+        K_ERRORf(READ, "%s (big-endian host)", Filesystem::getFileName(fn));
+    try{
+        m_Time = fs::last_write_time(fs::path(fn));
+    }catch(const fs::filesystem_error&){}
+    m_pFile = kit::make_unique<MappedFile>(fn);
+    m_pData = m_pFile->data();
+    m_Size = m_pFile->size();
+    parse();
+}
+
+MeshFile :: ~MeshFile() {}
+
+void MeshFile :: parse()
+{
+    auto name = Filesystem::getFileName(m_Filename);
+    auto u32 = [this](size_t offset) -> uint32_t {
+        uint32_t r;
+        memcpy(&r, m_pData + offset, sizeof(r));
+        return r;
+    };
+
+    if(m_Size < HEADER_SIZE || memcmp(m_pData, MAGIC, sizeof(MAGIC)) != 0)
+        K_ERRORf(PARSE, "%s (not a qmesh)", name);
+    if(u32(4) != VERSION)
+        K_ERRORf(PARSE, "%s (qmesh version %s, expected %s)", name % u32(4) % VERSION);
+    size_t count = u32(8);
+    if(count > (m_Size - HEADER_SIZE) / UNIT_SIZE)
+        K_ERRORf(PARSE, "%s (truncated unit table)", name);
+
+    // offset and size of something in the file, in bytes
+    auto range = [&](size_t offset, size_t bytes) -> const char* {
+        if(offset > m_Size || bytes > m_Size - offset)
+            K_ERRORf(PARSE, "%s (block past end of file)", name);
+        return m_pData + offset;
+    };
+    auto str = [&](size_t entry) -> string {
+        size_t offset = u32(entry), size = u32(entry + 4);
+        return string(range(offset, size), size);
+    };
+    auto block = [&](size_t entry, size_t elem_size, size_t& size) -> const char* {
+        size_t offset = u32(entry);
+        size = u32(entry + 4);
+        if(size && offset % 16)
+            K_ERRORf(PARSE, "%s (unaligned block)", name);
+        return range(offset, size * elem_size);
+    };
+
+    m_Units.resize(count);
+    for(size_t i = 0; i < count; ++i)
+    {
+        size_t entry = HEADER_SIZE + i * UNIT_SIZE;
+        Unit& unit = m_Units[i];
+        unit.name = str(entry);
+        unit.material = str(entry + 8);
+        unit.indices.data = (const glm::uvec3*)block(
+            entry + 16, sizeof(glm::uvec3), unit.indices.size
+        );
+        unit.vertices.data = (const glm::vec3*)block(
+            entry + 24, sizeof(glm::vec3), unit.vertices.size
+        );
+        unit.wrap.data = (const glm::vec2*)block(
+            entry + 32, sizeof(glm::vec2), unit.wrap.size
+        );
+        unit.normals.data = (const glm::vec3*)block(
+            entry + 40, sizeof(glm::vec3), unit.normals.size
+        );
+        unit.tangents.data = (const glm::vec4*)block(
+            entry + 48, sizeof(glm::vec4), unit.tangents.size
+        );
+        unit.fade.data = (const float*)block(
+            entry + 56, sizeof(float), unit.fade.size
+        );
+        for(const glm::uvec3& tri: unit.indices)
+            if(tri.x >= unit.vertices.size ||
+                tri.y >= unit.vertices.size ||
+                tri.z >= unit.vertices.size)
+            {
+                K_ERRORf(PARSE, "%s (index out of range in %s)", name % unit.name);
+            }
+    }
+}
+
+shared_ptr<MeshFile> MeshFile :: open(const string& fn)
+{
+    auto l = unique_lock<mutex>(s_Mutex);
+    auto& file = s_Files[fn];
+    auto r = file.lock();
+    if(r) {
+        // recooked since it was mapped
+        try{
+            if(fs::last_write_time(fs::path(fn)) != r->time())
+                r.reset();
+        }catch(const fs::filesystem_error&){}
+    }
+    if(not r) {
+        r = make_shared<MeshFile>(fn);
+        file = r;
+    }
+    s_pLast = r;
+    return r;
+}
+
+void MeshFile :: forget()
+{
+    shared_ptr<MeshFile> last;
+    auto l = unique_lock<mutex>(s_Mutex);
+    // unmapped outside the lock
+    swap(last, s_pLast);
+    l.unlock();
+}
+
+bool MeshFile :: is_container(const string& fn)
+{
+    return Filesystem::getExtension(fn) == "qmesh";
+}
+
+string MeshFile :: cooked(const string& fn)
+{
+    if(is_container(fn))
+        return string();
+    string cfn = Filesystem::cutExtension(fn) + ".qmesh";
+    if(not AssetManifest::get()->exists(cfn))
+        return string();
+    // edited since it was cooked
+    try{
+        if(fs::last_write_time(fs::path(cfn)) < fs::last_write_time(fs::path(fn)))
+            return string();
+    }catch(const fs::filesystem_error&){
+        return string();
+    }
+    return cfn;
+}
+
+const MeshFile::Unit* MeshFile :: unit(const string& name) const
+{
+    for(auto&& u: m_Units)
+        if(u.name == name)
+            return &u;
+    return nullptr;
+}
+
@@ -0,0 +1,109 @@
+#ifndef _MESHFILE_H_R3WQ8N1E
+#define _MESHFILE_H_R3WQ8N1E
+
+#include "MappedFile.h"
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ctime>
+
+/*
+ *  A cooked mesh file (.qmesh), mapped into memory read only (see
+ *  MappedFile).
+ *
+ *  Holds every mesh unit of an OBJ or JSON scene ("object:material"),
+ *  each as raw little-endian attribute blocks that are used as they are,
+ *  without parsing:
+ *
+ *      header      "QMSH", version, unit count, 0             (u32 x 4)
+ *      unit table  per unit: name and material (offset, size), then
+ *                  indices, vertices, wrap, normals, tangents and fade
+ *                  (offset, count)                            (u32 x 16)
+ *      strings
+ *      blocks      16 byte aligned uvec3, vec3, vec2, vec3, vec4, float
+ *
+ *  Written by util/blender/io_scene_qor/qmesh.py, which also converts
+ *  existing OBJ and JSON files.
+ *
+ *  Pure CPU, no GL context needed.
+ */
+class MeshFile
+{
+    public:
+
+        static const uint32_t VERSION = 1;
+
+        template<class T>
+        struct Block
+        {
+            const T* data = nullptr;
+            size_t size = 0;
+
+            const T* begin() const { return data; }
+            const T* end() const { return data + size; }
+            bool empty() const { return size == 0; }
+        };
+
+        struct Unit
+        {
+            std::string name;
+            // resource the unit is textured with, or empty
+            std::string material;
+
+            Block<glm::uvec3> indices;
+            Block<glm::vec3> vertices;
+            Block<glm::vec2> wrap;
+            Block<glm::vec3> normals;
+            Block<glm::vec4> tangents;
+            Block<float> fade;
+        };
+
+        // throws (READ or PARSE) on files it can't use
+        explicit MeshFile(const std::string& fn);
+        ~MeshFile();
+
+        MeshFile(const MeshFile&) = delete;
+        MeshFile& operator=(const MeshFile&) = delete;
+
+        /*
+         * Shares the mapping of fn with anyone else reading it, so the
+         * units of one file loading together map and check it once.  The
+         * last file opened stays mapped until another is (or forget()).
+         */
+        static std::shared_ptr<MeshFile> open(const std::string& fn);
+        static void forget();
+
+        // files this loads
+        static bool is_container(const std::string& fn);
+
+        /*
+         * Cooked file next to a mesh (foo.qmesh for foo.obj or foo.json)
+         * that is at least as new as it, or an empty string
+         */
+        static std::string cooked(const std::string& fn);
+
+        const std::vector<Unit>& units() const { return m_Units; }
+
+        // unit named "object:material", or null
+        const Unit* unit(const std::string& name) const;
+
+        const std::string& filename() const { return m_Filename; }
+        std::time_t time() const { return m_Time; }
+
+    private:
+
+        void parse();
+
+        std::string m_Filename;
+        std::time_t m_Time = 0;
+        std::vector<Unit> m_Units;
+
+        std::unique_ptr<MappedFile> m_pFile;
+        const char* m_pData = nullptr;
+        size_t m_Size = 0;
+};
+
+#endif
+
@@ -288,6 +288,15 @@ void Node :: render(Pass* pass) const
     }
 }
 
+void Node :: render_instances(
+    Pass* pass,
+    const Node* const* nodes,
+    unsigned count
+) const {
+    for(unsigned i = 0; i < count; ++i)
+        nodes[i]->render(pass);
+}
+
 void Node :: logic(Freq::Time t)
 {
     if(m_bDetach) {
@@ -890,8 +899,20 @@ std::vector<const Node*> Node :: visible_nodes(Camera* camera) const
 
 std::vector<Node*> Node :: query(Box box, std::function<bool(Node*)> cond)
 {
-    assert(false);
-    return std::vector<Node*>();
+    // Brute force walk of the subtree.  For frequent queries over many
+    // nodes, index them with the partitioner and use its query() instead.
+    std::vector<Node*> r;
+    LoopCtrl lc = LC_STEP;
+    each([&](Node* n){
+        if(not n->world_box().collision(box)) {
+            if(n->skip_child_box_check())
+                lc = LC_SKIP;
+            return;
+        }
+        if(not cond || cond(n))
+            r.push_back(n);
+    }, Each::RECURSIVE, &lc);
+    return r;
 }
 
 bool Node :: bake_visible()
@@ -23,6 +23,7 @@
 
 class PhysicsObject;
 class Camera;
+class OcclusionBuffer;
 
 class Node:
     public Actuation,
@@ -97,6 +98,7 @@ class Node:
 
          // assumes bounding box completely contains children
         bool m_bSkipChildBoxCheck = false;
+        bool m_bTranslucent = false;
         
     protected:
 
@@ -352,6 +354,35 @@ class Node:
             RENDER_INDICATORS=kit::bit(3)
         };
         virtual void render_self(Pass* pass) const {}
+
+        /*
+         * State hints for the render queue, so visible nodes can be drawn
+         * grouped by state.  0 means no particular state.
+         */
+        virtual unsigned render_texture_id() const { return 0; }
+        virtual unsigned render_buffer_id() const { return 0; }
+
+        /*
+         * Nodes returning the same non-null key can be drawn together by
+         * one render_instances() call (e.g. meshes sharing mesh data).
+         */
+        virtual const void* render_instance_key() const { return nullptr; }
+
+        /*
+         * Draws nodes[0..count), which share this node's instance key.
+         * Render signals still fire for each node, but around the shared
+         * draw.  The default draws them one by one.
+         */
+        virtual void render_instances(
+            Pass* pass,
+            const Node* const* nodes,
+            unsigned count
+        ) const;
+
+        // translucent nodes are drawn back-to-front instead of by state
+        bool translucent() const { return m_bTranslucent; }
+        void translucent(bool b) { m_bTranslucent = b; }
+
         virtual void render(Pass* pass) const override;
         virtual void set_render_matrix(Pass* pass) const;
 
@@ -414,6 +445,15 @@ class Node:
         }
         
         virtual bool is_partitioner(Camera* camera) const { return false; }
+
+        /*
+         * Occluders are drawn into the partitioner's occlusion buffer, and
+         * visible nodes they hide are culled
+         */
+        virtual bool is_occluder() const { return false; }
+        virtual void rasterize_occluder(OcclusionBuffer* buf) const {}
+        // chooses a level of detail for this frame's view
+        virtual void select_lod(const Camera* camera) const {}
         virtual std::vector<const Node*> visible_nodes(Camera* camera) const;
         virtual std::vector<Node*> query(
             Box box,
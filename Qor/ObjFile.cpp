@@ -0,0 +1,363 @@
+#include "ObjFile.h"
+#include "MappedFile.h"
+#include "Filesystem.h"
+#include "kit/log/errors.h"
+#include "kit/log/log.h"
+#include <boost/filesystem.hpp>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <unordered_set>
+using namespace std;
+using namespace glm;
+namespace fs = boost::filesystem;
+
+namespace {
+
+    // position, wrap and normal of a face corner
+    struct Corner
+    {
+        float v[8];
+
+        bool operator==(const Corner& rhs) const {
+            return memcmp(v, rhs.v, sizeof(v)) == 0;
+        }
+    };
+
+    struct CornerHash
+    {
+        size_t operator()(const Corner& c) const {
+            uint64_t h = 1469598103934665603ULL;
+            for(float f: c.v) {
+                uint32_t bits;
+                memcpy(&bits, &f, sizeof(bits));
+                h = (h ^ bits) * 1099511628211ULL;
+            }
+            return size_t(h ^ (h >> 32));
+        }
+    };
+
+    // a unit being built, with its corners so far
+    struct Builder
+    {
+        ObjFile::Unit* unit;
+        unordered_map<Corner, unsigned, CornerHash> index;
+    };
+
+    // parses shared by open()
+    struct Entry
+    {
+        mutex m;
+        weak_ptr<ObjFile> file;
+    };
+    mutex s_Mutex;
+    map<string, shared_ptr<Entry>> s_Entries;
+    shared_ptr<ObjFile> s_pLast;
+
+    bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    const char* skip_space(const char* p, const char* end) {
+        while(p != end && is_space(*p))
+            ++p;
+        return p;
+    }
+
+    // next whitespace separated token
+    string token(const char*& p, const char* end) {
+        p = skip_space(p, end);
+        const char* start = p;
+        while(p != end && not is_space(*p))
+            ++p;
+        return string(start, p);
+    }
+
+    bool starts_with(const char* p, const char* end, const char* prefix) {
+        size_t n = strlen(prefix);
+        return size_t(end - p) >= n && memcmp(p, prefix, n) == 0;
+    }
+
+    // 1-based (or negative, from the end) OBJ index into size elements,
+    // false if there is none or it is out of range
+    bool parse_index(const char*& p, const char* end, size_t size, size_t& r) {
+        bool neg = false;
+        if(p != end && (*p == '-' || *p == '+'))
+            neg = *p++ == '-';
+        if(p == end || *p < '0' || *p > '9')
+            return false;
+        uint64_t i = 0;
+        for(; p != end && *p >= '0' && *p <= '9'; ++p)
+            if(i < size + 1)
+                i = i * 10 + (*p - '0');
+        if(i == 0 || i > size)
+            return false;
+        r = neg ? size - i : i - 1;
+        return true;
+    }
+
+}
+
+ObjFile :: ObjFile(const string& fn):
+    m_Filename(fn)
+{
+    MappedFile file(fn);
+    try{
+        m_Time = fs::last_write_time(fs::path(fn));
+    }catch(const fs::filesystem_error&){}
+    parse(file.begin(), file.end());
+}
+
+shared_ptr<ObjFile> ObjFile :: open(const string& fn)
+{
+    shared_ptr<Entry> entry;
+    {
+        auto l = unique_lock<mutex>(s_Mutex);
+        auto& e = s_Entries[fn];
+        if(not e)
+            e = make_shared<Entry>();
+        entry = e;
+    }
+
+    // loads of other files go on while this one parses
+    auto l = unique_lock<mutex>(entry->m);
+    auto r = entry->file.lock();
+    if(r) {
+        try{
+            if(fs::last_write_time(fs::path(fn)) != r->time())
+                r.reset();
+        }catch(const fs::filesystem_error&){}
+    }
+    if(not r) {
+        r = make_shared<ObjFile>(fn);
+        entry->file = r;
+    }
+    {
+        auto ml = unique_lock<mutex>(s_Mutex);
+        s_pLast = r;
+    }
+    return r;
+}
+
+void ObjFile :: forget()
+{
+    shared_ptr<ObjFile> last;
+    auto l = unique_lock<mutex>(s_Mutex);
+    // freed outside the lock
+    swap(last, s_pLast);
+    l.unlock();
+}
+
+const ObjFile::Unit* ObjFile :: unit(const string& name) const
+{
+    auto itr = m_Units.find(name);
+    if(itr == m_Units.end() || itr->second.faces.empty())
+        return nullptr;
+    return &itr->second;
+}
+
+float ObjFile :: parse_float(const char*& p, const char* end)
+{
+    static const float POW10[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+    };
+
+    p = skip_space(p, end);
+    const char* start = p;
+    bool neg = false;
+    if(p != end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+
+    uint64_t m = 0;
+    int e = 0;
+    bool digits = false;
+    // digits that didn't fit in m
+    bool lost = false;
+    for(; p != end && *p >= '0' && *p <= '9'; ++p) {
+        digits = true;
+        if(m < 100000000000000000ULL)
+            m = m * 10 + (*p - '0');
+        else {
+            ++e;
+            lost = true;
+        }
+    }
+    if(p != end && *p == '.') {
+        ++p;
+        for(; p != end && *p >= '0' && *p <= '9'; ++p) {
+            digits = true;
+            if(m < 100000000000000000ULL) {
+                m = m * 10 + (*p - '0');
+                --e;
+            } else
+                lost = true;
+        }
+    }
+    if(not digits) {
+        // not a number, skip it
+        while(p != end && not is_space(*p))
+            ++p;
+        return 0.0f;
+    }
+    if(p != end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        bool eneg = false;
+        if(q != end && (*q == '-' || *q == '+'))
+            eneg = *q++ == '-';
+        if(q != end && *q >= '0' && *q <= '9') {
+            int x = 0;
+            for(; q != end && *q >= '0' && *q <= '9'; ++q)
+                if(x < 10000)
+                    x = x * 10 + (*q - '0');
+            e += eneg ? -x : x;
+            p = q;
+        }
+    }
+
+    // exact in a float and scaled by an exact power of ten, so one
+    // correctly rounded operation (what strtof gives)
+    if(not lost && m < (1u << 24) && e >= -10 && e <= 10) {
+        float f = float(m);
+        f = e < 0 ? f / POW10[-e] : f * POW10[e];
+        return neg ? -f : f;
+    }
+
+    char buf[64];
+    size_t n = min<size_t>(p - start, sizeof(buf) - 1);
+    memcpy(buf, start, n);
+    buf[n] = '\0';
+    return strtof(buf, nullptr);
+}
+
+void ObjFile :: parse(const char* p, const char* end)
+{
+    vector<vec3> verts;
+    vector<vec2> wrap;
+    vector<vec3> normals;
+
+    unordered_map<string, Builder> builders;
+    unordered_set<string> named;
+    string object, material;
+    Builder* current = nullptr;
+    unsigned untriangulated = 0;
+
+    while(p != end)
+    {
+        const char* line_end = (const char*)memchr(p, '\n', end - p);
+        if(not line_end)
+            line_end = end;
+        const char* line = p;
+        p = line_end == end ? end : line_end + 1;
+
+        const char* q = skip_space(line, line_end);
+        if(q == line_end || *q == '#')
+            continue;
+
+        if(starts_with(line, line_end, "v ")) {
+            q = line + 2;
+            vec3 v;
+            v.x = parse_float(q, line_end);
+            v.y = parse_float(q, line_end);
+            v.z = parse_float(q, line_end);
+            verts.push_back(v);
+        }
+        else if(starts_with(line, line_end, "vt ")) {
+            q = line + 3;
+            vec2 v;
+            v.x = parse_float(q, line_end);
+            v.y = 1.0f - parse_float(q, line_end);
+            wrap.push_back(v);
+        }
+        else if(starts_with(line, line_end, "vn ")) {
+            q = line + 3;
+            vec3 v;
+            v.x = parse_float(q, line_end);
+            v.y = parse_float(q, line_end);
+            v.z = parse_float(q, line_end);
+            normals.push_back(v);
+        }
+        else if(starts_with(line, line_end, "f ")) {
+            if(not current) {
+                string name = object + ":" + material;
+                current = &builders[name];
+                current->unit = &m_Units[name];
+            }
+            unsigned index[4];
+            unsigned count = 0;
+            q = line + 2;
+            while(true)
+            {
+                q = skip_space(q, line_end);
+                if(q == line_end)
+                    break;
+                if(count == 4) {
+                    ++untriangulated;
+                    break;
+                }
+                // v/vt/vn, missing or bad ones are zero
+                Corner c = {};
+                size_t i;
+                if(parse_index(q, line_end, verts.size(), i))
+                    memcpy(c.v, &verts[i], sizeof(vec3));
+                if(q != line_end && *q == '/') {
+                    ++q;
+                    if(parse_index(q, line_end, wrap.size(), i))
+                        memcpy(c.v + 3, &wrap[i], sizeof(vec2));
+                }
+                if(q != line_end && *q == '/') {
+                    ++q;
+                    if(parse_index(q, line_end, normals.size(), i))
+                        memcpy(c.v + 5, &normals[i], sizeof(vec3));
+                }
+                while(q != line_end && not is_space(*q))
+                    ++q;
+                // -0 and 0 are the same corner
+                for(float& f: c.v)
+                    f += 0.0f;
+
+                Unit& unit = *current->unit;
+                auto ins = current->index.insert(make_pair(c, unsigned(unit.vertices.size())));
+                if(ins.second) {
+                    unit.vertices.push_back(vec3(c.v[0], c.v[1], c.v[2]));
+                    unit.wrap.push_back(vec2(c.v[3], c.v[4]));
+                    unit.normals.push_back(vec3(c.v[5], c.v[6], c.v[7]));
+                }
+                index[count++] = ins.first->second;
+            }
+            if(count < 3) {
+                ++untriangulated;
+                continue;
+            }
+            auto& faces = current->unit->faces;
+            faces.push_back(uvec3(index[0], index[1], index[2]));
+            // triangulate quad
+            if(count == 4)
+                faces.push_back(uvec3(index[2], index[3], index[0]));
+        }
+        else if(starts_with(line, line_end, "o ")) {
+            q = line + 2;
+            object = token(q, line_end);
+            current = nullptr;
+        }
+        else if(starts_with(line, line_end, "usemtl ")) {
+            q = line + 7;
+            material = token(q, line_end);
+            current = nullptr;
+            string name = object + ":" + material;
+            if(named.insert(name).second)
+                m_Names.push_back(name);
+        }
+        else if(starts_with(line, line_end, "mtllib ")) {
+            q = line + 7;
+            m_MtlLib = token(q, line_end);
+        }
+    }
+
+    if(untriangulated)
+        WARNINGf("%s faces in %s aren't triangles or quads",
+            untriangulated % Filesystem::getFileName(m_Filename)
+        );
+}
+
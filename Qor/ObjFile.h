@@ -0,0 +1,70 @@
+#ifndef _OBJFILE_H_T5MZ0C7J
+#define _OBJFILE_H_T5MZ0C7J
+
+#include <glm/glm.hpp>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+ *  A Wavefront OBJ file, parsed in one pass over the mapped file into
+ *  every object:material submesh it has.
+ *
+ *  Each submesh shares the vertices its faces repeat (same position,
+ *  wrap and normal), found by hashing, in the order they first appear.
+ *  Quads are split in two.
+ *
+ *  Pure CPU, no GL context needed.
+ */
+class ObjFile
+{
+    public:
+
+        struct Unit
+        {
+            std::vector<glm::vec3> vertices;
+            std::vector<glm::vec2> wrap;
+            std::vector<glm::vec3> normals;
+            std::vector<glm::uvec3> faces;
+        };
+
+        // throws (READ) if fn can't be opened
+        explicit ObjFile(const std::string& fn);
+
+        /*
+         * Shares the parse of fn with anyone else loading it, so a mesh's
+         * submeshes read the file once.  The last file opened stays
+         * parsed until another is (or forget()).
+         */
+        static std::shared_ptr<ObjFile> open(const std::string& fn);
+        static void forget();
+
+        // submesh of "object:material", or null if it has no faces
+        const Unit* unit(const std::string& name) const;
+
+        // "object:material" of each usemtl, in file order
+        const std::vector<std::string>& names() const { return m_Names; }
+
+        const std::string& mtllib() const { return m_MtlLib; }
+        const std::string& filename() const { return m_Filename; }
+        std::time_t time() const { return m_Time; }
+
+        // strtof's result (to the float) for the decimal in [p, end),
+        // moving p past it, 0 if there is none
+        static float parse_float(const char*& p, const char* end);
+
+    private:
+
+        void parse(const char* p, const char* end);
+
+        std::string m_Filename;
+        std::time_t m_Time = 0;
+        std::string m_MtlLib;
+        std::vector<std::string> m_Names;
+        std::unordered_map<std::string, Unit> m_Units;
+};
+
+#endif
+
@@ -0,0 +1,295 @@
+#include "OcclusionBuffer.h"
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define QOR_OCCLUSION_SSE2
+#endif
+using namespace std;
+using namespace glm;
+
+const unsigned OcclusionBuffer :: TILE;
+bool OcclusionBuffer :: s_bSIMD = true;
+
+OcclusionBuffer :: OcclusionBuffer(unsigned w, unsigned h)
+{
+    resize(w, h);
+}
+
+void OcclusionBuffer :: resize(unsigned w, unsigned h)
+{
+    m_TilesX = std::max(1u, (w + TILE - 1) / TILE);
+    m_TilesY = std::max(1u, (h + TILE - 1) / TILE);
+    m_Width = m_TilesX * TILE;
+    m_Height = m_TilesY * TILE;
+    m_Depth.assign(m_Width * m_Height, 1.0f);
+    m_TileMax.assign(m_TilesX * m_TilesY, 1.0f);
+}
+
+void OcclusionBuffer :: begin(const mat4& view_projection)
+{
+    m_Start = chrono::steady_clock::now();
+    m_ViewProjection = view_projection;
+    fill(m_Depth.begin(), m_Depth.end(), 1.0f);
+    fill(m_TileMax.begin(), m_TileMax.end(), 1.0f);
+    m_Stats = Stats();
+}
+
+void OcclusionBuffer :: rasterize(
+    const mat4& model,
+    const float* verts, size_t vert_count,
+    const unsigned* indices, size_t index_count
+){
+    if(not verts || not vert_count)
+        return;
+
+    const mat4 mvp = m_ViewProjection * model;
+    m_Clip.resize(vert_count);
+    for(size_t i = 0; i < vert_count; ++i)
+        m_Clip[i] = mvp * vec4(verts[i*3], verts[i*3+1], verts[i*3+2], 1.0f);
+
+    ++m_Stats.occluders;
+    if(indices)
+    {
+        for(size_t i = 0; i + 2 < index_count; i += 3)
+        {
+            if(indices[i] >= vert_count ||
+                indices[i+1] >= vert_count ||
+                indices[i+2] >= vert_count
+            )
+                continue;
+            triangle(m_Clip[indices[i]], m_Clip[indices[i+1]], m_Clip[indices[i+2]]);
+        }
+    }
+    else
+    {
+        for(size_t i = 0; i + 2 < vert_count; i += 3)
+            triangle(m_Clip[i], m_Clip[i+1], m_Clip[i+2]);
+    }
+}
+
+void OcclusionBuffer :: triangle(const vec4& a, const vec4& b, const vec4& c)
+{
+    ++m_Stats.triangles;
+
+    // clip against the near plane (z >= -w), giving up to a quad
+    const vec4* in[3] = {&a, &b, &c};
+    vec4 poly[4];
+    unsigned n = 0;
+    for(unsigned i = 0; i < 3; ++i)
+    {
+        const vec4& p = *in[i];
+        const vec4& q = *in[(i + 1) % 3];
+        float dp = p.z + p.w;
+        float dq = q.z + q.w;
+        if(dp >= 0.0f)
+            poly[n++] = p;
+        if((dp >= 0.0f) != (dq >= 0.0f))
+            poly[n++] = p + (q - p) * (dp / (dp - dq));
+    }
+    if(n < 3)
+        return;
+
+    vec3 s[4];
+    for(unsigned i = 0; i < n; ++i)
+    {
+        float w = poly[i].w;
+        if(w <= 0.0f)
+            return;
+        s[i] = vec3(
+            (poly[i].x / w * 0.5f + 0.5f) * m_Width,
+            (poly[i].y / w * 0.5f + 0.5f) * m_Height,
+            poly[i].z / w * 0.5f + 0.5f
+        );
+    }
+    raster(s[0], s[1], s[2]);
+    if(n == 4)
+        raster(s[0], s[2], s[3]);
+}
+
+void OcclusionBuffer :: raster(const vec3& a, const vec3& b_, const vec3& c_)
+{
+    vec3 b = b_, c = c_;
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if(std::abs(area) < 1e-8f)
+        return;
+    // both windings occlude
+    if(area < 0.0f) {
+        std::swap(b, c);
+        area = -area;
+    }
+
+    // pixels whose centers are in the bounds
+    float minx = std::max(0.0f, std::min(a.x, std::min(b.x, c.x)));
+    float maxx = std::min(float(m_Width), std::max(a.x, std::max(b.x, c.x)));
+    float miny = std::max(0.0f, std::min(a.y, std::min(b.y, c.y)));
+    float maxy = std::min(float(m_Height), std::max(a.y, std::max(b.y, c.y)));
+    int x0 = int(std::ceil(minx - 0.5f));
+    int x1 = std::min(int(m_Width) - 1, int(std::floor(maxx - 0.5f)));
+    int y0 = int(std::ceil(miny - 0.5f));
+    int y1 = std::min(int(m_Height) - 1, int(std::floor(maxy - 0.5f)));
+    if(x0 > x1 || y0 > y1)
+        return;
+
+    // edge functions E(p) = A*x + B*y + C, positive inside, each one
+    // the (unnormalized) weight of the opposite vertex.  Edges are set up
+    // from their lesser vertex, so triangles sharing an edge get exactly
+    // opposite values and leave no cracks between them.
+    const vec3* v[3] = {&b, &c, &a};
+    float A[3], B[3], C[3];
+    for(unsigned i = 0; i < 3; ++i)
+    {
+        const vec3* p = v[i];
+        const vec3* q = v[(i + 1) % 3];
+        const bool flip = q->x < p->x || (q->x == p->x && q->y < p->y);
+        if(flip)
+            std::swap(p, q);
+        A[i] = p->y - q->y;
+        B[i] = q->x - p->x;
+        C[i] = -(A[i] * p->x + B[i] * p->y);
+        if(flip) {
+            A[i] = -A[i];
+            B[i] = -B[i];
+            C[i] = -C[i];
+        }
+    }
+    const float inv = 1.0f / area;
+    const float dx = (A[0] * a.z + A[1] * b.z + A[2] * c.z) * inv;
+    const float dy = (B[0] * a.z + B[1] * b.z + B[2] * c.z) * inv;
+    const float d0 = (C[0] * a.z + C[1] * b.z + C[2] * c.z) * inv;
+
+    // rows are whole tiles wide, so 4-pixel steps from an aligned x stay
+    // in the row
+    const int xs = x0 & ~3;
+    for(int y = y0; y <= y1; ++y)
+    {
+        const float py = y + 0.5f;
+        float* row = &m_Depth[y * m_Width];
+        float e[3];
+        for(unsigned i = 0; i < 3; ++i)
+            e[i] = B[i] * py + C[i];
+        const float dr = dy * py + d0;
+
+#ifdef QOR_OCCLUSION_SSE2
+        if(s_bSIMD)
+        {
+            const __m128 zero = _mm_setzero_ps();
+            const __m128 steps = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            const __m128 a0 = _mm_set1_ps(A[0]), a1 = _mm_set1_ps(A[1]), a2 = _mm_set1_ps(A[2]);
+            const __m128 e0 = _mm_set1_ps(e[0]), e1 = _mm_set1_ps(e[1]), e2 = _mm_set1_ps(e[2]);
+            const __m128 vdx = _mm_set1_ps(dx), vdr = _mm_set1_ps(dr);
+            for(int x = xs; x <= x1; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), steps);
+                __m128 in = _mm_and_ps(
+                    _mm_and_ps(
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), e0), zero),
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), e1), zero)
+                    ),
+                    _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), e2), zero)
+                );
+                if(not _mm_movemask_ps(in))
+                    continue;
+                __m128 cur = _mm_loadu_ps(row + x);
+                __m128 d = _mm_min_ps(cur, _mm_add_ps(_mm_mul_ps(vdx, px), vdr));
+                _mm_storeu_ps(row + x, _mm_or_ps(
+                    _mm_and_ps(in, d),
+                    _mm_andnot_ps(in, cur)
+                ));
+            }
+            continue;
+        }
+#endif
+        for(int x = xs; x <= x1; ++x)
+        {
+            const float px = x + 0.5f;
+            if(A[0] * px + e[0] < 0.0f ||
+                A[1] * px + e[1] < 0.0f ||
+                A[2] * px + e[2] < 0.0f
+            )
+                continue;
+            row[x] = std::min(row[x], dx * px + dr);
+        }
+    }
+}
+
+void OcclusionBuffer :: end()
+{
+    for(unsigned ty = 0; ty < m_TilesY; ++ty)
+        for(unsigned tx = 0; tx < m_TilesX; ++tx)
+        {
+            float m = 0.0f;
+            for(unsigned y = ty * TILE; y < (ty + 1) * TILE; ++y)
+            {
+                const float* row = &m_Depth[y * m_Width + tx * TILE];
+                for(unsigned x = 0; x < TILE; ++x)
+                    m = std::max(m, row[x]);
+            }
+            m_TileMax[ty * m_TilesX + tx] = m;
+        }
+    m_Stats.raster_ms = chrono::duration<float, milli>(
+        chrono::steady_clock::now() - m_Start
+    ).count();
+}
+
+bool OcclusionBuffer :: visible(const Box& box) const
+{
+    const vec3& lo = box.min();
+    const vec3& hi = box.max();
+    if(lo.x > hi.x || lo.y > hi.y || lo.z > hi.z)
+        return true;
+    if(not (std::isfinite(lo.x) && std::isfinite(lo.y) && std::isfinite(lo.z) &&
+        std::isfinite(hi.x) && std::isfinite(hi.y) && std::isfinite(hi.z)
+    ))
+        return true;
+
+    ++m_Stats.tested;
+
+    float minx = float(m_Width), maxx = 0.0f;
+    float miny = float(m_Height), maxy = 0.0f;
+    float dmin = 1.0f;
+    for(unsigned i = 0; i < 8; ++i)
+    {
+        vec4 p = m_ViewProjection * vec4(
+            (i & 1) ? hi.x : lo.x,
+            (i & 2) ? hi.y : lo.y,
+            (i & 4) ? hi.z : lo.z,
+            1.0f
+        );
+        // in front of the near plane: can't tell
+        if(p.w <= 0.0f || p.z < -p.w)
+            return true;
+        float x = (p.x / p.w * 0.5f + 0.5f) * m_Width;
+        float y = (p.y / p.w * 0.5f + 0.5f) * m_Height;
+        minx = std::min(minx, x);
+        maxx = std::max(maxx, x);
+        miny = std::min(miny, y);
+        maxy = std::max(maxy, y);
+        dmin = std::min(dmin, p.z / p.w * 0.5f + 0.5f);
+    }
+    // partly off screen: frustum culling's call
+    if(minx < 0.0f || miny < 0.0f || maxx >= m_Width || maxy >= m_Height)
+        return true;
+
+    const unsigned x0 = unsigned(minx), x1 = unsigned(maxx);
+    const unsigned y0 = unsigned(miny), y1 = unsigned(maxy);
+    for(unsigned ty = y0 / TILE; ty <= y1 / TILE; ++ty)
+        for(unsigned tx = x0 / TILE; tx <= x1 / TILE; ++tx)
+        {
+            // every occluder in the tile is nearer than the box
+            if(dmin > m_TileMax[ty * m_TilesX + tx])
+                continue;
+            const unsigned ya = std::max(y0, ty * TILE);
+            const unsigned yb = std::min(y1, (ty + 1) * TILE - 1);
+            const unsigned xa = std::max(x0, tx * TILE);
+            const unsigned xb = std::min(x1, (tx + 1) * TILE - 1);
+            for(unsigned y = ya; y <= yb; ++y)
+                for(unsigned x = xa; x <= xb; ++x)
+                    if(dmin <= m_Depth[y * m_Width + x])
+                        return true;
+        }
+
+    ++m_Stats.culled;
+    return false;
+}
+
@@ -0,0 +1,99 @@
+#ifndef _OCCLUSIONBUFFER_H_T3JW9C5E
+#define _OCCLUSIONBUFFER_H_T3JW9C5E
+
+#include <vector>
+#include <cstddef>
+#include <chrono>
+#include <glm/glm.hpp>
+#include "Graphics.h"
+
+/*
+ *  Low resolution CPU depth buffer for occlusion culling.
+ *
+ *  Occluder triangles are rasterized (4 pixels at a time with SSE2) into
+ *  a depth buffer holding the nearest occluder depth of each pixel, then
+ *  end() takes the farthest depth of each TILE x TILE block.  visible()
+ *  tests a world space box against the blocks first and only looks at
+ *  single pixels of blocks it can't decide on.
+ *
+ *  Boxes straddling the near plane or leaving the screen are always
+ *  visible, as are boxes without extent.
+ *
+ *  Pure CPU, usable without a GL context.
+ */
+class OcclusionBuffer
+{
+    public:
+
+        struct Stats
+        {
+            unsigned occluders = 0;
+            unsigned triangles = 0;
+            unsigned tested = 0;
+            unsigned culled = 0;
+            // time spent in begin() .. end()
+            float raster_ms = 0.0f;
+        };
+
+        static const unsigned TILE = 8;
+
+        // sizes are rounded up to whole tiles
+        OcclusionBuffer(unsigned w = 256, unsigned h = 128);
+
+        void resize(unsigned w, unsigned h);
+
+        // clears the buffer for a new frame
+        void begin(const glm::mat4& view_projection);
+
+        /*
+         * Rasterizes model space triangles: verts are 3 floats each,
+         * indices (3 per triangle) may be null for unindexed triangles
+         */
+        void rasterize(
+            const glm::mat4& model,
+            const float* verts, size_t vert_count,
+            const unsigned* indices = nullptr, size_t index_count = 0
+        );
+
+        // builds the block depths, call before visible()
+        void end();
+
+        bool visible(const Box& box) const;
+
+        // depth in [0,1] (1 is far) of the nearest occluder at a pixel
+        float depth(unsigned x, unsigned y) const {
+            return m_Depth[y * m_Width + x];
+        }
+
+        unsigned width() const { return m_Width; }
+        unsigned height() const { return m_Height; }
+
+        const Stats& stats() const { return m_Stats; }
+
+        // rasterizes with SSE2 where built with it, for comparing the two
+        static bool simd() { return s_bSIMD; }
+        static void simd(bool b) { s_bSIMD = b; }
+
+    private:
+
+        static bool s_bSIMD;
+
+        // clip space triangle
+        void triangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+        // screen space triangle (x, y in pixels, z depth)
+        void raster(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+        unsigned m_Width = 0;
+        unsigned m_Height = 0;
+        unsigned m_TilesX = 0;
+        unsigned m_TilesY = 0;
+        std::vector<float> m_Depth;
+        std::vector<float> m_TileMax;
+        std::vector<glm::vec4> m_Clip;
+        glm::mat4 m_ViewProjection;
+        std::chrono::steady_clock::time_point m_Start;
+        mutable Stats m_Stats;
+};
+
+#endif
+
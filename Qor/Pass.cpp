@@ -20,27 +20,15 @@ void Pass :: texture(unsigned id, unsigned slot) {
 }
 
 void Pass :: vertex_array(unsigned int id) {
-    if(id!=m_VertexArrayID){
-        GL_TASK_START()
-            glBindVertexArray(id);
-        GL_TASK_END()
-    }
+    GLState::get()->bind_vertex_array(id);
 }
 
 void Pass :: vertex_buffer(unsigned int id) {
-    if(id!=m_VertexBufferID) {
-        GL_TASK_START()
-            glBindBuffer(GL_ARRAY_BUFFER, id);
-        GL_TASK_END()
-    }
+    GLState::get()->bind_buffer(GL_ARRAY_BUFFER, id);
 }
 
 void Pass :: element_buffer(unsigned int id) {
-    if(id!=m_VertexBufferID) {
-        GL_TASK_START()
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, id);
-        GL_TASK_END()
-    }
+    GLState::get()->bind_buffer(GL_ELEMENT_ARRAY_BUFFER, id);
 }
 
 //void enable_layout(Pipeline::Attribute attr) {
@@ -72,6 +60,9 @@ PassType Pass :: type() const {
 unsigned Pass :: layout(unsigned attrs) {
     return m_pPipeline->layout(attrs);
 }
+unsigned Pass :: layout_mask(unsigned attrs) const {
+    return m_pPipeline->layout_mask(attrs);
+}
 void Pass :: texture_slots(unsigned slot_flags){
     m_pPipeline->texture_slots(slot_flags);
 }
@@ -48,6 +48,7 @@ class Pass
 
         virtual void texture(unsigned id, unsigned slot = 0);
 
+        // redundant binds are filtered by GLState
         void vertex_array(unsigned int id);
         void vertex_buffer(unsigned int id);
         void element_buffer(unsigned int id);
@@ -59,6 +60,7 @@ class Pass
         PassType type() const;
 
         unsigned layout(unsigned attrs);
+        unsigned layout_mask(unsigned attrs) const;
         void texture_slots(unsigned slot_flags);
         unsigned attribute_id(unsigned id);
 
@@ -74,16 +76,19 @@ class Pass
         bool is_visible(const Node* n) const;
         
         void material(Color a, Color d, Color s, Color e);
+
+        // number of instances drawn by the next geometry apply()
+        // (set by Pipeline::begin_instances)
+        unsigned instances() const { return m_Instances; }
+        void instances(unsigned n) { m_Instances = n; }
         
     private:
 
-        unsigned m_VertexArrayID = 0;
-        unsigned m_VertexBufferID = 0;
-
         Pipeline* m_pPipeline = nullptr;
         IPartitioner* m_pPartitioner = nullptr;
         Camera* m_pCamera = nullptr;
         unsigned m_Flags = 0;
+        unsigned m_Instances = 1;
         std::function<bool(const Node*)> m_VisibilityFunc;
 
         MatrixStack m_Stack;
@@ -68,12 +68,13 @@ Pipeline :: Pipeline(
         //glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
         //glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-        glEnable(GL_DEPTH_TEST);
+        auto gl = GLState::get();
+        gl->enable(GL_DEPTH_TEST);
         //glDepthFunc(GL_LESS);
         //glFrontFace(GL_CCW);
-        glCullFace(GL_BACK);
-        glEnable(GL_CULL_FACE);
-        glEnable(GL_MULTISAMPLE);
+        gl->cull_face(GL_BACK);
+        gl->enable(GL_CULL_FACE);
+        gl->enable(GL_MULTISAMPLE);
         assert(glGetError() == GL_NO_ERROR);
     GL_TASK_END()
 }
@@ -92,10 +93,7 @@ Pipeline :: ~Pipeline()
 void Pipeline :: backfaces(bool b)
 {
     GL_TASK_START()
-        if(b)
-            glDisable(GL_CULL_FACE);
-        else
-            glEnable(GL_CULL_FACE);
+        GLState::get()->enable(GL_CULL_FACE, not b);
     GL_TASK_END()
 }
 
@@ -167,9 +165,26 @@ unsigned Pipeline :: load_shaders(vector<string> names)
             slot->m_ViewID = slot->m_pShader->uniform(
                 "View"
             );
+            slot->m_ProjectionID = slot->m_pShader->uniform(
+                "Projection"
+            );
+            slot->m_InstanceModelViewAttribute = (int)slot->m_pShader->attribute(
+                "InstanceModelView"
+            );
+            slot->m_InstanceNormalAttribute = (int)slot->m_pShader->attribute(
+                "InstanceNormalMatrix"
+            );
             slot->m_NormalID = slot->m_pShader->uniform(
                 "NormalMatrix"
             );
+            slot->m_NumLightsID = slot->m_pShader->uniform("NumLights");
+            slot->m_LightPosID = slot->m_pShader->uniform("LightPos");
+            slot->m_LightAmbientID = slot->m_pShader->uniform("LightAmbient");
+            slot->m_LightDiffuseID = slot->m_pShader->uniform("LightDiffuse");
+            slot->m_LightSpecularID = slot->m_pShader->uniform("LightSpecular");
+            slot->m_LightDistID = slot->m_pShader->uniform("LightDist");
+            slot->m_PositionScaleID = slot->m_pShader->uniform("PositionScale");
+            slot->m_PositionOffsetID = slot->m_pShader->uniform("PositionOffset");
             
             for(int i=0; i < int(s_TextureUniformNames.size() + 1); ++i) {
                 int tex_id = slot->m_pShader->uniform(
@@ -231,8 +246,7 @@ void Pipeline :: texture(
 ){
     GL_TASK_START()
         auto l = this->lock();
-        glActiveTexture(GL_TEXTURE0 + slot);
-        glBindTexture(GL_TEXTURE_2D, id);
+        GLState::get()->bind_texture(slot, id);
         try{
             int u = m_Shaders.at((unsigned)m_ActiveShader)->m_Textures.at(slot);
             if(u != -1)
@@ -251,7 +265,7 @@ void Pipeline :: texture_nobind(
     auto l = this->lock();
     GL_TASK_START()
         auto l = this->lock();
-        glActiveTexture(GL_TEXTURE0 + slot);
+        GLState::get()->active_texture(slot);
     GL_TASK_END()
 }
 
@@ -298,8 +312,19 @@ void Pipeline :: render(
         //pass.visibility_func(std::bind(&Camera::is_visible, camera, std::placeholders::_1));
         partitioner->camera(camera);
         partitioner->partition(root);
+        // without depth testing, draw order is what decides overlaps
+        m_RenderQueue.build(
+            partitioner->visible_nodes(),
+            camera,
+            not m_bBlend && not (flags & NO_DEPTH) && not camera->is_ortho()
+        );
         //bool has_lights = false;
-        bool has_lights = flags & LIGHTS;
+
+        // clustered lighting shades every light in the detail pass,
+        // ortho cameras fall back to multipass
+        bool clustered = (flags & LIGHTS) && (flags & CLUSTERED) &&
+            not camera->is_ortho();
+        bool has_lights = (flags & LIGHTS) && not clustered;
         //pass.flags(pass.flags() & ~Pass::RECURSIVE);
         //LOGf("visible lights: %s", partitioner->visible_lights().size());
         //if(not partitioner->visible_lights().empty() &&
@@ -312,19 +337,13 @@ void Pipeline :: render(
         if(has_lights)
             pass.flags(pass.flags() & ~Pass::RECURSIVE);
         
-        if(m_bBlend || (flags & NO_DEPTH))
-            glDisable(GL_DEPTH_TEST);
-        else
-            glEnable(GL_DEPTH_TEST);
+        auto gl = GLState::get();
+        gl->enable(GL_DEPTH_TEST, not (m_bBlend || (flags & NO_DEPTH)));
         
         if(not m_bBlend && has_lights)
         {
-            if(not (flags & NO_DEPTH))
-                glEnable(GL_DEPTH_TEST);
-            else
-                glDisable(GL_DEPTH_TEST);
-
-            glDisable(GL_BLEND);
+            gl->enable(GL_DEPTH_TEST, not (flags & NO_DEPTH));
+            gl->disable(GL_BLEND);
 
             assert(glGetError() == GL_NO_ERROR);
             if(m_ShaderOverrides.at((unsigned)PassType::BASE) == (unsigned)PassType::NONE)
@@ -341,42 +360,49 @@ void Pipeline :: render(
             }
             else
             {
-                auto&& rng = partitioner->visible_nodes();
-                for(auto&& node: rng) {
-                    if(!node)
-                        continue;
-                    node->render(&pass);
-                }
+                render_batches(&pass);
             }
         }
 
         // set up multi-pass state
         if(not has_lights){
             if(m_bBlend) {
-                glEnable(GL_BLEND);
-                if(m_BlendFunc)
+                gl->enable(GL_BLEND);
+                if(m_BlendFunc) {
                     m_BlendFunc();
-                else{
-                    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+                    // custom blend state bypasses the cache
+                    gl->invalidate();
+                } else {
+                    gl->blend_func(GL_SRC_ALPHA, GL_ONE);
                 }
                 //glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
             }else{
                 //glDisable(GL_BLEND);
-                glEnable(GL_BLEND);
-                glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                gl->enable(GL_BLEND);
+                gl->blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
             }
         }else{
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-            glEnable(GL_BLEND);
+            gl->enable(GL_BLEND);
+            gl->blend_func(GL_SRC_ALPHA, GL_ONE);
             //glDepthMask(false);
-            glDepthFunc(GL_EQUAL);
+            gl->depth_func(GL_EQUAL);
         }
         
         pass.flags(pass.flags() & ~Pass::BASE);
 
         assert(glGetError() == GL_NO_ERROR);
-        if(m_ShaderOverrides.at((unsigned)PassType::NORMAL) == (unsigned)PassType::NONE)
+        if(clustered)
+        {
+            if(m_ClusteredShader == (unsigned)PassType::NONE)
+                m_ClusteredShader = load_shaders({"clustered"});
+            shader((PassType)m_ClusteredShader);
+            m_ClusteredLighting.build(partitioner->visible_lights(), camera);
+            m_ClusteredLighting.bind(
+                m_Shaders.at((unsigned)m_ActiveShader)->m_pShader.get(),
+                uvec2(m_pWindow->size())
+            );
+        }
+        else if(m_ShaderOverrides.at((unsigned)PassType::NORMAL) == (unsigned)PassType::NONE)
             shader(PassType::NORMAL);
         else
             shader((PassType)(m_ShaderOverrides.at((unsigned)PassType::NORMAL)));
@@ -393,71 +419,167 @@ void Pipeline :: render(
             }
             else
             {
-                unsigned n = 0;
-                auto&& rng = partitioner->visible_nodes();
-                for(auto&& node: rng) {
-                    if(!node)
-                        continue;
-                    node->render(&pass);
-                    ++n;
-                }
-                //LOGf("rendered %s nodes", n);
+                render_batches(&pass);
             }
         }
         else
         {
             on_pass(&pass);
 
-            unsigned l = 0;
-            auto visible_lights = partitioner->visible_lights();
-            auto visible_nodes = partitioner->visible_nodes();
-            
-            int i = 0;
+            // each group only needs the lights that reach it
             int passes = 0;
-            bool break_outer = false;
-            while(not break_outer && visible_lights.size()) {
-                
-                auto light_batch = kit::slice(visible_lights, 0, MAX_LIGHTS_PER_PASS);
-                visible_lights = kit::slice(visible_lights, MAX_LIGHTS_PER_PASS);
-            
-                int i = 0;
-                for(auto&& light: light_batch){
-                    if(not light){
-                        break_outer = true;
-                        break;
-                    }
-                    this->light(light, i);
-                    ++i;
-                }
-                if(i == 0) // no lights this pass
-                    break;
-                
-                int u = m_Shaders.at((unsigned)m_ActiveShader)->m_pShader->uniform("NumLights");
-                if(u >= 0)
-                    m_Shaders.at((unsigned)m_ActiveShader)->m_pShader->uniform(u, i);
-                
-                for(const auto& node: visible_nodes) {
-                    if(not node)
-                        continue;
-                    node->render(&pass);
+            for(auto&& group: partitioner->light_groups())
+            {
+                for(unsigned ofs = 0; ofs < group.lights.size(); ofs += MAX_LIGHTS_PER_PASS)
+                {
+                    unsigned n = std::min<unsigned>(
+                        MAX_LIGHTS_PER_PASS, group.lights.size() - ofs
+                    );
+                    this->lights(&group.lights[ofs], n);
+                    
+                    for(const auto& node: group.nodes)
+                        node->render(&pass);
+                    ++passes;
                 }
-                ++passes;
             }
             //LOGf("rendered %s passes", passes);
         }
 
         if(has_lights){
-            glDepthMask(true);
-            glDepthFunc(GL_LEQUAL);
+            gl->depth_mask(true);
+            gl->depth_func(GL_LEQUAL);
         }
         if(m_bBlend && not (flags & NO_DEPTH))
-            glEnable(GL_DEPTH_TEST);
+            gl->enable(GL_DEPTH_TEST);
 
         //this->light(nullptr);
         this->pass(nullptr);
     GL_TASK_END()
 }
 
+void Pipeline :: render_batches(Pass* pass)
+{
+    auto&& nodes = m_RenderQueue.nodes();
+    for(auto&& batch: m_RenderQueue.batches())
+    {
+        const Node* node = nodes[batch.first];
+        if(batch.count == 1)
+            node->render(pass);
+        else
+            node->render_instances(pass, &nodes[batch.first], batch.count);
+    }
+}
+
+bool Pipeline :: begin_instances(
+    Pass* pass, const Node* const* nodes, unsigned count
+){
+    if(Headless::enabled())
+        return false;
+    
+    auto l = this->lock();
+    
+    const unsigned active = (unsigned)m_ActiveShader;
+    if(active > (unsigned)PassType::NORMAL)
+        return false;
+    
+    bool r = false;
+    GL_TASK_START()
+        auto l = this->lock();
+        
+        if(m_InstancedShaders.empty())
+        {
+            // glVertexAttribDivisor is core in 3.3
+            if(GLEW_VERSION_3_3) {
+                unsigned first = load_shaders({"base_instanced", "basic_instanced"});
+                m_InstancedShaders = {first, first + 1};
+            } else
+                m_InstancedShaders.assign(2, (unsigned)PassType::NONE);
+        }
+        const unsigned slot = m_InstancedShaders.at(active);
+        if(slot == (unsigned)PassType::NONE)
+            return;
+        auto& shader = m_Shaders.at(slot);
+        if(shader->m_InstanceModelViewAttribute < 0)
+            return;
+
+        m_InstancingShader = m_ActiveShader;
+        this->shader((PassType)slot);
+        // mesh vertex arrays are left alone, instances use the default one
+        pass->vertex_array(0);
+        shader->m_pShader->uniform(shader->m_ProjectionID, m_ProjectionMatrix);
+        shader->m_pShader->uniform(shader->m_ViewID, m_ViewMatrix);
+
+        // model view, and normal matrix if the shader wants it
+        const bool normals = shader->m_InstanceNormalAttribute >= 0;
+        const unsigned stride = normals ? 16 + 9 : 16;
+        m_InstanceData.resize(count * stride);
+        float* data = &m_InstanceData[0];
+        for(unsigned i = 0; i < count; ++i)
+        {
+            mat4 mv = m_ViewMatrix * *nodes[i]->matrix_c(Space::WORLD);
+            const float* f = &mv[0][0];
+            std::copy(f, f + 16, data);
+            if(normals) {
+                mat3 n = mat3(glm::transpose(glm::inverse(mv)));
+                const float* nf = &n[0][0];
+                std::copy(nf, nf + 9, data + 16);
+            }
+            data += stride;
+        }
+
+        if(not m_InstanceBuffer)
+            glGenBuffers(1, &m_InstanceBuffer);
+        pass->vertex_buffer(m_InstanceBuffer);
+        // orphan the old storage so we don't wait on draws still using it
+        glBufferData(GL_ARRAY_BUFFER, m_InstanceData.size() * sizeof(float), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, m_InstanceData.size() * sizeof(float), &m_InstanceData[0]);
+
+        for(unsigned c = 0; c < 4; ++c) {
+            unsigned attr = shader->m_InstanceModelViewAttribute + c;
+            GLState::get()->attribute_array(attr, true);
+            glVertexAttribPointer(attr, 4, GL_FLOAT, GL_FALSE,
+                stride * sizeof(float), (GLubyte*)NULL + c * 4 * sizeof(float));
+            glVertexAttribDivisor(attr, 1);
+        }
+        if(normals)
+            for(unsigned c = 0; c < 3; ++c) {
+                unsigned attr = shader->m_InstanceNormalAttribute + c;
+                GLState::get()->attribute_array(attr, true);
+                glVertexAttribPointer(attr, 3, GL_FLOAT, GL_FALSE,
+                    stride * sizeof(float), (GLubyte*)NULL + (16 + c * 3) * sizeof(float));
+                glVertexAttribDivisor(attr, 1);
+            }
+
+        pass->instances(count);
+        r = true;
+    GL_TASK_END()
+    return r;
+}
+
+void Pipeline :: end_instances(Pass* pass)
+{
+    auto l = this->lock();
+    if(m_InstancingShader == PassType::NONE)
+        return;
+    
+    GL_TASK_START()
+        auto l = this->lock();
+        auto& shader = m_Shaders.at((unsigned)m_ActiveShader);
+        for(unsigned c = 0; c < 4; ++c) {
+            glVertexAttribDivisor(shader->m_InstanceModelViewAttribute + c, 0);
+            GLState::get()->attribute_array(shader->m_InstanceModelViewAttribute + c, false);
+        }
+        if(shader->m_InstanceNormalAttribute >= 0)
+            for(unsigned c = 0; c < 3; ++c) {
+                glVertexAttribDivisor(shader->m_InstanceNormalAttribute + c, 0);
+                GLState::get()->attribute_array(shader->m_InstanceNormalAttribute + c, false);
+            }
+        pass->instances(1);
+        this->shader(m_InstancingShader);
+        m_InstancingShader = PassType::NONE;
+    GL_TASK_END()
+}
+
 //void Pipeline :: ortho(bool origin_bottom)
 //{
 //    auto l = this->lock();
@@ -490,7 +612,7 @@ void Pipeline :: render(
 void Pipeline :: winding(bool cw)
 {
     GL_TASK_START()
-        glFrontFace(cw ? GL_CW : GL_CCW);
+        GLState::get()->front_face(cw ? GL_CW : GL_CCW);
     GL_TASK_END()
 }
 
@@ -543,6 +665,12 @@ std::shared_ptr<Program> Pipeline :: shader() {
     return m_Shaders.at((unsigned)m_ActiveShader)->m_pShader;
 }
 
+unsigned Pipeline :: layout_mask(unsigned attrs) const
+{
+    auto l = this->lock();
+    return attrs & m_Shaders.at((unsigned)m_ActiveShader)->m_SupportedLayout;
+}
+
 unsigned Pipeline :: layout(unsigned attrs)
 {
     auto l = this->lock();
@@ -552,35 +680,16 @@ unsigned Pipeline :: layout(unsigned attrs)
     // get compatible layout
     attrs &= shader->m_SupportedLayout;
     
-    for(unsigned i=0; i < (unsigned)AttributeID::MAX; ++i)
-    //for(unsigned i=0; cur_layout!=attrs; ++i)
+    // attribute arrays are global state, so GLState filters the ones
+    // already enabled by the last draw (or another shader)
+    auto gl = GLState::get();
+    for(unsigned i=0; i < shader->m_Attributes.size(); ++i)
     {
         unsigned bit = 1U << i;
-        //assert(bit < (unsigned)AttributeID::MAX);
-        unsigned abit = attrs & bit;
-        //unsigned abit = 1;
-        
-        if((cur_layout & bit) != abit)
-        {
-            if(abit) {
-                try{
-                    glEnableVertexAttribArray(shader->m_Attributes.at(i));
-                    //LOGf("enable: %s", i);
-                    cur_layout |= bit;
-                }catch(...){}
-                //glEnableVertexAttribArray(i);
-            } else {
-                try{
-                    glDisableVertexAttribArray(shader->m_Attributes.at(i));
-                    //LOGf("disable: %s", i);
-                    cur_layout &= ~bit;
-                }catch(...){}
-                //glDisableVertexAttribArray(i);
-            }
-            
-            cur_layout ^= bit;
-        }
+        if(shader->m_SupportedLayout & bit)
+            gl->attribute_array(shader->m_Attributes[i], attrs & bit);
     }
+    cur_layout = attrs;
     
     return attrs;
     
@@ -631,6 +740,57 @@ void Pipeline :: light(const Light* light, unsigned slot)
         light->bind(m_pPass, slot);
 }
 
+void Pipeline :: lights(const Light* const* lights, unsigned count)
+{
+    auto l = this->lock();
+    count = std::min<unsigned>(count, MAX_LIGHTS_PER_PASS);
+    
+    vec4 pos[MAX_LIGHTS_PER_PASS];
+    vec3 ambient[MAX_LIGHTS_PER_PASS];
+    vec3 diffuse[MAX_LIGHTS_PER_PASS];
+    vec3 specular[MAX_LIGHTS_PER_PASS];
+    float dist[MAX_LIGHTS_PER_PASS];
+    for(unsigned i = 0; i < count; ++i)
+    {
+        const Light* light = lights[i];
+        auto p = light->position(Space::WORLD);
+        pos[i] = vec4(p.x, p.y, p.z,
+            light->light_type() == Light::Type::DIRECTIONAL ? 0.0f : 1.0f
+        );
+        ambient[i] = light->ambient().vec3();
+        diffuse[i] = light->diffuse().vec3();
+        specular[i] = light->specular().vec3();
+        dist[i] = light->dist();
+    }
+    
+    GL_TASK_START()
+        auto& slot = m_Shaders.at((unsigned)m_ActiveShader);
+        auto& shader = slot->m_pShader;
+        shader->uniform(slot->m_NumLightsID, (int)count);
+        if(!count)
+            return;
+        shader->uniform(slot->m_LightPosID, 4, count, &pos[0].x);
+        shader->uniform(slot->m_LightAmbientID, 3, count, &ambient[0].x);
+        shader->uniform(slot->m_LightDiffuseID, 3, count, &diffuse[0].x);
+        shader->uniform(slot->m_LightSpecularID, 3, count, &specular[0].x);
+        shader->uniform(slot->m_LightDistID, 1, count, dist);
+    GL_TASK_END()
+}
+
+void Pipeline :: position_decode(const vec3& scale, const vec3& offset)
+{
+    auto l = this->lock();
+    auto& slot = m_Shaders.at((unsigned)m_ActiveShader);
+    if(slot->m_PositionScale == scale && slot->m_PositionOffset == offset)
+        return;
+    slot->m_PositionScale = scale;
+    slot->m_PositionOffset = offset;
+    GL_TASK_START()
+        slot->m_pShader->uniform(slot->m_PositionScaleID, scale);
+        slot->m_pShader->uniform(slot->m_PositionOffsetID, offset);
+    GL_TASK_END()
+}
+
 void Pipeline :: material(Color a, Color d, Color s, Color e)
 {
     auto l = this->lock();
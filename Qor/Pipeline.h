@@ -10,6 +10,9 @@
 #include "kit/cache/cache.h"
 #include "kit/args/args.h"
 #include "IRealtime.h"
+#include "RenderQueue.h"
+#include "ClusteredLighting.h"
+#include "GLState.h"
 #include <functional>
 
 class BasicPartitioner;
@@ -39,7 +42,9 @@ class Pipeline:
             NO_CLEAR = kit::bit(0),
             NO_DEPTH = kit::bit(1),
             LIGHTS = kit::bit(2),
-            RENDER_MASK = kit::mask(2)
+            // with LIGHTS: single pass clustered lighting instead of multipass
+            CLUSTERED = kit::bit(3),
+            RENDER_MASK = kit::mask(4)
         };
         
         enum class AttributeID : unsigned
@@ -98,11 +103,61 @@ class Pipeline:
         //    m_pCamera=camera;
         //}
         
+        // draw order and state change counts of the last render()
+        const RenderQueue::Stats& render_stats() const {
+            auto l = this->lock();
+            return m_RenderQueue.stats();
+        }
+        // sort visible nodes by state before drawing (default: on)
+        bool sort_draws() const {
+            auto l = this->lock();
+            return m_RenderQueue.enabled();
+        }
+        void sort_draws(bool b) {
+            auto l = this->lock();
+            m_RenderQueue.enabled(b);
+        }
+        
+        // light binning of the last CLUSTERED render()
+        const ClusteredLighting::Stats& cluster_stats() const {
+            auto l = this->lock();
+            return m_ClusteredLighting.stats();
+        }
+
+        // draw calls and (skipped) GL binds of the last full frame
+        const GLState::Stats& gl_stats() const {
+            return GLState::get()->stats();
+        }
+        
         void pass(Pass* pass) {m_pPass=pass;}
         Pass* pass() { return m_pPass; }
         const Pass* pass() const { return m_pPass; }
 
+        /*
+         * Instanced drawing of nodes sharing the same mesh data.
+         * begin_instances() switches to the instanced variant of the
+         * active shader and uploads the per-instance matrices of nodes.
+         * It returns false, changing nothing, if the active shader has no
+         * instanced variant (only base and basic do), in which case the
+         * nodes must be drawn one by one.
+         * end_instances() restores the shader and attribute state.
+         */
+        bool begin_instances(Pass* pass, const Node* const* nodes, unsigned count);
+        void end_instances(Pass* pass);
+
         void light(const Light* light, unsigned slot = 0);
+
+        /*
+         * Upload up to 8 lights (and NumLights) to the active shader as
+         * uniform arrays, one call per array through cached locations
+         */
+        void lights(const Light* const* lights, unsigned count);
+
+        /*
+         * Position decode (pos * scale + offset) of the mesh about to be
+         * drawn with the active shader, only uploaded when it changes
+         */
+        void position_decode(const glm::vec3& scale, const glm::vec3& offset);
         //const Light* light() const { return m_pLight; }
         //std::shared_ptr<Node> root() { return m_pRoot.lock(); }
 
@@ -136,6 +191,8 @@ class Pipeline:
         virtual std::shared_ptr<Program> shader(unsigned slot);
         
         unsigned layout(unsigned attrs);
+        // attrs the active shader supports, without touching GL state
+        unsigned layout_mask(unsigned attrs) const;
         
         bool blend() const {
             auto l = this->lock();
@@ -187,6 +244,10 @@ class Pipeline:
         //unsigned m_OpenTextureSlots = 0;
         
         void shader(PassType type);
+
+        // draws the render queue's batches
+        void render_batches(Pass* pass);
+        
         void clear_shaders()
         {
             auto l = lock();
@@ -199,6 +260,15 @@ class Pipeline:
         //std::weak_ptr<Node> m_pRoot;
         //std::weak_ptr<Node> m_pCamera;
         std::shared_ptr<BasicPartitioner> m_pPartitioner;
+        RenderQueue m_RenderQueue;
+        ClusteredLighting m_ClusteredLighting;
+        unsigned m_ClusteredShader = (unsigned)PassType::NONE;
+
+        // instanced variants of the base and basic slots, loaded on first use
+        std::vector<unsigned> m_InstancedShaders;
+        PassType m_InstancingShader = PassType::NONE;
+        unsigned m_InstanceBuffer = 0;
+        std::vector<float> m_InstanceData;
         const Light* m_pLight = nullptr;
         PassType m_ActiveShader = PassType::NONE;
         Color m_BGColor;
@@ -1,24 +1,29 @@
 #include "PipelineShader.h"
 #include "Filesystem.h"
+#include "ProgramCache.h"
 using namespace std;
 
 PipelineShader :: PipelineShader(const string& fn):
     Resource(fn),
-    m_pShader(make_shared<Program>(
-        make_shared<Shader>(
-            Filesystem::cutExtension(fn) + ".vp",
-            Shader::VERTEX
-        ),
-        make_shared<Shader>(
-            Filesystem::cutExtension(fn) + ".fp",
-            Shader::FRAGMENT
-        )
+    m_pShader(ProgramCache::get()->program(
+        source("vertex", ".vp"),
+        source("fragment", ".fp")
     ))
 {
     for(auto& tex: m_Textures)
         tex = -1;
 }
 
+string PipelineShader :: source(const string& key, const string& ext) const
+{
+    // stages default to the config's own name, but can be shared with
+    // another shader (e.g. the instanced variants reuse base.fp)
+    string fn = m_pConfig->at<string>(key, string());
+    if(fn.empty())
+        return Filesystem::cutExtension(m_Filename) + ext;
+    return Filesystem::getPath(m_Filename) + fn;
+}
+
 void PipelineShader :: link()
 {
     if(!m_pShader->link())
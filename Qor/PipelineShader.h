@@ -31,6 +31,7 @@ class PipelineShader:
         Program::UniformID m_ModelViewID= -1;
         Program::UniformID m_ModelID= -1;
         Program::UniformID m_ViewID= -1;
+        Program::UniformID m_ProjectionID = -1;
         Program::UniformID m_NormalID = -1;
 
         Program::UniformID m_MaterialAmbientID = -1;
@@ -38,14 +39,38 @@ class PipelineShader:
         Program::UniformID m_MaterialSpecularID = -1;
         Program::UniformID m_MaterialEmissiveID = -1;
         Program::UniformID m_MaterialShininessID = -1;
+
+        // light arrays, uploaded once per light batch
+        Program::UniformID m_NumLightsID = -1;
+        Program::UniformID m_LightPosID = -1;
+        Program::UniformID m_LightAmbientID = -1;
+        Program::UniformID m_LightDiffuseID = -1;
+        Program::UniformID m_LightSpecularID = -1;
+        Program::UniformID m_LightDistID = -1;
+
+        // position decode of compact vertex formats, and the values
+        // last uploaded
+        Program::UniformID m_PositionScaleID = -1;
+        Program::UniformID m_PositionOffsetID = -1;
+        glm::vec3 m_PositionScale = glm::vec3(1.0f);
+        glm::vec3 m_PositionOffset = glm::vec3(0.0f);
         
         std::vector<Program::UniformID> m_Textures;
         std::vector<unsigned> m_Attributes;
+
+        // per-instance attributes of instanced shaders (mat4 and mat3)
+        int m_InstanceModelViewAttribute = -1;
+        int m_InstanceNormalAttribute = -1;
         //unsigned m_TextureSlots = 0;
 
         unsigned m_Layout = 0;
         unsigned m_SupportedLayout = 0;
         unsigned m_ActiveTextureSlots = 0;
+
+    private:
+
+        // vertex or fragment source file, from the config's key if set
+        std::string source(const std::string& key, const std::string& ext) const;
 };
 
 #endif
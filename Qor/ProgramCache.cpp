@@ -0,0 +1,246 @@
+#include "ProgramCache.h"
+#include "Filesystem.h"
+#include "kit/log/log.h"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+using namespace std;
+namespace fs = boost::filesystem;
+
+bool ProgramCache :: s_bEnabled = true;
+
+namespace {
+
+    const char MAGIC[4] = {'Q', 'P', 'R', 'G'};
+    // bump when the layout below changes
+    const uint32_t VERSION = 1;
+
+    vector<char> read_file(const string& fn)
+    {
+        ifstream file(fn, ios::binary);
+        if(!file)
+            return vector<char>();
+        return vector<char>(
+            (istreambuf_iterator<char>(file)),
+            istreambuf_iterator<char>()
+        );
+    }
+
+    string hex(uint64_t v)
+    {
+        ostringstream ss;
+        ss << std::hex << setw(16) << setfill('0') << v;
+        return ss.str();
+    }
+
+    void write_u32(ofstream& f, uint32_t v) {
+        f.write((const char*)&v, sizeof(v));
+    }
+    void write_string(ofstream& f, const string& s) {
+        write_u32(f, s.size());
+        f.write(s.data(), s.size());
+    }
+
+    // reads that fail past the end instead of throwing
+    class Reader
+    {
+        public:
+            explicit Reader(const vector<char>& buf):
+                m_Buffer(buf)
+            {}
+
+            bool bytes(char* out, size_t n) {
+                if(m_Offset + n > m_Buffer.size())
+                    return false;
+                if(n)
+                    memcpy(out, &m_Buffer[m_Offset], n);
+                m_Offset += n;
+                return true;
+            }
+            bool u32(uint32_t& v) {
+                return bytes((char*)&v, sizeof(v));
+            }
+            bool i32(int32_t& v) {
+                return bytes((char*)&v, sizeof(v));
+            }
+            bool str(string& s) {
+                uint32_t len;
+                if(!u32(len) || m_Offset + len > m_Buffer.size())
+                    return false;
+                s.assign(m_Buffer.begin() + m_Offset, m_Buffer.begin() + m_Offset + len);
+                m_Offset += len;
+                return true;
+            }
+            template<class T>
+            bool locations(unordered_map<string, T>& m) {
+                uint32_t count;
+                if(!u32(count))
+                    return false;
+                for(uint32_t i = 0; i < count; ++i) {
+                    string name;
+                    int32_t loc;
+                    if(!str(name) || !i32(loc))
+                        return false;
+                    m[name] = loc;
+                }
+                return true;
+            }
+
+        private:
+            const vector<char>& m_Buffer;
+            size_t m_Offset = 0;
+    };
+
+    template<class T>
+    void write_locations(ofstream& f, const unordered_map<string, T>& m) {
+        write_u32(f, m.size());
+        for(auto&& loc: m) {
+            write_string(f, loc.first);
+            int32_t v = loc.second;
+            f.write((const char*)&v, sizeof(v));
+        }
+    }
+
+}
+
+ProgramCache* ProgramCache :: get()
+{
+    static ProgramCache cache;
+    return &cache;
+}
+
+uint64_t ProgramCache :: hash(const char* data, size_t len, uint64_t h)
+{
+    // FNV-1a, which unlike std::hash stays the same between builds
+    for(size_t i = 0; i < len; ++i) {
+        h ^= uint8_t(data[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+string ProgramCache :: key(const vector<char>& vp_src, const vector<char>& fp_src)
+{
+    if(m_Driver.empty())
+        for(GLenum e: {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            auto s = (const char*)glGetString(e);
+            m_Driver += s ? s : "";
+            m_Driver += "\n";
+        }
+    return m_Driver +
+        hex(hash(vp_src.data(), vp_src.size())) + " " +
+        hex(hash(fp_src.data(), fp_src.size()));
+}
+
+shared_ptr<Program> ProgramCache :: program(const string& vp_fn, const string& fp_fn)
+{
+    auto compile = [&]{
+        return make_shared<Program>(
+            make_shared<Shader>(vp_fn, Shader::VERTEX),
+            make_shared<Shader>(fp_fn, Shader::FRAGMENT)
+        );
+    };
+    if(not s_bEnabled || not Program::binaries_supported())
+        return compile();
+
+    // missing sources are reported by Shader
+    auto vp_src = read_file(vp_fn);
+    auto fp_src = read_file(fp_fn);
+    if(vp_src.empty() || fp_src.empty())
+        return compile();
+
+    string name = Filesystem::getFileNameNoExt(vp_fn);
+    if(Filesystem::getFileNameNoExt(fp_fn) != name)
+        name += "-" + Filesystem::getFileNameNoExt(fp_fn);
+    string fn = (fs::path(m_Path) / (name + ".bin")).string();
+    string k = key(vp_src, fp_src);
+
+    auto program = load(fn, k);
+    if(program) {
+        ++m_Stats.hits;
+        return program;
+    }
+    ++m_Stats.misses;
+    program = compile();
+    save(fn, k, *program);
+    return program;
+}
+
+shared_ptr<Program> ProgramCache :: load(const string& fn, const string& key)
+{
+    auto buf = read_file(fn);
+    if(buf.empty())
+        return nullptr;
+
+    // stale (edited shader, new driver) or damaged entries are recompiled
+    Reader r(buf);
+    char magic[sizeof(MAGIC)];
+    uint32_t version, format, len;
+    string file_key;
+    unordered_map<string, Program::UniformID> uniforms;
+    unordered_map<string, int> attributes;
+    if(!r.bytes(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)
+        return nullptr;
+    if(!r.u32(version) || version != VERSION)
+        return nullptr;
+    if(!r.str(file_key) || file_key != key)
+        return nullptr;
+    if(!r.u32(format) || !r.locations(uniforms) || !r.locations(attributes))
+        return nullptr;
+    if(!r.u32(len))
+        return nullptr;
+    vector<char> data(len);
+    if(!len || !r.bytes(&data[0], len))
+        return nullptr;
+
+    auto program = Program::from_binary(format, data);
+    if(!program) {
+        LOGf("Cached program %s was rejected, recompiling", Filesystem::getFileName(fn));
+        return nullptr;
+    }
+    program->reflection(std::move(uniforms), std::move(attributes));
+    program->use();
+    return program;
+}
+
+void ProgramCache :: save(const string& fn, const string& key, const Program& program)
+{
+    unsigned format;
+    vector<char> data;
+    if(not program.binary(format, data))
+        return;
+
+    boost::system::error_code ec;
+    fs::create_directories(fs::path(m_Path), ec);
+    if(ec) {
+        WARNINGf("Unable to create program cache %s", m_Path);
+        return;
+    }
+
+    // written aside and moved into place, so a crash leaves no half file
+    string tmp = fn + ".tmp";
+    {
+        ofstream f(tmp, ios::binary | ios::trunc);
+        f.write(MAGIC, sizeof(MAGIC));
+        write_u32(f, VERSION);
+        write_string(f, key);
+        write_u32(f, format);
+        write_locations(f, program.uniforms());
+        write_locations(f, program.attributes());
+        write_u32(f, data.size());
+        f.write(&data[0], data.size());
+        if(!f) {
+            WARNINGf("Unable to write %s", tmp);
+            f.close();
+            fs::remove(fs::path(tmp), ec);
+            return;
+        }
+    }
+    fs::rename(fs::path(tmp), fs::path(fn), ec);
+    if(ec)
+        fs::remove(fs::path(tmp), ec);
+}
+
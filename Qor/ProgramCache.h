@@ -0,0 +1,72 @@
+#ifndef _PROGRAMCACHE_H_T3N9BW5K
+#define _PROGRAMCACHE_H_T3N9BW5K
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Shader.h"
+
+/*
+ *  Linked shader programs kept on disk in the driver's binary format, so
+ *  later launches skip compiling and linking.
+ *
+ *  Entries are keyed by a hash of both shader sources and the GL vendor,
+ *  renderer and version, and carry the program's uniform and attribute
+ *  locations so reflection needs no GL queries either.  Entries that are
+ *  stale, damaged or rejected by the driver are compiled from source and
+ *  written again.
+ *
+ *  GL thread only.
+ */
+class ProgramCache
+{
+    public:
+
+        struct Stats
+        {
+            unsigned hits = 0;
+            unsigned misses = 0;
+        };
+
+        static ProgramCache* get();
+
+        ProgramCache(const ProgramCache&) = delete;
+        ProgramCache& operator=(const ProgramCache&) = delete;
+
+        // settings.json: video.program-cache
+        static bool enabled() { return s_bEnabled; }
+        static void enabled(bool b) { s_bEnabled = b; }
+
+        // linked program of a vertex and fragment shader file
+        std::shared_ptr<Program> program(
+            const std::string& vp_fn,
+            const std::string& fp_fn
+        );
+
+        // directory the binaries go in
+        void path(const std::string& dir) { m_Path = dir; }
+        const std::string& path() const { return m_Path; }
+
+        const Stats& stats() const { return m_Stats; }
+
+    private:
+
+        ProgramCache() = default;
+
+        static uint64_t hash(const char* data, size_t len, uint64_t h = 14695981039346656037ULL);
+
+        std::string key(const std::vector<char>& vp_src, const std::vector<char>& fp_src);
+        std::shared_ptr<Program> load(const std::string& fn, const std::string& key);
+        void save(const std::string& fn, const std::string& key, const Program& program);
+
+        std::string m_Path = "cache/programs";
+        // vendor, renderer and version, read on first use
+        std::string m_Driver;
+        Stats m_Stats;
+
+        static bool s_bEnabled;
+};
+
+#endif
+
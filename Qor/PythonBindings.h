@@ -25,6 +25,11 @@
 #include "kit/math/vectorops.h"
 #include "BasicPartitioner.h"
 #include "Headless.h"
+#include "StreamBuffer.h"
+#include "OcclusionBuffer.h"
+#include "TextureAtlas.h"
+#include "TextureStreamer.h"
+#include "ProgramCache.h"
 
 using namespace boost::python;
 using namespace glm;
@@ -645,6 +650,10 @@ namespace Scripting
     void cache(std::string fn) {
         qor()->resources()->cache(fn);
     }
+    // queued for the loaders, in the cache once the state is done loading
+    void cache_async(std::string fn) {
+        qor()->resources()->load_async(fn);
+    }
     void optimize() {
         qor()->resources()->optimize();
     }
@@ -743,6 +752,29 @@ namespace Scripting
         return l;
     }
 
+    void index(NodeBind n) {
+        qor()->pipeline()->partitioner()->index(n.n);
+    }
+    void deindex(NodeBind n) {
+        qor()->pipeline()->partitioner()->deindex(n.n.get());
+    }
+    list query_radius(glm::vec3 center, float radius) {
+        static std::vector<Node*> v;
+        qor()->pipeline()->partitioner()->query_radius(center, radius, v);
+        list l;
+        for(Node* n: v)
+            l.append<NodeBind>(NodeBind(n));
+        return l;
+    }
+    list query_nearest(glm::vec3 point, unsigned k) {
+        static std::vector<Node*> v;
+        qor()->pipeline()->partitioner()->query_nearest(point, k, v);
+        list l;
+        for(Node* n: v)
+            l.append<NodeBind>(NodeBind(n));
+        return l;
+    }
+
     void on_collision(NodeBind a, NodeBind b, boost::python::object cb){
         qor()->pipeline()->partitioner()->on_collision(a.n, b.n, [cb](Node* aa, Node* bb){
             cb(NodeBind(aa), NodeBind(bb));
@@ -874,6 +906,110 @@ namespace Scripting
         }
     }
 
+    dict gl_stats()
+    {
+        dict d;
+        const GLState::Stats& s = qor()->pipeline()->gl_stats();
+        d["draw_calls"] = s.draw_calls;
+        d["instances"] = s.instances;
+        d["binds"] = s.binds;
+        d["skipped_binds"] = s.skipped_binds;
+        const StreamBuffer::Stats& st = StreamBuffer::get()->stats();
+        d["stream_writes"] = st.writes;
+        d["stream_bytes"] = st.bytes;
+        d["stream_overflows"] = st.overflows;
+        d["stream_stalls"] = st.stalls;
+        return d;
+    }
+
+    dict vertex_memory()
+    {
+        dict d;
+        const MeshVertexBuffer::Stats& s = MeshVertexBuffer::stats();
+        d["buffers"] = s.buffers;
+        d["bytes"] = s.bytes;
+        d["float_bytes"] = s.float_bytes;
+        d["saved"] = s.saved();
+        return d;
+    }
+
+    void occlusion_culling(bool b) {
+        qor()->pipeline()->partitioner()->occlusion_culling(b);
+    }
+    dict occlusion_stats()
+    {
+        dict d;
+        auto buf = qor()->pipeline()->partitioner()->occlusion_buffer();
+        if(not buf)
+            return d;
+        const OcclusionBuffer::Stats& s = buf->stats();
+        d["occluders"] = s.occluders;
+        d["triangles"] = s.triangles;
+        d["tested"] = s.tested;
+        d["culled"] = s.culled;
+        d["raster_ms"] = s.raster_ms;
+        return d;
+    }
+
+    void atlas_save(std::string prefix) {
+        TextureAtlas::get()->save(prefix);
+    }
+    void atlas_load(std::string fn) {
+        TextureAtlas::get()->load(fn);
+    }
+    dict atlas_stats()
+    {
+        dict d;
+        d["pages"] = TextureAtlas::get()->pages();
+        d["images"] = TextureAtlas::get()->images();
+        return d;
+    }
+
+    dict texture_streaming_stats()
+    {
+        dict d;
+        auto streamer = TextureStreamer::get();
+        d["pending"] = streamer->pending();
+        d["uploads"] = streamer->stats().uploads;
+        d["bytes"] = streamer->stats().bytes;
+        return d;
+    }
+
+    dict program_cache_stats()
+    {
+        dict d;
+        d["hits"] = ProgramCache::get()->stats().hits;
+        d["misses"] = ProgramCache::get()->stats().misses;
+        return d;
+    }
+
+    // per resource class, e.g. resource_stats()["texture"]["gpu_bytes"]
+    dict resource_stats()
+    {
+        dict d;
+        for(auto&& r: qor()->resources()->residency()) {
+            dict c;
+            c["entries"] = r.entries;
+            c["in_use"] = r.in_use;
+            c["cpu_bytes"] = r.cpu_bytes;
+            c["gpu_bytes"] = r.gpu_bytes;
+            c["budget"] = r.budget;
+            c["evicted"] = r.evicted;
+            d[r.name] = c;
+        }
+        return d;
+    }
+    void resource_budget(std::string name, unsigned mb) {
+        qor()->resources()->budget(name, size_t(mb) * 1024 * 1024);
+    }
+    unsigned evict() {
+        return qor()->resources()->enforce_budgets();
+    }
+
+    void lod_bias(float f) {
+        Mesh::lod_bias(f);
+    }
+
     bool is_server(){
         return Headless::server();
     }
@@ -914,6 +1050,7 @@ namespace Scripting
         def("screen_w", screen_w);
         def("screen_h", screen_h);
         def("cache", cache, args("fn"));
+        def("cache_async", cache_async, args("fn"));
         def("optimize", optimize);
         def("find", find);
         def("on_enter", on_enter);
@@ -926,6 +1063,19 @@ namespace Scripting
         def("quad", quad);
         def("cube", cube);
         def("uniform", uniform);
+        def("gl_stats", gl_stats);
+        def("vertex_memory", vertex_memory);
+        def("occlusion_culling", occlusion_culling);
+        def("occlusion_stats", occlusion_stats);
+        def("lod_bias", lod_bias);
+        def("atlas_save", atlas_save);
+        def("atlas_load", atlas_load);
+        def("atlas_stats", atlas_stats);
+        def("texture_streaming_stats", texture_streaming_stats);
+        def("program_cache_stats", program_cache_stats);
+        def("resource_stats", resource_stats);
+        def("resource_budget", resource_budget, args("name", "mb"));
+        def("evict", evict);
         def("headless", Headless::enabled);
         def("server", is_server);
 
@@ -960,6 +1110,10 @@ namespace Scripting
         
         def("clear_collisions", clear_collisions);
         def("register_object", register_object);
+        def("index", index);
+        def("deindex", deindex);
+        def("query_radius", query_radius);
+        def("query_nearest", query_nearest);
 
         //def("to_string", Vector::to_string);
         //def("to_string", Matrix::to_string);
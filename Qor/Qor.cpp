@@ -3,6 +3,13 @@
 //#include "Sprite.h"
 //#include "Grid.h"
 #include "Headless.h"
+#include "GLState.h"
+#include "StreamBuffer.h"
+#include "TextureAtlas.h"
+#include "TextureStreamer.h"
+#include "AssetManifest.h"
+#include "MeshFile.h"
+#include "GLTask.h"
 #include "Physics.h"
 #include "Light.h"
 #include "Node.h"
@@ -21,6 +28,8 @@
 #include "kit/meta/schema.h"
 #include <stdexcept>
 #include <iostream>
+#include <fstream>
+#include <sstream>
 #include <thread>
 #include <boost/algorithm/string.hpp>
 #include <future>
@@ -78,6 +87,11 @@ Qor :: Qor(const Args& args, std::string appname="qor"):
     m_Resources.register_class<Font>("font");
     //m_Resources.register_class<GUI::Form>("form");
     m_Resources.register_class<PipelineShader>("shader");
+
+    // settings.json: memory.<class>-mb
+    m_Resources.budgets(m_Resources.config()->ensure(
+        "memory", make_shared<Meta>()
+    ));
     
     m_Resources.register_resolver(bind(
         &Qor::resolve_resource,
@@ -89,6 +103,11 @@ Qor :: Qor(const Args& args, std::string appname="qor"):
         this,
         std::placeholders::_1
     ));
+    m_Resources.register_dependencies(bind(
+        &Qor::resource_dependencies,
+        this,
+        std::placeholders::_1
+    ));
     m_Resources.register_preserver([](const std::string& s){
         auto ext = Filesystem::getExtension(s);
         if(ext == "ogg")
@@ -114,6 +133,12 @@ Qor :: Qor(const Args& args, std::string appname="qor"):
     for(string& p: m_SearchPaths)
         boost::replace_all(p,"/","\\");
 #endif
+
+    // file name lookups for resource_path()
+    AssetManifest::get()->build(m_SearchPaths, "cache/assets.index");
+#ifndef NDEBUG
+    AssetManifest::get()->watch();
+#endif
         
     m_pWindow = make_shared<Window>(m_Args, &m_Resources);
     
@@ -175,8 +200,15 @@ Qor :: ~Qor()
     //assert(TaskHandler::get() == this);
     //TaskHandler::get(this);
     //assert(!TaskHandler::get());
+    // loaders may still be running GL tasks, let them finish first
+    m_Resources.stop_loaders();
     clear_states_now();
     m_pPipeline.reset();
+    GL_TASK_START()
+        StreamBuffer::get()->clear();
+        TextureAtlas::get()->clear();
+        TextureStreamer::get()->clear();
+    GL_TASK_END()
 }
 
 void Qor :: logic()
@@ -187,6 +219,8 @@ void Qor :: logic()
         m_FPS = m_FramesLastSecond;
         LOGf("FPS: %s", m_FPS);
         m_FramesLastSecond = 0;
+        // unused resources past their class's budget, least recent first
+        m_Resources.enforce_budgets();
     }
     while(!(t = m_pTimer->tick()).ms())
     {
@@ -200,6 +234,8 @@ void Qor :: logic()
     //t = m_pTimer->tick();
     ++m_FramesLastSecond;
 
+    AssetManifest::get()->poll();
+
     m_pInput->logic(t);
     if(m_pInput->quit_flag())
     {
@@ -221,7 +257,11 @@ void Qor :: render()
         
     if(state())
         state()->render();
+
     m_pWindow->render();
+    GLState::get()->frame();
+    StreamBuffer::get()->frame();
+    TextureStreamer::get()->frame();
     //CEGUI::System::getSingleton().renderAllGUIContexts();
 }
 
@@ -249,6 +289,9 @@ void Qor :: run(unsigned state_id)
                 continue;
             }else{
                 state()->preload();
+                m_Resources.wait_loads();
+                ObjFile::forget();
+                MeshFile::forget();
                 state()->finish_loading();
                 continue;
             }
@@ -333,6 +376,15 @@ unsigned Qor :: resolve_resource(
 
     //LOGf("Loading resource \"%s\"...", Filesystem::getFileName(fn));
     
+    // mesh units of a cooked scene, without parsing its json
+    if(ends_with(fn_cut, ".qmesh") || (
+        ends_with(fn_cut, ".json") &&
+        not Filesystem::getInternal(fn).empty() &&
+        not MeshFile::cooked(fn_cut).empty()
+    )){
+        static unsigned class_id = m_Resources.class_id("meshdata");
+        return class_id;
+    }
     if(ends_with(fn_cut, ".json"))
     {
         auto config = make_shared<Meta>(fn_cut);
@@ -363,6 +415,11 @@ unsigned Qor :: resolve_resource(
             return class_id;
         }
     }
+    // images with a cooked .ktx/.dds beside them load it (see Texture)
+    if(ends_with(fn_cut, ".ktx") || ends_with(fn_cut, ".dds")) {
+        static unsigned class_id = m_Resources.class_id("texture");
+        return class_id;
+    }
     if(ends_with(fn_cut, ".mtl")) {
         static unsigned class_id = m_Resources.class_id("material");
         return class_id;
@@ -398,6 +455,19 @@ unsigned Qor :: resolve_resource(
     return std::numeric_limits<unsigned>::max();
 }
 
+vector<string> Qor :: resource_dependencies(const string& fn)
+{
+    // materials take their textures, mesh units their material
+    unsigned class_id = resolve_resource(make_tuple(fn, (ICache*)&m_Resources));
+    static unsigned material = m_Resources.class_id("material");
+    static unsigned meshdata = m_Resources.class_id("meshdata");
+    if(class_id == material)
+        return Material::dependencies(fn, &m_Resources);
+    if(class_id == meshdata)
+        return Mesh::Data::dependencies(fn, &m_Resources);
+    return vector<string>();
+}
+
 string Qor :: resource_path(
     string s
 ){
@@ -413,50 +483,18 @@ string Qor :: resource_path(
         s = std::move(sfn);
     }
         
-    // the recursive dir search for filename 's'
+    // look up filename 's' in the search paths
     string internals = Filesystem::getInternal(s);
     string s_cut = Filesystem::cutInternal(s);
     string ext = Filesystem::getExtension(s_cut);
     
-    auto itr = m_Paths.find(s_cut);
-    if(itr != m_Paths.end())
+    string ns = AssetManifest::get()->find(s_cut);
+    if(not ns.empty())
     {
-        if(fs::exists(path(itr->second))){
-            if(internals.empty())
-                return itr->second;
-            else
-                return itr->second + ":" + internals;
-        }else{
-            m_Paths.erase(itr);
-        }
-    }
-
-    const path fn = path(s_cut);
-    const recursive_directory_iterator end;
-    for(const string& p: m_SearchPaths) {
-        try{
-            const auto it = find_if(
-                recursive_directory_iterator(path(p)),
-                end,
-                [&fn](const directory_entry& e) {
-                    return e.path().filename() == fn;
-                }
-            );
-            if(it != end)
-            {
-                auto ns = it->path().string();
-                if(internals.empty())
-                {
-                    r = ns;
-                    break;
-                }
-                else
-                {
-                    r = ns + ":" + internals;
-                    break;
-                }
-            }
-        }catch(boost::filesystem::filesystem_error&){}
+        if(internals.empty())
+            r = ns;
+        else
+            r = ns + ":" + internals;
     }
     if(r!=s) // found?
     {
@@ -467,7 +505,6 @@ string Qor :: resource_path(
             if(fs::exists(chng))
                 r = chng + ":" + internals;
         }
-        m_Paths[s_cut] = Filesystem::cutInternal(r); // cache for later
     }
     return r;
     //return std::string();
@@ -23,6 +23,8 @@
 #include "kit/cache/cache.h"
 #include "PipelineShader.h"
 #include "ResourceCache.h"
+#include "ObjFile.h"
+#include "MeshFile.h"
 
 class Qor:
     public StateManager<State>,
@@ -173,6 +175,10 @@ class Qor:
         std::string resource_path(
             std::string
         );
+        // what a resource takes from the cache, for async load ordering
+        std::vector<std::string> resource_dependencies(
+            const std::string& fn
+        );
         bool exists(std::string);
         
         //std::tuple<
@@ -222,6 +228,10 @@ class Qor:
             m_pAudio->set_context();
 #endif
             s->preload();
+            // anything preload() queued with cache_async()
+            m_Resources.wait_loads();
+            ObjFile::forget();
+            MeshFile::forget();
             s->finish_loading();
         }
         
@@ -239,8 +249,6 @@ class Qor:
         
         // Resource Cache+Factory
         ResourceCache m_Resources;
-        // cache of paths transformed by resource_path
-        std::unordered_map<std::string, std::string> m_Paths;
         
         unsigned m_LoadingState = ~0u;
         std::atomic<bool> m_bQuit = ATOMIC_VAR_INIT(false);
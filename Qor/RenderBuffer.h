@@ -3,6 +3,7 @@
 
 #include "Common.h"
 #include "Texture.h"
+#include "GLState.h"
 #include "kit/log/log.h"
 
 class RenderBuffer
@@ -19,7 +20,7 @@ public:
         glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, m_Width, m_Height);
         glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_DepthBufferID);
         glGenTextures(1, &m_Texture.id_ref());
-        glBindTexture(GL_TEXTURE_2D, m_Texture.id_ref());
+        GLState::get()->bind_texture(0, m_Texture.id_ref());
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_Width, m_Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
         // glTexParameters, glGenerateMipmap
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_Texture.id_ref(), 0);
@@ -0,0 +1,197 @@
+#include "RenderQueue.h"
+#include "Node.h"
+#include "Camera.h"
+#include <algorithm>
+#include <limits>
+using namespace std;
+using namespace glm;
+
+#define LAYER_BITS 8
+#define TEXTURE_BITS 16
+#define BUFFER_BITS 16
+#define DEPTH_BITS 23
+
+namespace {
+    inline uint64_t field(uint64_t v, unsigned bits) {
+        return std::min<uint64_t>(v, (uint64_t(1) << bits) - 1);
+    }
+}
+
+void RenderQueue :: clear()
+{
+    m_Entries.clear();
+    m_Sorted.clear();
+    m_Batches.clear();
+    m_Stats = Stats();
+}
+
+void RenderQueue :: build(
+    const std::vector<const Node*>& nodes,
+    const Camera* camera,
+    bool sort
+){
+    clear();
+    m_Sorted.reserve(nodes.size());
+
+    if(not m_bEnabled || not camera || not sort)
+    {
+        for(auto&& n: nodes)
+            if(n)
+                m_Sorted.push_back(n);
+        m_Stats.nodes = m_Sorted.size();
+        batch();
+        return;
+    }
+
+    m_Entries.reserve(nodes.size());
+    m_Depths.clear();
+    m_Depths.reserve(nodes.size());
+
+    // view space depth, and range for quantizing
+    const mat4& view = camera->view();
+    float dmin = std::numeric_limits<float>::max();
+    float dmax = std::numeric_limits<float>::lowest();
+    for(auto&& n: nodes)
+    {
+        if(not n)
+            continue;
+        const Box& box = n->world_box();
+        float d = 0.0f;
+        if(not box.quick_zero() && not box.quick_full())
+            d = -(view * vec4(box.center(), 1.0f)).z;
+        else
+            d = -(view * vec4(n->position(Space::WORLD), 1.0f)).z;
+        m_Depths.push_back(d);
+        dmin = std::min(dmin, d);
+        dmax = std::max(dmax, d);
+    }
+    const float drange = dmax - dmin;
+    const uint64_t dmask = (uint64_t(1) << DEPTH_BITS) - 1;
+
+    // partitioner sorts by layer, so the layer rank is a running count
+    unsigned i = 0;
+    unsigned rank = 0;
+    int last_layer = 0;
+    for(auto&& n: nodes)
+    {
+        if(not n)
+            continue;
+
+        if(i && n->layer() != last_layer)
+            ++rank;
+        last_layer = n->layer();
+
+        uint64_t depth = 0;
+        if(drange > 0.0f)
+            depth = uint64_t((m_Depths[i] - dmin) / drange * dmask);
+        depth = field(depth, DEPTH_BITS);
+
+        uint64_t key = field(rank, LAYER_BITS);
+        if(n->translucent())
+        {
+            key = (key << 1) | 1;
+            key = (key << DEPTH_BITS) | (dmask - depth);
+            key = (key << TEXTURE_BITS) | field(n->render_texture_id(), TEXTURE_BITS);
+            key = (key << BUFFER_BITS) | field(n->render_buffer_id(), BUFFER_BITS);
+        }
+        else
+        {
+            key = (key << 1);
+            key = (key << TEXTURE_BITS) | field(n->render_texture_id(), TEXTURE_BITS);
+            key = (key << BUFFER_BITS) | field(n->render_buffer_id(), BUFFER_BITS);
+            key = (key << DEPTH_BITS) | depth;
+        }
+
+        m_Entries.push_back(Entry{key, n});
+        ++i;
+    }
+
+    count_changes(false);
+    radix_sort();
+
+    for(auto&& e: m_Entries)
+        m_Sorted.push_back(e.node);
+    m_Stats.nodes = m_Sorted.size();
+
+    count_changes(true);
+    batch();
+}
+
+void RenderQueue :: batch()
+{
+    const void* last = nullptr;
+    for(unsigned i = 0; i < m_Sorted.size(); ++i)
+    {
+        const void* key = m_Sorted[i]->render_instance_key();
+        if(key && key == last)
+            ++m_Batches.back().count;
+        else
+            m_Batches.push_back(Batch{i, 1});
+        last = key;
+    }
+
+    m_Stats.batches = m_Batches.size();
+    for(auto&& b: m_Batches)
+        if(b.count > 1)
+            m_Stats.instanced += b.count;
+}
+
+void RenderQueue :: radix_sort()
+{
+    const size_t sz = m_Entries.size();
+    if(sz < 2)
+        return;
+    m_Swap.resize(sz);
+
+    Entry* src = &m_Entries[0];
+    Entry* dst = &m_Swap[0];
+
+    // LSD, 8 bits at a time, skipping bytes that are the same for all keys
+    for(unsigned shift = 0; shift < 64; shift += 8)
+    {
+        unsigned count[256] = {0};
+        for(size_t j = 0; j < sz; ++j)
+            ++count[(src[j].key >> shift) & 0xFF];
+
+        if(count[(src[0].key >> shift) & 0xFF] == sz)
+            continue;
+
+        unsigned sum = 0;
+        for(unsigned b = 0; b < 256; ++b) {
+            unsigned c = count[b];
+            count[b] = sum;
+            sum += c;
+        }
+        for(size_t j = 0; j < sz; ++j)
+            dst[count[(src[j].key >> shift) & 0xFF]++] = src[j];
+        std::swap(src, dst);
+    }
+
+    if(src != &m_Entries[0])
+        std::copy(src, src + sz, m_Entries.begin());
+}
+
+void RenderQueue :: count_changes(bool sorted)
+{
+    unsigned tex = 0, buf = 0;
+
+    const Node* prev = nullptr;
+    for(auto&& e: m_Entries)
+    {
+        const Node* n = e.node;
+        if(not prev || n->render_texture_id() != prev->render_texture_id())
+            ++tex;
+        if(not prev || n->render_buffer_id() != prev->render_buffer_id())
+            ++buf;
+        prev = n;
+    }
+
+    if(sorted) {
+        m_Stats.texture_changes = tex;
+        m_Stats.buffer_changes = buf;
+    } else {
+        m_Stats.unsorted_texture_changes = tex;
+        m_Stats.unsorted_buffer_changes = buf;
+    }
+}
+
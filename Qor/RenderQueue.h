@@ -0,0 +1,105 @@
+#ifndef _RENDERQUEUE_H_5XH0T2LC
+#define _RENDERQUEUE_H_5XH0T2LC
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+class Node;
+class Camera;
+
+/*
+ *  Orders a frame's visible nodes to minimize GL state changes.
+ *
+ *  Each node gets a packed 64-bit key, most significant first:
+ *
+ *    opaque:      [layer:8][0:1][texture:16][buffer:16][depth:23]
+ *    translucent: [layer:8][1:1][depth:23 far-to-near][texture:16][buffer:16]
+ *
+ *  so layers still draw in order, opaque geometry is grouped by state and
+ *  then front-to-back, and translucent geometry stays back-to-front.
+ *  The shader is the pipeline's, the same for every node of a pass, so it
+ *  isn't part of the key.
+ *  Keys are radix sorted, which is stable, so ties keep scene order.
+ *
+ *  Consecutive sorted nodes with the same render_instance_key() are then
+ *  grouped into batches that can be drawn with one instanced draw.
+ */
+class RenderQueue
+{
+    public:
+
+        struct Stats
+        {
+            unsigned nodes = 0;
+            unsigned texture_changes = 0;
+            unsigned buffer_changes = 0;
+
+            // changes the same nodes would have caused in scene order
+            unsigned unsorted_texture_changes = 0;
+            unsigned unsorted_buffer_changes = 0;
+
+            unsigned batches = 0;
+            // nodes in batches of more than one
+            unsigned instanced = 0;
+
+            int saved() const {
+                return
+                    (int(unsorted_texture_changes) - int(texture_changes)) +
+                    (int(unsorted_buffer_changes) - int(buffer_changes));
+            }
+        };
+
+        // run of nodes()[first, first + count)
+        struct Batch
+        {
+            unsigned first;
+            unsigned count;
+        };
+
+        RenderQueue() {}
+
+        /*
+         * Build keys for nodes (expected in layer order, as the partitioner
+         * provides them) and sort.  Without sort, nodes keep scene order
+         * and are only batched: blended and depthless passes, and ortho
+         * cameras, draw in the order the scene gives them.
+         */
+        void build(
+            const std::vector<const Node*>& nodes,
+            const Camera* camera,
+            bool sort = true
+        );
+        void clear();
+
+        const std::vector<const Node*>& nodes() const { return m_Sorted; }
+        const std::vector<Batch>& batches() const { return m_Batches; }
+        const Stats& stats() const { return m_Stats; }
+
+        bool enabled() const { return m_bEnabled; }
+        void enabled(bool b) { m_bEnabled = b; }
+
+    private:
+
+        struct Entry
+        {
+            uint64_t key;
+            const Node* node;
+        };
+
+        void radix_sort();
+        void count_changes(bool sorted);
+        void batch();
+
+        std::vector<Entry> m_Entries;
+        std::vector<Entry> m_Swap;
+        std::vector<float> m_Depths;
+        std::vector<const Node*> m_Sorted;
+        std::vector<Batch> m_Batches;
+        Stats m_Stats;
+
+        bool m_bEnabled = true;
+};
+
+#endif
+
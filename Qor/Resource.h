@@ -33,6 +33,13 @@ class Resource:
 
         std::shared_ptr<Meta> config() { return m_pConfig; }
         std::shared_ptr<const Meta> config() const { return m_pConfig; }
+
+        /*
+         * Memory this holds, counted against its class's budget in
+         * ResourceCache.  GPU bytes are what it has uploaded.
+         */
+        virtual size_t cpu_bytes() const { return 0; }
+        virtual size_t gpu_bytes() const { return 0; }
         
     protected:
         
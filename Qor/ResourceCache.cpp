@@ -1,9 +1,23 @@
 #include "ResourceCache.h"
+#include "TaskHandler.h"
+#include "kit/log/errors.h"
+#include "kit/log/log.h"
+#include <algorithm>
+#include <map>
 using namespace std;
 
+const unsigned ResourceCache :: MAX_LOADERS;
+
+ResourceCache :: ~ResourceCache()
+{
+    stop_loaders();
+}
+
 std::shared_ptr<Meta> ResourceCache :: config(std::string fn)
 {
     fn = transform(fn);
+    // loaders read scene units (and their dependencies) at once
+    auto l = unique_lock<mutex>(m_ConfigMutex);
     auto itr = m_Configs.find(fn);
     if(itr == m_Configs.end())
     {
@@ -14,3 +28,369 @@ std::shared_ptr<Meta> ResourceCache :: config(std::string fn)
     return itr->second;
 }
 
+shared_future<shared_ptr<Resource>> ResourceCache :: load_async(const string& name)
+{
+    string fn = transform(name);
+    auto l = unique_lock<mutex>(m_LoadMutex);
+    if(m_Loaders.empty())
+    {
+        unsigned count = max(2u, min(MAX_LOADERS, thread::hardware_concurrency()));
+        m_bStopLoaders = false;
+        m_Running = count;
+        for(unsigned i = 0; i < count; ++i)
+            m_Loaders.emplace_back(bind(&ResourceCache::loader, this));
+    }
+    return queue_load(fn)->future;
+}
+
+shared_ptr<ResourceCache::Load> ResourceCache :: queue_load(const string& fn)
+{
+    auto itr = m_Loads.find(fn);
+    if(itr != m_Loads.end())
+        return itr->second;
+
+    // a new batch
+    if(m_Loads.empty())
+        m_Progress = LoadProgress();
+
+    auto load = make_shared<Load>();
+    load->name = fn;
+    load->future = load->promise.get_future().share();
+    m_Loads[fn] = load;
+    ++m_Progress.total;
+    m_Ready.push_back(load);
+    m_LoadCV.notify_all();
+    return load;
+}
+
+bool ResourceCache :: waits_on(const Load* a, const Load* b) const
+{
+    if(a == b)
+        return true;
+    for(const Load* dep: a->waits_on)
+        if(waits_on(dep, b))
+            return true;
+    return false;
+}
+
+void ResourceCache :: loader()
+{
+    auto l = unique_lock<mutex>(m_LoadMutex);
+    while(true)
+    {
+        m_LoadCV.wait(l, [this]{
+            return m_bStopLoaders || not m_Ready.empty();
+        });
+        if(m_bStopLoaders)
+            break;
+        auto load = std::move(m_Ready.front());
+        m_Ready.pop_front();
+
+        if(not load->scheduled)
+        {
+            // queue what it needs first, it runs once those are in
+            load->scheduled = true;
+            l.unlock();
+            vector<string> deps;
+            try{
+                if(m_Dependencies)
+                    deps = m_Dependencies(load->name);
+                for(auto&& dep: deps)
+                    dep = transform(dep);
+            }catch(...){
+                deps.clear();
+            }
+            l.lock();
+
+            for(auto&& dep: deps)
+            {
+                auto d = queue_load(dep);
+                // skip cycles, the cache sorts those out like it always has
+                if(waits_on(d.get(), load.get()))
+                    continue;
+                d->dependents.push_back(load);
+                load->waits_on.push_back(d.get());
+            }
+            if(load->waits_on.empty())
+                m_Ready.push_back(load);
+            m_LoadCV.notify_all();
+            continue;
+        }
+
+        l.unlock();
+        try{
+            load->promise.set_value(cache(load->name));
+        }catch(...){
+            load->promise.set_exception(current_exception());
+        }
+        l.lock();
+        finish_load(load);
+        {
+            auto rl = unique_lock<mutex>(m_pResidents->mutex);
+            m_pResidents->publish();
+        }
+    }
+    --m_Running;
+    m_LoadCV.notify_all();
+}
+
+void ResourceCache :: finish_load(const shared_ptr<Load>& load)
+{
+    for(auto&& d: load->dependents)
+    {
+        auto& w = d->waits_on;
+        w.erase(std::remove(w.begin(), w.end(), load.get()), w.end());
+        if(w.empty())
+            m_Ready.push_back(d);
+    }
+    load->dependents.clear();
+    m_Loads.erase(load->name);
+    ++m_Progress.done;
+    m_LoadCV.notify_all();
+}
+
+ResourceCache::LoadProgress ResourceCache :: load_progress() const
+{
+    auto l = unique_lock<mutex>(m_LoadMutex);
+    return m_Progress;
+}
+
+void ResourceCache :: wait_loads()
+{
+    {
+        // what this thread cached while queueing
+        auto rl = unique_lock<mutex>(m_pResidents->mutex);
+        m_pResidents->publish();
+    }
+    auto l = unique_lock<mutex>(m_LoadMutex);
+    wait_until(l, [this]{ return m_Loads.empty(); });
+}
+
+void ResourceCache :: wait_until(unique_lock<mutex>& l, function<bool()> done)
+{
+    while(not done())
+    {
+        // loads may be waiting on GL tasks only this thread can run
+        auto tasks = TaskHandler::get();
+        if(tasks && tasks->is_handler()) {
+            l.unlock();
+            tasks->do_tasks();
+            l.lock();
+            m_LoadCV.wait_for(l, chrono::milliseconds(1));
+        }
+        else
+            m_LoadCV.wait(l);
+    }
+}
+
+void ResourceCache :: stop_loaders()
+{
+    auto l = unique_lock<mutex>(m_LoadMutex);
+    m_bStopLoaders = true;
+    m_LoadCV.notify_all();
+    // the ones mid-load finish it first
+    wait_until(l, [this]{ return m_Running == 0; });
+    l.unlock();
+    for(auto&& t: m_Loaders)
+        t.join();
+    l.lock();
+    m_Loaders.clear();
+    m_Ready.clear();
+    m_Loads.clear();
+    m_Progress = LoadProgress();
+    m_bStopLoaders = false;
+}
+
+void ResourceCache :: budget(const string& class_name, size_t bytes)
+{
+    auto l = unique_lock<mutex>(m_pResidents->mutex);
+    for(auto&& c: m_Classes)
+        if(c.second.name == class_name) {
+            c.second.budget = bytes;
+            return;
+        }
+    l.unlock();
+    K_ERRORf(GENERAL, "No resource class \"%s\"", class_name);
+}
+
+size_t ResourceCache :: budget(const string& class_name) const
+{
+    auto l = unique_lock<mutex>(m_pResidents->mutex);
+    for(auto&& c: m_Classes)
+        if(c.second.name == class_name)
+            return c.second.budget;
+    return 0;
+}
+
+void ResourceCache :: budgets(shared_ptr<Meta> cfg)
+{
+    auto l = unique_lock<mutex>(m_pResidents->mutex);
+    for(auto&& c: m_Classes) {
+        int mb = cfg->at<int>(c.second.name + "-mb", 0);
+        c.second.budget = size_t(max(0, mb)) * 1024 * 1024;
+    }
+}
+
+void ResourceCache::Residents :: add(Resource* r, type_index type)
+{
+    auto l = std::unique_lock<std::mutex>(this->mutex);
+    // anything this thread made before is owned by now
+    publish();
+    auto id = this_thread::get_id();
+    entries.insert(make_pair(r, Resident{type, 0, id, false}));
+    pending[id].push_back(r);
+}
+
+void ResourceCache::Residents :: remove(Resource* r)
+{
+    auto l = std::unique_lock<std::mutex>(this->mutex);
+    auto itr = entries.find(r);
+    if(itr == entries.end())
+        return;
+    if(not itr->second.published) {
+        auto p = pending.find(itr->second.thread);
+        if(p != pending.end()) {
+            auto& v = p->second;
+            v.erase(std::remove(v.begin(), v.end(), r), v.end());
+            if(v.empty())
+                pending.erase(p);
+        }
+    }
+    entries.erase(itr);
+}
+
+void ResourceCache::Residents :: publish()
+{
+    auto p = pending.find(this_thread::get_id());
+    if(p == pending.end())
+        return;
+    for(Resource* r: p->second)
+        entries.at(r).published = true;
+    pending.erase(p);
+}
+
+vector<ResourceCache::Snapshot> ResourceCache :: snapshot(bool mark)
+{
+    vector<Snapshot> r;
+    auto l = unique_lock<mutex>(m_pResidents->mutex);
+    // nothing held may be let go in here: the last one out takes the lock
+    r.reserve(m_pResidents->entries.size());
+    m_pResidents->publish();
+    for(auto&& e: m_pResidents->entries)
+    {
+        if(not e.second.published)
+            continue;
+        auto c = m_ClassIDs.find(e.second.type);
+        if(c == m_ClassIDs.end())
+            continue;
+        shared_ptr<Resource> res;
+        try{
+            res = e.first->shared_from_this();
+        }catch(const bad_weak_ptr&){
+            // on its way out
+            continue;
+        }
+        // more than the cache's and ours
+        bool in_use = res.use_count() > 2;
+        if(mark && (in_use || not e.second.used))
+            e.second.used = m_Scan;
+        r.push_back(Snapshot{std::move(res), c->second, e.second.used, in_use});
+    }
+    return r;
+}
+
+unsigned ResourceCache :: enforce_budgets()
+{
+    auto sl = unique_lock<mutex>(m_ScanMutex);
+    ++m_Scan;
+    auto entries = snapshot(true);
+
+    unordered_map<unsigned, size_t> budgets;
+    {
+        auto l = unique_lock<mutex>(m_pResidents->mutex);
+        for(auto&& c: m_Classes)
+            if(c.second.budget)
+                budgets[c.first] = c.second.budget;
+    }
+    if(budgets.empty())
+        return 0;
+
+    unordered_map<unsigned, size_t> totals;
+    vector<pair<Snapshot*, size_t>> unused;
+    for(auto&& e: entries)
+    {
+        if(not budgets.count(e.class_id))
+            continue;
+        size_t bytes = e.resource->cpu_bytes() + e.resource->gpu_bytes();
+        totals[e.class_id] += bytes;
+        if(not e.in_use)
+            unused.push_back(make_pair(&e, bytes));
+    }
+
+    // least recently used first
+    stable_sort(unused.begin(), unused.end(), [](
+        const pair<Snapshot*, size_t>& a,
+        const pair<Snapshot*, size_t>& b
+    ){
+        return a.first->used < b.first->used;
+    });
+
+    unordered_map<unsigned, unsigned> evicted;
+    unsigned count = 0;
+    for(auto&& u: unused)
+    {
+        unsigned id = u.first->class_id;
+        auto& total = totals[id];
+        if(total <= budgets[id])
+            continue;
+        total -= u.second;
+        // leaves the cache's as the only one
+        u.first->resource.reset();
+        ++evicted[id];
+        ++count;
+    }
+    if(not count)
+        return 0;
+
+    // the rest are still held by entries, so only the evicted go
+    optimize();
+
+    {
+        auto l = unique_lock<mutex>(m_pResidents->mutex);
+        for(auto&& e: evicted)
+            m_Classes[e.first].evicted += e.second;
+    }
+    LOGf("Evicted %s resources over budget", count);
+    return count;
+}
+
+vector<ResourceCache::Residency> ResourceCache :: residency()
+{
+    auto sl = unique_lock<mutex>(m_ScanMutex);
+    auto entries = snapshot(false);
+
+    map<unsigned, Residency> classes;
+    {
+        auto l = unique_lock<mutex>(m_pResidents->mutex);
+        for(auto&& c: m_Classes) {
+            auto& r = classes[c.first];
+            r.name = c.second.name;
+            r.budget = c.second.budget;
+            r.evicted = c.second.evicted;
+        }
+    }
+    for(auto&& e: entries)
+    {
+        auto& r = classes[e.class_id];
+        ++r.entries;
+        if(e.in_use)
+            ++r.in_use;
+        r.cpu_bytes += e.resource->cpu_bytes();
+        r.gpu_bytes += e.resource->gpu_bytes();
+    }
+
+    vector<Residency> r;
+    for(auto&& c: classes)
+        r.push_back(c.second);
+    return r;
+}
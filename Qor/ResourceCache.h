@@ -4,12 +4,76 @@
 #include "Resource.h"
 #include "kit/cache/cache.h"
 #include "kit/meta/meta.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+/*
+ *  A resource being loaded by ResourceCache::cache_async()
+ */
+template<class T>
+class ResourceHandle
+{
+    public:
+        ResourceHandle() = default;
+        explicit ResourceHandle(std::shared_future<std::shared_ptr<Resource>> f):
+            m_Future(std::move(f))
+        {}
+
+        bool valid() const { return m_Future.valid(); }
+
+        // loaded, or failed to
+        bool ready() const {
+            return m_Future.valid() &&
+                m_Future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+
+        // waits for the load and rethrows its error, null if it isn't a T
+        std::shared_ptr<T> get() const {
+            return std::dynamic_pointer_cast<T>(m_Future.get());
+        }
+
+    private:
+        std::shared_future<std::shared_ptr<Resource>> m_Future;
+};
 
 class ResourceCache:
     public Cache<Resource, std::string>
 {
     public:
-        
+
+        struct LoadProgress
+        {
+            size_t done = 0;
+            size_t total = 0;
+        };
+
+        // entries of a class and the memory they hold
+        struct Residency
+        {
+            std::string name;
+            unsigned entries = 0;
+            // held by something other than the cache
+            unsigned in_use = 0;
+            size_t cpu_bytes = 0;
+            size_t gpu_bytes = 0;
+            // bytes, 0 for no limit
+            size_t budget = 0;
+            // since startup
+            unsigned evicted = 0;
+        };
+
+        static const unsigned MAX_LOADERS = 8;
+
         ResourceCache() = default;
         ResourceCache(std::string fn):
             Cache<Resource, std::string>(fn)
@@ -17,9 +81,9 @@ class ResourceCache:
         ResourceCache(std::shared_ptr<Meta> cfg):
             Cache<Resource, std::string>(cfg)
         {}
-        
-        virtual ~ResourceCache() {}
-        
+
+        virtual ~ResourceCache();
+
         std::shared_ptr<Meta> config() {
             return Cache<Resource, std::string>::config();
         }
@@ -28,9 +92,194 @@ class ResourceCache:
         }
         std::shared_ptr<Meta> config(std::string fn);
 
+        /*
+         * Caches name on the loader threads and returns at once.  What it
+         * takes from the cache while loading (see register_dependencies())
+         * is loaded first, alongside anything else that's ready to go.
+         */
+        template<class T>
+        ResourceHandle<T> cache_async(const std::string& name) {
+            return ResourceHandle<T>(load_async(name));
+        }
+        std::shared_future<std::shared_ptr<Resource>> load_async(const std::string& name);
+
+        /*
+         * Names of the resources a resource will get from the cache,
+         * worked out without loading it
+         */
+        void register_dependencies(
+            std::function<std::vector<std::string>(const std::string&)> func
+        ){
+            m_Dependencies = func;
+        }
+
+        // async loads done and queued since the queue last ran empty
+        LoadProgress load_progress() const;
+
+        // waits for every async load, running GL tasks on the GL thread
+        void wait_loads();
+
+        // drops loads not yet started and stops the loader threads
+        void stop_loaders();
+
+        /*
+         * Same as Cache's, but the entries it makes are tracked for
+         * residency() and budgets
+         */
+        template<class T>
+        unsigned register_class(const std::string& name) {
+            unsigned id = Cache<Resource, std::string>::register_class<Entry<T>>(name);
+            auto l = std::unique_lock<std::mutex>(m_pResidents->mutex);
+            m_ClassIDs[std::type_index(typeid(T))] = id;
+            m_Classes[id].name = name;
+            return id;
+        }
+
+        /*
+         * Bytes (CPU and GPU together) the entries of a class may hold, 0
+         * for no limit.  Past it, enforce_budgets() drops the ones nothing
+         * else holds, least recently used first.
+         */
+        void budget(const std::string& class_name, size_t bytes);
+        size_t budget(const std::string& class_name) const;
+
+        // "<class>-mb" of each registered class in cfg (settings.json: memory)
+        void budgets(std::shared_ptr<Meta> cfg);
+
+        /*
+         * Notes which entries are in use and evicts unused ones of classes
+         * over budget, returning how many.  Call regularly: use is only
+         * seen here, so the LRU order is as fine as the calls are.
+         */
+        unsigned enforce_budgets();
+
+        // per registered class
+        std::vector<Residency> residency();
+
     private:
 
+        // an entry that was cached, with the scan it was last seen in use
+        struct Resident
+        {
+            std::type_index type;
+            uint64_t used;
+            // made on, and whether another thread may take a reference
+            // yet (see Residents::publish())
+            std::thread::id thread;
+            bool published;
+        };
+
+        struct Residents
+        {
+            std::mutex mutex;
+            std::unordered_map<Resource*, Resident> entries;
+            // entries not yet published, by the thread that made them
+            std::unordered_map<std::thread::id, std::vector<Resource*>> pending;
+
+            void add(Resource* r, std::type_index type);
+            void remove(Resource* r);
+
+            /*
+             * The shared_ptr owning an entry is only set up after its
+             * constructor returns, so other threads leave it alone until
+             * the thread that made it gets back to the cache.  Needs the
+             * lock.
+             */
+            void publish();
+        };
+
+        /*
+         * What register_class() registers in place of T, so the cache's
+         * entries are known without it having to say.  Shares the list
+         * with its cache, since entries may outlive it.
+         */
+        template<class T>
+        class Entry:
+            public T
+        {
+            public:
+                Entry(const std::tuple<std::string, ICache*>& args):
+                    T(args)
+                {
+                    auto cache = dynamic_cast<ResourceCache*>(std::get<1>(args));
+                    if(not cache)
+                        return;
+                    m_pResidents = cache->m_pResidents;
+                    m_pResidents->add(this, std::type_index(typeid(T)));
+                }
+                virtual ~Entry() {
+                    if(m_pResidents)
+                        m_pResidents->remove(this);
+                }
+
+            private:
+                std::shared_ptr<Residents> m_pResidents;
+        };
+
+        struct Class
+        {
+            std::string name;
+            size_t budget = 0;
+            unsigned evicted = 0;
+        };
+
+        // a look at every entry, holding them so none go mid-scan
+        struct Snapshot
+        {
+            std::shared_ptr<Resource> resource;
+            unsigned class_id;
+            uint64_t used;
+            bool in_use;
+        };
+        std::vector<Snapshot> snapshot(bool mark);
+
+        struct Load
+        {
+            std::string name;
+            std::promise<std::shared_ptr<Resource>> promise;
+            std::shared_future<std::shared_ptr<Resource>> future;
+            // dependencies were looked up
+            bool scheduled = false;
+            // loads this one waits on, and the loads waiting on it
+            std::vector<Load*> waits_on;
+            std::vector<std::shared_ptr<Load>> dependents;
+        };
+
+        std::shared_ptr<Load> queue_load(const std::string& name);
+        // a already waits on b, directly or not
+        bool waits_on(const Load* a, const Load* b) const;
+        void finish_load(const std::shared_ptr<Load>& load);
+        void loader();
+        void wait_until(
+            std::unique_lock<std::mutex>& l,
+            std::function<bool()> done
+        );
+
         std::unordered_map<std::string, std::shared_ptr<Meta>> m_Configs;
+        std::mutex m_ConfigMutex;
+
+        std::function<std::vector<std::string>(const std::string&)> m_Dependencies;
+
+        mutable std::mutex m_LoadMutex;
+        std::condition_variable m_LoadCV;
+        // loads in progress, by transformed name
+        std::unordered_map<std::string, std::shared_ptr<Load>> m_Loads;
+        // loads to schedule or run, in order
+        std::deque<std::shared_ptr<Load>> m_Ready;
+        std::vector<std::thread> m_Loaders;
+        // loader threads yet to exit
+        unsigned m_Running = 0;
+        bool m_bStopLoaders = false;
+        LoadProgress m_Progress;
+
+        std::shared_ptr<Residents> m_pResidents = std::make_shared<Residents>();
+        // guarded by m_pResidents->mutex
+        std::unordered_map<std::type_index, unsigned> m_ClassIDs;
+        std::unordered_map<unsigned, Class> m_Classes;
+        // enforce_budgets() calls, the clock entries are used by
+        uint64_t m_Scan = 0;
+        // one scan at a time
+        std::mutex m_ScanMutex;
 };
 
 #endif
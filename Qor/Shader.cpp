@@ -124,6 +124,8 @@ Program :: Program(shared_ptr<Shader> vp, shared_ptr<Shader> fp)
         K_ERROR(ACTION, "attach vertex shader");
     if(!attach(fp))
         K_ERROR(ACTION, "attach fragment shader");
+    if(binaries_supported())
+        glProgramParameteri(m_ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     if(!link())
         K_ERROR(ACTION, "link shader program");
     use();
@@ -131,6 +133,62 @@ Program :: Program(shared_ptr<Shader> vp, shared_ptr<Shader> fp)
     dtor.resolve();
 }
 
+shared_ptr<Program> Program :: from_binary(unsigned format, const vector<char>& data)
+{
+    if(data.empty() || !binaries_supported())
+        return nullptr;
+    auto program = shared_ptr<Program>(new Program());
+    program->m_ID = glCreateProgram();
+    if(!program->m_ID)
+        return nullptr;
+    glProgramBinary(program->m_ID, format, &data[0], data.size());
+    int r = 0;
+    glGetProgramiv(program->m_ID, GL_LINK_STATUS, &r);
+    if(!r) {
+        // a rejected binary isn't an error, just a recompile
+        while(glGetError() != GL_NO_ERROR) {}
+        return nullptr;
+    }
+    program->m_Linked = true;
+    return program;
+}
+
+bool Program :: binary(unsigned& format, vector<char>& data) const
+{
+    if(!m_ID || !m_Linked || !binaries_supported())
+        return false;
+    int len = 0;
+    glGetProgramiv(m_ID, GL_PROGRAM_BINARY_LENGTH, &len);
+    if(len <= 0)
+        return false;
+    data.resize(len);
+    GLenum fmt = 0;
+    GLsizei actual_len = 0;
+    glGetProgramBinary(m_ID, len, &actual_len, &fmt, &data[0]);
+    if(actual_len <= 0)
+        return false;
+    data.resize(actual_len);
+    format = fmt;
+    return true;
+}
+
+bool Program :: binaries_supported()
+{
+    if(!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+        return false;
+    int formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+void Program :: reflection(
+    unordered_map<string, UniformID> uniforms,
+    unordered_map<string, int> attributes
+){
+    m_Uniforms = std::move(uniforms);
+    m_AttributeLocations = std::move(attributes);
+}
+
 Program :: ~Program()
 {
     unload();
@@ -140,7 +198,7 @@ void Program :: unload()
 {
     if(m_ID)
     {
-        glDeleteProgram(m_ID);
+        GLState::get()->delete_program(m_ID);
         m_ID = 0;
     }
 }
@@ -163,20 +221,91 @@ bool Program :: link()
     glLinkProgram(m_ID);
     glGetProgramiv(m_ID, GL_LINK_STATUS, &r);
     m_Linked = true;
+    cache_uniforms();
+    cache_attributes();
     return r!=0;
 }
 
+void Program :: cache_uniforms()
+{
+    m_Uniforms.clear();
+    
+    int count = 0, max_len = 0;
+    glGetProgramiv(m_ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(m_ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_len);
+    if(count <= 0 || max_len <= 0)
+        return;
+    
+    vector<char> buf(max_len + 1);
+    for(int i = 0; i < count; ++i)
+    {
+        GLsizei len = 0;
+        GLint size = 0;
+        GLenum type;
+        glGetActiveUniform(m_ID, i, buf.size(), &len, &size, &type, &buf[0]);
+        string name(&buf[0], len);
+        
+        // arrays are reported as "name[0]"
+        auto bracket = name.find('[');
+        if(bracket != string::npos)
+            name = name.substr(0, bracket);
+        
+        UniformID loc = glGetUniformLocation(m_ID, name.c_str());
+        if(loc < 0)
+            continue;
+        m_Uniforms[name] = loc;
+        if(size > 1 || bracket != string::npos)
+            for(int j = 0; j < size; ++j)
+            {
+                string elem = name + "[" + to_string(j) + "]";
+                UniformID eloc = glGetUniformLocation(m_ID, elem.c_str());
+                if(eloc >= 0)
+                    m_Uniforms[elem] = eloc;
+            }
+    }
+}
+
+void Program :: cache_attributes()
+{
+    m_AttributeLocations.clear();
+    
+    int count = 0, max_len = 0;
+    glGetProgramiv(m_ID, GL_ACTIVE_ATTRIBUTES, &count);
+    glGetProgramiv(m_ID, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &max_len);
+    if(count <= 0 || max_len <= 0)
+        return;
+    
+    vector<char> buf(max_len + 1);
+    for(int i = 0; i < count; ++i)
+    {
+        GLsizei len = 0;
+        GLint size = 0;
+        GLenum type;
+        glGetActiveAttrib(m_ID, i, buf.size(), &len, &size, &type, &buf[0]);
+        string name(&buf[0], len);
+        auto bracket = name.find('[');
+        if(bracket != string::npos)
+            name = name.substr(0, bracket);
+        int loc = glGetAttribLocation(m_ID, name.c_str());
+        if(loc >= 0)
+            m_AttributeLocations[name] = loc;
+    }
+}
+
 bool Program :: use()
 {
     if(!m_ID)
         return false;
-    glUseProgram(m_ID);
+    GLState::get()->use_program(m_ID);
     return true;
 }
 
 unsigned Program :: attribute(std::string name)
 {
-    return glGetAttribLocation(m_ID, name.c_str());
+    auto itr = m_AttributeLocations.find(name);
+    if(itr == m_AttributeLocations.end())
+        return ~0u;
+    return (unsigned)itr->second;
 }
 
 bool Program :: attribute(unsigned int index, std::string name)
@@ -188,12 +317,14 @@ bool Program :: attribute(unsigned int index, std::string name)
     return err == GL_NO_ERROR;
 }
 
-Program::UniformID Program :: uniform(string n) const
+Program::UniformID Program :: uniform(const string& n) const
 {
-    UniformID id = glGetUniformLocation(m_ID, n.c_str());
+    auto itr = m_Uniforms.find(n);
+    if(itr == m_Uniforms.end())
+        return -1;
     //if(id < 0)
     //    K_ERROR(READ, string("shader uniform ") + n);
-    return id;
+    return itr->second;
 }
 
 void Program :: uniform(UniformID uid, float v) const {
@@ -248,12 +379,24 @@ void Program :: uniform(UniformID uid, const glm::vec4& vec) const {
     if(!isValidUniformID(uid)) return;
     glUniform4fv((GLint)(uid), 1, glm::value_ptr(vec));
 }
-//void Program :: uniform(UniformID uid, unsigned int size, unsigned int count, const int* v) {
-//    if(!isValidUniformID(uid)) return;
-//    // todo: add
-//}
-//void Program :: uniform(UniformID uid, unsigned int size, unsigned int count, const float* v){
-//    if(!isValidUniformID(uid)) return;
-//    // todo: add
-//}
+void Program :: uniform(UniformID uid, unsigned int size, unsigned int count, const int* v) const {
+    if(!isValidUniformID(uid)) return;
+    switch(size) {
+        case 1: glUniform1iv((GLint)uid, count, v); break;
+        case 2: glUniform2iv((GLint)uid, count, v); break;
+        case 3: glUniform3iv((GLint)uid, count, v); break;
+        case 4: glUniform4iv((GLint)uid, count, v); break;
+        default: assert(false);
+    }
+}
+void Program :: uniform(UniformID uid, unsigned int size, unsigned int count, const float* v) const {
+    if(!isValidUniformID(uid)) return;
+    switch(size) {
+        case 1: glUniform1fv((GLint)uid, count, v); break;
+        case 2: glUniform2fv((GLint)uid, count, v); break;
+        case 3: glUniform3fv((GLint)uid, count, v); break;
+        case 4: glUniform4fv((GLint)uid, count, v); break;
+        default: assert(false);
+    }
+}
 
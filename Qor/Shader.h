@@ -5,8 +5,11 @@
 #include <list>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include "kit/math/common.h"
 #include "Common.h"
+#include "GLState.h"
 #include "kit/log/errors.h"
 
 class Shader
@@ -64,11 +67,47 @@ class Program
         unsigned int m_ID = 0;
         std::list<std::shared_ptr<Shader>> m_Shaders;
 
+        // active uniform locations, resolved once per link
+        // arrays are listed by name, "name[0]" and each "name[i]"
+        std::unordered_map<std::string, UniformID> m_Uniforms;
+        // active attribute locations, resolved with the uniforms
+        std::unordered_map<std::string, int> m_AttributeLocations;
+
+        Program() = default;
+
         bool attach(std::shared_ptr<Shader>& shader);
+        void cache_uniforms();
+        void cache_attributes();
 
     public:
 
         Program(std::shared_ptr<Shader> vp, std::shared_ptr<Shader> fp);
+
+        /*
+         * Program from a binary an earlier binary() call gave, or null if
+         * the driver rejects it (new driver or GPU).  Has no reflection
+         * until reflection() is called.
+         */
+        static std::shared_ptr<Program> from_binary(
+            unsigned format,
+            const std::vector<char>& data
+        );
+        // the linked program in the driver's format, false if unavailable
+        bool binary(unsigned& format, std::vector<char>& data) const;
+        // GL_ARB_get_program_binary with at least one format
+        static bool binaries_supported();
+
+        const std::unordered_map<std::string, UniformID>& uniforms() const {
+            return m_Uniforms;
+        }
+        const std::unordered_map<std::string, int>& attributes() const {
+            return m_AttributeLocations;
+        }
+        // reflection saved along with a binary, instead of asking GL
+        void reflection(
+            std::unordered_map<std::string, UniformID> uniforms,
+            std::unordered_map<std::string, int> attributes
+        );
         virtual ~Program();
         bool use();
         void unload();
@@ -87,9 +126,11 @@ class Program
         //    glBindFragDataLocation(m_ID, 0, "FragColor");
         //}
         bool attribute(unsigned int index, std::string name);
+        // location of an active attribute, or ~0u (no GL call)
         unsigned attribute(std::string name);
 
-        UniformID uniform(std::string n) const;
+        // location of an active uniform, or -1 (no GL call)
+        UniformID uniform(const std::string& n) const;
         void uniform(UniformID uid, float v) const;
         void uniform(UniformID uid, float v, float v2) const;
         void uniform(UniformID uid, float v, float v2, float v3) const;
@@ -108,7 +149,7 @@ class Program
         void uniform(UniformID uid, unsigned int size, unsigned int count, const int* v) const;
         void uniform(UniformID uid, unsigned int size, unsigned int count, const float* v) const;
         
-        static void unuseAll() { glUseProgram(0); }
+        static void unuseAll() { GLState::get()->use_program(0); }
 };
 
 #endif
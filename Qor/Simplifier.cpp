@@ -0,0 +1,304 @@
+#include "Simplifier.h"
+#include <algorithm>
+#include <numeric>
+#include <map>
+#include <utility>
+#include <cmath>
+using namespace std;
+using namespace glm;
+
+// how much harder open borders are to move than the surface
+static const double BORDER_WEIGHT = 100.0;
+// new/old normal cosine below which a collapse counts as a flip
+static const double FLIP_COSINE = 0.2;
+
+void Simplifier :: Quadric :: add_plane(const dvec4& p, double w)
+{
+    q[0] += w*p.x*p.x; q[1] += w*p.x*p.y; q[2] += w*p.x*p.z; q[3] += w*p.x*p.w;
+    q[4] += w*p.y*p.y; q[5] += w*p.y*p.z; q[6] += w*p.y*p.w;
+    q[7] += w*p.z*p.z; q[8] += w*p.z*p.w;
+    q[9] += w*p.w*p.w;
+}
+
+Simplifier::Quadric& Simplifier :: Quadric :: operator+=(const Quadric& rhs)
+{
+    for(unsigned i = 0; i < 10; ++i)
+        q[i] += rhs.q[i];
+    return *this;
+}
+
+double Simplifier :: Quadric :: error(const dvec3& v) const
+{
+    return
+        q[0]*v.x*v.x + 2.0*q[1]*v.x*v.y + 2.0*q[2]*v.x*v.z + 2.0*q[3]*v.x +
+        q[4]*v.y*v.y + 2.0*q[5]*v.y*v.z + 2.0*q[6]*v.y +
+        q[7]*v.z*v.z + 2.0*q[8]*v.z +
+        q[9];
+}
+
+Simplifier :: Simplifier(
+    const float* verts, size_t vert_count,
+    const unsigned* indices, size_t index_count
+){
+    if(not verts || not vert_count)
+        return;
+
+    // weld vertices sharing a position
+    vector<unsigned> order(vert_count);
+    iota(order.begin(), order.end(), 0u);
+    auto less_pos = [verts](unsigned a, unsigned b) {
+        return lexicographical_compare(verts + a*3, verts + a*3 + 3, verts + b*3, verts + b*3 + 3);
+    };
+    sort(order.begin(), order.end(), less_pos);
+    m_PositionOf.resize(vert_count);
+    for(size_t i = 0; i < vert_count; ++i)
+    {
+        unsigned v = order[i];
+        if(i == 0 || less_pos(order[i-1], v))
+        {
+            m_Positions.push_back(dvec3(verts[v*3], verts[v*3+1], verts[v*3+2]));
+            m_VertexAt.push_back(v);
+        }
+        m_PositionOf[v] = unsigned(m_Positions.size() - 1);
+    }
+
+    const size_t positions = m_Positions.size();
+    m_Parent.resize(positions);
+    iota(m_Parent.begin(), m_Parent.end(), 0u);
+    m_Replace.assign(positions, 0);
+    m_Version.assign(positions, 0);
+    m_Quadrics.resize(positions);
+    m_Triangles.resize(positions);
+
+    if(indices)
+    {
+        for(size_t i = 0; i + 2 < index_count; i += 3)
+            if(indices[i] < vert_count &&
+                indices[i+1] < vert_count &&
+                indices[i+2] < vert_count
+            )
+                m_Corners.insert(m_Corners.end(), indices + i, indices + i + 3);
+    }
+    else
+    {
+        m_Corners.resize(vert_count / 3 * 3);
+        iota(m_Corners.begin(), m_Corners.end(), 0u);
+    }
+
+    // face quadrics, and how many faces use each edge to find borders
+    map<pair<unsigned, unsigned>, unsigned> edges;
+    const size_t tris = m_Corners.size() / 3;
+    m_Removed.assign(tris, false);
+    for(size_t t = 0; t < tris; ++t)
+    {
+        unsigned p[3];
+        for(unsigned i = 0; i < 3; ++i)
+            p[i] = m_PositionOf[m_Corners[t*3+i]];
+        if(p[0] == p[1] || p[1] == p[2] || p[2] == p[0]) {
+            m_Removed[t] = true;
+            continue;
+        }
+        ++m_Live;
+        dvec3 n = cross(m_Positions[p[1]] - m_Positions[p[0]], m_Positions[p[2]] - m_Positions[p[0]]);
+        double len = length(n);
+        if(len > 0.0)
+        {
+            n /= len;
+            Quadric q;
+            q.add_plane(dvec4(n, -dot(n, m_Positions[p[0]])));
+            for(unsigned i = 0; i < 3; ++i)
+                m_Quadrics[p[i]] += q;
+        }
+        for(unsigned i = 0; i < 3; ++i)
+        {
+            m_Triangles[p[i]].push_back(unsigned(t));
+            unsigned a = p[i], b = p[(i+1)%3];
+            ++edges[make_pair(std::min(a,b), std::max(a,b))];
+        }
+    }
+
+    // planes through border edges, perpendicular to their face
+    for(size_t t = 0; t < tris; ++t)
+    {
+        if(m_Removed[t])
+            continue;
+        unsigned p[3];
+        for(unsigned i = 0; i < 3; ++i)
+            p[i] = m_PositionOf[m_Corners[t*3+i]];
+        dvec3 n = cross(m_Positions[p[1]] - m_Positions[p[0]], m_Positions[p[2]] - m_Positions[p[0]]);
+        for(unsigned i = 0; i < 3; ++i)
+        {
+            unsigned a = p[i], b = p[(i+1)%3];
+            if(edges[make_pair(std::min(a,b), std::max(a,b))] != 1)
+                continue;
+            dvec3 e = m_Positions[b] - m_Positions[a];
+            dvec3 bn = cross(e, n);
+            double len = length(bn);
+            if(len <= 0.0)
+                continue;
+            bn /= len;
+            Quadric q;
+            q.add_plane(dvec4(bn, -dot(bn, m_Positions[a])), BORDER_WEIGHT * dot(e, e));
+            m_Quadrics[a] += q;
+            m_Quadrics[b] += q;
+        }
+    }
+
+    for(auto&& e: edges) {
+        push(e.first.first, e.first.second);
+        push(e.first.second, e.first.first);
+    }
+}
+
+unsigned Simplifier :: position(unsigned vertex) const
+{
+    return m_PositionOf[vertex];
+}
+
+unsigned Simplifier :: root(unsigned pos)
+{
+    while(m_Parent[pos] != pos)
+        pos = m_Parent[pos] = m_Parent[m_Parent[pos]];
+    return pos;
+}
+
+unsigned Simplifier :: resolve(unsigned vertex)
+{
+    // follow collapses to a vertex at a position still alive
+    unsigned p = position(vertex);
+    while(m_Parent[p] != p) {
+        vertex = m_Replace[p];
+        p = position(vertex);
+    }
+    return vertex;
+}
+
+void Simplifier :: push(unsigned from, unsigned to)
+{
+    Quadric q = m_Quadrics[from];
+    q += m_Quadrics[to];
+    Collapse c;
+    c.cost = std::max(0.0, q.error(m_Positions[to]));
+    c.from = from;
+    c.to = to;
+    c.from_version = m_Version[from];
+    c.to_version = m_Version[to];
+    m_Heap.push_back(c);
+    push_heap(m_Heap.begin(), m_Heap.end());
+}
+
+bool Simplifier :: flips(unsigned from, unsigned to)
+{
+    for(unsigned t: m_Triangles[from])
+    {
+        if(m_Removed[t])
+            continue;
+        unsigned p[3];
+        bool shared = false;
+        for(unsigned i = 0; i < 3; ++i) {
+            p[i] = root(position(m_Corners[t*3+i]));
+            shared = shared || p[i] == to;
+        }
+        // goes away with the collapse
+        if(shared)
+            continue;
+        dvec3 before = cross(m_Positions[p[1]] - m_Positions[p[0]], m_Positions[p[2]] - m_Positions[p[0]]);
+        for(unsigned i = 0; i < 3; ++i)
+            if(p[i] == from)
+                p[i] = to;
+        dvec3 after = cross(m_Positions[p[1]] - m_Positions[p[0]], m_Positions[p[2]] - m_Positions[p[0]]);
+        double lb = length(before), la = length(after);
+        if(la <= 0.0)
+            return true;
+        if(lb > 0.0 && dot(before, after) < FLIP_COSINE * lb * la)
+            return true;
+    }
+    return false;
+}
+
+void Simplifier :: collapse(unsigned from, unsigned to)
+{
+    unsigned replace = m_VertexAt[to];
+    bool found = false;
+    for(unsigned t: m_Triangles[from])
+    {
+        if(m_Removed[t])
+            continue;
+        unsigned at_to = ~0u;
+        for(unsigned i = 0; i < 3; ++i)
+        {
+            unsigned v = resolve(m_Corners[t*3+i]);
+            if(position(v) == to)
+                at_to = v;
+        }
+        if(at_to != ~0u)
+        {
+            // prefer a vertex from a face across the edge, so attributes
+            // (UVs at seams) come from the same side
+            if(not found) {
+                replace = at_to;
+                found = true;
+            }
+            m_Removed[t] = true;
+            --m_Live;
+        }
+        else
+            m_Triangles[to].push_back(t);
+    }
+    m_Triangles[from].clear();
+    m_Replace[from] = replace;
+    m_Parent[from] = to;
+    m_Quadrics[to] += m_Quadrics[from];
+    ++m_Version[to];
+
+    // drop dead faces and requeue the edges around what's left
+    auto& tris = m_Triangles[to];
+    tris.erase(remove_if(tris.begin(), tris.end(), [this](unsigned t){
+        return m_Removed[t];
+    }), tris.end());
+    vector<unsigned> neighbors;
+    for(unsigned t: tris)
+        for(unsigned i = 0; i < 3; ++i)
+        {
+            unsigned p = root(position(m_Corners[t*3+i]));
+            if(p != to)
+                neighbors.push_back(p);
+        }
+    sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
+    for(unsigned n: neighbors) {
+        push(n, to);
+        push(to, n);
+    }
+}
+
+Simplifier::Level Simplifier :: simplify(size_t triangles)
+{
+    while(m_Live > triangles && not m_Heap.empty())
+    {
+        pop_heap(m_Heap.begin(), m_Heap.end());
+        Collapse c = m_Heap.back();
+        m_Heap.pop_back();
+
+        if(m_Parent[c.from] != c.from || m_Parent[c.to] != c.to)
+            continue;
+        if(c.from_version != m_Version[c.from] || c.to_version != m_Version[c.to])
+            continue;
+        // requeued with new costs whenever a neighbor changes
+        if(flips(c.from, c.to))
+            continue;
+
+        m_Error = std::max(m_Error, sqrt(c.cost));
+        collapse(c.from, c.to);
+    }
+
+    Level level;
+    level.error = float(m_Error);
+    level.indices.reserve(m_Live * 3);
+    for(size_t t = 0; t < m_Removed.size(); ++t)
+        if(not m_Removed[t])
+            for(unsigned i = 0; i < 3; ++i)
+                level.indices.push_back(resolve(m_Corners[t*3+i]));
+    return level;
+}
+
@@ -0,0 +1,92 @@
+#ifndef _SIMPLIFIER_H_N5D2K8QA
+#define _SIMPLIFIER_H_N5D2K8QA
+
+#include <vector>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/*
+ *  Quadric error mesh simplification (Garland-Heckbert) by half-edge
+ *  collapses: a vertex is only ever moved onto one of its neighbors, so
+ *  every level is a new index list over the original vertices and keeps
+ *  their UVs, normals and other attributes.
+ *
+ *  Vertices are welded by position first, so triangle soups (and seams)
+ *  simplify as one surface.  Open borders are weighted to stay put and
+ *  collapses that would flip a triangle are skipped.
+ *
+ *  simplify() can be called again with smaller targets to build a chain
+ *  of levels, each starting where the last one stopped.
+ */
+class Simplifier
+{
+    public:
+
+        struct Level
+        {
+            std::vector<unsigned> indices;
+            // largest collapse error so far, in model units
+            float error = 0.0f;
+        };
+
+        /*
+         * verts are 3 floats each, indices (3 per triangle) may be null
+         * for unindexed triangles
+         */
+        Simplifier(
+            const float* verts, size_t vert_count,
+            const unsigned* indices = nullptr, size_t index_count = 0
+        );
+
+        // collapses until at most triangles are left (or nothing can go)
+        Level simplify(size_t triangles);
+
+        size_t triangles() const { return m_Live; }
+
+    private:
+
+        // symmetric 4x4 error quadric
+        struct Quadric
+        {
+            double q[10] = {};
+            void add_plane(const glm::dvec4& p, double w = 1.0);
+            Quadric& operator+=(const Quadric& rhs);
+            double error(const glm::dvec3& v) const;
+        };
+
+        struct Collapse
+        {
+            double cost;
+            unsigned from;
+            unsigned to;
+            unsigned from_version;
+            unsigned to_version;
+            bool operator<(const Collapse& rhs) const {
+                return cost > rhs.cost; // min heap
+            }
+        };
+
+        unsigned position(unsigned vertex) const;
+        unsigned root(unsigned pos);
+        unsigned resolve(unsigned vertex);
+        void push(unsigned from, unsigned to);
+        bool flips(unsigned from, unsigned to);
+        void collapse(unsigned from, unsigned to);
+
+        std::vector<glm::dvec3> m_Positions;
+        std::vector<unsigned> m_PositionOf; // per vertex
+        std::vector<unsigned> m_VertexAt; // per position, any vertex
+        std::vector<unsigned> m_Parent; // per position, itself if alive
+        std::vector<unsigned> m_Replace; // vertex taking a collapsed one's place
+        std::vector<unsigned> m_Version;
+        std::vector<Quadric> m_Quadrics;
+        std::vector<std::vector<unsigned>> m_Triangles; // per position
+        std::vector<unsigned> m_Corners; // 3 vertices per triangle
+        std::vector<bool> m_Removed;
+        std::vector<Collapse> m_Heap;
+        size_t m_Live = 0;
+        double m_Error = 0.0;
+};
+
+#endif
+
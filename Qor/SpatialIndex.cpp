@@ -0,0 +1,188 @@
+#include "SpatialIndex.h"
+#include "Node.h"
+#include <algorithm>
+using namespace std;
+using namespace glm;
+
+SpatialIndex :: SpatialIndex():
+    // most indexed nodes rarely move, so keep the fat boxes tight
+    m_Tree(0.05f, 0.01f),
+    m_pPending(std::make_shared<Pending>())
+{}
+
+SpatialIndex :: ~SpatialIndex()
+{
+    clear();
+}
+
+void SpatialIndex :: add(const std::shared_ptr<Node>& node)
+{
+    // a freed node's address may have been reused by this one
+    apply_frees();
+    auto itr = m_Proxies.find(node.get());
+    if(itr != m_Proxies.end()) {
+        if(alive(itr->second.proxy))
+            return;
+        remove(node.get());
+    }
+
+    auto id = m_Tree.insert(node);
+    auto& e = m_Proxies[node.get()];
+    e.proxy = id;
+
+    const Node* raw = node.get();
+    auto pending = std::weak_ptr<Pending>(m_pPending);
+    e.pend_con = node->on_pend.connect([pending, id]{
+        auto p = pending.lock();
+        if(p)
+            p->moved.push_back(id);
+    });
+    e.free_con = node->on_free.connect([pending, id, raw]{
+        auto p = pending.lock();
+        if(p)
+            p->freed.emplace_back(id, raw);
+    });
+}
+
+void SpatialIndex :: remove(const Node* node)
+{
+    auto itr = m_Proxies.find(node);
+    if(itr == m_Proxies.end())
+        return;
+    m_Tree.remove(itr->second.proxy);
+    itr->second.pend_con.disconnect();
+    itr->second.free_con.disconnect();
+    m_Proxies.erase(itr);
+}
+
+void SpatialIndex :: clear()
+{
+    for(auto& p: m_Proxies) {
+        p.second.pend_con.disconnect();
+        p.second.free_con.disconnect();
+    }
+    m_Tree.clear();
+    m_Proxies.clear();
+    // drop the old queue so stale connections can't reach the new tree
+    m_pPending = std::make_shared<Pending>();
+}
+
+void SpatialIndex :: apply_frees()
+{
+    auto& freed = m_pPending->freed;
+
+    // only remove the entry if it's still the freed node's own leaf
+    for(auto& f: freed) {
+        auto itr = m_Proxies.find(f.second);
+        if(itr != m_Proxies.end() && itr->second.proxy == f.first)
+            remove(f.second);
+    }
+    freed.clear();
+}
+
+void SpatialIndex :: refit()
+{
+    apply_frees();
+
+    auto& moved = m_pPending->moved;
+    for(auto id: moved)
+        if(m_Tree.valid(id))
+            m_Tree.update(id);
+    moved.clear();
+}
+
+unsigned SpatialIndex :: query(
+    const Box& box,
+    std::vector<Node*>& out,
+    const Cond_t& cond
+){
+    refit();
+    out.clear();
+    m_Tree.query(box, [&](AABBTree::Proxy id){
+        if(not alive(id))
+            return true;
+        Node* n = m_Tree.get(id);
+        if(n->world_box().collision(box) && (not cond || cond(n)))
+            out.push_back(n);
+        return true;
+    });
+    return out.size();
+}
+
+unsigned SpatialIndex :: query_radius(
+    glm::vec3 center,
+    float radius,
+    std::vector<Node*>& out,
+    const Cond_t& cond
+){
+    refit();
+    out.clear();
+    const float r2 = radius * radius;
+    m_Tree.query(center, radius, [&](AABBTree::Proxy id){
+        if(not alive(id))
+            return true;
+        Node* n = m_Tree.get(id);
+        if(AABBTree::distance2(n->world_box(), center) <= r2 &&
+            (not cond || cond(n)))
+            out.push_back(n);
+        return true;
+    });
+    return out.size();
+}
+
+unsigned SpatialIndex :: query_ray(
+    glm::vec3 origin,
+    glm::vec3 dir,
+    float dist,
+    std::vector<Node*>& out,
+    const Cond_t& cond
+){
+    refit();
+    out.clear();
+    m_Scratch.clear();
+
+    float len = length(dir);
+    if(floatcmp(len, 0.0f))
+        return 0;
+    dir /= len;
+    const vec3 inv(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+
+    m_Tree.raycast(origin, dir, dist, [&](AABBTree::Proxy id, float){
+        if(not alive(id))
+            return true;
+        Node* n = m_Tree.get(id);
+        float t;
+        if(AABBTree::ray_box(origin, inv, n->world_box(), dist, t) &&
+            (not cond || cond(n)))
+            m_Scratch.emplace_back(t, id);
+        return true;
+    });
+
+    std::sort(ENTIRE(m_Scratch));
+    for(auto& hit: m_Scratch)
+        out.push_back(m_Tree.get(hit.second));
+    return out.size();
+}
+
+unsigned SpatialIndex :: query_nearest(
+    glm::vec3 point,
+    unsigned k,
+    std::vector<Node*>& out,
+    const Cond_t& cond
+){
+    refit();
+    out.clear();
+
+    m_Tree.nearest(point, k, m_Scratch, [&](AABBTree::Proxy id){
+        if(not alive(id))
+            return -1.0f;
+        Node* n = m_Tree.get(id);
+        if(cond && not cond(n))
+            return -1.0f;
+        return AABBTree::distance2(n->world_box(), point);
+    });
+    for(auto& e: m_Scratch)
+        out.push_back(m_Tree.get(e.second));
+    return out.size();
+}
+
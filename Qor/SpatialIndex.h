@@ -0,0 +1,114 @@
+#ifndef _SPATIALINDEX_H_7KD2VQ0N
+#define _SPATIALINDEX_H_7KD2VQ0N
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <boost/signals2.hpp>
+#include "AABBTree.h"
+
+class Node;
+
+/*
+ *  Scene-wide spatial index over arbitrary nodes, for gameplay queries
+ *  (sensing, area effects, pickups) that would otherwise walk the tree.
+ *
+ *  Indexed nodes are tracked through on_pend/on_free, so the index only
+ *  does work for nodes that actually moved.  All queries write into a
+ *  caller-provided buffer (cleared first) and return the result count,
+ *  so reusing the buffer avoids any per-call allocation.
+ *
+ *  Freed nodes are dropped before the next add or query, so a new node
+ *  allocated at a freed node's address is indexed as a new node.
+ */
+class SpatialIndex
+{
+    public:
+
+        typedef std::function<bool(Node*)> Cond_t;
+
+        SpatialIndex();
+        ~SpatialIndex();
+
+        SpatialIndex(const SpatialIndex&) = delete;
+        SpatialIndex& operator=(const SpatialIndex&) = delete;
+
+        void add(const std::shared_ptr<Node>& node);
+        void remove(const Node* node);
+        bool contains(const Node* node) const {
+            auto itr = m_Proxies.find(node);
+            return itr != m_Proxies.end() && alive(itr->second.proxy);
+        }
+        size_t size() const { return m_Proxies.size(); }
+        bool empty() const { return m_Proxies.empty(); }
+        void clear();
+
+        // apply moves and removals since the last refit
+        void refit();
+
+        // nodes whose world box overlaps box
+        unsigned query(
+            const Box& box,
+            std::vector<Node*>& out,
+            const Cond_t& cond = Cond_t()
+        );
+
+        // nodes whose world box touches the sphere
+        unsigned query_radius(
+            glm::vec3 center,
+            float radius,
+            std::vector<Node*>& out,
+            const Cond_t& cond = Cond_t()
+        );
+
+        // nodes whose world box is hit by the ray within dist,
+        // sorted by distance along the ray
+        unsigned query_ray(
+            glm::vec3 origin,
+            glm::vec3 dir,
+            float dist,
+            std::vector<Node*>& out,
+            const Cond_t& cond = Cond_t()
+        );
+
+        // up to k nodes nearest to point (by world box), nearest first
+        unsigned query_nearest(
+            glm::vec3 point,
+            unsigned k,
+            std::vector<Node*>& out,
+            const Cond_t& cond = Cond_t()
+        );
+
+    private:
+
+        bool alive(AABBTree::Proxy id) const {
+            return not m_Tree.ref(id).expired();
+        }
+
+        // drop nodes freed since the last refit
+        void apply_frees();
+
+        struct Pending
+        {
+            std::vector<AABBTree::Proxy> moved;
+            std::vector<std::pair<AABBTree::Proxy, const Node*>> freed;
+        };
+
+        struct Entry
+        {
+            AABBTree::Proxy proxy;
+            boost::signals2::connection pend_con;
+            boost::signals2::connection free_con;
+        };
+
+        AABBTree m_Tree;
+        std::unordered_map<const Node*, Entry> m_Proxies;
+        std::shared_ptr<Pending> m_pPending;
+
+        // reused for sorting ray and nearest results
+        std::vector<std::pair<float, AABBTree::Proxy>> m_Scratch;
+};
+
+#endif
+
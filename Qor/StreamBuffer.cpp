@@ -0,0 +1,148 @@
+#include "StreamBuffer.h"
+#include "GLState.h"
+#include "kit/log/log.h"
+#include <cstring>
+using namespace std;
+
+const unsigned StreamBuffer :: FRAMES;
+const unsigned StreamBuffer :: DEFAULT_SIZE;
+
+StreamBuffer* StreamBuffer :: get()
+{
+    static StreamBuffer buffer;
+    return &buffer;
+}
+
+void StreamBuffer :: init()
+{
+    glGenBuffers(1, &m_ID);
+    GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_ID);
+    if(GLEW_ARB_buffer_storage)
+    {
+        const GLbitfield flags =
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, m_Size, nullptr, flags);
+        m_pMapped = (uint8_t*)glMapBufferRange(GL_ARRAY_BUFFER, 0, m_Size, flags);
+        if(m_pMapped) {
+            m_Mode = PERSISTENT;
+            return;
+        }
+        // immutable storage can't be respecified, start over
+        GLState::get()->delete_buffers(1, &m_ID);
+        glGenBuffers(1, &m_ID);
+        GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_ID);
+    }
+    glBufferData(GL_ARRAY_BUFFER, m_Size, nullptr, GL_STREAM_DRAW);
+    m_Mode = GLEW_VERSION_3_2 ? UNSYNCHRONIZED : ORPHAN;
+}
+
+unsigned StreamBuffer :: region_size() const
+{
+    // orphaning hands the driver the whole buffer every frame
+    return m_Mode == ORPHAN ? m_Size : m_Size / FRAMES;
+}
+
+unsigned StreamBuffer :: write(const void* data, unsigned bytes, unsigned align)
+{
+    if(not m_ID)
+        init();
+
+    unsigned head = (m_Head + align - 1) / align * align;
+    if(head + bytes > region_size()) {
+        ++m_Stats.overflows;
+        return ~0u;
+    }
+    unsigned ofs = m_Region * region_size() + head;
+
+    switch(m_Mode)
+    {
+        case PERSISTENT:
+            memcpy(m_pMapped + ofs, data, bytes);
+            break;
+        case UNSYNCHRONIZED: {
+            GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_ID);
+            void* dst = glMapBufferRange(
+                GL_ARRAY_BUFFER, ofs, bytes,
+                GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                    GL_MAP_INVALIDATE_RANGE_BIT
+            );
+            if(not dst)
+                return ~0u;
+            memcpy(dst, data, bytes);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            break;
+        }
+        case ORPHAN:
+            GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_ID);
+            if(not m_Head)
+                glBufferData(GL_ARRAY_BUFFER, m_Size, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, ofs, bytes, data);
+            break;
+        default:
+            return ~0u;
+    }
+
+    m_Head = head + bytes;
+    ++m_Stats.writes;
+    m_Stats.bytes += bytes;
+    return ofs;
+}
+
+void StreamBuffer :: wait(unsigned region)
+{
+    GLsync& fence = m_Fences[region];
+    if(not fence)
+        return;
+    GLenum r = glClientWaitSync(fence, 0, 0);
+    if(r == GL_TIMEOUT_EXPIRED)
+    {
+        ++m_Stats.stalls;
+        do {
+            r = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        } while(r == GL_TIMEOUT_EXPIRED);
+    }
+    if(r == GL_WAIT_FAILED)
+        WARNING("stream buffer fence wait failed");
+    glDeleteSync(fence);
+    fence = 0;
+}
+
+void StreamBuffer :: frame()
+{
+    ++m_FrameID;
+    m_LastFrame = m_Stats;
+    m_Stats = Stats();
+    if(not m_ID)
+        return;
+
+    if(m_Mode != ORPHAN)
+    {
+        if(m_Head)
+            m_Fences[m_Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_Region = (m_Region + 1) % FRAMES;
+        wait(m_Region);
+    }
+    m_Head = 0;
+}
+
+void StreamBuffer :: clear()
+{
+    if(not m_ID)
+        return;
+    for(unsigned i = 0; i < FRAMES; ++i)
+        if(m_Fences[i]) {
+            glDeleteSync(m_Fences[i]);
+            m_Fences[i] = 0;
+        }
+    if(m_pMapped) {
+        GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_ID);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        m_pMapped = nullptr;
+    }
+    GLState::get()->delete_buffers(1, &m_ID);
+    m_ID = 0;
+    m_Mode = NONE;
+    m_Region = 0;
+    m_Head = 0;
+}
+
@@ -0,0 +1,102 @@
+#ifndef _STREAMBUFFER_H_R4M8W1PB
+#define _STREAMBUFFER_H_R4M8W1PB
+
+#include "Common.h"
+#include <cstdint>
+
+/*
+ *  Ring of vertex data rewritten every frame, shared by all dynamic
+ *  geometry so changing it never creates or deletes GL buffers.
+ *
+ *  The buffer is split into one region per frame in flight.  Each frame
+ *  writes into its own region, which is fenced at the end of the frame and
+ *  waited on before it comes around again.  Uses a persistently mapped
+ *  buffer (GL_ARB_buffer_storage) when available, unsynchronized
+ *  glMapBufferRange with fences otherwise (GL 3.2), and orphaning the
+ *  whole buffer once per frame as a last resort.
+ *
+ *  Data written is only good until the region is reused, so users write
+ *  again on every frame they draw.
+ *
+ *  GL thread only.
+ */
+class StreamBuffer
+{
+    public:
+
+        enum Mode
+        {
+            NONE,
+            PERSISTENT,
+            UNSYNCHRONIZED,
+            ORPHAN
+        };
+
+        struct Stats
+        {
+            unsigned writes = 0;
+            unsigned bytes = 0;
+            // writes that did not fit this frame's region
+            unsigned overflows = 0;
+            // frames that had to wait on the GPU for a region
+            unsigned stalls = 0;
+        };
+
+        static const unsigned FRAMES = 3;
+        static const unsigned DEFAULT_SIZE = 4 * 1024 * 1024;
+
+        static StreamBuffer* get();
+
+        StreamBuffer(const StreamBuffer&) = delete;
+        StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+        /*
+         * Copies data into this frame's region at a multiple of align and
+         * returns the byte offset into id(), or ~0u if it does not fit
+         * (callers fall back to a buffer of their own)
+         */
+        unsigned write(const void* data, unsigned bytes, unsigned align = 4);
+
+        // GL_ARRAY_BUFFER the offsets from write() refer to
+        unsigned id() const { return m_ID; }
+        Mode mode() const { return m_Mode; }
+
+        // counts up once per frame, so users know when to write again
+        unsigned frame_id() const { return m_FrameID; }
+
+        // end of frame: fences this region and moves on to the next
+        void frame();
+
+        // size of the whole ring, takes effect before the first write()
+        void size(unsigned bytes) { if(not m_ID) m_Size = bytes; }
+        unsigned size() const { return m_Size; }
+        // bytes write() can take in one frame
+        unsigned region_size() const;
+
+        void clear();
+
+        const Stats& stats() const { return m_LastFrame; }
+
+    private:
+
+        StreamBuffer() = default;
+
+        void init();
+        void wait(unsigned region);
+
+        unsigned m_ID = 0;
+        Mode m_Mode = NONE;
+        unsigned m_Size = DEFAULT_SIZE;
+        unsigned m_Region = 0;
+        // bytes used of the current region
+        unsigned m_Head = 0;
+        unsigned m_FrameID = 0;
+        uint8_t* m_pMapped = nullptr;
+        GLsync m_Fences[FRAMES] = {};
+
+        Stats m_Stats;
+        Stats m_LastFrame;
+};
+
+#endif
+
@@ -3,6 +3,7 @@
 #include <boost/lexical_cast.hpp>
 #include "kit/log/log.h"
 #include "ResourceCache.h"
+#include "GLState.h"
 using namespace std;
 using namespace glm;
 
@@ -132,7 +133,7 @@ void Text :: redraw()
     
     GL_TASK_START()
         glGenTextures(1, &m_ID);
-        glBindTexture(GL_TEXTURE_2D, m_ID);
+        GLState::get()->bind_texture(0, m_ID);
         int mode = GL_RGBA;
         
         glTexImage2D(GL_TEXTURE_2D, 0, mode, tmp->w, tmp->h,
@@ -165,6 +166,8 @@ void Text :: redraw()
             make_shared<Wrap>(Prefab::quad_wrap(vec2(0.0f,1.0f), vec2(1.0f,0.0f)))
         }, std::make_shared<MeshMaterial>(m_pTexture)
     );
+    // replaced on every change of text
+    m_pMesh->dynamic(true);
 
     add(m_pMesh);
 }
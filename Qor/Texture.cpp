@@ -8,6 +8,8 @@
 #include "kit/log/log.h"
 #include "Filesystem.h"
 #include "GLTask.h"
+#include "GLState.h"
+#include "CompressedImage.h"
 using namespace std;
 
 unsigned Texture :: DEFAULT_FLAGS =
@@ -32,6 +34,16 @@ Texture :: Texture(const std::string& fn, unsigned int flags):
     m_Filename(fn)
 {
     if(not Headless::enabled()) {
+        // a cooked KTX/DDS next to the image is loaded in its place
+        string cooked = CompressedImage::is_container(fn) ?
+            fn : CompressedImage::cooked(fn);
+        if(not cooked.empty()) {
+            if(load_compressed(cooked, flags, cooked != fn))
+                return;
+            if(cooked == fn)
+                K_ERROR(READ, Filesystem::getFileName(fn));
+        }
+
         GL_TASK_START()
         
         {
@@ -59,13 +71,8 @@ Texture :: Texture(const std::string& fn, unsigned int flags):
         //}
 
         //glActiveTexture(GL_TEXTURE0);
-        int last_id;
-        glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_id);
         glGenTextures(1,&m_ID);
-        glBindTexture(GL_TEXTURE_2D, m_ID);
-        BOOST_SCOPE_EXIT_ALL(last_id) {
-            glBindTexture(GL_TEXTURE_2D, last_id);
-        };
+        GLState::get()->bind_texture(0, m_ID);
         
         {
             auto err = glGetError();
@@ -76,41 +83,17 @@ Texture :: Texture(const std::string& fn, unsigned int flags):
         glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,m_Size.x,m_Size.y,0,
             GL_BGRA,GL_UNSIGNED_BYTE,(void*)FreeImage_GetBits(tempImage));
 
-        float filter = 2.0f;
-        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &filter);
-        float aniso = std::min<float>(filter, ANISOTROPY);
-        if (filter >= 1.9f)
-            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, aniso);
+        parameters(flags, flags & MIPMAP);
 
-        if(flags & CLAMP)
-        {
-            glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
-            glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
-        }
-        else
-        {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        }
-
-        if(flags & FILTER)
-        {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-            if(flags & MIPMAP)
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-            else
-                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        } else {
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        }
-        
+        m_GPUBytes = 4 * size_t(m_Size.x) * m_Size.y;
         if(flags & MIPMAP)
         {
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 4);
             
             glGenerateMipmap(GL_TEXTURE_2D);
+            // the levels below add about a third
+            m_GPUBytes += m_GPUBytes / 3;
         }
 
         {
@@ -162,14 +145,137 @@ Texture :: Texture(const std::string& fn, unsigned int flags):
 //    //return m_ID;
 //}
 
+void Texture :: parameters(unsigned flags, bool mipmaps)
+{
+    float filter = 2.0f;
+    glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &filter);
+    float aniso = std::min<float>(filter, ANISOTROPY);
+    if (filter >= 1.9f)
+        glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, aniso);
+
+    if(flags & CLAMP)
+    {
+        glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+    }
+    else
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    }
+
+    if(flags & FILTER)
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if(mipmaps)
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        else
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    }
+}
+
+bool Texture :: load_compressed(
+    const std::string& fn,
+    unsigned int flags,
+    bool has_source
+){
+    // parse on the loading thread, only the upload needs GL
+    std::shared_ptr<CompressedImage> image;
+    try{
+        image = std::make_shared<CompressedImage>(fn);
+    }catch(const Error& e){
+        WARNINGf("Skipping cooked texture %s", Filesystem::getFileName(fn));
+        return false;
+    }
+
+    // software GL in CI often lacks S3TC, so decode it instead (GLEW's
+    // extension flags are only written at startup)
+    if(not image->supported() && not image->decompress()) {
+        WARNINGf("%s: format %s is not supported, using the source image",
+            Filesystem::getFileName(fn) % image->internal_format()
+        );
+        return false;
+    }
+
+    // a single level file has no chain, so make one like the source
+    // path does; GL can't generate levels of block formats
+    const auto& levels = image->levels();
+    bool generate = (flags & MIPMAP) && levels.size() == 1;
+    if(generate && image->compressed()) {
+        if(has_source) {
+            WARNINGf("%s has no mip levels, using the source image",
+                Filesystem::getFileName(fn)
+            );
+            return false;
+        }
+        WARNINGf("%s has no mip levels, drawing without them",
+            Filesystem::getFileName(fn)
+        );
+        generate = false;
+    }
+
+    bool uploaded = false;
+    GL_TASK_START()
+
+        glGenTextures(1,&m_ID);
+        GLState::get()->bind_texture(0, m_ID);
+
+        m_GPUBytes = 0;
+        for(unsigned i = 0; i < levels.size(); ++i)
+        {
+            const auto& level = levels[i];
+            m_GPUBytes += level.data.size();
+            if(image->compressed())
+                glCompressedTexImage2D(GL_TEXTURE_2D, i, image->internal_format(),
+                    level.width, level.height, 0,
+                    (GLsizei)level.data.size(), level.data.data()
+                );
+            else
+                glTexImage2D(GL_TEXTURE_2D, i, image->internal_format(),
+                    level.width, level.height, 0,
+                    image->format(), image->type(), level.data.data()
+                );
+        }
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        if(generate)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 4);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            m_GPUBytes += m_GPUBytes / 3;
+        }
+        else
+        {
+            // the mip chain comes from the file
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels.size() - 1);
+        }
+        parameters(flags, (flags & MIPMAP) && (generate || levels.size() > 1));
+
+        {
+            auto err = glGetError();
+            if(err != GL_NO_ERROR)
+                K_ERRORf(GENERAL, "OpenGL Error: %s", err);
+        }
+
+        m_Size = glm::uvec2(image->width(), image->height());
+        uploaded = true;
+
+    GL_TASK_END()
+    return uploaded;
+}
+
 void Texture :: unload()
 {
     if(m_ID)
     {
         GL_TASK_ASYNC_START()
-            glDeleteTextures(1,&m_ID);
+            GLState::get()->delete_textures(1,&m_ID);
         GL_TASK_ASYNC_END()
         m_ID = 0;
+        m_GPUBytes = 0;
     }
 }
 
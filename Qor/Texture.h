@@ -34,7 +34,8 @@ class Texture:
         
         Texture(Texture&& t):
             m_ID(t.leak()),
-            m_Filename(std::move(t.m_Filename))
+            m_Filename(std::move(t.m_Filename)),
+            m_GPUBytes(t.m_GPUBytes)
         {}
         Texture(const Texture&) = delete;
         Texture& operator=(Texture&& t) {
@@ -42,6 +43,7 @@ class Texture:
             m_ID = t.leak();
             m_Filename = std::move(t.m_Filename);
             m_Size = t.m_Size;
+            m_GPUBytes = t.m_GPUBytes;
             return *this;
         }
         Texture& operator=(const Texture&) = delete;
@@ -63,9 +65,9 @@ class Texture:
         /*
          * Return OpenGL Texture ID for the given pass
          */
-        //virtual unsigned int id(Pass* pass = nullptr) const override {
-        //    return m_ID;
-        //}
+        virtual unsigned int id(Pass* pass = nullptr) const override {
+            return m_ID;
+        }
         virtual void bind(Pass* pass, unsigned slot=0) const override {
             if(Headless::enabled())
                 return;
@@ -90,6 +92,9 @@ class Texture:
             return id;
         }
 
+        // as uploaded, with its mip levels
+        virtual size_t gpu_bytes() const override { return m_GPUBytes; }
+
         virtual glm::uvec2 size() const override { return m_Size; }
         virtual void size(unsigned w, unsigned h) override { m_Size=glm::uvec2(w,h); }
         virtual glm::uvec2 center() const override { return m_Size/2u; }
@@ -112,10 +117,26 @@ class Texture:
     protected:
         
         unsigned int load(std::string fn, unsigned int flags = DEFAULT_FLAGS);
+
+        /*
+         * Loads a KTX/DDS file with its own mip levels, false if it can't
+         * be read or uploaded so the caller can fall back to the source image.
+         * Single level files get their mips generated when MIPMAP is set,
+         * except block formats, which fall back if has_source is set.
+         */
+        bool load_compressed(
+            const std::string& fn,
+            unsigned int flags,
+            bool has_source
+        );
+        // wrap, filter and anisotropy for the bound texture (GL thread)
+        static void parameters(unsigned flags, bool mipmaps);
+
         unsigned int m_ID = 0;
         std::string m_Filename;
         //ResourceCache<Texture>* m_Cache = nullptr;
         glm::uvec2 m_Size;
+        size_t m_GPUBytes = 0;
 };
 
 #endif
@@ -0,0 +1,449 @@
+#include "TextureAtlas.h"
+#include "GLTask.h"
+#include "GLState.h"
+#include "Headless.h"
+#include "Filesystem.h"
+#include "kit/log/log.h"
+#include <FreeImage.h>
+#include <boost/scope_exit.hpp>
+#include <json/json.h>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+using namespace std;
+using namespace glm;
+
+const unsigned TextureAtlas :: PAGE_SIZE;
+const unsigned TextureAtlas :: MAX_IMAGE;
+const unsigned TextureAtlas :: GUTTER;
+const unsigned TextureAtlas :: MIP_LEVELS;
+
+bool TextureAtlas :: s_bEnabled = false;
+
+AtlasPacker :: AtlasPacker(unsigned w, unsigned h):
+    m_Width(w),
+    m_Height(h)
+{
+    m_Skyline.push_back(Segment{0, 0, w});
+}
+
+unsigned AtlasPacker :: fit(size_t i, unsigned w, unsigned h) const
+{
+    if(m_Skyline[i].x + w > m_Width)
+        return ~0u;
+    // rests on the highest segment it spans
+    unsigned y = 0;
+    unsigned left = w;
+    for(; left && i < m_Skyline.size(); ++i)
+    {
+        y = std::max(y, m_Skyline[i].y);
+        if(y + h > m_Height)
+            return ~0u;
+        left -= std::min(left, m_Skyline[i].w);
+    }
+    return y;
+}
+
+bool AtlasPacker :: pack(unsigned w, unsigned h, uvec2& pos)
+{
+    size_t best = 0;
+    unsigned best_y = ~0u;
+    for(size_t i = 0; i < m_Skyline.size(); ++i)
+    {
+        unsigned y = fit(i, w, h);
+        if(y < best_y) {
+            best = i;
+            best_y = y;
+        }
+    }
+    if(best_y == ~0u)
+        return false;
+
+    pos = uvec2(m_Skyline[best].x, best_y);
+    const unsigned end = pos.x + w;
+
+    // the rect's top replaces the segments under it
+    vector<Segment> skyline(m_Skyline.begin(), m_Skyline.begin() + best);
+    skyline.push_back(Segment{pos.x, best_y + h, w});
+    for(size_t i = best; i < m_Skyline.size(); ++i)
+    {
+        Segment s = m_Skyline[i];
+        const unsigned s_end = s.x + s.w;
+        if(s_end <= end)
+            continue;
+        if(s.x < end) {
+            s.w = s_end - end;
+            s.x = end;
+        }
+        skyline.push_back(s);
+    }
+
+    // merge neighbors of the same height
+    m_Skyline.clear();
+    for(const Segment& s: skyline)
+    {
+        if(not m_Skyline.empty() && m_Skyline.back().y == s.y)
+            m_Skyline.back().w += s.w;
+        else
+            m_Skyline.push_back(s);
+    }
+
+    m_Used += size_t(w) * h;
+    return true;
+}
+
+float AtlasPacker :: occupancy() const
+{
+    return float(m_Used) / (float(m_Width) * m_Height);
+}
+
+AtlasPage :: AtlasPage(uvec2 size)
+{
+    m_Size = size;
+    m_Filename = "(atlas page)";
+}
+
+void AtlasPage :: upload(unsigned x, unsigned y, unsigned w, unsigned h, const uint8_t* bgra)
+{
+    if(not m_ID)
+    {
+        glGenTextures(1, &m_ID);
+        GLState::get()->bind_texture(0, m_ID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_Size.x, m_Size.y, 0,
+            GL_BGRA, GL_UNSIGNED_BYTE, nullptr);
+
+        float filter = 2.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &filter);
+        float aniso = std::min<float>(filter, ANISOTROPY);
+        if (filter >= 1.9f)
+            glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, aniso);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if(DEFAULT_FLAGS & FILTER)
+        {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        } else {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        }
+        // deeper levels would blend across the gutters
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, TextureAtlas::MIP_LEVELS);
+    }
+    else
+        GLState::get()->bind_texture(0, m_ID);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_BGRA, GL_UNSIGNED_BYTE, bgra);
+    m_bDirty = true;
+
+    auto err = glGetError();
+    if(err != GL_NO_ERROR)
+        K_ERRORf(GENERAL, "OpenGL Error: %s", err);
+}
+
+void AtlasPage :: update_mipmaps() const
+{
+    if(not m_bDirty || not m_ID)
+        return;
+    GLState::get()->bind_texture(0, m_ID);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    m_bDirty = false;
+}
+
+void AtlasPage :: bind(Pass* pass, unsigned slot) const
+{
+    if(Headless::enabled())
+        return;
+    update_mipmaps();
+    pass->texture(m_ID, slot);
+}
+
+void AtlasPage :: bind_nomaterial(Pass* pass, unsigned slot) const
+{
+    if(Headless::enabled())
+        return;
+    update_mipmaps();
+    pass->texture(m_ID, slot);
+}
+
+AtlasTexture :: AtlasTexture(
+    shared_ptr<AtlasPage> page,
+    const string& fn,
+    uvec2 pos,
+    uvec2 size
+):
+    ITexture(fn),
+    m_pPage(page),
+    m_Filename(fn),
+    m_Position(pos),
+    m_Size(size)
+{
+    vec2 page_size = vec2(m_pPage->size());
+    m_Region = vec4(vec2(pos) / page_size, vec2(size) / page_size);
+}
+
+TextureAtlas* TextureAtlas :: get()
+{
+    static TextureAtlas atlas;
+    return &atlas;
+}
+
+// decodes an image the way Texture does, false if it can't
+static bool decode(const string& fn, vector<uint8_t>& bgra, uvec2& size)
+{
+    FIBITMAP* img = FreeImage_Load(
+        FreeImage_GetFileType(fn.c_str(), 0),
+        fn.c_str()
+    );
+    if(not img)
+        return false;
+    FIBITMAP* img32 = FreeImage_ConvertTo32Bits(img);
+    FreeImage_Unload(img);
+    if(not img32)
+        return false;
+    BOOST_SCOPE_EXIT_ALL(img32) {
+        FreeImage_Unload(img32);
+    };
+    FreeImage_FlipVertical(img32);
+
+    size = uvec2(FreeImage_GetWidth(img32), FreeImage_GetHeight(img32));
+    const unsigned pitch = FreeImage_GetPitch(img32);
+    const uint8_t* bits = FreeImage_GetBits(img32);
+    bgra.resize(size.x * size.y * 4);
+    for(unsigned y = 0; y < size.y; ++y)
+        memcpy(&bgra[y * size.x * 4], bits + y * pitch, size.x * 4);
+    return true;
+}
+
+shared_ptr<AtlasTexture> TextureAtlas :: add(const string& fn)
+{
+    if(auto image = find(fn))
+        return image;
+
+    vector<uint8_t> bgra;
+    uvec2 size;
+    if(not decode(fn, bgra, size))
+        return nullptr;
+    return add(fn, bgra.data(), size.x, size.y);
+}
+
+shared_ptr<AtlasTexture> TextureAtlas :: add(
+    const string& name,
+    const uint8_t* bgra,
+    unsigned w, unsigned h
+){
+    if(not w || not h || w > MAX_IMAGE || h > MAX_IMAGE)
+        return nullptr;
+
+    // edges repeated into the gutter, rounded up to whole gutters so
+    // everything packed stays aligned to them
+    const unsigned pw = (w + 3 * GUTTER - 1) / GUTTER * GUTTER;
+    const unsigned ph = (h + 3 * GUTTER - 1) / GUTTER * GUTTER;
+    vector<uint8_t> padded(pw * ph * 4);
+    for(unsigned y = 0; y < ph; ++y)
+    {
+        const unsigned sy = unsigned(clamp(int(y) - int(GUTTER), 0, int(h) - 1));
+        for(unsigned x = 0; x < pw; ++x)
+        {
+            const unsigned sx = unsigned(clamp(int(x) - int(GUTTER), 0, int(w) - 1));
+            memcpy(&padded[(y * pw + x) * 4], bgra + (sy * w + sx) * 4, 4);
+        }
+    }
+
+    shared_ptr<AtlasTexture> image;
+    shared_ptr<AtlasPage> page;
+    uvec2 pos;
+    {
+        auto l = unique_lock<mutex>(m_Mutex);
+        auto itr = m_Images.find(name);
+        if(itr != m_Images.end())
+            return itr->second;
+
+        for(auto&& p: m_Pages)
+            if(p.packer && p.packer->pack(pw, ph, pos)) {
+                page = p.texture;
+                break;
+            }
+        if(not page)
+        {
+            Page p;
+            p.texture = make_shared<AtlasPage>(uvec2(PAGE_SIZE));
+            p.packer = make_shared<AtlasPacker>(PAGE_SIZE, PAGE_SIZE);
+            if(not p.packer->pack(pw, ph, pos))
+                return nullptr;
+            page = p.texture;
+            m_Pages.push_back(p);
+        }
+        image = make_shared<AtlasTexture>(page, name, pos + uvec2(GUTTER), uvec2(w, h));
+        m_Images[name] = image;
+    }
+
+    // outside the lock, the GL thread may be waiting on it
+    if(not Headless::enabled())
+    {
+        GL_TASK_START()
+            page->upload(pos.x, pos.y, pw, ph, padded.data());
+        GL_TASK_END()
+    }
+    return image;
+}
+
+shared_ptr<AtlasTexture> TextureAtlas :: find(const string& name) const
+{
+    auto l = unique_lock<mutex>(m_Mutex);
+    auto itr = m_Images.find(name);
+    if(itr == m_Images.end())
+        return nullptr;
+    return itr->second;
+}
+
+void TextureAtlas :: save(const string& prefix) const
+{
+    if(Headless::enabled())
+        return;
+
+    // copied so reading the pages back doesn't hold the lock
+    vector<Page> all_pages;
+    map<string, shared_ptr<AtlasTexture>> all_images;
+    {
+        auto l = unique_lock<mutex>(m_Mutex);
+        all_pages = m_Pages;
+        all_images = m_Images;
+    }
+
+    Json::Value root;
+    Json::Value pages(Json::arrayValue);
+    for(size_t i = 0; i < all_pages.size(); ++i)
+    {
+        const AtlasPage* page = all_pages[i].texture.get();
+        const uvec2 size = page->size();
+        vector<uint8_t> bgra(size.x * size.y * 4);
+        if(page->id())
+        {
+            GL_TASK_START()
+                GLState::get()->bind_texture(0, page->id());
+                glPixelStorei(GL_PACK_ALIGNMENT, 4);
+                glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE, bgra.data());
+            GL_TASK_END()
+        }
+
+        FIBITMAP* img = FreeImage_ConvertFromRawBits(
+            bgra.data(), size.x, size.y, size.x * 4, 32,
+            FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK
+        );
+        if(not img)
+            K_ERRORf(GENERAL, "unable to save atlas page %s", i);
+        BOOST_SCOPE_EXIT_ALL(img) {
+            FreeImage_Unload(img);
+        };
+        // undo the flip decode() does
+        FreeImage_FlipVertical(img);
+        string fn = prefix + to_string(i) + ".png";
+        if(not FreeImage_Save(FIF_PNG, img, fn.c_str()))
+            K_ERROR(WRITE, fn);
+        pages.append(Filesystem::getFileName(fn));
+    }
+    root["pages"] = pages;
+
+    Json::Value images(Json::objectValue);
+    for(auto&& entry: all_images)
+    {
+        const AtlasTexture* image = entry.second.get();
+        unsigned page_index = 0;
+        for(size_t i = 0; i < all_pages.size(); ++i)
+            if(all_pages[i].texture == image->page())
+                page_index = i;
+        Json::Value rect(Json::arrayValue);
+        rect.append(page_index);
+        rect.append(image->position().x);
+        rect.append(image->position().y);
+        rect.append(image->size().x);
+        rect.append(image->size().y);
+        images[entry.first] = rect;
+    }
+    root["images"] = images;
+
+    string fn = prefix + ".json";
+    ofstream f(fn);
+    if(not f.good())
+        K_ERROR(WRITE, fn);
+    f << Json::StyledWriter().write(root);
+}
+
+void TextureAtlas :: load(const string& fn)
+{
+    auto buf = Filesystem::file_to_buffer(fn);
+    if(buf.empty())
+        K_ERROR(READ, fn);
+
+    Json::Value root;
+    Json::Reader reader;
+    if(not reader.parse(&buf[0], root) || not root.isObject())
+        K_ERROR(PARSE, fn);
+
+    const string path = Filesystem::getPath(fn);
+    vector<shared_ptr<AtlasPage>> pages;
+    for(const Json::Value& page_fn: root["pages"])
+    {
+        vector<uint8_t> bgra;
+        uvec2 size;
+        string page_path = path + page_fn.asString();
+        if(not decode(page_path, bgra, size))
+            K_ERROR(READ, page_path);
+        auto page = make_shared<AtlasPage>(size);
+        if(not Headless::enabled())
+        {
+            GL_TASK_START()
+                page->upload(0, 0, size.x, size.y, bgra.data());
+            GL_TASK_END()
+        }
+        pages.push_back(page);
+    }
+
+    auto l = unique_lock<mutex>(m_Mutex);
+    for(auto&& page: pages)
+    {
+        Page p;
+        p.texture = page;
+        m_Pages.push_back(p);
+    }
+    const Json::Value& images = root["images"];
+    for(auto itr = images.begin(); itr != images.end(); ++itr)
+    {
+        const Json::Value& rect = *itr;
+        if(not rect.isArray() || rect.size() < 5)
+            K_ERROR(PARSE, fn);
+        unsigned page_index = rect[0u].asUInt();
+        if(page_index >= pages.size())
+            K_ERROR(PARSE, fn);
+        m_Images[itr.key().asString()] = make_shared<AtlasTexture>(
+            pages[page_index],
+            itr.key().asString(),
+            uvec2(rect[1u].asUInt(), rect[2u].asUInt()),
+            uvec2(rect[3u].asUInt(), rect[4u].asUInt())
+        );
+    }
+}
+
+void TextureAtlas :: clear()
+{
+    auto l = unique_lock<mutex>(m_Mutex);
+    m_Images.clear();
+    m_Pages.clear();
+}
+
+size_t TextureAtlas :: pages() const
+{
+    auto l = unique_lock<mutex>(m_Mutex);
+    return m_Pages.size();
+}
+
+size_t TextureAtlas :: images() const
+{
+    auto l = unique_lock<mutex>(m_Mutex);
+    return m_Images.size();
+}
+
@@ -0,0 +1,202 @@
+#ifndef _TEXTUREATLAS_H_W2C7QF4M
+#define _TEXTUREATLAS_H_W2C7QF4M
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "Texture.h"
+
+/*
+ *  Skyline bottom-left rectangle packer
+ *
+ *  The skyline is the top edge of everything packed so far, as segments
+ *  from left to right.  A new rect goes where it would sit lowest, leftmost
+ *  on ties.
+ */
+class AtlasPacker
+{
+    public:
+        AtlasPacker(unsigned w, unsigned h);
+
+        // finds room for a w x h rect, false if there is none
+        bool pack(unsigned w, unsigned h, glm::uvec2& pos);
+
+        // fraction of the area used
+        float occupancy() const;
+
+    private:
+        struct Segment
+        {
+            unsigned x;
+            unsigned y;
+            unsigned w;
+        };
+
+        // height a w wide rect would sit at on segment i, or ~0u
+        unsigned fit(size_t i, unsigned w, unsigned h) const;
+
+        unsigned m_Width;
+        unsigned m_Height;
+        size_t m_Used = 0;
+        std::vector<Segment> m_Skyline;
+};
+
+/*
+ *  Texture page of an atlas, rebuilding its mipmaps on the first bind
+ *  after images were added
+ */
+class AtlasPage:
+    public Texture
+{
+    public:
+        explicit AtlasPage(glm::uvec2 size);
+        virtual ~AtlasPage() {}
+
+        // copies a w x h BGRA image in at x, y (GL thread)
+        void upload(unsigned x, unsigned y, unsigned w, unsigned h, const uint8_t* bgra);
+
+        virtual void bind(Pass* pass, unsigned slot=0) const override;
+        virtual void bind_nomaterial(Pass* pass, unsigned slot=0) const override;
+
+    private:
+        void update_mipmaps() const;
+
+        mutable bool m_bDirty = false;
+};
+
+/*
+ *  An image inside an atlas page
+ *
+ *  id() and bind() are the page's, so draws of any image on the same page
+ *  share a texture and sort together in the render queue.  region() maps
+ *  the image's own UVs onto the page.
+ */
+class AtlasTexture:
+    public ITexture
+{
+    public:
+        AtlasTexture(
+            std::shared_ptr<AtlasPage> page,
+            const std::string& fn,
+            glm::uvec2 pos,
+            glm::uvec2 size
+        );
+        virtual ~AtlasTexture() {}
+
+        virtual unsigned int id(Pass* pass = nullptr) const override {
+            return m_pPage->id(pass);
+        }
+        virtual void bind(Pass* pass, unsigned slot=0) const override {
+            m_pPage->bind(pass, slot);
+        }
+        virtual void bind_nomaterial(Pass* pass, unsigned slot=0) const override {
+            m_pPage->bind_nomaterial(pass, slot);
+        }
+        virtual operator bool() const override { return bool(*m_pPage); }
+
+        virtual glm::uvec2 size() const override { return m_Size; }
+        virtual void size(unsigned w, unsigned h) override {}
+        virtual glm::uvec2 center() const override { return m_Size/2u; }
+
+        virtual glm::vec4 region() const override { return m_Region; }
+
+        virtual std::string name() const override { return m_Filename; }
+        virtual std::string filename() const override { return m_Filename; }
+
+        virtual Color ambient() override { return Color::white(1.0f); }
+        virtual Color diffuse() override { return Color::white(1.0f); }
+        virtual Color specular() override { return Color::white(1.0f); }
+        virtual Color emissive() override { return Color::white(0.0f); }
+
+        const std::shared_ptr<AtlasPage>& page() const { return m_pPage; }
+        // pixel position of the image in the page
+        glm::uvec2 position() const { return m_Position; }
+
+    private:
+        std::shared_ptr<AtlasPage> m_pPage;
+        std::string m_Filename;
+        glm::uvec2 m_Position;
+        glm::uvec2 m_Size;
+        glm::vec4 m_Region;
+};
+
+/*
+ *  Packs small images into shared texture pages so sprites and UI drawn
+ *  from different images can share a texture bind.
+ *
+ *  Images are surrounded by a GUTTER of their own edge pixels and placed
+ *  at multiples of it, so the first MIP_LEVELS mip levels never blend in a
+ *  neighbor.  Wraps on meshes using an atlas texture are remapped to its
+ *  region (see Wrap::region()); meshes whose UVs repeat draw from the
+ *  image's own texture instead (Material::unatlas()).
+ *
+ *  Atlases can be built at runtime as images load, or offline with save()
+ *  and brought back with load(), after which the same file names come
+ *  from the saved pages.
+ */
+class TextureAtlas
+{
+    public:
+
+        static const unsigned PAGE_SIZE = 2048;
+        // images larger than this in either direction stay textures
+        static const unsigned MAX_IMAGE = 512;
+        static const unsigned GUTTER = 4;
+        static const unsigned MIP_LEVELS = 2;
+
+        static TextureAtlas* get();
+
+        TextureAtlas(const TextureAtlas&) = delete;
+        TextureAtlas& operator=(const TextureAtlas&) = delete;
+
+        // used by materials (settings.json: video.atlas)
+        static bool enabled() { return s_bEnabled; }
+        static void enabled(bool b) { s_bEnabled = b; }
+
+        /*
+         * Adds an image file (or finds it if already added), null if it is
+         * too large or can't be read
+         */
+        std::shared_ptr<AtlasTexture> add(const std::string& fn);
+        // tightly packed BGRA rows, in the order Texture uploads them
+        std::shared_ptr<AtlasTexture> add(
+            const std::string& name,
+            const uint8_t* bgra,
+            unsigned w, unsigned h
+        );
+        std::shared_ptr<AtlasTexture> find(const std::string& name) const;
+
+        // writes pages to <prefix>N.png and the image list to <prefix>.json
+        void save(const std::string& prefix) const;
+        // reads an atlas written by save()
+        void load(const std::string& fn);
+
+        void clear();
+
+        size_t pages() const;
+        size_t images() const;
+
+    private:
+
+        TextureAtlas() = default;
+
+        struct Page
+        {
+            std::shared_ptr<AtlasPage> texture;
+            // null for pages from load(), which take no more images
+            std::shared_ptr<AtlasPacker> packer;
+        };
+
+        mutable std::mutex m_Mutex;
+        std::vector<Page> m_Pages;
+        std::map<std::string, std::shared_ptr<AtlasTexture>> m_Images;
+
+        static bool s_bEnabled;
+};
+
+#endif
+
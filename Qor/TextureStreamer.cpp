@@ -0,0 +1,334 @@
+#include "TextureStreamer.h"
+#include "GLTask.h"
+#include "GLState.h"
+#include "Headless.h"
+#include "kit/log/errors.h"
+#include "kit/log/log.h"
+#include <FreeImage.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <cstring>
+using namespace std;
+
+const unsigned TextureStreamer :: WORKERS;
+const unsigned TextureStreamer :: DEFAULT_BUDGET;
+bool TextureStreamer :: s_bEnabled = false;
+
+StreamedTexture :: StreamedTexture(const string& fn, unsigned flags, unsigned placeholder):
+    Texture(placeholder),
+    m_Flags(flags)
+{
+    m_Filename = fn;
+    m_Size = glm::uvec2(1, 1);
+}
+
+StreamedTexture :: ~StreamedTexture()
+{
+    // the placeholder is shared, don't let Texture delete it
+    if(m_ID && m_ID == TextureStreamer::get()->placeholder())
+        leak();
+}
+
+TextureStreamer* TextureStreamer :: get()
+{
+    static TextureStreamer streamer;
+    return &streamer;
+}
+
+void TextureStreamer :: budget(unsigned bytes, float ms)
+{
+    auto l = unique_lock<mutex>(m_Mutex);
+    m_BudgetBytes = bytes;
+    m_BudgetMS = ms;
+}
+
+shared_ptr<StreamedTexture> TextureStreamer :: load(const string& fn, unsigned flags)
+{
+    if(Headless::enabled()) {
+        auto tex = make_shared<StreamedTexture>(fn, flags, 0);
+        tex->m_bReady = true;
+        return tex;
+    }
+
+    {
+        // not under m_Mutex, which frame() takes on the GL thread
+        auto l = unique_lock<mutex>(m_PlaceholderMutex);
+        if(not m_Placeholder) {
+            GL_TASK_START()
+                const uint8_t white[4] = {255, 255, 255, 255};
+                unsigned id;
+                glGenTextures(1, &id);
+                GLState::get()->bind_texture(0, id);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0,
+                    GL_BGRA, GL_UNSIGNED_BYTE, white);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                m_Placeholder = id;
+            GL_TASK_END()
+        }
+    }
+
+    auto tex = make_shared<StreamedTexture>(fn, flags, m_Placeholder);
+    auto job = make_shared<Job>();
+    job->texture = tex;
+    job->filename = fn;
+    job->flags = flags;
+
+    auto l = unique_lock<mutex>(m_Mutex);
+    if(m_Workers.empty())
+        start();
+    m_Decode.push_back(job);
+    m_CV.notify_one();
+    return tex;
+}
+
+void TextureStreamer :: start()
+{
+    m_bQuit = false;
+    for(unsigned i = 0; i < WORKERS; ++i)
+        m_Workers.emplace_back(bind(&TextureStreamer::worker, this));
+}
+
+void TextureStreamer :: worker()
+{
+    auto l = unique_lock<mutex>(m_Mutex);
+    while(true)
+    {
+        m_CV.wait(l, [this]{
+            return m_bQuit || not m_Decode.empty();
+        });
+        if(m_bQuit)
+            break;
+        auto job = std::move(m_Decode.front());
+        m_Decode.pop_front();
+        ++m_Decoding;
+        l.unlock();
+
+        // nobody wants it anymore
+        if(not job->texture.expired()) {
+            try{
+                decode(*job);
+            }catch(...){
+                job->failed = true;
+            }
+        }
+
+        l.lock();
+        --m_Decoding;
+        if(not job->texture.expired())
+            m_Upload.push_back(std::move(job));
+    }
+}
+
+void TextureStreamer :: decode(Job& job)
+{
+    const string& fn = job.filename;
+
+    string cooked = CompressedImage::is_container(fn) ?
+        fn : CompressedImage::cooked(fn);
+    if(not cooked.empty())
+    {
+        try{
+            auto image = make_shared<CompressedImage>(cooked);
+            // GLEW's extension flags are only written at startup
+            if(image->supported() || image->decompress()) {
+                job.image = image;
+                return;
+            }
+        }catch(const Error&){}
+        if(cooked == fn) {
+            job.failed = true;
+            return;
+        }
+    }
+
+    FIBITMAP* loaded = FreeImage_Load(FreeImage_GetFileType(fn.c_str(), 0), fn.c_str());
+    if(not loaded) {
+        job.failed = true;
+        return;
+    }
+    FIBITMAP* image = FreeImage_ConvertTo32Bits(loaded);
+    FreeImage_Unload(loaded);
+    if(not image) {
+        job.failed = true;
+        return;
+    }
+    // same orientation as Texture
+    FreeImage_FlipVertical(image);
+    job.size = glm::uvec2(FreeImage_GetWidth(image), FreeImage_GetHeight(image));
+    const unsigned row = job.size.x * 4;
+    job.pixels.resize(size_t(row) * job.size.y);
+    for(unsigned y = 0; y < job.size.y; ++y)
+        memcpy(&job.pixels[size_t(y) * row], FreeImage_GetScanLine(image, y), row);
+    FreeImage_Unload(image);
+}
+
+size_t TextureStreamer :: upload(Job& job)
+{
+    auto tex = job.texture.lock();
+    if(not tex)
+        return 0;
+    if(job.failed) {
+        WARNINGf("Could not stream texture %s", Filesystem::getFileName(job.filename));
+        tex->m_bReady = true;
+        return 0;
+    }
+
+    struct Level
+    {
+        unsigned width;
+        unsigned height;
+        const uint8_t* data;
+        size_t bytes;
+        size_t offset;
+    };
+    vector<Level> levels;
+    size_t total = 0;
+    auto add_level = [&](unsigned w, unsigned h, const uint8_t* data, size_t bytes) {
+        levels.push_back(Level{w, h, data, bytes, total});
+        total += (bytes + 15) / 16 * 16;
+    };
+    if(job.image)
+        for(auto&& level: job.image->levels())
+            add_level(level.width, level.height, level.data.data(), level.data.size());
+    else
+        add_level(job.size.x, job.size.y, job.pixels.data(), job.pixels.size());
+
+    const bool compressed = job.image && job.image->compressed();
+    const GLenum internal_format = job.image ? job.image->internal_format() : GL_RGBA8;
+    const GLenum format = job.image ? job.image->format() : GL_BGRA;
+    const GLenum type = job.image ? job.image->type() : GL_UNSIGNED_BYTE;
+
+    // stage through a pixel unpack buffer, orphaned for every upload, so
+    // the driver copies into the texture without holding us up
+    auto gl = GLState::get();
+    if(not m_PBO)
+        glGenBuffers(1, &m_PBO);
+    gl->bind_buffer(GL_PIXEL_UNPACK_BUFFER, m_PBO);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, total, nullptr, GL_STREAM_DRAW);
+    uint8_t* staging = (uint8_t*)glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, total,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT
+    );
+    if(staging) {
+        for(auto&& level: levels)
+            memcpy(staging + level.offset, level.data, level.bytes);
+        if(not glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER))
+            staging = nullptr; // contents lost, upload from memory instead
+    }
+    if(not staging)
+        gl->bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    unsigned id;
+    glGenTextures(1, &id);
+    gl->bind_texture(0, id);
+    for(unsigned i = 0; i < levels.size(); ++i)
+    {
+        const Level& level = levels[i];
+        const void* src = staging ? (const void*)level.offset : level.data;
+        if(compressed)
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, internal_format,
+                level.width, level.height, 0, (GLsizei)level.bytes, src
+            );
+        else
+            glTexImage2D(GL_TEXTURE_2D, i, internal_format,
+                level.width, level.height, 0, format, type, src
+            );
+    }
+    gl->bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    const unsigned flags = job.flags;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    if(job.image) {
+        // cooked files bring their own mip chain
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels.size() - 1);
+        StreamedTexture::parameters(flags, (flags & Texture::MIPMAP) && levels.size() > 1);
+    } else {
+        StreamedTexture::parameters(flags, flags & Texture::MIPMAP);
+        if(flags & Texture::MIPMAP) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 4);
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+    }
+
+    tex->m_ID = id;
+    tex->m_Size = levels.empty() ?
+        glm::uvec2(1, 1) : glm::uvec2(levels[0].width, levels[0].height);
+    tex->m_GPUBytes = total;
+    if(not job.image && (flags & Texture::MIPMAP))
+        tex->m_GPUBytes += total / 3;
+    tex->m_bReady = true;
+    return total;
+}
+
+void TextureStreamer :: frame()
+{
+    auto start = chrono::steady_clock::now();
+    size_t bytes = 0;
+    while(true)
+    {
+        shared_ptr<Job> job;
+        size_t budget_bytes;
+        float budget_ms;
+        {
+            auto l = unique_lock<mutex>(m_Mutex);
+            if(m_Upload.empty())
+                break;
+            job = std::move(m_Upload.front());
+            m_Upload.pop_front();
+            budget_bytes = m_BudgetBytes;
+            budget_ms = m_BudgetMS;
+        }
+        size_t n = upload(*job);
+        bytes += n;
+        ++m_Stats.uploads;
+        m_Stats.bytes += n;
+
+        // the rest waits for the next frame
+        float ms = chrono::duration<float, milli>(
+            chrono::steady_clock::now() - start
+        ).count();
+        if(bytes >= budget_bytes || ms >= budget_ms)
+            break;
+    }
+
+    m_LastFrame = m_Stats;
+    m_Stats = Stats();
+}
+
+size_t TextureStreamer :: pending() const
+{
+    auto l = unique_lock<mutex>(m_Mutex);
+    return m_Decode.size() + m_Decoding + m_Upload.size();
+}
+
+void TextureStreamer :: clear()
+{
+    {
+        auto l = unique_lock<mutex>(m_Mutex);
+        m_bQuit = true;
+        m_CV.notify_all();
+    }
+    for(auto&& t: m_Workers)
+        t.join();
+    {
+        auto l = unique_lock<mutex>(m_Mutex);
+        m_Workers.clear();
+        m_Decode.clear();
+        m_Upload.clear();
+        m_bQuit = false;
+    }
+
+    if(m_PBO) {
+        GLState::get()->delete_buffers(1, &m_PBO);
+        m_PBO = 0;
+    }
+    if(m_Placeholder) {
+        unsigned id = m_Placeholder;
+        GLState::get()->delete_textures(1, &id);
+        m_Placeholder = 0;
+    }
+    m_Stats = m_LastFrame = Stats();
+}
+
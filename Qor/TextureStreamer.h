@@ -0,0 +1,145 @@
+#ifndef _TEXTURESTREAMER_H_P8D3LZ6N
+#define _TEXTURESTREAMER_H_P8D3LZ6N
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "Texture.h"
+#include "CompressedImage.h"
+
+/*
+ *  Texture whose image arrives later
+ *
+ *  Starts out as the streamer's shared 1x1 white placeholder and takes on
+ *  the real texture ID and size when its upload is done, so anything
+ *  holding it picks up the image without being told.
+ */
+class StreamedTexture:
+    public Texture
+{
+    public:
+        StreamedTexture(const std::string& fn, unsigned flags, unsigned placeholder);
+        virtual ~StreamedTexture();
+
+        // the image is up (or failed to load and the placeholder stays)
+        bool ready() const { return m_bReady; }
+        unsigned flags() const { return m_Flags; }
+
+    private:
+        friend class TextureStreamer;
+
+        std::atomic<bool> m_bReady{false};
+        unsigned m_Flags;
+};
+
+/*
+ *  Loads textures without stalling the frame
+ *
+ *  Images (or their cooked .ktx/.dds, see CompressedImage) are decoded on
+ *  worker threads.  The GL thread uploads the decoded ones in frame(),
+ *  staged through a pixel unpack buffer, until the frame's byte or time
+ *  budget runs out.  At least one upload happens per frame.
+ */
+class TextureStreamer
+{
+    public:
+
+        struct Stats
+        {
+            unsigned uploads = 0;
+            unsigned bytes = 0;
+        };
+
+        static const unsigned WORKERS = 2;
+        static const unsigned DEFAULT_BUDGET = 8 * 1024 * 1024;
+
+        static TextureStreamer* get();
+
+        TextureStreamer(const TextureStreamer&) = delete;
+        TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+        // used by materials (settings.json: video.texture-streaming)
+        static bool enabled() { return s_bEnabled; }
+        static void enabled(bool b) { s_bEnabled = b; }
+
+        /*
+         * Starts decoding fn and returns at once with a texture showing the
+         * placeholder until the image is uploaded
+         */
+        std::shared_ptr<StreamedTexture> load(
+            const std::string& fn,
+            unsigned flags = Texture::DEFAULT_FLAGS
+        );
+
+        /*
+         * Uploads within the budget per frame
+         * (settings.json: video.texture-upload-kb, video.texture-upload-ms)
+         */
+        void budget(unsigned bytes, float ms);
+
+        // GL thread, once per frame: uploads what's been decoded
+        void frame();
+
+        // textures still decoding or waiting to be uploaded
+        size_t pending() const;
+
+        unsigned placeholder() const { return m_Placeholder; }
+
+        // GL thread: stops the workers and drops unfinished loads
+        void clear();
+
+        const Stats& stats() const { return m_LastFrame; }
+
+    private:
+
+        TextureStreamer() = default;
+
+        struct Job
+        {
+            std::weak_ptr<StreamedTexture> texture;
+            std::string filename;
+            unsigned flags = 0;
+            // a cooked file, or else tightly packed BGRA pixels
+            std::shared_ptr<CompressedImage> image;
+            std::vector<uint8_t> pixels;
+            glm::uvec2 size;
+            bool failed = false;
+        };
+
+        void start();
+        void worker();
+        static void decode(Job& job);
+        // returns the bytes uploaded
+        size_t upload(Job& job);
+
+        mutable std::mutex m_Mutex;
+        std::condition_variable m_CV;
+        std::deque<std::shared_ptr<Job>> m_Decode;
+        std::deque<std::shared_ptr<Job>> m_Upload;
+        // jobs a worker is decoding right now
+        size_t m_Decoding = 0;
+        std::vector<std::thread> m_Workers;
+        bool m_bQuit = false;
+
+        std::mutex m_PlaceholderMutex;
+        std::atomic<unsigned> m_Placeholder{0};
+        unsigned m_PBO = 0;
+
+        size_t m_BudgetBytes = DEFAULT_BUDGET;
+        float m_BudgetMS = 2.0f;
+
+        Stats m_Stats;
+        Stats m_LastFrame;
+
+        static bool s_bEnabled;
+};
+
+#endif
+
@@ -2,6 +2,7 @@
 #define _VERTEXBUFFER_H_XI1UX68Y
 
 #include <vector>
+#include "GLState.h"
 
 /*
  * Wraps OpenGL's Vertex Buffer Object (VBO) which can send vertex attribute
@@ -22,7 +23,7 @@ class VertexBuffer
         {
             if(m_ID)
             {
-                glDeleteBuffers(1, &m_ID);
+                GLState::get()->delete_buffers(1, &m_ID);
                 m_ID = 0;
             }
             m_bNeedsCache = false;
@@ -34,7 +35,7 @@ class VertexBuffer
             {
                 const_cast<VertexBuffer*>(this)->clear_cache();
                 glGenBuffers(1, &m_ID);
-                glBindBuffer(GL_ARRAY_BUFFER, m_ID);
+                GLState::get()->bind_buffer(GL_ARRAY_BUFFER, m_ID);
                 glBufferData(
                     GL_ARRAY_BUFFER,
                     m_Size * Count * sizeof(float),
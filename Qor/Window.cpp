@@ -7,6 +7,10 @@
 #include <future>
 #include "Texture.h"
 #include "Text.h"
+#include "Mesh.h"
+#include "TextureAtlas.h"
+#include "TextureStreamer.h"
+#include "ProgramCache.h"
 
 using namespace std;
 
@@ -85,6 +89,35 @@ Window :: Window(
             }
             if(video_cfg->has("anisotropy"))
                 Texture::set_anisotropy(float(video_cfg->at<int>("anisotropy")));
+            if(video_cfg->has("vertex-format")) {
+                string fmt = video_cfg->at<string>("vertex-format");
+                if(fmt == "compact")
+                    MeshVertexBuffer::default_format(MeshVertexBuffer::COMPACT);
+                else if(fmt == "compact-positions")
+                    MeshVertexBuffer::default_format(
+                        MeshVertexBuffer::COMPACT |
+                        MeshVertexBuffer::COMPACT_POSITIONS
+                    );
+                else if(fmt != "full")
+                    WARNINGf("unknown vertex-format \"%s\"", fmt);
+            }
+            if(video_cfg->has("atlas"))
+                TextureAtlas::enabled(video_cfg->at<bool>("atlas"));
+            if(video_cfg->has("texture-streaming"))
+                TextureStreamer::enabled(video_cfg->at<bool>("texture-streaming"));
+            if(video_cfg->has("texture-upload-kb") || video_cfg->has("texture-upload-ms"))
+                TextureStreamer::get()->budget(
+                    unsigned(video_cfg->at<int>("texture-upload-kb", TextureStreamer::DEFAULT_BUDGET / 1024)) * 1024,
+                    float(video_cfg->at<double>("texture-upload-ms", 2.0))
+                );
+            if(video_cfg->has("program-cache"))
+                ProgramCache::enabled(video_cfg->at<bool>("program-cache"));
+            if(video_cfg->has("lod-levels")) {
+                int levels = video_cfg->at<int>("lod-levels");
+                Mesh::Data::lod_levels(levels > 0 ? levels : 0);
+            }
+            if(video_cfg->has("lod-bias"))
+                Mesh::lod_bias(float(video_cfg->at<double>("lod-bias")));
             
             if(video_cfg->at("vsync", false))
                 SDL_GL_SetSwapInterval(1);
@@ -0,0 +1,102 @@
+#include <catch.hpp>
+#include "../AABBTree.h"
+#include "../Node.h"
+#include <algorithm>
+#include <random>
+#include <set>
+using namespace std;
+using namespace glm;
+
+namespace {
+    struct Leaf
+    {
+        shared_ptr<Node> node;
+        AABBTree::Proxy proxy;
+    };
+
+    shared_ptr<Node> cube(const vec3& pos, float size) {
+        auto node = make_shared<Node>();
+        node->box() = Box(vec3(-size), vec3(size));
+        node->pend_box();
+        node->position(pos);
+        return node;
+    }
+}
+
+TEST_CASE("AABBTree queries match brute force after edits", "[aabbtree]")
+{
+    mt19937 rng(1);
+    uniform_real_distribution<float> pos(-50.0f, 50.0f);
+    uniform_real_distribution<float> size(0.1f, 2.0f);
+    uniform_real_distribution<float> step(-3.0f, 3.0f);
+
+    AABBTree tree;
+    vector<Leaf> leaves;
+    for(unsigned i = 0; i < 500; ++i) {
+        auto node = cube(vec3(pos(rng), pos(rng), pos(rng)), size(rng));
+        leaves.push_back(Leaf{node, tree.insert(node)});
+    }
+    // move half, some far enough to be reinserted
+    for(unsigned i = 0; i < leaves.size(); i += 2) {
+        auto& l = leaves[i];
+        l.node->position(l.node->position() + vec3(step(rng), step(rng), step(rng)) * float(i % 5));
+        tree.update(l.proxy);
+    }
+    // remove a quarter
+    for(unsigned i = 0; i < leaves.size(); i += 4)
+        tree.remove(leaves[i].proxy);
+    leaves.erase(remove_if(leaves.begin(), leaves.end(), [&](const Leaf& l){
+        return not tree.valid(l.proxy) || tree.get(l.proxy) != l.node.get();
+    }), leaves.end());
+    REQUIRE(tree.size() == leaves.size());
+    REQUIRE(tree.size() == 375);
+
+    for(unsigned q = 0; q < 50; ++q)
+    {
+        const vec3 c(pos(rng), pos(rng), pos(rng));
+
+        // boxes: fat leaves are a superset, exact boxes must agree
+        const Box box(c - vec3(8.0f), c + vec3(8.0f));
+        set<Node*> expected, found;
+        for(auto&& l: leaves)
+            if(l.node->world_box().collision(box))
+                expected.insert(l.node.get());
+        tree.query(box, [&](AABBTree::Proxy p){
+            if(tree.get(p)->world_box().collision(box))
+                found.insert(tree.get(p));
+            return true;
+        });
+        REQUIRE(found == expected);
+
+        // rays toward the origin
+        const vec3 dir = -c;
+        const vec3 inv(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+        float t;
+        expected.clear();
+        found.clear();
+        for(auto&& l: leaves)
+            if(AABBTree::ray_box(c, inv, l.node->world_box(), 1.0f, t))
+                expected.insert(l.node.get());
+        tree.raycast(c, dir, 1.0f, [&](AABBTree::Proxy p, float){
+            if(AABBTree::ray_box(c, inv, tree.get(p)->world_box(), 1.0f, t))
+                found.insert(tree.get(p));
+            return true;
+        });
+        REQUIRE(found == expected);
+
+        // nearest
+        const unsigned K = 8;
+        vector<float> brute;
+        for(auto&& l: leaves)
+            brute.push_back(AABBTree::distance2(l.node->world_box(), c));
+        sort(brute.begin(), brute.end());
+        brute.resize(K);
+        vector<pair<float, AABBTree::Proxy>> near;
+        tree.nearest(c, K, near, [&](AABBTree::Proxy p){
+            return AABBTree::distance2(tree.get(p)->world_box(), c);
+        });
+        REQUIRE(near.size() == K);
+        for(unsigned i = 0; i < K; ++i)
+            REQUIRE(near[i].first == Approx(brute[i]));
+    }
+}
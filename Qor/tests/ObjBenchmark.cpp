@@ -0,0 +1,72 @@
+#include <catch.hpp>
+#include "../ObjFile.h"
+#include <boost/filesystem.hpp>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+using namespace std;
+namespace fs = boost::filesystem;
+
+// run with: suite "[benchmark]"
+TEST_CASE("OBJ import of a 1M triangle model", "[.][benchmark]")
+{
+    // 708x708 quad grid in two materials, 1,002,528 triangles
+    const unsigned N = 708;
+    auto fn = (fs::temp_directory_path() / fs::unique_path("%%%%-%%%%.obj")).string();
+    {
+        ofstream f(fn);
+        f << "mtllib grid.mtl\no Grid\n";
+        char buf[128];
+        for(unsigned y = 0; y <= N; ++y)
+            for(unsigned x = 0; x <= N; ++x) {
+                snprintf(buf, sizeof(buf), "v %.6f %.6f %.6f\n",
+                    x * 0.125f, (x * y % 17) * 0.01f, y * -0.125f);
+                f << buf;
+            }
+        for(unsigned y = 0; y <= N; ++y)
+            for(unsigned x = 0; x <= N; ++x) {
+                snprintf(buf, sizeof(buf), "vt %.6f %.6f\n", x / float(N), y / float(N));
+                f << buf;
+            }
+        f << "vn 0.000000 1.000000 0.000000\n";
+        for(unsigned half = 0; half < 2; ++half) {
+            f << "usemtl " << (half ? "rock" : "grass") << "\n";
+            for(unsigned y = half * N / 2; y < (half + 1) * N / 2; ++y)
+                for(unsigned x = 0; x < N; ++x) {
+                    unsigned a = y * (N + 1) + x + 1;
+                    unsigned b = a + 1, c = a + N + 2, d = a + N + 1;
+                    f << "f " << a << "/" << a << "/1 " << b << "/" << b << "/1 "
+                        << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+                }
+        }
+    }
+    auto bytes = fs::file_size(fn);
+
+    auto t = chrono::high_resolution_clock::now();
+    auto obj = make_shared<ObjFile>(fn);
+    auto ms = chrono::duration_cast<chrono::milliseconds>(
+        chrono::high_resolution_clock::now() - t
+    ).count();
+
+    size_t triangles = 0;
+    size_t vertices = 0;
+    for(auto&& name: obj->names()) {
+        auto unit = obj->unit(name);
+        REQUIRE(unit);
+        triangles += unit->faces.size();
+        vertices += unit->vertices.size();
+    }
+    cout << bytes / (1024 * 1024) << "MB, " << triangles << " triangles, "
+        << vertices << " vertices in " << ms << "ms ("
+        << (ms ? bytes / 1024 / ms : 0) << "MB/s)" << endl;
+
+    REQUIRE(obj->names().size() == 2);
+    REQUIRE(obj->mtllib() == "grid.mtl");
+    REQUIRE(triangles == 2 * N * N);
+    // the row between the materials is in both
+    REQUIRE(vertices == (N + 1) * (N + 1) + (N + 1));
+
+    fs::remove(fn);
+}
+
@@ -0,0 +1,116 @@
+#include <catch.hpp>
+#include "../ObjFile.h"
+#include <boost/filesystem.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+using namespace std;
+using namespace glm;
+namespace fs = boost::filesystem;
+
+TEST_CASE("OBJ floats parse the same as strtof", "[obj]")
+{
+    mt19937 rng(1);
+    uniform_int_distribution<int> kind(0, 3), digits(1, 9), exponent(-30, 30);
+    uniform_real_distribution<double> value(-1000.0, 1000.0);
+    unsigned differ = 0;
+    for(unsigned i = 0; i < 2000000; ++i)
+    {
+        // what exporters write: fixed, short, scientific and round-trip
+        char buf[64];
+        switch(kind(rng)) {
+            case 0:
+                snprintf(buf, sizeof(buf), "%.6f", value(rng));
+                break;
+            case 1:
+                snprintf(buf, sizeof(buf), "%.*f", digits(rng), value(rng));
+                break;
+            case 2:
+                snprintf(buf, sizeof(buf), "%.*e", digits(rng),
+                    value(rng) * pow(10.0, exponent(rng)));
+                break;
+            default:
+                snprintf(buf, sizeof(buf), "%.17g", value(rng));
+                break;
+        }
+        const char* end = buf + strlen(buf);
+        const char* p = buf;
+        float f = ObjFile::parse_float(p, end);
+        float expected = strtof(buf, nullptr);
+        if(memcmp(&f, &expected, sizeof(f)) != 0 || p != end)
+            ++differ;
+    }
+    REQUIRE(differ == 0);
+
+    const char text[] = "  -1.5e2 nan? 7";
+    const char* p = text;
+    const char* end = text + sizeof(text) - 1;
+    REQUIRE(ObjFile::parse_float(p, end) == -150.0f);
+    // not a number: skipped as zero
+    REQUIRE(ObjFile::parse_float(p, end) == 0.0f);
+    REQUIRE(ObjFile::parse_float(p, end) == 7.0f);
+    REQUIRE(p == end);
+}
+
+TEST_CASE("OBJ faces, indices and shared corners", "[obj]")
+{
+    auto fn = (fs::temp_directory_path() / fs::unique_path("%%%%-%%%%.obj")).string();
+    {
+        ofstream f(fn);
+        f <<
+            "mtllib test.mtl\n"
+            "o Box\n"
+            "v 0 0 0\n"
+            "v 1 0 0\n"
+            "v 1 1 0\n"
+            "v 0 1 0\n"
+            "v -0 -0 0\n"
+            "vt 0 0\n"
+            "vt 1 0\n"
+            "vt 1 1\n"
+            "vt 0 1\n"
+            "vn 0 0 1\n"
+            "usemtl red\n"
+            "# a quad, split in two\n"
+            "f 1/1/1 2/2/1 3/3/1 4/4/1\n"
+            "# counted from the end\n"
+            "f -5/-4/-1 -3/-2/-1 -2/-1/-1\n"
+            "# -0 is the same corner as 0\n"
+            "f 5/1/1 2/2/1 3/3/1\n"
+            "usemtl blue\n"
+            "f 1/1/1 2/2/1 3/3/1\n";
+    }
+
+    {
+        ObjFile obj(fn);
+        REQUIRE(obj.mtllib() == "test.mtl");
+        REQUIRE(obj.names() == (vector<string>{"Box:red", "Box:blue"}));
+        REQUIRE(obj.unit("Box:green") == nullptr);
+
+        auto red = obj.unit("Box:red");
+        REQUIRE(red);
+        // four corners, shared by every face
+        REQUIRE(red->vertices.size() == 4);
+        REQUIRE(red->wrap.size() == 4);
+        REQUIRE(red->normals.size() == 4);
+        REQUIRE(red->faces == (vector<uvec3>{
+            uvec3(0, 1, 2), uvec3(2, 3, 0),
+            uvec3(0, 2, 3),
+            uvec3(0, 1, 2)
+        }));
+        REQUIRE(red->vertices[2] == vec3(1.0f, 1.0f, 0.0f));
+        // flipped for GL
+        REQUIRE(red->wrap[0] == vec2(0.0f, 1.0f));
+        REQUIRE(red->normals[3] == vec3(0.0f, 0.0f, 1.0f));
+
+        // its own corners
+        auto blue = obj.unit("Box:blue");
+        REQUIRE(blue);
+        REQUIRE(blue->vertices.size() == 3);
+        REQUIRE(blue->faces.size() == 1);
+    }
+    fs::remove(fn);
+}
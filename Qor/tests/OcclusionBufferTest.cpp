@@ -0,0 +1,149 @@
+#include <catch.hpp>
+#include "../OcclusionBuffer.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cmath>
+#include <random>
+#include <vector>
+using namespace std;
+using namespace glm;
+
+namespace {
+    // 256x128 buffer looking down -z from the origin
+    mat4 view_projection() {
+        return perspective(radians(90.0f), 2.0f, 0.1f, 100.0f);
+    }
+
+    // quad in the z plane, as two triangles sharing a diagonal
+    void quad(OcclusionBuffer& buf, float x0, float y0, float x1, float y1, float z) {
+        const float verts[] = {
+            x0, y0, z,  x1, y0, z,  x1, y1, z,
+            x0, y0, z,  x1, y1, z,  x0, y1, z
+        };
+        buf.rasterize(mat4(1.0f), verts, 6);
+    }
+}
+
+TEST_CASE("Occluders hide boxes behind them", "[occlusion]")
+{
+    OcclusionBuffer buf(256, 128);
+    buf.begin(view_projection());
+    quad(buf, -2.0f, -2.0f, 2.0f, 2.0f, -5.0f);
+    buf.end();
+
+    REQUIRE(not buf.visible(Box(vec3(-0.5f, -0.5f, -10.0f), vec3(0.5f, 0.5f, -9.0f))));
+    // in front of it
+    REQUIRE(buf.visible(Box(vec3(-0.5f, -0.5f, -4.0f), vec3(0.5f, 0.5f, -3.0f))));
+    REQUIRE(buf.stats().culled == 1);
+}
+
+TEST_CASE("Partly covered boxes stay visible", "[occlusion]")
+{
+    OcclusionBuffer buf(256, 128);
+    buf.begin(view_projection());
+    quad(buf, -2.0f, -2.0f, 2.0f, 2.0f, -5.0f);
+    buf.end();
+
+    // reaches past the right edge of the occluder
+    REQUIRE(buf.visible(Box(vec3(1.0f, -0.5f, -10.0f), vec3(6.0f, 0.5f, -9.0f))));
+}
+
+TEST_CASE("Near plane straddlers", "[occlusion]")
+{
+    OcclusionBuffer buf(256, 128);
+    buf.begin(view_projection());
+    quad(buf, -2.0f, -2.0f, 2.0f, 2.0f, -5.0f);
+    buf.end();
+
+    // boxes through the near plane can't be projected, so they're kept
+    REQUIRE(buf.visible(Box(vec3(-0.5f, -0.5f, -10.0f), vec3(0.5f, 0.5f, 1.0f))));
+
+    // a floor running from behind the camera is clipped, not dropped
+    buf.begin(view_projection());
+    const float floor[] = {
+        -50.0f, -1.0f, 5.0f,  50.0f, -1.0f, 5.0f,  50.0f, -1.0f, -50.0f,
+        -50.0f, -1.0f, 5.0f,  50.0f, -1.0f, -50.0f,  -50.0f, -1.0f, -50.0f
+    };
+    buf.rasterize(mat4(1.0f), floor, 6);
+    buf.end();
+    REQUIRE(not buf.visible(Box(vec3(-0.5f, -3.0f, -10.0f), vec3(0.5f, -2.0f, -9.0f))));
+    REQUIRE(buf.visible(Box(vec3(-0.5f, 2.0f, -10.0f), vec3(0.5f, 3.0f, -9.0f))));
+}
+
+TEST_CASE("Triangles sharing an edge leave no cracks", "[occlusion]")
+{
+    // one world unit per pixel, so the shared edges cross pixel centers
+    OcclusionBuffer buf(256, 128);
+    buf.begin(ortho(0.0f, 256.0f, 0.0f, 128.0f, -10.0f, 10.0f));
+    const vec2 center(100.5f, 60.5f);
+    const vector<vec2> rim {
+        vec2(40.5f, 20.5f), vec2(160.5f, 10.5f), vec2(220.5f, 70.5f),
+        vec2(130.5f, 120.5f), vec2(30.5f, 100.5f)
+    };
+    vector<float> verts;
+    for(size_t i = 0; i < rim.size(); ++i) {
+        const vec2& a = rim[i];
+        const vec2& b = rim[(i + 1) % rim.size()];
+        for(const vec2& p: {center, a, b})
+            verts.insert(verts.end(), {p.x, p.y, 0.0f});
+    }
+    buf.rasterize(mat4(1.0f), verts.data(), verts.size() / 3);
+    buf.end();
+
+    // every pixel center inside the fan (clear of its outer edges) is covered
+    unsigned inside = 0, cracks = 0;
+    for(unsigned y = 0; y < buf.height(); ++y)
+        for(unsigned x = 0; x < buf.width(); ++x)
+        {
+            const vec2 p(x + 0.5f, y + 0.5f);
+            bool in = true;
+            for(size_t i = 0; i < rim.size() && in; ++i) {
+                const vec2& a = rim[i];
+                const vec2& b = rim[(i + 1) % rim.size()];
+                in = (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x) > 0.01f;
+            }
+            if(not in)
+                continue;
+            ++inside;
+            if(buf.depth(x, y) == 1.0f)
+                ++cracks;
+        }
+    REQUIRE(inside > 1000);
+    REQUIRE(cracks == 0);
+}
+
+TEST_CASE("SSE2 and scalar rasterizers agree", "[occlusion]")
+{
+    mt19937 rng(1);
+    uniform_real_distribution<float> xy(-8.0f, 8.0f);
+    uniform_real_distribution<float> z(-20.0f, -1.0f);
+    vector<float> verts;
+    for(unsigned i = 0; i < 64 * 3; ++i)
+        verts.insert(verts.end(), {xy(rng), xy(rng), z(rng)});
+    vector<Box> boxes;
+    for(unsigned i = 0; i < 256; ++i) {
+        vec3 lo(xy(rng), xy(rng), z(rng));
+        boxes.push_back(Box(lo, lo + vec3(0.5f)));
+    }
+
+    OcclusionBuffer simd(256, 128), scalar(256, 128);
+    for(OcclusionBuffer* buf: {&simd, &scalar}) {
+        OcclusionBuffer::simd(buf == &simd);
+        buf->begin(view_projection());
+        buf->rasterize(mat4(1.0f), verts.data(), verts.size() / 3);
+        buf->end();
+    }
+    OcclusionBuffer::simd(true);
+
+    unsigned differ = 0, covered = 0;
+    for(unsigned y = 0; y < simd.height(); ++y)
+        for(unsigned x = 0; x < simd.width(); ++x) {
+            if(std::abs(simd.depth(x, y) - scalar.depth(x, y)) > 1e-5f)
+                ++differ;
+            if(scalar.depth(x, y) < 1.0f)
+                ++covered;
+        }
+    REQUIRE(covered > 0);
+    REQUIRE(differ == 0);
+    for(auto&& box: boxes)
+        REQUIRE(simd.visible(box) == scalar.visible(box));
+}
@@ -0,0 +1,43 @@
+#include <catch.hpp>
+#include "../BasicPartitioner.h"
+#include "../Camera.h"
+#include "../Headless.h"
+#include "../Light.h"
+#include "../ResourceCache.h"
+#include <algorithm>
+using namespace std;
+
+TEST_CASE("Perspective cameras keep lights and unbounded nodes", "[partitioner]")
+{
+    Headless::enable();
+    ResourceCache resources(make_shared<Meta>(
+        MetaFormat::JSON, "{\"audio\": {\"volume\": 100}}"
+    ));
+    auto root = make_shared<Node>();
+    auto camera = make_shared<Camera>("", nullptr, &resources);
+    camera->perspective();
+    root->add(camera);
+
+    // as Scene loads it
+    auto light = make_shared<Light>(make_shared<Meta>(
+        MetaFormat::JSON, "{\"type\": \"light\", \"distance\": 10.0}"
+    ));
+    root->add(light);
+    REQUIRE(not light->box().quick_zero());
+    REQUIRE(light->box().max().x == Approx(10.0f));
+
+    auto group = make_shared<Node>();
+    root->add(group);
+    REQUIRE(camera->in_frustum(Box::Zero()));
+    REQUIRE(camera->in_frustum(Box::Full()));
+
+    BasicPartitioner partitioner;
+    partitioner.camera(camera.get());
+    partitioner.partition(root.get());
+
+    const auto& lights = partitioner.visible_lights();
+    REQUIRE(find(lights.begin(), lights.end(), light.get()) != lights.end());
+    const auto& nodes = partitioner.visible_nodes();
+    REQUIRE(find(nodes.begin(), nodes.end(), group.get()) != nodes.end());
+}
+
@@ -0,0 +1,148 @@
+#include <catch.hpp>
+#include "../RenderQueue.h"
+#include "../Camera.h"
+#include "../Headless.h"
+#include "../ResourceCache.h"
+#include <random>
+#include <tuple>
+using namespace std;
+using namespace glm;
+
+namespace {
+    // a node with the state the queue sorts on, z units in front of the camera
+    class StateNode:
+        public Node
+    {
+        public:
+            StateNode(unsigned texture, unsigned buffer, float z):
+                m_Texture(texture),
+                m_Buffer(buffer)
+            {
+                box() = Box(vec3(-0.5f), vec3(0.5f));
+                pend_box();
+                position(vec3(0.0f, 0.0f, -z));
+            }
+            virtual ~StateNode() {}
+
+            virtual unsigned render_texture_id() const override { return m_Texture; }
+            virtual unsigned render_buffer_id() const override { return m_Buffer; }
+            virtual const void* render_instance_key() const override { return m_pInstance; }
+
+            const void* m_pInstance = nullptr;
+
+        private:
+            unsigned m_Texture, m_Buffer;
+    };
+
+    float depth(const Node* n) {
+        return -n->position(Space::WORLD).z;
+    }
+
+    struct Fixture
+    {
+        Fixture():
+            resources(make_shared<Meta>(
+                MetaFormat::JSON, "{\"audio\": {\"volume\": 100}}"
+            ))
+        {
+            Headless::enable();
+            camera = make_shared<Camera>("", nullptr, &resources);
+            camera->perspective();
+        }
+
+        const Node* add(shared_ptr<StateNode> n) {
+            owned.push_back(n);
+            nodes.push_back(n.get());
+            return n.get();
+        }
+
+        ResourceCache resources;
+        shared_ptr<Camera> camera;
+        vector<shared_ptr<Node>> owned;
+        vector<const Node*> nodes;
+    };
+}
+
+TEST_CASE("Render queue groups opaque nodes by state, then near to far", "[renderqueue]")
+{
+    Fixture f;
+    mt19937 rng(1);
+    uniform_int_distribution<unsigned> state(0, 3);
+    uniform_real_distribution<float> z(1.0f, 100.0f);
+    for(unsigned i = 0; i < 1000; ++i)
+        f.add(make_shared<StateNode>(state(rng), state(rng), z(rng)));
+
+    RenderQueue queue;
+    queue.build(f.nodes, f.camera.get());
+    const auto& sorted = queue.nodes();
+    REQUIRE(sorted.size() == f.nodes.size());
+    for(unsigned i = 1; i < sorted.size(); ++i)
+    {
+        auto a = make_tuple(sorted[i-1]->render_texture_id(), sorted[i-1]->render_buffer_id());
+        auto b = make_tuple(sorted[i]->render_texture_id(), sorted[i]->render_buffer_id());
+        REQUIRE(a <= b);
+        if(a == b)
+            REQUIRE(depth(sorted[i-1]) <= depth(sorted[i]) + 0.001f);
+    }
+
+    const auto& stats = queue.stats();
+    REQUIRE(stats.texture_changes == 4);
+    REQUIRE(stats.buffer_changes <= 16);
+    REQUIRE(stats.saved() > 0);
+}
+
+TEST_CASE("Render queue key packing", "[renderqueue]")
+{
+    Fixture f;
+
+    // layers draw in order before anything else
+    auto late = make_shared<StateNode>(0, 0, 1.0f);
+    late->layer(1);
+    // out of range ids saturate instead of spilling into the
+    // translucent bit
+    auto wide = f.add(make_shared<StateNode>(70000, 0, 5.0f));
+    auto capped = f.add(make_shared<StateNode>(65535, 1, 5.0f));
+    // translucent after opaque, far to near whatever their state
+    auto near_glass = make_shared<StateNode>(1, 1, 2.0f);
+    near_glass->translucent(true);
+    auto far_glass = make_shared<StateNode>(9, 9, 50.0f);
+    far_glass->translucent(true);
+    f.add(near_glass);
+    f.add(far_glass);
+    // equal keys keep scene order
+    auto first = f.add(make_shared<StateNode>(3, 4, 7.0f));
+    auto second = f.add(make_shared<StateNode>(3, 4, 7.0f));
+    f.add(late);
+
+    RenderQueue queue;
+    queue.build(f.nodes, f.camera.get());
+    const vector<const Node*> expected {
+        first, second, wide, capped, far_glass.get(), near_glass.get(), late.get()
+    };
+    REQUIRE(queue.nodes() == expected);
+
+    // scene order when asked not to sort
+    queue.build(f.nodes, f.camera.get(), false);
+    REQUIRE(queue.nodes() == f.nodes);
+}
+
+TEST_CASE("Render queue batches runs of instances", "[renderqueue]")
+{
+    Fixture f;
+    int mesh_a, mesh_b;
+    for(unsigned i = 0; i < 6; ++i) {
+        auto n = make_shared<StateNode>(0, i < 4 ? 1 : 2, 10.0f + i);
+        n->m_pInstance = i < 4 ? (const void*)&mesh_a : (const void*)&mesh_b;
+        f.add(n);
+    }
+    f.add(make_shared<StateNode>(0, 3, 1.0f));
+
+    RenderQueue queue;
+    queue.build(f.nodes, f.camera.get());
+    const auto& batches = queue.batches();
+    REQUIRE(batches.size() == 3);
+    REQUIRE(batches[0].count == 4);
+    REQUIRE(batches[1].count == 2);
+    REQUIRE(batches[2].count == 1);
+    REQUIRE(queue.stats().instanced == 6);
+}
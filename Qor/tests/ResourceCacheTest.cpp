@@ -0,0 +1,98 @@
+#include <catch.hpp>
+#include "../ResourceCache.h"
+#include "kit/log/errors.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
+using namespace std;
+
+namespace {
+    // what each part takes from the cache
+    const map<string, vector<string>> s_Parts = {
+        {"car", {"wheel", "engine"}},
+        {"engine", {"piston"}},
+        {"wreck", {"wheel", "broken"}}
+    };
+    mutex s_Mutex;
+    vector<string> s_Started;
+
+    vector<string> parts(const string& fn) {
+        auto itr = s_Parts.find(fn);
+        return itr == s_Parts.end() ? vector<string>() : itr->second;
+    }
+
+    // takes its parts from the cache while loading, like a material
+    class Part:
+        public Resource
+    {
+        public:
+            Part(const tuple<string, ICache*>& args):
+                Resource(get<0>(args))
+            {
+                string fn = get<0>(args);
+                {
+                    auto l = unique_lock<mutex>(s_Mutex);
+                    s_Started.push_back(fn);
+                }
+                if(fn == "broken")
+                    K_ERRORf(READ, "part \"%s\"", fn);
+                auto cache = (ResourceCache*)get<1>(args);
+                for(auto&& p: parts(fn))
+                    cache->cache(p);
+            }
+            virtual ~Part() {}
+    };
+
+    size_t started(const string& fn) {
+        auto itr = find(s_Started.begin(), s_Started.end(), fn);
+        REQUIRE(itr != s_Started.end());
+        REQUIRE(count(s_Started.begin(), s_Started.end(), fn) == 1);
+        return itr - s_Started.begin();
+    }
+
+    void setup(ResourceCache& resources) {
+        s_Started.clear();
+        unsigned id = resources.register_class<Part>("part");
+        resources.register_resolver([id](const tuple<string, ICache*>&){
+            return id;
+        });
+        resources.register_dependencies(&parts);
+    }
+}
+
+TEST_CASE("Async loads start after what they depend on", "[resources]")
+{
+    ResourceCache resources;
+    setup(resources);
+
+    auto car = resources.cache_async<Part>("car");
+    REQUIRE(car.get());
+    resources.wait_loads();
+
+    auto l = unique_lock<mutex>(s_Mutex);
+    REQUIRE(started("piston") < started("engine"));
+    REQUIRE(started("engine") < started("car"));
+    REQUIRE(started("wheel") < started("car"));
+    auto progress = resources.load_progress();
+    REQUIRE(progress.total == 4);
+    REQUIRE(progress.done == progress.total);
+}
+
+TEST_CASE("Async load errors reach what depends on them", "[resources]")
+{
+    ResourceCache resources;
+    setup(resources);
+
+    auto wreck = resources.cache_async<Part>("wreck");
+    auto broken = resources.cache_async<Part>("broken");
+    REQUIRE_THROWS(broken.get());
+    REQUIRE_THROWS(wreck.get());
+    resources.wait_loads();
+
+    // the rest of it still loaded
+    auto wheel = resources.cache_async<Part>("wheel");
+    REQUIRE(wheel.get());
+    resources.wait_loads();
+    auto progress = resources.load_progress();
+    REQUIRE(progress.done == progress.total);
+}
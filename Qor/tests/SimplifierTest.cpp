@@ -0,0 +1,85 @@
+#include <catch.hpp>
+#include "../Simplifier.h"
+#include <algorithm>
+#include <vector>
+using namespace std;
+using namespace glm;
+
+namespace {
+    const unsigned N = 20;
+
+    // N x N quads in the xy plane, facing +z
+    void grid(vector<float>& verts, vector<unsigned>& indices) {
+        for(unsigned y = 0; y <= N; ++y)
+            for(unsigned x = 0; x <= N; ++x)
+                verts.insert(verts.end(), {float(x), float(y), 0.0f});
+        for(unsigned y = 0; y < N; ++y)
+            for(unsigned x = 0; x < N; ++x) {
+                unsigned a = y * (N + 1) + x;
+                unsigned b = a + 1, c = a + N + 2, d = a + N + 1;
+                indices.insert(indices.end(), {a, b, c, a, c, d});
+            }
+    }
+
+    vec3 vert(const vector<float>& verts, unsigned i) {
+        return vec3(verts[i*3], verts[i*3+1], verts[i*3+2]);
+    }
+
+    // signed area facing +z
+    float area(const vector<float>& verts, const vector<unsigned>& indices) {
+        float r = 0.0f;
+        for(size_t i = 0; i + 2 < indices.size(); i += 3) {
+            vec3 a = vert(verts, indices[i]);
+            vec3 b = vert(verts, indices[i+1]);
+            vec3 c = vert(verts, indices[i+2]);
+            float z = cross(b - a, c - a).z * 0.5f;
+            REQUIRE(z > 0.0f);
+            r += z;
+        }
+        return r;
+    }
+}
+
+TEST_CASE("Simplifier drops triangles and keeps borders", "[simplifier]")
+{
+    vector<float> verts;
+    vector<unsigned> indices;
+    grid(verts, indices);
+    const size_t vert_count = verts.size() / 3;
+
+    Simplifier simplifier(verts.data(), vert_count, indices.data(), indices.size());
+    REQUIRE(simplifier.triangles() == 2 * N * N);
+
+    auto level = simplifier.simplify(200);
+    REQUIRE(level.indices.size() / 3 <= 200);
+    REQUIRE(level.indices.size() / 3 == simplifier.triangles());
+    REQUIRE(level.indices.size() % 3 == 0);
+    for(auto i: level.indices)
+        REQUIRE(i < vert_count);
+
+    // a flat sheet can lose everything but its outline, so the border
+    // (and with it the area) and the corners stay
+    REQUIRE(area(verts, level.indices) == Approx(float(N * N)));
+    for(unsigned corner: {0u, N, N * (N + 1), N * (N + 1) + N})
+        REQUIRE(find(level.indices.begin(), level.indices.end(), corner) != level.indices.end());
+    REQUIRE(level.error == Approx(0.0f).margin(0.0001f));
+
+    // the next level starts from this one
+    auto coarser = simplifier.simplify(50);
+    REQUIRE(coarser.indices.size() < level.indices.size());
+    REQUIRE(coarser.error >= level.error);
+}
+
+TEST_CASE("Simplifier welds triangle soups", "[simplifier]")
+{
+    vector<float> verts, soup;
+    vector<unsigned> indices;
+    grid(verts, indices);
+    for(auto i: indices)
+        soup.insert(soup.end(), {verts[i*3], verts[i*3+1], verts[i*3+2]});
+
+    Simplifier simplifier(soup.data(), soup.size() / 3);
+    auto level = simplifier.simplify(200);
+    REQUIRE(level.indices.size() / 3 <= 200);
+    REQUIRE(area(soup, level.indices) == Approx(float(N * N)));
+}
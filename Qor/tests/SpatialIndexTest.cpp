@@ -0,0 +1,72 @@
+#include <catch.hpp>
+#include "../SpatialIndex.h"
+#include "../Node.h"
+#include <vector>
+using namespace std;
+using namespace glm;
+
+namespace {
+    shared_ptr<Node> cube(const vec3& pos) {
+        auto node = make_shared<Node>();
+        node->box() = Box(vec3(-0.5f), vec3(0.5f));
+        node->pend_box();
+        node->position(pos);
+        return node;
+    }
+}
+
+TEST_CASE("Spatial index finds nodes added at a freed node's address", "[spatialindex]")
+{
+    SpatialIndex index;
+    vector<Node*> out;
+
+    auto old = cube(vec3(0.0f));
+    const Node* addr = old.get();
+    index.add(old);
+    old.reset();
+
+    // no query in between, so the free is still pending; allocate until
+    // the address comes back (usually the first try)
+    vector<shared_ptr<Node>> nodes;
+    shared_ptr<Node> reused;
+    for(unsigned i = 0; i < 64 && not reused; ++i) {
+        auto n = cube(vec3(10.0f, 0.0f, 0.0f));
+        if(n.get() == addr)
+            reused = n;
+        nodes.push_back(n);
+    }
+    for(auto&& n: nodes)
+        index.add(n);
+
+    REQUIRE(index.size() == nodes.size());
+    for(auto&& n: nodes)
+        REQUIRE(index.contains(n.get()));
+    REQUIRE(index.query(Box(vec3(-1.0f), vec3(1.0f)), out) == 0);
+    REQUIRE(index.query(Box(vec3(9.0f, -1.0f, -1.0f), vec3(11.0f, 1.0f, 1.0f)), out) == nodes.size());
+}
+
+TEST_CASE("Spatial index stops tracking removed nodes", "[spatialindex]")
+{
+    SpatialIndex index;
+    vector<Node*> out;
+
+    auto a = cube(vec3(0.0f));
+    auto b = cube(vec3(0.0f));
+    index.add(a);
+    index.add(b);
+    index.remove(a.get());
+    REQUIRE(not index.contains(a.get()));
+
+    // moving and freeing a removed node leaves the index alone
+    a->position(vec3(5.0f));
+    a.reset();
+    REQUIRE(index.query(Box(vec3(-1.0f), vec3(1.0f)), out) == 1);
+    REQUIRE(out[0] == b.get());
+
+    b->position(vec3(5.0f));
+    REQUIRE(index.query(Box(vec3(4.0f), vec3(6.0f)), out) == 1);
+    index.clear();
+    REQUIRE(index.empty());
+    b->position(vec3(0.0f));
+    REQUIRE(index.query(Box(vec3(-1.0f), vec3(1.0f)), out) == 0);
+}
@@ -0,0 +1,119 @@
+#version 120
+/* keep in sync with ClusteredLighting::MAX_LIGHTS_PER_CLUSTER */
+#define MAX_CLUSTER_LIGHTS 64
+
+uniform vec4 FogColor = vec4(0.0, 0.0, 0.0, 0.0);
+uniform float Brightness = 1.0;
+
+/* 4 texels per light: view pos (or dir) + radius, diffuse, specular, ambient */
+uniform sampler2D LightData;
+uniform vec2 LightDataSize;
+/* per cluster: offset into LightIndices, count */
+uniform sampler2D LightClusters;
+uniform vec3 ClusterGrid;
+uniform sampler2D LightIndices;
+uniform vec2 LightIndicesSize;
+/* near, slices / log(far/near) */
+uniform vec2 ClusterDepth;
+uniform vec2 ViewportSize;
+/* directional lights, stored first in LightData */
+uniform int NumGlobalLights;
+
+varying vec3 Position;
+varying vec2 Wrap;
+varying vec3 Normal;
+varying float Depth;
+
+uniform sampler2D Texture;
+
+uniform vec3 MaterialAmbient = vec3(0.1, 0.1, 0.1);
+uniform vec4 MaterialDiffuse = vec4(1.0, 1.0, 1.0, 1.0);
+uniform vec3 MaterialSpecular = vec3(1.0, 1.0, 1.0);
+uniform vec3 MaterialEmissive = vec3(0.0, 0.0, 0.0);
+uniform float MaterialShininess = 64.0;
+
+#define M_PI 3.1415926535897932384626433832795
+#define M_TAU (M_PI * 2.0)
+
+bool floatcmp(float a, float b, float e)
+{
+    return abs(a-b) < e;
+}
+
+vec4 fetch(sampler2D tex, vec2 size, float x, float y)
+{
+    return texture2D(tex, (vec2(x, y) + 0.5) / size);
+}
+
+vec3 shade(float light, vec3 n, vec3 v)
+{
+    vec4 pos = fetch(LightData, LightDataSize, 0.0, light);
+    vec3 diffuse = fetch(LightData, LightDataSize, 1.0, light).rgb;
+    vec3 specular = fetch(LightData, LightDataSize, 2.0, light).rgb;
+    vec3 ambient = fetch(LightData, LightDataSize, 3.0, light).rgb;
+
+    vec3 s;
+    float atten = 1.0;
+    if(pos.w < 0.0) {
+        s = normalize(pos.xyz);
+    } else {
+        vec3 dir = pos.xyz - Position;
+        float dist = length(dir);
+        s = dir / max(dist, 0.0001);
+        atten = cos(clamp(dist/pos.w,0.0,1.0) * M_TAU / 4.0);
+    }
+    vec3 r = reflect(-s,n);
+    float diff = max(dot(s,n),0.0);
+    float spec = pow(max(dot(r,v), 0.0), MaterialShininess);
+    return atten * (
+        MaterialAmbient * ambient +
+        MaterialDiffuse.rgb * diffuse * diff +
+        MaterialSpecular * specular * spec
+    );
+}
+
+void main()
+{
+    vec4 color = texture2D(Texture, Wrap);
+    float e = 0.1; // threshold
+    if(floatcmp(color.r, 1.0, e) &&
+        floatcmp(color.g, 0.0, e) &&
+        floatcmp(color.b, 1.0, e))
+    {
+        discard;
+    }
+
+    if(floatcmp(color.a, 0.0, e)) {
+        discard;
+    }
+    
+    vec3 n = normalize(Normal);
+    vec3 v = normalize(vec3(-Position));
+    vec3 light = vec3(0.0, 0.0, 0.0);
+
+    for(int i=0; i<NumGlobalLights; i++)
+        light += shade(float(i), n, v);
+
+    /* find this fragment's cluster */
+    vec2 tile = floor(gl_FragCoord.xy / ViewportSize * ClusterGrid.xy);
+    tile = clamp(tile, vec2(0.0), ClusterGrid.xy - 1.0);
+    float slice = floor(log(max(-Position.z, ClusterDepth.x) / ClusterDepth.x) * ClusterDepth.y);
+    slice = clamp(slice, 0.0, ClusterGrid.z - 1.0);
+    vec2 cluster = fetch(LightClusters, vec2(ClusterGrid.x * ClusterGrid.y, ClusterGrid.z),
+        tile.x + tile.y * ClusterGrid.x, slice
+    ).rg;
+
+    for(int i=0; i<MAX_CLUSTER_LIGHTS; i++){
+        if(float(i) >= cluster.y)
+            break;
+        float k = cluster.x + float(i);
+        float idx = fetch(LightIndices, LightIndicesSize,
+            mod(k, LightIndicesSize.x), floor(k / LightIndicesSize.x)
+        ).r;
+        light += shade(idx, n, v);
+    }
+
+    vec4 fragcolor = color * vec4(light, MaterialDiffuse.a);
+    gl_FragColor = mix(fragcolor, vec4(FogColor.rgb,1.0), FogColor.a * Depth) * Brightness;
+}
+
@@ -19,6 +19,12 @@ class ExportQor(bpy.types.Operator, ExportHelper):
     bl_label = "Export Qor JSON"
 
     filename_ext = ".json"
+
+    binary = BoolProperty(
+        name="Binary Meshes",
+        description="Also write mesh data to a .qmesh beside the .json, which loads without parsing",
+        default=False
+    )
     
     def invoke(self, context, event):
         return ExportHelper.invoke(self, context, event)
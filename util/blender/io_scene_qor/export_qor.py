@@ -335,7 +335,7 @@ def iterate_data(scene, obj, context, entries):
         iterate_properties(doc, obj)
         entries[doc["name"]] = doc
 
-def save(operator, context, filepath=""):
+def save(operator, context, filepath="", binary=False):
 
     buf = {}
     
@@ -375,5 +375,9 @@ def save(operator, context, filepath=""):
     out.write(json.dumps(buf,indent=4,sort_keys=True))
     out.close()
 
+    if binary:
+        from . import qmesh
+        qmesh.write(os.path.splitext(filepath)[0] + ".qmesh", qmesh.from_json(buf))
+
     return {"FINISHED"}
 
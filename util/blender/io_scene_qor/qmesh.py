@@ -0,0 +1,215 @@
+#!/usr/bin/env python
+# Writes cooked .qmesh files (see Qor/MeshFile.h) and converts Qor JSON
+# scenes and OBJ files to them.  Doesn't need Blender:
+#
+#   python qmesh.py data/level.json data/crate.obj
+#
+# writes data/level.qmesh and data/crate.qmesh, which Qor then loads in
+# place of the originals until they are edited again.
+
+import os
+import sys
+import json
+import struct
+from array import array
+
+MAGIC = b"QMSH"
+VERSION = 1
+HEADER_SIZE = 16
+UNIT_SIZE = 64
+ALIGN = 16
+
+# attribute blocks in file order: (key, typecode, components)
+BLOCKS = [
+    ("indices", "I", 3),
+    ("vertices", "f", 3),
+    ("wrap", "f", 2),
+    ("normals", "f", 3),
+    ("tangents", "f", 4),
+    ("fade", "f", 1),
+]
+
+def align(n):
+    return (n + ALIGN - 1) // ALIGN * ALIGN
+
+def write(fn, units):
+    """
+    units: list of dicts with "name" ("object:material"), "material"
+    (resource name or "") and flat lists for each of BLOCKS
+    """
+    strings = b""
+    table = b""
+    blocks = []
+
+    string_start = HEADER_SIZE + UNIT_SIZE * len(units)
+    string_size = sum(
+        len(u["name"].encode("utf-8")) + len(u.get("material", "").encode("utf-8"))
+        for u in units
+    )
+    offset = align(string_start + string_size)
+
+    for u in units:
+        entry = []
+        for s in (u["name"], u.get("material", "")):
+            s = s.encode("utf-8")
+            entry += [string_start + len(strings), len(s)]
+            strings += s
+        for key, code, comps in BLOCKS:
+            data = array(code, u.get(key, []))
+            if sys.byteorder != "little":
+                data.byteswap()
+            count = len(data) // comps
+            entry += [offset if count else 0, count]
+            if count:
+                raw = data[:count * comps].tobytes()
+                blocks.append((offset, raw))
+                offset = align(offset + len(raw))
+        table += struct.pack("<16I", *entry)
+
+    if offset >= 1 << 32:
+        raise ValueError("%s: too big for qmesh" % fn)
+
+    tmp = fn + ".tmp"
+    with open(tmp, "wb") as out:
+        out.write(MAGIC + struct.pack("<3I", VERSION, len(units), 0))
+        out.write(table)
+        out.write(strings)
+        for start, raw in blocks:
+            out.write(b"\0" * (start - out.tell()))
+            out.write(raw)
+    os.replace(tmp, fn)
+
+def numbers(v, kind):
+    if v is None:
+        return []
+    if isinstance(v, str):
+        v = v.split()
+    return [kind(e) for e in v]
+
+def from_json(doc):
+    """ units of the meshes in a Qor JSON scene (as export_qor writes it) """
+    units = []
+    for name, e in sorted(doc.get("data", {}).items()):
+        if not isinstance(e, dict) or "vertices" not in e or ":" not in name:
+            continue
+        image = e.get("image") or ""
+        if not os.path.splitext(image)[1]:
+            image += ".png"
+        unit = {
+            "name": name,
+            "material": "" if image == ".png" else image,
+        }
+        for key, code, comps in BLOCKS:
+            unit[key] = numbers(e.get(key), int if code == "I" else float)
+        units.append(unit)
+    return units
+
+def f32(x):
+    return struct.unpack("<f", struct.pack("<f", x))[0]
+
+def floats(tokens, n):
+    r = []
+    for t in tokens[:n]:
+        try:
+            r.append(f32(float(t)))
+        except ValueError:
+            break
+    return r + [0.0] * (n - len(r))
+
+def from_obj(fn):
+    """
+    units of an OBJ file, one per object and material, with vertices
+    shared the same way Qor's OBJ loader shares them
+    """
+    verts, wrap, normals = [], [], []
+    mtllib = ""
+    obj, mat = "", ""
+    order = []
+    faces = {}
+
+    with open(fn) as f:
+        for line in f:
+            line = line.rstrip("\r\n")
+            if line.strip().startswith("#"):
+                continue
+            tokens = line.split()[1:]
+            if line.startswith("mtllib "):
+                mtllib = tokens[0] if tokens else ""
+            elif line.startswith("o "):
+                obj = tokens[0] if tokens else ""
+            elif line.startswith("usemtl "):
+                mat = tokens[0] if tokens else ""
+                if (obj, mat) not in order:
+                    order.append((obj, mat))
+            elif line.startswith("v "):
+                verts.append(tuple(floats(tokens, 3)))
+            elif line.startswith("vn "):
+                normals.append(tuple(floats(tokens, 3)))
+            elif line.startswith("vt "):
+                uv = floats(tokens, 2)
+                uv[1] = f32(1.0 - uv[1])
+                wrap.append(tuple(uv))
+            elif line.startswith("f "):
+                shared, index_of, indices = faces.setdefault((obj, mat), ([], {}, []))
+                index = [0] * 4
+                count = min(len(tokens), 4)
+                for i in range(count):
+                    parts = tokens[i].split("/")
+                    attr = []
+                    for j, (src, zero) in enumerate((
+                        (verts, (0.0,) * 3), (wrap, (0.0,) * 2), (normals, (0.0,) * 3)
+                    )):
+                        try:
+                            k = int(parts[j])
+                            k = k - 1 if k > 0 else len(src) + k
+                            attr.append(src[k] if 0 <= k < len(src) else zero)
+                        except (IndexError, ValueError):
+                            attr.append(zero)
+                    # -0 and 0 are the same corner
+                    key = tuple(tuple(c + 0.0 for c in a) for a in attr)
+                    if key not in index_of:
+                        index_of[key] = len(shared)
+                        shared.append(key)
+                    index[i] = index_of[key]
+                if count < 3:
+                    continue
+                indices += index[0:3]
+                if count == 4:
+                    indices += [index[2], index[3], index[0]]
+
+    units = []
+    for obj, mat in order:
+        shared, index_of, indices = faces.get((obj, mat), ([], {}, []))
+        if not shared:
+            continue
+        units.append({
+            "name": obj + ":" + mat,
+            "material": mtllib + ":" + mat,
+            "indices": indices,
+            "vertices": [c for v in shared for c in v[0]],
+            "wrap": [c for v in shared for c in v[1]],
+            "normals": [c for v in shared for c in v[2]],
+        })
+    return units
+
+def convert(fn):
+    """ writes fn's .qmesh beside it, returns its name """
+    base, ext = os.path.splitext(fn)
+    ext = ext.lower()
+    if ext == ".json":
+        with open(fn) as f:
+            units = from_json(json.load(f))
+    elif ext == ".obj":
+        units = from_obj(fn)
+    else:
+        raise ValueError("%s: not a .json or .obj file" % fn)
+    out = base + ".qmesh"
+    write(out, units)
+    return out
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.stderr.write("usage: %s FILE.json|FILE.obj ...\n" % sys.argv[0])
+        sys.exit(1)
+    for fn in sys.argv[1:]:
+        print(convert(fn))